@@ -78,10 +78,8 @@ AtomicForm::AtomicForm(QWidget *parent) :
   confirmDeleteDialog->setIcon(QMessageBox::Warning);
   //confirmDeleteDialog->setWindowModality(Qt::WindowModal);
 
-  // Listen to kvs changes:
-  connect(&kvs, &KVStore::valueLocked, this, &AtomicForm::lockValue);
-  connect(&kvs, &KVStore::valueUnlocked, this, &AtomicForm::unlockValue);
-  connect(&kvs, &KVStore::valueDeleted, this, &AtomicForm::unlockValue);
+  /* Changes of the widgets keys are listened to as the widgets are added
+   * (see changeKey). */
 }
 
 AtomicForm::~AtomicForm()
@@ -121,22 +119,31 @@ void AtomicForm::addWidget(AtomicWidget *aw, bool deletable)
   setEnabled(locked.size() >= widgets.size());
 }
 
-void AtomicForm::changeKey(std::string const &, std::string const &newKey)
+void AtomicForm::changeKey(std::string const &oldKey, std::string const &newKey)
 {
-  kvs.lock.lock_shared();
+  // Listen to the locks of only the keys of the widgets:
+  if (oldKey.length() > 0 && ! isMyKey(oldKey))
+    disconnect(kvs.subscribeKey(oldKey), nullptr, this, nullptr);
+
+  if (newKey.length() > 0) {
+    KVSubscriber const *subscriber = kvs.subscribeKey(newKey);
+    connect(subscriber, &KVSubscriber::valueLocked,
+            this, &AtomicForm::lockValue, Qt::UniqueConnection);
+    connect(subscriber, &KVSubscriber::valueUnlocked,
+            this, &AtomicForm::unlockValue, Qt::UniqueConnection);
+    connect(subscriber, &KVSubscriber::valueDeleted,
+            this, &AtomicForm::unlockValue, Qt::UniqueConnection);
+  }
 
   std::optional<QString> owner;
 
   if (newKey.length() > 0) {
-    auto it = kvs.map.find(newKey);
-    if (it != kvs.map.end())
-      if (it->second.isLocked())
-        owner = it->second.owner;
+    std::shared_ptr<KValue const> kv = kvs.get(newKey);
+    if (kv && kv->isLocked())
+      owner = kv->owner;
   }
 
   setOwner(newKey, owner);
-
-  kvs.lock.unlock_shared();
 }
 
 void AtomicForm::wantEdit()
@@ -8,19 +8,7 @@
 static bool const verbose = true;
 
 AtomicWidget::AtomicWidget(QWidget *parent) :
-  QWidget(parent)
-{
-  connect(&kvs, &KVStore::valueCreated,
-          this, &AtomicWidget::setValueFromStore);
-  connect(&kvs, &KVStore::valueChanged,
-          this, &AtomicWidget::setValueFromStore);
-  connect(&kvs, &KVStore::valueDeleted,
-          this, &AtomicWidget::forgetValue);
-  connect(&kvs, &KVStore::valueLocked,
-          this, &AtomicWidget::lockValue);
-  connect(&kvs, &KVStore::valueUnlocked,
-          this, &AtomicWidget::unlockValue);
-}
+  QWidget(parent) {}
 
 void AtomicWidget::relayoutWidget(QWidget *w)
 {
@@ -41,23 +29,37 @@ void AtomicWidget::setKey(std::string const &newKey)
   std::string const oldKey = key;
   key = newKey;
 
+  // Listen to the changes of that key only:
+  if (oldKey.length() > 0)
+    disconnect(kvs.subscribeKey(oldKey), nullptr, this, nullptr);
+
   if (key.length() > 0) {
-    kvs.lock.lock_shared();
-    auto it = kvs.map.find(key);
-    if (it == kvs.map.end()) {
+    KVSubscriber const *subscriber = kvs.subscribeKey(key);
+    connect(subscriber, &KVSubscriber::valueCreated,
+            this, &AtomicWidget::setValueFromStore);
+    connect(subscriber, &KVSubscriber::valueChanged,
+            this, &AtomicWidget::setValueFromStore);
+    connect(subscriber, &KVSubscriber::valueDeleted,
+            this, &AtomicWidget::forgetValue);
+    connect(subscriber, &KVSubscriber::valueLocked,
+            this, &AtomicWidget::lockValue);
+    connect(subscriber, &KVSubscriber::valueUnlocked,
+            this, &AtomicWidget::unlockValue);
+
+    std::shared_ptr<KValue const> kv = kvs.get(key);
+    if (! kv) {
       if (verbose)
         qDebug() << "AtomicWidget[" << QString::fromStdString(key)
                  << "]: ...which is not in the kvs";
       setEnabled(false);
     } else {
-      bool const ok = setValue(it->first, it->second.val);
+      bool const ok = setValue(key, kv->val);
       if (verbose)
         qDebug() << "AtomicWidget[" << QString::fromStdString(key)
-                 << "]: set value to" << *it->second.val << (ok ? " (ok)":" XXXXXX");
+                 << "]: set value to" << *kv->val << (ok ? " (ok)":" XXXXXX");
       assert(ok);
-      setEnabled(it->second.isMine());
+      setEnabled(kv->isMine());
     }
-    kvs.lock.unlock_shared();
   } else {
     // or set the value to nullptr?
     setEnabled(false);
@@ -0,0 +1,205 @@
+#include <iostream>
+#include <thread>
+#include <sys/resource.h>
+extern "C" {
+# include <caml/mlvalues.h>
+# include <caml/memory.h>
+# include <caml/alloc.h>
+# include <caml/callback.h>
+# include <caml/threads.h>
+// Defined by OCaml mlvalues but conflicting with further Qt includes:
+# undef alloc
+# undef flush
+}
+#include <QApplication>
+#include <QDebug>
+#include <QTimer>
+#include "conf.h"
+#include "Diagnostics.h"
+#include "FunctionItem.h"
+#include "GraphModel.h"
+#include "GraphViewSettings.h"
+#include "misc.h"
+#include "NamesTree.h"
+#include "ProgramItem.h"
+#include "RamenValue.h" // for ocamlThreadId
+#include "SiteItem.h"
+#include "TailModel.h"
+#include "Benchmark.h"
+
+template<class F>
+void Benchmark::ModelTimer::around(
+  KVSubscriber const *subscriber, F connectReceivers)
+{
+  auto connectAll = [subscriber](auto f) {
+    QObject::connect(subscriber, &KVSubscriber::valueCreated, f);
+    QObject::connect(subscriber, &KVSubscriber::valueChanged, f);
+    QObject::connect(subscriber, &KVSubscriber::valueLocked, f);
+    QObject::connect(subscriber, &KVSubscriber::valueUnlocked, f);
+    QObject::connect(subscriber, &KVSubscriber::valueDeleted, f);
+    // Some models defer their notifications until then:
+    QObject::connect(&kvs, &KVStore::batchDelivered, f);
+  };
+
+  connectAll([this]() { timer.start(); });
+  connectReceivers();
+  connectAll([this]() { totTime += timer.nsecsElapsed(); });
+}
+
+Benchmark::Benchmark(QString const &recording_, QObject *parent) :
+  QObject(parent),
+  recording(recording_),
+  graphModelTime("GraphModel"),
+  namesTreeTime("NamesTree"),
+  tailModelTime("TailModel")
+{
+  connect(this, &Benchmark::replayDone, this, &Benchmark::finish);
+}
+
+static void do_replay_thread(Benchmark *benchmark, QString const recording)
+{
+  ocamlThreadId = std::this_thread::get_id();
+  caml_c_thread_register();
+  caml_acquire_runtime_system();
+
+  QElapsedTimer syncTime;
+  syncTime.start();
+  unsigned numMsgs = 0;
+  double recordedDuration = 0.;
+  {
+    CAMLparam0();
+    CAMLlocal2(fname_, res_);
+    fname_ = caml_copy_string(recording.toStdString().c_str());
+    value *replay = caml_named_value("replay");
+    res_ = caml_callback(*replay, fname_);
+    numMsgs = Int_val(Field(res_, 0));
+    recordedDuration = Double_val(Field(res_, 1));
+    CAMLdrop;
+  }
+
+  caml_release_runtime_system();
+  caml_c_thread_unregister();
+
+  benchmark->replayed(numMsgs, recordedDuration, syncTime.elapsed());
+}
+
+void Benchmark::replayed(
+  unsigned numMsgs, double recordedDuration, qint64 syncTime)
+{
+  // Queued, since this is called from the sync thread:
+  emit replayDone(numMsgs, recordedDuration, syncTime);
+}
+
+int Benchmark::run()
+{
+  GraphViewSettings *settings = new GraphViewSettings;
+
+  KVSubscriber const *sites = kvs.subscribePrefix("sites/");
+  graphModelTime.around(sites, [settings]() {
+    GraphModel::globalGraphModel = new GraphModel(settings);
+  });
+  namesTreeTime.around(sites, []() {
+    NamesTree::globalNamesTree = new NamesTree(true);
+    NamesTree::globalNamesTreeAnySites = new NamesTree(false);
+  });
+
+  // Once the models are up to date, open the tails of any new worker:
+  connect(&kvs, &KVStore::batchDelivered, this, &Benchmark::openTails);
+
+  replayTime.start();
+  std::thread replay_thread(do_replay_thread, this, recording);
+
+  int ret = qApp->exec();
+
+  replay_thread.join();
+
+  tails.clear();
+  danceOfDel<NamesTree>(&NamesTree::globalNamesTreeAnySites);
+  danceOfDel<NamesTree>(&NamesTree::globalNamesTree);
+  danceOfDel<GraphModel>(&GraphModel::globalGraphModel);
+  danceOfDel<GraphViewSettings>(&settings);
+
+  return ret;
+}
+
+void Benchmark::openTails()
+{
+  for (SiteItem const *siteItem : GraphModel::globalGraphModel->sites) {
+    for (ProgramItem const *programItem : siteItem->programs) {
+      for (FunctionItem const *functionItem : programItem->functions) {
+        std::shared_ptr<Function> function =
+          std::static_pointer_cast<Function>(functionItem->shared);
+        if (! function->worker || ! function->outType()) continue;
+
+        QString const &workerSign = function->worker->workerSign;
+        auto it = openedTails.find(function.get());
+        if (it != openedTails.end() && it->second == workerSign) continue;
+        openedTails[function.get()] = workerSign;
+
+        std::shared_ptr<TailModel> tail;
+        tailModelTime.around(
+          kvs.subscribePrefix(
+            TailModel::keyPrefixOf(function->fqName, workerSign)),
+          [&tail, &function]() { tail = function->getTail(); });
+        if (tail) tails.push_back(tail);
+      }
+    }
+  }
+}
+
+void Benchmark::finish(
+  unsigned numMsgs, double recordedDuration, qint64 syncTime)
+{
+  /* The last changes may still wait in the store for their batch to be
+   * delivered, which happens within a frame: */
+  QTimer::singleShot(2 * KVStore::frameDuration, this,
+                     [this, numMsgs, recordedDuration, syncTime]() {
+    report(numMsgs, recordedDuration, syncTime);
+    qApp->quit();
+  });
+}
+
+void Benchmark::report(
+  unsigned numMsgs, double recordedDuration, qint64 syncTime)
+{
+  qint64 const totTime = replayTime.elapsed();
+
+  struct rusage usage;
+  long maxRss = 0;
+  if (0 == getrusage(RUSAGE_SELF, &usage)) {
+    maxRss = usage.ru_maxrss;
+#   ifdef __APPLE__
+    maxRss /= 1024; // bytes rather than kilobytes
+#   endif
+  }
+
+  KVStore::DeliveryStats const &stats = kvs.deliveryStats;
+  size_t numTuples = 0;
+  for (std::shared_ptr<TailModel> const &tail : tails)
+    numTuples += tail->rowCount();
+
+  auto perSec = [](double n, qint64 ms) {
+    return ms > 0 ? n * 1000. / ms : 0.;
+  };
+
+  std::cout
+    << "Replayed " << numMsgs << " messages (recorded over "
+    << recordedDuration << "s)\n"
+    << "  sync thread: " << syncTime << "ms, "
+    << perSec(numMsgs, syncTime) << " msgs/s\n"
+    << "  until delivered: " << totTime << "ms, "
+    << perSec(numMsgs, totTime) << " msgs/s\n"
+    << "  batches: " << stats.numBatches << ", "
+    << stats.numChanges << " changes, at most "
+    << stats.maxBatchSize << " per batch, max latency "
+    << stats.maxLatency << "ms\n"
+    << "  tails: " << tails.size() << ", " << numTuples << " tuples\n";
+
+  for (ModelTimer const *t :
+         { &graphModelTime, &namesTreeTime, &tailModelTime }) {
+    std::cout << "  " << t->name << ": " << t->totTime / 1000000 << "ms\n";
+  }
+
+  std::cout << "  peak memory: " << maxRss / 1024 << "MiB\n\n"
+            << diagnostics.report().toStdString() << std::endl;
+}
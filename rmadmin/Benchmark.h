@@ -0,0 +1,80 @@
+#ifndef BENCHMARK_H_191018
+#define BENCHMARK_H_191018
+#include <map>
+#include <memory>
+#include <vector>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QString>
+
+/* Replays a recording of the messages received from the server (see the
+ * --record command line option) through the KVStore and the main models,
+ * without displaying any window, and reports how fast it went:
+ *
+ *   RmAdmin --record /tmp/msgs some.host   # then quit once synced
+ *   RmAdmin --benchmark /tmp/msgs
+ *
+ * Messages are replayed as fast as possible, by the same sync thread
+ * callbacks as when connected to a server. The store delivers them to the
+ * models as usual, once per frame. As all tails are opened as soon as
+ * possible, tail tuples are also stored and unserialized. */
+
+class Function;
+class KVSubscriber;
+class TailModel;
+
+class Benchmark : public QObject
+{
+  Q_OBJECT
+
+public:
+  /* Time spent by some receivers of the KVStore signals.
+   * As the slots connected to a signal are called in the order they have
+   * been connected, a receiver can be timed by connecting a slot that starts
+   * a timer before the receiver connects, and one that stops it after: */
+  class ModelTimer
+  {
+    QElapsedTimer timer;
+
+  public:
+    char const *const name;
+    qint64 totTime = 0; // nanoseconds
+
+    ModelTimer(char const *name_) : name(name_) {}
+
+    // Times whatever connectReceivers connects to that subscriber:
+    template<class F>
+    void around(KVSubscriber const *, F connectReceivers);
+  };
+
+private:
+  QString const recording;
+
+  ModelTimer graphModelTime, namesTreeTime, tailModelTime;
+
+  // Tails already opened, with the signature of their worker:
+  std::map<Function const *, QString> openedTails;
+  std::vector<std::shared_ptr<TailModel>> tails;
+
+  QElapsedTimer replayTime;
+
+  void report(unsigned numMsgs, double recordedDuration, qint64 syncTime);
+
+public:
+  Benchmark(QString const &recording, QObject *parent = nullptr);
+
+  // Returns the exit code:
+  int run();
+
+  // Called by the sync thread once all messages have been replayed:
+  void replayed(unsigned numMsgs, double recordedDuration, qint64 syncTime);
+
+private slots:
+  void openTails();
+  void finish(unsigned numMsgs, double recordedDuration, qint64 syncTime);
+
+signals:
+  void replayDone(unsigned, double, qint64);
+};
+
+#endif
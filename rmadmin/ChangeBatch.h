@@ -0,0 +1,77 @@
+#ifndef CHANGEBATCH_H_191018
+#define CHANGEBATCH_H_191018
+#include <cstddef>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+/* The changes accumulated by the KVStore until they are delivered to the GUI
+ * thread (see KVStore::queueChange).
+ * Consecutive changes of the same key that can be merged (such as several
+ * Changed, or a Created followed by some Changed) are collapsed into the last
+ * of them, as receivers only need to learn about the final value. Not so
+ * for values that are each significant, such as the tuples that are set one
+ * after the other into the same response key of a replay.
+ * Kind must have the enumerators Created, Changed, Locked and Unlocked.
+ * Free of any Qt dependency so that it can be tested on its own. */
+
+template<class Kind, class Key, class Snapshot>
+class ChangeBatch
+{
+public:
+  struct Change {
+    Kind kind;
+    std::shared_ptr<Key const> key;
+    std::shared_ptr<Snapshot const> snapshot;
+  };
+
+private:
+  std::vector<Change> changes;
+
+  // Index in changes of the last change of each (interned) key:
+  std::unordered_map<Key const *, size_t> lastChangeOf;
+
+public:
+  bool empty() const { return changes.empty(); }
+
+  size_t size() const { return changes.size(); }
+
+  /* Unless keepAll, a Changed is merged into a previous Created or Changed,
+   * and a lock change into a previous lock change. Anything else (such as a
+   * deletion, or a change of value after a change of lock) is kept in
+   * order: */
+  void add(
+    Kind kind, std::shared_ptr<Key const> key,
+    std::shared_ptr<Snapshot const> snapshot, bool keepAll)
+  {
+    auto it = lastChangeOf.find(key.get());
+    if (it != lastChangeOf.end()) {
+      Change &last = changes[it->second];
+      if (! keepAll && kind == Kind::Changed &&
+          (last.kind == Kind::Created || last.kind == Kind::Changed)) {
+        last.snapshot = snapshot;
+        return;
+      }
+      if ((kind == Kind::Locked || kind == Kind::Unlocked) &&
+          (last.kind == Kind::Locked || last.kind == Kind::Unlocked)) {
+        last.kind = kind;
+        last.snapshot = snapshot;
+        return;
+      }
+    }
+
+    lastChangeOf[key.get()] = changes.size();
+    changes.push_back({ kind, key, snapshot });
+  }
+
+  // Returns all the changes, in order, and starts a new batch:
+  std::vector<Change> take()
+  {
+    std::vector<Change> res;
+    res.swap(changes);
+    lastChangeOf.clear();
+    return res;
+  }
+};
+
+#endif
@@ -0,0 +1,79 @@
+/* Checks how ChangeBatch merges changes.
+ * Built and run by `make unit-check`, without Qt. */
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "ChangeBatch.h"
+
+enum Kind { Created, Changed, Locked, Unlocked, Deleted };
+
+typedef ChangeBatch<Kind, std::string, int> Batch;
+
+static int numFailures = 0;
+
+static void check(bool ok, char const *what)
+{
+  if (ok) return;
+  std::cerr << "FAILED: " << what << std::endl;
+  numFailures ++;
+}
+
+static std::shared_ptr<int const> val(int v)
+{
+  return std::make_shared<int const>(v);
+}
+
+// Many tuples set into the same key must all be delivered, in order:
+static void testKeepAll()
+{
+  unsigned const n = 100;
+  auto key = std::make_shared<std::string const>("clients/1/response/1");
+  Batch batch;
+
+  batch.add(Created, key, val(0), true);
+  for (unsigned i = 1; i < n; i ++) batch.add(Changed, key, val(i), true);
+
+  std::vector<Batch::Change> const changes = batch.take();
+  check(changes.size() == n, "all the values are delivered");
+  for (unsigned i = 0; i < changes.size(); i ++)
+    check(*changes[i].snapshot == (int)i, "values are delivered in order");
+  check(batch.empty(), "take empties the batch");
+}
+
+// Whereas only the last value matters for other keys:
+static void testMerge()
+{
+  auto k1 = std::make_shared<std::string const>("sites/a/workers/b/stats");
+  auto k2 = std::make_shared<std::string const>("sites/a/workers/c/stats");
+  Batch batch;
+
+  batch.add(Created, k1, val(1), false);
+  batch.add(Changed, k2, val(2), false);
+  batch.add(Changed, k1, val(3), false);
+  batch.add(Changed, k2, val(4), false);
+  batch.add(Locked, k1, val(5), false);
+  batch.add(Unlocked, k1, val(6), false);
+  batch.add(Changed, k1, val(7), false);
+
+  std::vector<Batch::Change> const changes = batch.take();
+  check(changes.size() == 4, "changes are merged");
+  check(changes[0].kind == Created && *changes[0].snapshot == 3,
+        "a Changed is merged into a Created");
+  check(changes[1].kind == Changed && *changes[1].snapshot == 4,
+        "a Changed is merged into a Changed");
+  check(changes[2].kind == Unlocked && *changes[2].snapshot == 6,
+        "lock changes are merged");
+  check(changes[3].kind == Changed && *changes[3].snapshot == 7,
+        "a Changed is not merged across a lock change");
+}
+
+int main()
+{
+  testKeepAll();
+  testMerge();
+
+  if (numFailures > 0) return EXIT_FAILURE;
+  std::cout << "ChangeBatch: all tests passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -1,6 +1,10 @@
+#include <algorithm>
 #include <QDebug>
+#include <QTimer>
 #include <QVBoxLayout>
 #include "Chart.h"
+#include "Column.h"
+#include "conf.h"
 #include "RamenType.h"
 #include "RamenValue.h"
 #include "PastData.h"
@@ -17,8 +21,19 @@ Chart::Chart(std::shared_ptr<TailModel const> tailModel_,
   tailModel(tailModel_),
   pastData(pastData_),
   columns(columns_),
-  graphic(nullptr)
+  graphic(nullptr),
+  needReset(true),
+  needReplot(false),
+  numPlottedRows(0),
+  removedFirst(0),
+  removedEnd(0)
 {
+  refreshTimer = new QTimer(this);
+  refreshTimer->setSingleShot(true);
+  refreshTimer->setInterval(KVStore::frameDuration);
+  connect(refreshTimer, &QTimer::timeout,
+          this, &Chart::refresh);
+
   timeRangeEdit = new TimeRangeEdit;
   connect(timeRangeEdit, &TimeRangeEdit::valueChanged,
           this, &Chart::updateChart);
@@ -30,10 +45,17 @@ Chart::Chart(std::shared_ptr<TailModel const> tailModel_,
   updateGraphic();
 
   connect(tailModel.get(), &TailModel::rowsInserted,
+          this, &Chart::addRows);
+  // Replays complete long after they have been requested by iterValues:
+  connect(pastData.get(), &PastData::dataReceived,
           this, &Chart::updateChart);
+  // Rows must be read before they are removed:
+  connect(tailModel.get(), &TailModel::rowsAboutToBeRemoved,
+          this, &Chart::removeRows);
 }
 
-void Chart::iterValues(std::function<void (std::vector<RamenValue const *> const)> cb) const
+void Chart::iterValues(
+  std::function<void (std::vector<std::optional<double>> const &)> cb) const
 {
   if (columns.size() == 0) return;
 
@@ -46,36 +68,57 @@ void Chart::iterValues(std::function<void (std::vector<RamenValue const *> const
   TimeRange range = timeRangeEdit->getRange();
   TimeRange reqRange = range;
   if (tailRowCount > 0) {
-    double const oldestTail = tailModel->tuples[0].first;
+    double const oldestTail = tailModel->timeOf(0);
     if (reqRange.until > oldestTail) reqRange.until = oldestTail;
   }
   if (! reqRange.isEmpty())
     pastData->request(reqRange);
 
-  pastData->iterTuples(range, [&cb, this](std::shared_ptr<RamenValue const> tuple) {
-    std::vector<RamenValue const *> v;
-    v.reserve(columns.size());
-    for (unsigned column : columns) {
-      v.push_back(tuple->columnValue(column));
-    }
+  std::vector<std::optional<double>> v(columns.size());
+  pastData->iterTuples(range, [&cb, &v, this](
+      std::vector<std::unique_ptr<Column>> const &pastColumns, size_t row) {
+    for (size_t i = 0; i < columns.size(); i ++)
+      v[i] = pastColumns[columns[i]]->toDouble(row);
     cb(v);
   });
 
-  /* Then for tail data: */
-  // TODO: lock the tailModel to prevent points being added while we iterate
-  for (int row = 0; row < tailRowCount; row ++) {
-    if (row < tailModel->rowCount()) {
-      std::pair<double, std::unique_ptr<RamenValue const>> const &tuple =
-        tailModel->tuples[row];
-      if (tuple.first >= range.since && tuple.first < range.until) {
-        std::vector<RamenValue const *> v;
-        v.reserve(columns.size());
-        for (unsigned column : columns)
-          v.push_back(tuple.second->columnValue(column));
-        cb(v);
-      }
-    }
-  }
+  /* Then for tail data, read directly from its columns: */
+  tailModel->iterRows(range, [&cb, &v, this](
+      std::vector<std::unique_ptr<Column>> const &tailColumns, size_t row) {
+    for (size_t i = 0; i < columns.size(); i ++)
+      v[i] = tailColumns[columns[i]]->toDouble(row);
+    cb(v);
+  });
+}
+
+void Chart::iterNewValues(
+  std::function<void (std::vector<std::optional<double>> const &)> cb) const
+{
+  if (columns.size() == 0) return;
+
+  TimeRange const range = timeRangeEdit->getRange();
+  std::vector<std::optional<double>> v(columns.size());
+  tailModel->iterRows(range, [&cb, &v, this](
+      std::vector<std::unique_ptr<Column>> const &tailColumns, size_t row) {
+    for (size_t i = 0; i < columns.size(); i ++)
+      v[i] = tailColumns[columns[i]]->toDouble(row);
+    cb(v);
+  }, numPlottedRows);
+}
+
+void Chart::iterRemovedValues(
+  std::function<void (std::vector<std::optional<double>> const &)> cb) const
+{
+  if (columns.size() == 0) return;
+
+  TimeRange const range = timeRangeEdit->getRange();
+  std::vector<std::optional<double>> v(columns.size());
+  tailModel->iterRows(range, [&cb, &v, this](
+      std::vector<std::unique_ptr<Column>> const &tailColumns, size_t row) {
+    for (size_t i = 0; i < columns.size(); i ++)
+      v[i] = tailColumns[columns[i]]->toDouble(row);
+    cb(v);
+  }, removedFirst, removedEnd);
 }
 
 void Chart::updateGraphic()
@@ -85,7 +128,8 @@ void Chart::updateGraphic()
   graphic = defaultGraphic();
   layout->addWidget(graphic, 0, 0);
 
-  graphic->update();
+  needReset = true;
+  refresh();
 }
 
 /* This is called whenever a new dataSource is added (or removed) */
@@ -109,10 +153,50 @@ Graphic *Chart::defaultGraphic()
 
 void Chart::updateChart()
 {
-  if (verbose)
-    qDebug() << "Chart::updateChart";
+  needReset = true;
+  if (! refreshTimer->isActive()) refreshTimer->start();
+}
+
+void Chart::addRows()
+{
+  if (! refreshTimer->isActive()) refreshTimer->start();
+}
+
+void Chart::removeRows(QModelIndex const &, int first, int last)
+{
+  // Rows that are not plotted yet are not plotted at all after a reset:
+  if (needReset || first >= numPlottedRows) return;
+
+  removedFirst = first;
+  removedEnd = std::min(last + 1, numPlottedRows);
+  graphic->removeData();
+
+  // Plotted rows after the removed ones are shifted:
+  numPlottedRows -= removedEnd - removedFirst;
+  needReplot = true;
+  if (! refreshTimer->isActive()) refreshTimer->start();
+}
+
+void Chart::refresh()
+{
+  refreshTimer->stop();
+
+  int const rowCount = tailModel->rowCount();
+
+  if (needReset) {
+    if (verbose)
+      qDebug() << "Chart::refresh: reset with" << rowCount << "tail rows";
+    graphic->setData();
+  } else if (rowCount > numPlottedRows) {
+    graphic->addData();
+  } else if (! needReplot) {
+    return;
+  }
+
+  numPlottedRows = rowCount;
+  needReset = needReplot = false;
 
-  graphic->setData();
+  graphic->replot();
 }
 
 QString const Chart::labelName(int idx) const
@@ -12,13 +12,15 @@
  * graphics may have additional controls) */
 #include <functional>
 #include <memory>
+#include <optional>
 #include <vector>
 #include <QWidget>
 
+class QModelIndex;
+class QTimer;
 class QVBoxLayout;
 class Graphic;
 class PastData;
-struct RamenValue;
 class TailModel;
 class TimeRangeEdit;
 
@@ -33,6 +35,20 @@ class Chart : public QWidget
   QVBoxLayout *layout;
   Graphic *graphic;
 
+  /* Changes are applied to the graphic at most once per frame: either new
+   * tail rows are added to it, or all its data is reset (when the time range
+   * changes or past data is received). The tail rows before numPlottedRows
+   * are already part of the graphic.
+   * Points of evicted tail rows are removed from the graphic right before
+   * those rows are removed, and the graphic replotted with the next
+   * refresh: */
+  QTimer *refreshTimer;
+  bool needReset, needReplot;
+  int numPlottedRows;
+
+  // The plotted rows being removed (while in removeRows):
+  int removedFirst, removedEnd;
+
   Graphic *defaultGraphic();
 
   /* Controls: */
@@ -45,8 +61,21 @@ public:
         std::vector<int> columns,
         QWidget *parent = nullptr);
 
-  /* Iterate over the points of all datasets (within time range): */
-  void iterValues(std::function<void (std::vector<RamenValue const *> const)> cb) const;
+  /* Iterate over the points of all datasets (within time range), as the
+   * numeric value of each selected column (or nullopt for NULLs): */
+  void iterValues(
+    std::function<void (std::vector<std::optional<double>> const &)> cb) const;
+
+  // Same, but only for the tail rows that are not plotted yet:
+  void iterNewValues(
+    std::function<void (std::vector<std::optional<double>> const &)> cb) const;
+
+  // Same, but only for the plotted tail rows that are being removed:
+  void iterRemovedValues(
+    std::function<void (std::vector<std::optional<double>> const &)> cb) const;
+
+  typedef void (Chart::*IterFunction)(
+    std::function<void (std::vector<std::optional<double>> const &)>) const;
 
   QString const labelName(int idx) const;
 
@@ -56,8 +85,17 @@ public slots:
   // Update the graphic after adding/removing a dataset:
   void updateGraphic();
 
-  // Update the chosen graphic when controls have changed or points were added:
+  // Reset the data of the graphic when controls have changed:
   void updateChart();
+
+  // Add the new tail rows to the graphic:
+  void addRows();
+
+  // Remove those tail rows from the graphic:
+  void removeRows(QModelIndex const &, int first, int last);
+
+private slots:
+  void refresh();
 };
 
 #endif
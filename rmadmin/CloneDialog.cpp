@@ -27,10 +27,8 @@ CloneDialog::CloneDialog(std::string const &origKey, QWidget *parent) :
   extension = names.takeLast();
   origName = names.join('/');
 
-  kvs.lock.lock_shared();
-  auto it = kvs.map.find(origKey);
-  if (it != kvs.map.end()) value = it->second.val;
-  kvs.lock.unlock_shared();
+  std::shared_ptr<KValue const> kv = kvs.get(origKey);
+  if (kv) value = kv->val;
 
   QVBoxLayout *layout = new QVBoxLayout;
 
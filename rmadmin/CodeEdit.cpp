@@ -50,9 +50,8 @@ CodeEdit::CodeEdit(QWidget *parent) :
   layout->addWidget(compilationError);
   setLayout(layout);
 
-  // Connect the error label to this hide/show slot
-  connect(&kvs, &KVStore::valueCreated, this, &CodeEdit::setError);
-  connect(&kvs, &KVStore::valueChanged, this, &CodeEdit::setError);
+  /* The error label is connected to this hide/show slot when the key prefix
+   * is set. */
 
   // Display the corresponding widget when the extension combobox changes:
   connect(extensionsCombo, QOverload<int>::of(&QComboBox::currentIndexChanged),
@@ -101,23 +100,27 @@ void CodeEdit::setKeyPrefix(std::string const &prefix)
              << "replacing " << QString::fromStdString(keyPrefix);
 
   if (keyPrefix == prefix) return;
+  if (keyPrefix.length() > 0)
+    disconnect(kvs.subscribeKey(keyPrefix + "/info"), nullptr, this, nullptr);
   keyPrefix = prefix;
 
   std::string const alertKey = prefix + "/alert";
   std::string const ramenKey = prefix + "/ramen";
   std::string const infoKey = prefix + "/info";
 
+  // Connect the error label to this hide/show slot
+  KVSubscriber const *subscriber = kvs.subscribeKey(infoKey);
+  connect(subscriber, &KVSubscriber::valueCreated, this, &CodeEdit::setError);
+  connect(subscriber, &KVSubscriber::valueChanged, this, &CodeEdit::setError);
+
   unsigned numSources = 0;
 
-  kvs.lock.lock_shared();
-  KValue const *kv = nullptr;
-  auto it = kvs.map.find(infoKey);
-  if (it != kvs.map.end()) kv = &it->second;
+  std::shared_ptr<KValue const> info = kvs.get(infoKey);
   // Look for the ramen source:
-  it = kvs.map.find(ramenKey);
-  if (it != kvs.map.end() &&
+  std::shared_ptr<KValue const> kv = kvs.get(ramenKey);
+  if (kv &&
       /* Skip Null values that are created as placeholder during compilation: */
-      ! it->second.val->isNull()) {
+      ! kv->val->isNull()) {
     if (verbose)
       qDebug() << "CodeEdit::setKeyPrefix: found ramen code";
     editor->setCurrentWidget(0);
@@ -127,10 +130,10 @@ void CodeEdit::setKeyPrefix(std::string const &prefix)
     numSources ++;
   }
   // Takes precedence over the ramen source:
-  it = kvs.map.find(alertKey);
-  if (it != kvs.map.end() &&
+  kv = kvs.get(alertKey);
+  if (kv &&
       /* Skip Null values that are created as placeholder during compilation: */
-      ! it->second.val->isNull()) {
+      ! kv->val->isNull()) {
     if (verbose)
       qDebug() << "CodeEdit::setKeyPrefix: found an alert";
     editor->setCurrentWidget(1);
@@ -140,6 +143,5 @@ void CodeEdit::setKeyPrefix(std::string const &prefix)
     numSources ++;
   }
   extensionSwitcher->setVisible(numSources > 1);
-  resetError(kv);
-  kvs.lock.unlock_shared();
+  resetError(info.get());
 }
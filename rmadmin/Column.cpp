@@ -0,0 +1,143 @@
+#include <QDebug>
+#include "RamenValue.h"
+#include "Column.h"
+
+void Column::saveNulls(QDataStream &s, size_t first, size_t num) const
+{
+  // Packed 8 per byte:
+  for (size_t i = 0; i < num; i += 8) {
+    quint8 b = 0;
+    for (size_t j = 0; j < 8 && i + j < num; j ++)
+      if (nulls[first + i + j]) b |= 1U << j;
+    s << b;
+  }
+}
+
+void Column::loadNulls(QDataStream &s, size_t num)
+{
+  for (size_t i = 0; i < num; i += 8) {
+    quint8 b;
+    s >> b;
+    for (size_t j = 0; j < 8 && i + j < num; j ++)
+      nulls.push_back(b & (1U << j));
+  }
+}
+
+template<class V, class T>
+void NumColumn<V, T>::save(QDataStream &s, size_t first, size_t num) const
+{
+  saveNulls(s, first, num);
+  for (size_t i = first; i < first + num; i ++) {
+    T const v = values[i];
+    s.writeRawData((char const *)&v, sizeof(v));
+  }
+}
+
+template<class V, class T>
+void NumColumn<V, T>::load(QDataStream &s, size_t num)
+{
+  loadNulls(s, num);
+  for (size_t i = 0; i < num; i ++) {
+    T v;
+    s.readRawData((char *)&v, sizeof(v));
+    values.push_back(v);
+  }
+}
+
+template<class V, class T>
+void NumColumn<V, T>::append(RamenValue const *val)
+{
+  V const *v = dynamic_cast<V const *>(val);
+
+  if (val && ! v && ! val->isNull())
+    qCritical() << "NumColumn: Unexpected value" << val->toQString(std::string());
+
+  nulls.push_back(! v);
+  values.push_back(v ? v->v : T());
+}
+
+// The numeric columns a TupleDecoder can create:
+template class NumColumn<VFloat, double>;
+template class NumColumn<VBool, bool>;
+template class NumColumn<VU8, uint8_t>;
+template class NumColumn<VU16, uint16_t>;
+template class NumColumn<VU32, uint32_t>;
+template class NumColumn<VU64, uint64_t>;
+template class NumColumn<VU128, uint128_t>;
+template class NumColumn<VI8, int8_t>;
+template class NumColumn<VI16, int16_t>;
+template class NumColumn<VI32, int32_t>;
+template class NumColumn<VI64, int64_t>;
+template class NumColumn<VI128, int128_t>;
+
+void StringColumn::append(RamenValue const *val)
+{
+  starts.push_back(arena.length());
+
+  if (! val || val->isNull()) {
+    nulls.push_back(true);
+    return;
+  }
+
+  nulls.push_back(false);
+
+  if (anyType) {
+    arena.append(val->toQString(std::string()));
+    return;
+  }
+
+  VString const *v = dynamic_cast<VString const *>(val);
+  if (! v) {
+    qCritical() << "StringColumn: Unexpected value" << val->toQString(std::string());
+    arena.append(val->toQString(std::string()));
+    return;
+  }
+
+  arena.append(v->v);
+}
+
+void StringColumn::truncate(size_t numRows)
+{
+  if (numRows >= starts.size()) return;
+  arena.truncate(starts[numRows]);
+  starts.resize(numRows);
+  Column::truncate(numRows);
+}
+
+void StringColumn::dropFront(size_t numRows)
+{
+  int const cut = numRows < starts.size() ? starts[numRows] : arena.length();
+  arena.remove(0, cut);
+  starts.erase(starts.begin(), starts.begin() + numRows);
+  for (int &start : starts) start -= cut;
+  Column::dropFront(numRows);
+}
+
+void StringColumn::save(QDataStream &s, size_t first, size_t num) const
+{
+  saveNulls(s, first, num);
+  for (size_t i = first; i < first + num; i ++)
+    if (! nulls[i]) s << toQString(i);
+}
+
+void StringColumn::load(QDataStream &s, size_t num)
+{
+  size_t const first = nulls.size();
+  loadNulls(s, num);
+  for (size_t i = first; i < first + num; i ++) {
+    starts.push_back(arena.length());
+    if (nulls[i]) continue;
+    QString str;
+    s >> str;
+    arena.append(str);
+  }
+}
+
+QString StringColumn::toQString(size_t row) const
+{
+  if (nulls[row]) return QString("NULL");
+
+  int const start = starts[row];
+  int const stop = row + 1 < starts.size() ? starts[row + 1] : arena.length();
+  return arena.mid(start, stop - start);
+}
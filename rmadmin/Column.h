@@ -0,0 +1,179 @@
+#ifndef COLUMN_H_191018
+#define COLUMN_H_191018
+#include <memory>
+#include <optional>
+#include <vector>
+#include <QDataStream>
+#include <QString>
+
+/* Values of a given column of many tuples, stored contiguously rather than
+ * as one RamenValue per tuple and field.
+ * Numeric and boolean columns are typed arrays and string columns are a
+ * single arena, each with a bitmap of nulls. Any other values (network
+ * addresses, compound values...) are stored in a string column as their
+ * textual representation, which is all that can be done with them anyway.
+ * Columns are created and filled by a TupleDecoder, which knows the actual
+ * class of each column and thus appends to them without virtual calls. */
+
+struct RamenValue;
+
+class Column
+{
+protected:
+  // One bit per row, set for nulls:
+  std::vector<bool> nulls;
+
+  void saveNulls(QDataStream &, size_t first, size_t num) const;
+  void loadNulls(QDataStream &, size_t num);
+
+public:
+  virtual ~Column() {}
+
+  size_t size() const { return nulls.size(); }
+
+  bool isNull(size_t row) const { return nulls[row]; }
+
+  // Appends that value, which can be a VNull or nullptr for NULL:
+  virtual void append(RamenValue const *) = 0;
+
+  // Forget about the rows after the first numRows:
+  virtual void truncate(size_t numRows) { nulls.resize(numRows); }
+
+  // Forget about the first numRows rows:
+  virtual void dropFront(size_t numRows)
+  {
+    nulls.erase(nulls.begin(), nulls.begin() + numRows);
+  }
+
+  /* Writes num rows from first into that stream, and appends as many rows
+   * read from that stream (so that rows can be saved in a file to free some
+   * memory, see TailModel): */
+  virtual void save(QDataStream &, size_t first, size_t num) const = 0;
+  virtual void load(QDataStream &, size_t num) = 0;
+
+  virtual QString toQString(size_t row) const = 0;
+
+  // Used for plotting:
+  virtual std::optional<double> toDouble(size_t) const { return std::nullopt; }
+
+  virtual void reserve(size_t numRows) { nulls.reserve(numRows); }
+
+  /* Approximate memory used by the rows of that column, in bytes (not
+   * counting the reserved capacity, that is not given back anyway): */
+  virtual size_t memoryUsage() const { return nulls.size() / 8; }
+};
+
+/* The column for the scalar values of class V, which value is stored as a
+ * T. Values are converted back to V on the stack for display: */
+template<class V, class T>
+class NumColumn : public Column
+{
+  std::vector<T> values;
+
+public:
+  void append(RamenValue const *);
+
+  void push(T v)
+  {
+    nulls.push_back(false);
+    values.push_back(v);
+  }
+
+  void pushNull()
+  {
+    nulls.push_back(true);
+    values.push_back(T());
+  }
+
+  void truncate(size_t numRows)
+  {
+    Column::truncate(numRows);
+    values.resize(numRows);
+  }
+
+  void dropFront(size_t numRows)
+  {
+    Column::dropFront(numRows);
+    values.erase(values.begin(), values.begin() + numRows);
+  }
+
+  void save(QDataStream &, size_t first, size_t num) const;
+  void load(QDataStream &, size_t num);
+
+  QString toQString(size_t row) const
+  {
+    if (nulls[row]) return QString("NULL");
+    return V(values[row]).toQString(std::string());
+  }
+
+  std::optional<double> toDouble(size_t row) const
+  {
+    if (nulls[row]) return std::nullopt;
+    return V(values[row]).toDouble();
+  }
+
+  void reserve(size_t numRows)
+  {
+    Column::reserve(numRows);
+    values.reserve(numRows);
+  }
+
+  size_t memoryUsage() const
+  {
+    return Column::memoryUsage() + values.size() * sizeof(T);
+  }
+};
+
+class StringColumn : public Column
+{
+  // All strings one after the other:
+  QString arena;
+
+  // Where each string starts in the arena (they end where the next starts):
+  std::vector<int> starts;
+
+  // Whether to convert values to strings rather than expect VStrings:
+  bool const anyType;
+
+public:
+  StringColumn(bool anyType_ = false) : anyType(anyType_) {}
+
+  void append(RamenValue const *);
+
+  // Strings are serialized as bytes, one per character:
+  void push(char const *s, size_t len)
+  {
+    starts.push_back(arena.length());
+    nulls.push_back(false);
+    arena.append(QLatin1String(s, len));
+  }
+
+  void pushNull()
+  {
+    starts.push_back(arena.length());
+    nulls.push_back(true);
+  }
+
+  void truncate(size_t numRows);
+  void dropFront(size_t numRows);
+
+  void save(QDataStream &, size_t first, size_t num) const;
+  void load(QDataStream &, size_t num);
+
+  QString toQString(size_t) const;
+
+  void reserve(size_t numRows)
+  {
+    Column::reserve(numRows);
+    starts.reserve(numRows);
+  }
+
+  size_t memoryUsage() const
+  {
+    return
+      Column::memoryUsage() + arena.size() * sizeof(QChar) +
+      starts.size() * sizeof(int);
+  }
+};
+
+#endif
@@ -17,11 +17,7 @@ ConfTreeEditorDialog::ConfTreeEditorDialog(
   key(key_)
 {
   /* Locate the value in the kvs: */
-  KValue const *kv = nullptr;
-  kvs.lock.lock_shared();
-  auto it = kvs.map.find(key);
-  if (it != kvs.map.end()) kv = &it->second;
-  kvs.lock.unlock_shared();
+  std::shared_ptr<KValue const> kv = kvs.get(key);
   if (! kv) {
     assert(!"TODO: display a QLabel(error) instead");
   }
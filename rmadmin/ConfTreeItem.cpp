@@ -16,11 +16,8 @@ QVariant ConfTreeItem::data(int column, int role) const
 
   if (role == Qt::DecorationRole && column == 2 && key.length() > 0) {
     Resources *r = Resources::get();
-    bool isLocked = false;
-    kvs.lock.lock_shared();
-    auto it = kvs.map.find(key);
-    if (it != kvs.map.end()) isLocked = it->second.isLocked();
-    kvs.lock.unlock_shared();
+    std::shared_ptr<KValue const> kv = kvs.get(key);
+    bool const isLocked = kv && kv->isLocked();
     return isLocked ? QIcon(r->lockedPixmap) : QVariant();
   }
 
@@ -34,20 +31,10 @@ QVariant ConfTreeItem::data(int column, int role) const
     case 2: // lock status
       // k for the lock, and then maybe "locked by ... until ..."
       {
-        bool isLocked = false;
-        std::optional<QString> owner;
-        double expiry;
-        kvs.lock.lock_shared();
-        auto it = kvs.map.find(key);
-        if (it != kvs.map.end()) {
-          isLocked = it->second.isLocked();
-          owner = it->second.owner;
-          expiry = it->second.expiry;
-        }
-        kvs.lock.unlock_shared();
-        if (isLocked) {
-          return QString("locked by ") + *owner +
-                 QString(" until ") + stringOfDate(expiry);
+        std::shared_ptr<KValue const> kv = kvs.get(key);
+        if (kv && kv->isLocked()) {
+          return QString("locked by ") + *kv->owner +
+                 QString(" until ") + stringOfDate(kv->expiry);
         } else {
           return QString("");
         }
@@ -33,27 +33,31 @@ ConfTreeItem *ConfTreeWidget::findItem(QString const &name, ConfTreeItem *parent
   return nullptr;
 }
 
+void ConfTreeWidget::itemChanged(ConfTreeItem *item)
+{
+  if (item) {
+    item->emitDataChanged();
+    /* The view will then ask for its data again, and those will be fetched
+     * from the store. */
+    resizeColumnToContents(2);
+  }
+}
+
 // Slot to propagates editor valueChanged into the item emitDatachanged
-void ConfTreeWidget::editedValueChangedFromStore(std::string const &key, KValue const &kv)
+void ConfTreeWidget::editedValueChangedFromStore(conf::Key const &key, KValue const &)
 {
   if (startsWith(key, "tails/")) return;
 
-  editedValueChanged(key, kv.val);
+  itemChanged(itemOfKey(key));
 }
 
 void ConfTreeWidget::editedValueChanged(
   std::string const &key, std::shared_ptr<conf::Value const>)
 {
-  ConfTreeItem *item = itemOfKey(key);
-  if (item) {
-    item->emitDataChanged();
-    /* The view will then ask for its data again, and those will be fetched
-     * from the store. */
-    resizeColumnToContents(2);
-  }
+  itemChanged(itemOfKey(key));
 }
 
-void ConfTreeWidget::deleteItem(std::string const &key, KValue const &)
+void ConfTreeWidget::deleteItem(conf::Key const &key, KValue const &)
 {
   if (startsWith(key, "tails/")) return;
 
@@ -170,10 +174,10 @@ void ConfTreeWidget::createItemByNames(
   }
 }
 
-void ConfTreeWidget::createItem(std::string const &key, KValue const &kv)
+void ConfTreeWidget::createItem(conf::Key const &key, KValue const &kv)
 {
   if (verbose)
-    qDebug() << "ConfTreeWidget: createItem for key" << QString::fromStdString(key);
+    qDebug() << "ConfTreeWidget: createItem for key" << key.qs;
 
   if (startsWith(key, "tails/")) return;
 
@@ -182,8 +186,7 @@ void ConfTreeWidget::createItem(std::string const &key, KValue const &kv)
    * slot that will retrieve the item and call it's emitDataChanged function
    * (which will itself call the underlying model to signal a change).
    */
-  QString keyName = QString::fromStdString(key);
-  QStringList names = keyName.split("/", QString::SkipEmptyParts);
+  QStringList names(key.names);
   createItemByNames(names, key, kv, nullptr, true);
 }
 
@@ -209,6 +212,12 @@ ConfTreeItem *ConfTreeWidget::itemOfKey(std::string const &key)
   return findItemByNames(names);
 }
 
+ConfTreeItem *ConfTreeWidget::itemOfKey(conf::Key const &key)
+{
+  QStringList names(key.names);
+  return findItemByNames(names);
+}
+
 ConfTreeItem *ConfTreeWidget::findItemByNames(
   QStringList &names, ConfTreeItem *parent)
 {
@@ -246,6 +255,8 @@ ConfTreeWidget::ConfTreeWidget(QWidget *parent) :
   /* Get the activation signal to either collapse/expand or edit: */
   connect(this, &QTreeWidget::itemActivated, this, &ConfTreeWidget::activateItem);
 
+  everything = std::make_unique<TopicSubscription>("*");
+
   /* Register to every change in the kvs: */
   connect(&kvs, &KVStore::valueCreated,
           this, &ConfTreeWidget::createItem);
@@ -257,6 +268,10 @@ ConfTreeWidget::ConfTreeWidget(QWidget *parent) :
           this, &ConfTreeWidget::deleteItem);
 }
 
+ConfTreeWidget::~ConfTreeWidget()
+{
+}
+
 void ConfTreeWidget::keyPressEvent(QKeyEvent *event)
 {
   QTreeWidget::keyPressEvent(event);
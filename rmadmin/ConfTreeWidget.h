@@ -1,11 +1,14 @@
 #ifndef CONFTREEWIDGET_H_190715
 #define CONFTREEWIDGET_H_190715
+#include <memory>
 #include <QTreeWidget>
 #include <QStringList>
+#include "confKey.h"
 #include "confValue.h"
 
 class AtomicWidget;
 class ConfTreeItem;
+class TopicSubscription;
 struct KValue;
 
 #define CONFTREE_WIDGET_NUM_COLUMNS 4
@@ -19,23 +22,29 @@ class ConfTreeWidget : public QTreeWidget
   ConfTreeItem *findItemByNames(QStringList &names, ConfTreeItem * = nullptr);
 
   ConfTreeItem *itemOfKey(std::string const &);
+  ConfTreeItem *itemOfKey(conf::Key const &);
+  void itemChanged(ConfTreeItem *);
   ConfTreeItem *findItem(QString const &name, ConfTreeItem *parent) const;
 
   QWidget *actionWidget(std::string const &, bool, bool);
   QWidget *fillerWidget();
 
+  // The whole tree is displayed and must therefore be received:
+  std::unique_ptr<TopicSubscription> everything;
+
 public:
   ConfTreeWidget(QWidget *parent = nullptr);
+  ~ConfTreeWidget();
   QSize minimumSizeHint() const override;
 
 protected:
   void keyPressEvent(QKeyEvent *) override;
 
 protected slots:
-  void createItem(std::string const &, KValue const &);
+  void createItem(conf::Key const &, KValue const &);
   void editedValueChanged(std::string const &, std::shared_ptr<conf::Value const>);
-  void editedValueChangedFromStore(std::string const &, KValue const &kvp);
-  void deleteItem(std::string const &, KValue const &);
+  void editedValueChangedFromStore(conf::Key const &, KValue const &kvp);
+  void deleteItem(conf::Key const &, KValue const &);
   void deleteClicked(std::string const &);
   void activateItem(QTreeWidgetItem *item, int column);
   void openEditorWindow(std::string const &);
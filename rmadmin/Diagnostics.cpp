@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <QTextStream>
+#include "conf.h"
+#include "confKey.h"
+#include "PastData.h"
+#include "TailModel.h"
+#include "Diagnostics.h"
+
+Diagnostics diagnostics;
+
+void DurationHistogram::add(qint64 ns)
+{
+  unsigned b = 0;
+  for (qint64 us = ns / 1000; us > 0 && b < numBuckets - 1; us >>= 1) b ++;
+
+  buckets[b] ++;
+  count ++;
+  totTime += ns;
+
+  qint64 prevMax = maxTime.load();
+  while (ns > prevMax && ! maxTime.compare_exchange_weak(prevMax, ns)) ;
+}
+
+qint64 DurationHistogram::quantile(double q) const
+{
+  unsigned long const c = count.load();
+  if (c == 0) return 0;
+
+  unsigned long const rank = std::max(1UL, (unsigned long)(q * c));
+  unsigned long seen = 0;
+  for (unsigned b = 0; b < numBuckets; b ++) {
+    seen += buckets[b].load();
+    if (seen >= rank) return (qint64)1000 << b;
+  }
+  return maxTime.load();
+}
+
+Diagnostics::Diagnostics()
+{
+  started.start();
+}
+
+void Diagnostics::countMessage(conf::Key const &key)
+{
+  std::lock_guard<std::mutex> guard(messagesLock);
+  messagesPerFamily[key.family] ++;
+}
+
+void Diagnostics::addTailModel(TailModel const *tailModel)
+{
+  tailModels.insert(tailModel);
+}
+
+void Diagnostics::removeTailModel(TailModel const *tailModel)
+{
+  tailModels.erase(tailModel);
+}
+
+void Diagnostics::addPastData(PastData const *pastData)
+{
+  pastDatas.insert(pastData);
+}
+
+void Diagnostics::removePastData(PastData const *pastData)
+{
+  pastDatas.erase(pastData);
+}
+
+static QString durationToQString(qint64 ns)
+{
+  if (ns < 1000) return QString::number(ns) + "ns";
+  if (ns < 1000000) return QString::number(ns / 1000.) + "µs";
+  if (ns < 1000000000) return QString::number(ns / 1000000.) + "ms";
+  return QString::number(ns / 1000000000.) + "s";
+}
+
+static QString sizeToQString(size_t sz)
+{
+  if (sz < 1024) return QString::number(sz) + "B";
+  if (sz < 1024 * 1024) return QString::number(sz / 1024.) + "KiB";
+  return QString::number(sz / (1024. * 1024.)) + "MiB";
+}
+
+QString Diagnostics::report()
+{
+  QString s;
+  QTextStream out(&s);
+
+  double const uptime = started.elapsed() / 1000.;
+  double const sinceLast =
+    lastReport.isValid() ? lastReport.restart() / 1000. : uptime;
+  if (! lastReport.isValid()) lastReport.start();
+
+  out << "Uptime: " << uptime << "s\n\n";
+
+  {
+    std::map<QString, unsigned long> counts;
+    {
+      std::lock_guard<std::mutex> guard(messagesLock);
+      counts = messagesPerFamily;
+    }
+    unsigned long tot = 0, lastTot = 0;
+    out << "Received messages (total, average/s, recent/s):\n";
+    for (auto const &it : counts) {
+      unsigned long const last = lastMessagesPerFamily[it.first];
+      out << "  " << it.first << ": " << it.second << ", "
+          << (uptime > 0 ? it.second / uptime : 0.) << ", "
+          << (sinceLast > 0 ? (it.second - last) / sinceLast : 0.) << "\n";
+      tot += it.second;
+      lastTot += last;
+    }
+    out << "  total: " << tot << ", "
+        << (uptime > 0 ? tot / uptime : 0.) << ", "
+        << (sinceLast > 0 ? (tot - lastTot) / sinceLast : 0.) << "\n\n";
+    lastMessagesPerFamily = counts;
+  }
+
+  out << "Durations (count, average, median, 99th percentile, max):\n";
+  std::pair<char const *, DurationHistogram const *> const histograms[] = {
+    { "conf_new_key", &confNewKey },
+    { "conf_set_key", &confSetKey },
+    { "conf_del_key", &confDelKey },
+    { "conf_lock_key", &confLockKey },
+    { "conf_unlock_key", &confUnlockKey },
+    { "batch delivery", &batchDelivery },
+    { "GraphModel updates", &graphModelUpdates },
+    { "NamesTree updates", &namesTreeUpdates },
+    { "TailModel updates", &tailModelUpdates },
+    { "graph layouts", &layouts },
+    { "event loop latency", &eventLoopLatency }
+  };
+  for (auto const &h : histograms) {
+    unsigned long const c = h.second->count.load();
+    out << "  " << h.first << ": " << c;
+    if (c > 0) {
+      out << ", " << durationToQString(h.second->totTime.load() / c)
+          << ", " << durationToQString(h.second->quantile(0.5))
+          << ", " << durationToQString(h.second->quantile(0.99))
+          << ", " << durationToQString(h.second->maxTime.load());
+    }
+    out << "\n";
+  }
+  out << "\n";
+
+  KVStore::DeliveryStats const &stats = kvs.deliveryStats;
+  out << "Changes delivered to the GUI: " << stats.numChanges
+      << " in " << stats.numBatches << " batches, at most "
+      << stats.maxBatchSize << " per batch, max latency "
+      << stats.maxLatency << "ms\n\n";
+
+  size_t numTuples = 0, numSpilled = 0, memory = 0;
+  for (TailModel const *tailModel : tailModels) {
+    numTuples += tailModel->rowCount();
+    numSpilled += tailModel->spilledRows();
+    memory += tailModel->memoryUsage();
+  }
+  out << "Live TailModels: " << tailModels.size() << ", "
+      << numTuples << " tuples (" << numSpilled << " spilled), about "
+      << sizeToQString(memory) << " (budget "
+      << sizeToQString(TailModel::maxMemory) << " per tail, "
+      << sizeToQString(TailModel::maxTotMemory) << " in total)\n";
+
+  numTuples = 0;
+  for (PastData const *pastData : pastDatas)
+    numTuples += pastData->numTuples();
+  out << "Live PastData: " << pastDatas.size() << ", "
+      << numTuples << " tuples\n";
+
+  return s;
+}
@@ -0,0 +1,112 @@
+#ifndef DIAGNOSTICS_H_191018
+#define DIAGNOSTICS_H_191018
+#include <array>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <QElapsedTimer>
+#include <QString>
+
+/* Counters and histograms about RmAdmin internals, to tell whether the
+ * network, the conversion of the received values, the models or the GUI
+ * itself are to blame when RmAdmin becomes sluggish.
+ * They are displayed in the DiagnosticsWin, and can be dumped into a file
+ * from there. */
+
+class PastData;
+class TailModel;
+namespace conf {
+  struct Key;
+};
+
+/* Histogram of durations, with power of two buckets from 1µs on.
+ * Can be updated from any thread: */
+class DurationHistogram
+{
+public:
+  static unsigned const numBuckets = 24; // up to 2^23µs, about 8s
+
+  std::array<std::atomic<unsigned long>, numBuckets> buckets {};
+  std::atomic<unsigned long> count { 0 };
+  std::atomic<qint64> totTime { 0 }; // nanoseconds
+  std::atomic<qint64> maxTime { 0 }; // nanoseconds
+
+  void add(qint64 ns);
+
+  /* Upper bound of the bucket where that quantile falls, in nanoseconds,
+   * or 0 if the histogram is empty: */
+  qint64 quantile(double) const;
+};
+
+// Adds the time spent in its scope to a histogram:
+class ScopedTimer
+{
+  DurationHistogram &histogram;
+  QElapsedTimer timer;
+
+public:
+  ScopedTimer(DurationHistogram &histogram_) : histogram(histogram_)
+  {
+    timer.start();
+  }
+
+  ~ScopedTimer()
+  {
+    histogram.add(timer.nsecsElapsed());
+  }
+};
+
+class Diagnostics
+{
+  QElapsedTimer started;
+
+  // Messages received from the server, per family of keys (see conf::Key):
+  std::mutex messagesLock;
+  std::map<QString, unsigned long> messagesPerFamily;
+
+  // Counts at the time of the last report, to compute recent rates:
+  std::map<QString, unsigned long> lastMessagesPerFamily;
+  QElapsedTimer lastReport;
+
+  // Only ever accessed from the GUI thread:
+  std::set<TailModel const *> tailModels;
+  std::set<PastData const *> pastDatas;
+
+public:
+  Diagnostics();
+
+  /* Time spent by the sync thread in the callbacks receiving changes from
+   * the server (see conf.cpp), including the conversion of the values: */
+  DurationHistogram confNewKey, confSetKey, confDelKey, confLockKey,
+                    confUnlockKey;
+
+  /* Time spent by the GUI thread delivering a batch of changes (see
+   * KVStore::deliverBatch), and by the models in their slots: */
+  DurationHistogram batchDelivery;
+  DurationHistogram graphModelUpdates, namesTreeUpdates, tailModelUpdates;
+
+  // Time spent laying out the graph of functions with z3:
+  DurationHistogram layouts;
+
+  /* How late the GUI event loop processes a timer, which tells how long it
+   * is busy with anything, including painting (only measured while the
+   * DiagnosticsWin is visible): */
+  DurationHistogram eventLoopLatency;
+
+  void countMessage(conf::Key const &);
+
+  void addTailModel(TailModel const *);
+  void removeTailModel(TailModel const *);
+  void addPastData(PastData const *);
+  void removePastData(PastData const *);
+
+  /* Everything as human readable text. Recent rates are computed since the
+   * previous call: */
+  QString report();
+};
+
+extern Diagnostics diagnostics;
+
+#endif
@@ -0,0 +1,99 @@
+#include <QFile>
+#include <QFileDialog>
+#include <QFontDatabase>
+#include <QHBoxLayout>
+#include <QMessageBox>
+#include <QPlainTextEdit>
+#include <QScrollBar>
+#include <QPushButton>
+#include <QTextStream>
+#include <QTimer>
+#include <QVBoxLayout>
+#include "Diagnostics.h"
+#include "DiagnosticsWin.h"
+
+static int const refreshPeriod = 1000; // ms
+static int const latencyPeriod = 50; // ms
+
+DiagnosticsWin::DiagnosticsWin(QWidget *parent) :
+  SavedWindow("DiagnosticsWindow", tr("Diagnostics"), parent)
+{
+  text = new QPlainTextEdit;
+  text->setReadOnly(true);
+  text->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+  text->setLineWrapMode(QPlainTextEdit::NoWrap);
+
+  QPushButton *saveButton = new QPushButton(tr("Save to file…"));
+  connect(saveButton, &QPushButton::clicked,
+          this, &DiagnosticsWin::saveToFile);
+
+  QHBoxLayout *buttons = new QHBoxLayout;
+  buttons->addStretch();
+  buttons->addWidget(saveButton);
+
+  QVBoxLayout *layout = new QVBoxLayout;
+  layout->addWidget(text);
+  layout->addLayout(buttons);
+
+  QWidget *widget = new QWidget;
+  widget->setLayout(layout);
+  setCentralWidget(widget);
+
+  refreshTimer = new QTimer(this);
+  connect(refreshTimer, &QTimer::timeout,
+          this, &DiagnosticsWin::refresh);
+
+  latencyTimer = new QTimer(this);
+  latencyTimer->setTimerType(Qt::PreciseTimer);
+  connect(latencyTimer, &QTimer::timeout,
+          this, &DiagnosticsWin::measureLatency);
+}
+
+void DiagnosticsWin::showEvent(QShowEvent *event)
+{
+  refresh();
+  refreshTimer->start(refreshPeriod);
+  sinceLastTick.start();
+  latencyTimer->start(latencyPeriod);
+  SavedWindow::showEvent(event);
+}
+
+void DiagnosticsWin::hideEvent(QHideEvent *event)
+{
+  refreshTimer->stop();
+  latencyTimer->stop();
+  SavedWindow::hideEvent(event);
+}
+
+void DiagnosticsWin::refresh()
+{
+  // Preserve the scroll position while the text is replaced:
+  int const scroll = text->verticalScrollBar()->value();
+  text->setPlainText(diagnostics.report());
+  text->verticalScrollBar()->setValue(scroll);
+}
+
+void DiagnosticsWin::measureLatency()
+{
+  qint64 const elapsed = sinceLastTick.restart();
+  qint64 const late = elapsed - latencyPeriod;
+  diagnostics.eventLoopLatency.add(late > 0 ? late * 1000000 : 0);
+}
+
+void DiagnosticsWin::saveToFile()
+{
+  QString const fname = QFileDialog::getSaveFileName(
+    this, tr("Save Diagnostics"), "rmadmin-diagnostics.txt");
+  if (fname.isEmpty()) return;
+
+  QFile file(fname);
+  if (! file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+    QMessageBox::warning(
+      this, tr("Cannot save diagnostics"),
+      tr("Cannot open %1: %2").arg(fname).arg(file.errorString()));
+    return;
+  }
+
+  QTextStream out(&file);
+  out << diagnostics.report();
+}
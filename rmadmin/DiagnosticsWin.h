@@ -0,0 +1,42 @@
+#ifndef DIAGNOSTICSWIN_H_191018
+#define DIAGNOSTICSWIN_H_191018
+#include <QElapsedTimer>
+#include "SavedWindow.h"
+
+/* A window displaying the internal counters and histograms of RmAdmin (see
+ * Diagnostics.h), refreshed every second, that can also be saved into a file
+ * to be attached to a bug report. */
+
+class QHideEvent;
+class QPlainTextEdit;
+class QShowEvent;
+class QTimer;
+class QWidget;
+
+class DiagnosticsWin : public SavedWindow
+{
+  Q_OBJECT
+
+  QPlainTextEdit *text;
+
+  QTimer *refreshTimer;
+
+  /* A timer that should fire every latencyPeriod, and that measures how
+   * late it actually is: */
+  QTimer *latencyTimer;
+  QElapsedTimer sinceLastTick;
+
+protected:
+  void showEvent(QShowEvent *);
+  void hideEvent(QHideEvent *);
+
+public:
+  DiagnosticsWin(QWidget *parent = nullptr);
+
+private slots:
+  void refresh();
+  void measureLatency();
+  void saveToFile();
+};
+
+#endif
@@ -1,6 +1,7 @@
 #include <cassert>
 #include <QDebug>
 #include <QString>
+#include "Column.h"
 #include "EventTime.h"
 #include "RamenType.h"
 #include "RamenValue.h"
@@ -39,3 +40,11 @@ std::optional<double> EventTime::ofTuple(RamenValue const &tuple) const
   if (! startVal) return std::nullopt;
   return startVal->toDouble();
 }
+
+std::optional<double> EventTime::ofRow(
+  std::vector<std::unique_ptr<Column>> const &columns, size_t row) const
+{
+  if (startColumn < 0 || (size_t)startColumn >= columns.size())
+    return std::nullopt;
+  return columns[startColumn]->toDouble(row);
+}
@@ -2,8 +2,11 @@
 #define EVENTTIME_H_191008
 /* An object to represent a RamenEventTime and also perform quick extraction
  * of a tuple's event time: */
+#include <memory>
 #include <optional>
+#include <vector>
 
+class Column;
 struct RamenType;
 struct RamenValue;
 
@@ -15,6 +18,10 @@ struct EventTime
 
   std::optional<double> ofTuple(RamenValue const &) const;
 
+  // Same, for a tuple stored in columns (see TupleDecoder):
+  std::optional<double> ofRow(
+    std::vector<std::unique_ptr<Column>> const &, size_t row) const;
+
 private:
   /* Record the location of the start/stop field in the tuple, or -1 if
    * they are not present. */
@@ -66,11 +66,7 @@ void Function::checkTail()
 CompiledFunctionInfo const *Function::compiledInfo() const
 {
   std::string k = "sources/" + srcPath + "/info";
-  KValue const *kv = nullptr;
-  kvs.lock.lock_shared();
-  auto it = kvs.map.find(k);
-  if (it != kvs.map.end()) kv = &it->second;
-  kvs.lock.unlock_shared();
+  std::shared_ptr<KValue const> kv = kvs.get(k);
 
   if (! kv) {
     if (verbose) qDebug() << QString::fromStdString(k) << "not yet set";
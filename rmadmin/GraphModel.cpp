@@ -1,10 +1,10 @@
 #include <cassert>
 #include <list>
 #include <QDebug>
-#include <QRegularExpression>
 #include "GraphModel.h"
 #include "confValue.h"
 #include "conf.h"
+#include "Diagnostics.h"
 #include "FunctionItem.h"
 #include "ProgramItem.h"
 #include "SiteItem.h"
@@ -17,12 +17,15 @@ GraphModel::GraphModel(GraphViewSettings const *settings_, QObject *parent) :
   QAbstractItemModel(parent),
   settings(settings_)
 {
-  connect(&kvs, &KVStore::valueCreated,
+  KVSubscriber const *subscriber = kvs.subscribePrefix("sites/");
+  connect(subscriber, &KVSubscriber::valueCreated,
           this, &GraphModel::updateKey);
-  connect(&kvs, &KVStore::valueChanged,
+  connect(subscriber, &KVSubscriber::valueChanged,
           this, &GraphModel::updateKey);
-  connect(&kvs, &KVStore::valueDeleted,
+  connect(subscriber, &KVSubscriber::valueDeleted,
           this, &GraphModel::deleteKey);
+  connect(&kvs, &KVStore::batchDelivered,
+          this, &GraphModel::flushChanges);
 }
 
 QModelIndex GraphModel::index(int row, int column, QModelIndex const &parent) const
@@ -231,51 +234,6 @@ void GraphModel::reorder()
   }
 }
 
-class ParsedKey {
-public:
-  bool valid;
-  QString site, program, function, property, instanceSignature;
-  ParsedKey(std::string const &k)
-  {
-    static QRegularExpression re(
-      "^sites/(?<site>[^/]+)/"
-      "("
-        "workers/(?<program>.+)/"
-        "(?<function>[^/]+)/"
-        "(?<function_property>"
-          "worker|"
-          "stats/runtime|"
-          "archives/(times|num_files|current_size|alloc_size)|"
-          "instances/(?<signature>[^/]+)/(?<instance_property>[^/]+)"
-        ")"
-      "|"
-        "(?<site_property>is_master)"
-      ")$"
-      ,
-      QRegularExpression::DontCaptureOption
-    );
-    assert(re.isValid());
-    QString subject = QString::fromStdString(k);
-    QRegularExpressionMatch match = re.match(subject);
-    valid = match.hasMatch();
-    if (valid) {
-      site = match.captured("site");
-      program = match.captured("program");
-      function = match.captured("function");
-      // Try the deepest first:
-      instanceSignature = match.captured("signature");
-      if (instanceSignature.isNull()) {
-        property = match.captured("function_property");
-      } else {
-        property = match.captured("instance_property");
-      }
-      if (property.isNull()) {
-        property = match.captured("site_property");
-      }
-    }
-  }
-};
-
 FunctionItem const *GraphModel::find(QString const &site, QString const &program, QString const &function)
 {
   if (verbose)
@@ -364,7 +322,7 @@ void GraphModel::retryAddParents()
 
 void GraphModel::setFunctionProperty(
   SiteItem const *siteItem, ProgramItem const *programItem,
-  FunctionItem *functionItem, ParsedKey const &pk,
+  FunctionItem *functionItem, conf::Key const &pk,
   std::shared_ptr<conf::Value const> v)
 {
   if (verbose)
@@ -504,24 +462,16 @@ void GraphModel::setFunctionProperty(
       qDebug() << "Useless property" << pk.property;
   }
 
-  if (changed & STORAGE_CHANGED) {
-    if (verbose) qDebug() << "Emitting storagePropertyChanged";
-    emit storagePropertyChanged(functionItem);
-  }
-  if (changed & PROPERTY_CHANGED) {
-    if (verbose) qDebug() << "Emitting dataChanged";
-    QModelIndex topLeft(functionItem->index(this, 0));
-    QModelIndex bottomRight(functionItem->index(this, GraphModel::NumColumns - 1));
-    emit dataChanged(topLeft, bottomRight, { Qt::DisplayRole });
-  }
+  if (changed & STORAGE_CHANGED) changedStorage.insert(functionItem);
+  if (changed & PROPERTY_CHANGED) changedFunctions.insert(functionItem);
   if (changed & WORKER_CHANGED) {
     function->checkTail();
-    emit workerChanged();
+    workerHasChanged = true;
   }
 }
 
 void GraphModel::delFunctionProperty(
-  FunctionItem *functionItem, ParsedKey const &pk)
+  FunctionItem *functionItem, conf::Key const &pk)
 {
   if (verbose)
     qDebug() << "delFunctionProperty for" << pk.property;
@@ -587,31 +537,50 @@ void GraphModel::delFunctionProperty(
     }
   }
 
-  if (changed & STORAGE_CHANGED) {
-    if (verbose) qDebug() << "Emitting storagePropertyChanged";
+  if (changed & STORAGE_CHANGED) changedStorage.insert(functionItem);
+  if (changed) changedFunctions.insert(functionItem);
+  if (changed & WORKER_CHANGED) workerHasChanged = true;
+}
+
+void GraphModel::flushChanges()
+{
+  ScopedTimer timer(diagnostics.graphModelUpdates);
+
+  /* Swap first, as receivers might cause further changes to be recorded
+   * (that will then be part of the next batch): */
+  std::set<FunctionItem *> storage, functions;
+  storage.swap(changedStorage);
+  functions.swap(changedFunctions);
+  bool const worker = workerHasChanged;
+  workerHasChanged = false;
+
+  if (verbose && (! storage.empty() || ! functions.empty() || worker))
+    qDebug() << "Emitting changes for" << functions.size() << "functions,"
+             << storage.size() << "storage changes, worker changed:"
+             << worker;
+
+  for (FunctionItem *functionItem : storage)
     emit storagePropertyChanged(functionItem);
-  }
-  if (changed) {
-    if (verbose) qDebug() << "Emitting dataChanged";
+
+  for (FunctionItem *functionItem : functions) {
     QModelIndex topLeft(functionItem->index(this, 0));
     QModelIndex bottomRight(functionItem->index(this, GraphModel::NumColumns - 1));
     emit dataChanged(topLeft, bottomRight, { Qt::DisplayRole });
   }
-  if (changed & WORKER_CHANGED) {
-    emit workerChanged();
-  }
+
+  if (worker) emit workerChanged();
 }
 
-void GraphModel::setProgramProperty(ProgramItem *, ParsedKey const &, std::shared_ptr<conf::Value const>)
+void GraphModel::setProgramProperty(ProgramItem *, conf::Key const &, std::shared_ptr<conf::Value const>)
 {
 }
 
-void GraphModel::delProgramProperty(ProgramItem *, ParsedKey const &)
+void GraphModel::delProgramProperty(ProgramItem *, conf::Key const &)
 {
 }
 
 void GraphModel::setSiteProperty(
-  SiteItem *siteItem, ParsedKey const &pk, std::shared_ptr<conf::Value const> v)
+  SiteItem *siteItem, conf::Key const &pk, std::shared_ptr<conf::Value const> v)
 {
   if (pk.property == "is_master") {
     std::shared_ptr<Site> site =
@@ -633,7 +602,7 @@ void GraphModel::setSiteProperty(
   }
 }
 
-void GraphModel::delSiteProperty(SiteItem *siteItem, ParsedKey const &pk)
+void GraphModel::delSiteProperty(SiteItem *siteItem, conf::Key const &pk)
 {
   if (pk.property == "is_master") {
     std::shared_ptr<Site> site =
@@ -646,14 +615,13 @@ void GraphModel::delSiteProperty(SiteItem *siteItem, ParsedKey const &pk)
   emit dataChanged(index, index, { Qt::DisplayRole });
 }
 
-void GraphModel::updateKey(std::string const &key, KValue const &kv)
+void GraphModel::updateKey(conf::Key const &pk, KValue const &kv)
 {
-  ParsedKey pk(key);
-  if (! pk.valid) return;
+  if (! pk.isSiteKey) return;
+  ScopedTimer timer(diagnostics.graphModelUpdates);
 
   if (verbose)
-    qDebug() << "GraphModel key" << QString::fromStdString(key) << "set to value "
-             << *kv.val << "is valid:" << pk.valid;
+    qDebug() << "GraphModel key" << pk.qs << "set to value" << *kv.val;
 
   assert(pk.site.length() > 0);
 
@@ -742,14 +710,13 @@ void GraphModel::updateKey(std::string const &key, KValue const &kv)
   }
 }
 
-void GraphModel::deleteKey(std::string const &key, KValue const &)
+void GraphModel::deleteKey(conf::Key const &pk, KValue const &)
 {
-  ParsedKey pk(key);
-  if (! pk.valid) return;
+  if (! pk.isSiteKey) return;
+  ScopedTimer timer(diagnostics.graphModelUpdates);
 
   if (verbose)
-    qDebug() << "GraphModel key" << QString::fromStdString(key) << "deleted, is valid:"
-             << pk.valid;
+    qDebug() << "GraphModel key" << pk.qs << "deleted";
 
   assert(pk.site.length() > 0);
 
@@ -1,5 +1,6 @@
 #ifndef GRAPHMODEL_H_190507
 #define GRAPHMODEL_H_190507
+#include <set>
 #include <vector>
 #include <QVector>
 #include <QPointF>
@@ -38,9 +39,11 @@
 class FunctionItem;
 class GraphViewSettings;
 struct KValue;
-class ParsedKey;
 class ProgramItem;
 class SiteItem;
+namespace conf {
+  struct Key;
+};
 
 class GraphModel : public QAbstractItemModel
 {
@@ -64,12 +67,19 @@ class GraphModel : public QAbstractItemModel
   void removeParents(FunctionItem *child);  // also from pendings!
   void retryAddParents();
 
-  void setFunctionProperty(SiteItem const *, ProgramItem const *, FunctionItem *, ParsedKey const &p, std::shared_ptr<conf::Value const>);
-  void setProgramProperty(ProgramItem *, ParsedKey const &p, std::shared_ptr<conf::Value const>);
-  void setSiteProperty(SiteItem *, ParsedKey const &p, std::shared_ptr<conf::Value const>);
-  void delFunctionProperty(FunctionItem *, ParsedKey const &p);
-  void delProgramProperty(ProgramItem *, ParsedKey const &p);
-  void delSiteProperty(SiteItem *, ParsedKey const &p);
+  void setFunctionProperty(SiteItem const *, ProgramItem const *, FunctionItem *, conf::Key const &, std::shared_ptr<conf::Value const>);
+  void setProgramProperty(ProgramItem *, conf::Key const &, std::shared_ptr<conf::Value const>);
+  void setSiteProperty(SiteItem *, conf::Key const &, std::shared_ptr<conf::Value const>);
+  void delFunctionProperty(FunctionItem *, conf::Key const &);
+  void delProgramProperty(ProgramItem *, conf::Key const &);
+  void delSiteProperty(SiteItem *, conf::Key const &);
+
+  /* Notifications about functions are deferred until the whole batch of
+   * changes has been received (see KVStore::batchDelivered), so that a
+   * function which many properties change at once is signalled only once: */
+  std::set<FunctionItem *> changedFunctions;  // for dataChanged
+  std::set<FunctionItem *> changedStorage;  // for storagePropertyChanged
+  bool workerHasChanged = false;
 
 public:
   GraphViewSettings const *settings;
@@ -164,8 +174,9 @@ public:
   static GraphModel *globalGraphModel;
 
 private slots:
-  void updateKey(std::string const &, KValue const &);
-  void deleteKey(std::string const &, KValue const &);
+  void updateKey(conf::Key const &, KValue const &);
+  void deleteKey(conf::Key const &, KValue const &);
+  void flushChanges();
 
 signals:
   void positionChanged(QModelIndex const &index) const;
@@ -7,6 +7,7 @@
 #include <QParallelAnimationGroup>
 #include <QTouchEvent>
 #include <QGestureEvent>
+#include "Diagnostics.h"
 #include "GraphArrow.h"
 #include "FunctionItem.h"
 #include "ProgramItem.h"
@@ -291,7 +292,12 @@ void GraphView::startLayout()
   int const min_max = std::ceil(std::sqrt(numNodes));
   int const max_x = min_max * 2;
   int const max_y = min_max + min_max/2 + 1;
-  if (layout::solve(&nodes, max_x, max_y)) {
+  bool solved;
+  {
+    ScopedTimer timer(diagnostics.layouts);
+    solved = layout::solve(&nodes, max_x, max_y);
+  }
+  if (solved) {
 
     QParallelAnimationGroup *animGroup = new QParallelAnimationGroup;
     int const animDuration = 500; // ms
@@ -34,8 +34,15 @@ public:
   /* Reset the plot data from the chart iter function: */
   virtual void setData() = 0;
 
+  /* Add the points not plotted yet from the chart iterNewValues function: */
+  virtual void addData() = 0;
+
+  /* Remove the points of the tail rows about to be removed, from the chart
+   * iterRemovedValues function: */
+  virtual void removeData() = 0;
+
   /* Replot the graphics with the same data: */
-  virtual void replot() const = 0;
+  virtual void replot() = 0;
 };
 
 class InvalidGraphic : public Graphic
@@ -46,7 +53,9 @@ class InvalidGraphic : public Graphic
 public:
   InvalidGraphic(Chart *, QString);
   void setData() {}
-  void replot() const {}
+  void addData() {}
+  void removeData() {}
+  void replot() {}
 };
 
 #endif
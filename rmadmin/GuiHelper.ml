@@ -5,6 +5,7 @@ open RamenHelpers
 module T = RamenTypes
 module ZMQClient = RamenSyncZMQClient
 module Files = RamenFiles
+module N = RamenName
 
 let gc_debug = false
 
@@ -48,24 +49,41 @@ external signal_sync : ZMQClient.Status.t -> unit = "signal_sync"
 external should_quit : unit -> bool = "should_quit"
 
 type pending_req =
-  | NoReq
   | New of string * Value.t
   | Set of string * Value.t
   | Lock of string
   | LockOrCreate of string
   | Unlock of string
   | Del of string
+  | Subscribe of string
+  | Unsubscribe of string
 
-external next_pending_request : unit -> pending_req = "next_pending_request"
+(* Returns all requests queued by the GUI since last call, oldest first: *)
+external next_pending_requests : unit -> pending_req list =
+  "next_pending_requests"
 
-external conf_new_key :
-  string -> Value.t -> string -> float -> bool -> bool -> string -> float -> unit =
-    "no_use_for_bytecode" "conf_new_key"
+(* Readable whenever new requests have been queued: *)
+external wake_up_fd : unit -> Unix.file_descr = "wake_up_fd"
 
-let on_new _clt k v uid mtime can_write can_del owner expiry =
-  if gc_debug then Gc.compact () ;
-  conf_new_key (Key.to_string k) v uid mtime can_write can_del owner expiry ;
-  if gc_debug then Gc.compact ()
+(* Topics that are always subscribed to, whatever the open windows. Others
+ * (such as the tails of a function or the runtime stats) are subscribed to
+ * on demand by the GUI (see subscribeTopic in conf.h): *)
+let base_topics =
+  [ "time" ; "versions/*" ; "sources/*" ; "target_config" ; "storage/*" ;
+    "errors/global" ;
+    "sites/*/is_master" ; "sites/*/services/*" ;
+    "sites/*/workers/*/worker" ; "sites/*/workers/*/instances/*" ;
+    "sites/*/workers/*/archives/*" ]
+
+let base_globs = List.map Globs.compile base_topics
+
+(* How long to wait for some work at most, before checking whether we must
+ * quit or send a ping: *)
+let max_sync_wait = 0.1
+
+(* How many messages to receive at most before sending pending requests, so
+ * that user actions do not wait for the end of the initial sync: *)
+let max_msgs_in_batch = 1000
 
 external conf_set_key : string -> Value.t -> string -> float -> unit = "conf_set_key"
 
@@ -83,6 +101,114 @@ let on_del clt k _v =
   conf_del_key (Key.to_string k) ;
   if gc_debug then Gc.compact ()
 
+(* The server silently prunes the old tuples under "lasts/" (see
+ * RamenSyncZMQServer.purge_old_tailed_tuples) and expects clients to do the
+ * same, or they would accumulate in the client tree and in the KVStore.
+ * Tuples are decoded by the TailModel as soon as they are received, so only
+ * the last max_last_tuples of each tail are kept: *)
+let last_tuples : (N.site * N.fq * string, Key.t Queue.t) Hashtbl.t =
+  Hashtbl.create 10
+
+let purge_old_tailed_tuples clt = function
+  | Key.Tails (site, fq, instance, LastTuple _) as k ->
+      let seqs =
+        try Hashtbl.find last_tuples (site, fq, instance)
+        with Not_found ->
+          let seqs = Queue.create () in
+          Hashtbl.add last_tuples (site, fq, instance) seqs ;
+          seqs in
+      Queue.add k seqs ;
+      if Queue.length seqs > max_last_tuples then (
+        let old = Queue.take seqs in
+        match Client.Tree.get clt.Client.h old with
+        | exception Not_found ->
+            ()
+        | hv ->
+            clt.Client.h <- Client.Tree.rem old clt.Client.h ;
+            on_del clt old hv.Client.value)
+  | _ -> ()
+
+external conf_new_key :
+  string -> Value.t -> string -> float -> bool -> bool -> string -> float -> unit =
+    "no_use_for_bytecode" "conf_new_key"
+
+let on_new clt k v uid mtime can_write can_del owner expiry =
+  if gc_debug then Gc.compact () ;
+  conf_new_key (Key.to_string k) v uid mtime can_write can_del owner expiry ;
+  purge_old_tailed_tuples clt k ;
+  if gc_debug then Gc.compact ()
+
+(* Currently subscribed topics, in addition to the base ones: *)
+let extra_topics : (string * Globs.t) list ref = ref []
+
+let is_own_key clt k =
+  Some k = ZMQClient.my_errors clt ||
+  match k with
+  | Key.PerClient (socket, _) -> Some socket = clt.Client.my_socket
+  | _ -> false
+
+(* Topics which StopSync has not been acknowledged yet: *)
+let stopping_topics : (string, unit) Hashtbl.t = Hashtbl.create 10
+
+(* Whether the server is still expected to send updates for that key, not
+ * counting the subscription to [except]: *)
+let still_wanted ?except clt k =
+  is_own_key clt k ||
+  let k = Key.to_string k in
+  List.exists (fun g -> Globs.matches g k) base_globs ||
+  List.exists (fun (topic, g) ->
+    Some topic <> except && Globs.matches g k
+  ) !extra_topics
+
+(* Messages still in flight when a topic is unsubscribed from must not create
+ * again the keys that are no longer wanted: *)
+let is_stale clt = function
+  | Client.SrvMsg.SetKey { k ; _ }
+  | Client.SrvMsg.NewKey { k ; _ } ->
+      not (Client.mem clt k) && not (still_wanted clt k)
+  | _ ->
+      false
+
+let subscribe_topic topic =
+  if not (List.mem topic base_topics) then (
+    let glob = Globs.compile topic in
+    extra_topics := (topic, glob) :: !extra_topics ;
+    (* Otherwise this will be done once the StopSync is acknowledged (see
+     * below): *)
+    if not (Hashtbl.mem stopping_topics topic) then
+      ZMQClient.send_cmd (Client.CltMsg.StartSync glob)
+  )
+
+(* Once a topic is unsubscribed from, the server no longer sends updates for
+ * its keys, which would thus become stale. So they are deleted, unless they
+ * are still covered by another topic, once the server has acknowledged the
+ * StopSync (so that no update for those keys is still in flight).
+ * If the topic has been subscribed to again in the meantime, its keys are
+ * deleted all the same before synchronising it again, as the server then
+ * sends all the keys that are not covered by another topic: *)
+let unsubscribe_topic clt topic =
+  if not (List.mem topic base_topics) then (
+    let glob = Globs.compile topic in
+    extra_topics := List.remove_assoc topic !extra_topics ;
+    Hashtbl.replace stopping_topics topic () ;
+    let on_done () =
+      Hashtbl.remove stopping_topics topic ;
+      Client.Tree.fold clt.Client.h (fun k _ ks ->
+        if Globs.matches glob (Key.to_string k) &&
+           not (still_wanted ~except:topic clt k)
+        then
+          k :: ks
+        else ks
+      ) [] |>
+      List.iter (fun k ->
+        clt.Client.h <- Client.Tree.rem k clt.h ;
+        conf_del_key (Key.to_string k)) ;
+      if List.mem_assoc topic !extra_topics then
+        ZMQClient.send_cmd (Client.CltMsg.StartSync glob) in
+    ZMQClient.send_cmd ~on_ok:on_done ~on_ko:on_done
+                       (Client.CltMsg.StopSync glob)
+  )
+
 external conf_lock_key : string -> string -> float -> unit = "conf_lock_key"
 
 let on_lock clt k owner expiry =
@@ -99,71 +225,203 @@ let on_unlock clt k =
   conf_unlock_key (Key.to_string k) ;
   if gc_debug then Gc.compact ()
 
-let sync_loop clt =
+(*
+ * Local snapshot of the configuration
+ *
+ * So that the GUI does not have to wait for the whole configuration to be
+ * received at every start, the keys of the base topics are saved when
+ * quitting, and loaded at next start before even connecting. The server then
+ * sends only what changed since then (see CltMsg.StartSyncSince), and the
+ * keys that are gone are deleted once synchronised.
+ *)
+
+module Snapshot =
+struct
+  type t =
+    V1 of { since : float ; keys : (Key.t * Client.hash_value) list }
+
+  (* The base name is specific to the server and user: *)
+  let file_name base =
+    N.path_cat [ N.path base ; N.path RamenVersions.sync_conf ]
+
+  (* Neither the keys subscribed on demand nor those that are specific to this
+   * session are saved: *)
+  let must_save clt k hv =
+    hv.Client.eagerly = Client.Nope &&
+    k <> Key.Time &&
+    not (is_own_key clt k) &&
+    let k = Key.to_string k in
+    List.exists (fun g -> Globs.matches g k) base_globs
+
+  (* Returns the time of the snapshot and its keys, or None if there is no
+   * usable snapshot, in which case a full sync is in order: *)
+  let load base =
+    let fname = file_name base in
+    try
+      let fd = Files.safe_open fname Unix.[ O_RDONLY ; O_CLOEXEC ] 0 in
+      finally
+        (fun () -> Files.safe_close fd)
+        (fun () ->
+          match Files.marshal_from_fd fname fd with
+          | V1 { since ; keys } ->
+              !logger.info "Loading %d configuration keys from %a"
+                (List.length keys)
+                N.path_print fname ;
+              Some (since, keys)) ()
+    with Unix.(Unix_error (ENOENT, _, _)) ->
+          !logger.info "No local snapshot, will fully synchronise" ;
+          None
+       | e ->
+          Files.move_aside fname ;
+          !logger.error "Cannot read local snapshot, will fully synchronise: %s"
+            (Printexc.to_string e) ;
+          None
+
+  let save base clt =
+    let fname = file_name base in
+    let what = "Saving local snapshot" in
+    log_and_ignore_exceptions ~what (fun () ->
+      let since, keys =
+        Client.Tree.fold clt.Client.h (fun k hv (since, keys as prev) ->
+          if must_save clt k hv then
+            (* Locks will be received again: *)
+            let hv = Client.{ hv with owner = "" ; expiry = 0. } in
+            max since hv.Client.mtime, (k, hv) :: keys
+          else prev
+        ) (0., []) in
+      Files.mkdir_all ~is_file:true fname ;
+      let flags = Unix.[ O_WRONLY ; O_CREAT ; O_TRUNC ; O_CLOEXEC ] in
+      let fd = Files.safe_open fname flags 0o600 in
+      finally
+        (fun () -> Files.safe_close fd)
+        (fun () ->
+          !logger.info "Saving %d configuration keys into %a"
+            (List.length keys)
+            N.path_print fname ;
+          Files.marshal_into_fd fd (V1 { since ; keys })
+        ) ()
+    ) ()
+end
+
+(* [snapshot] is the base name of the local snapshot, or empty: *)
+let sync_loop snapshot clt =
   if gc_debug then Gc.compact () ;
   let msg_count = ref 0 in
-  let handle_msgs_in () =
-    match ZMQClient.recv_cmd () with
-    | exception Unix.(Unix_error ((EAGAIN|EINTR), _, _)) ->
-        ()
-    | msg ->
-        (* The internal store of the sync client is needed only internally
-         * to make sense of received messages. To limit its growth, let's
-         * not store tail tuples: *)
-        Client.process_msg clt msg ;
-        (match msg with
-        | SrvMsg.SetKey { k = Tails _ as k ; _ } ->
-            clt.Client.h <- Client.Tree.rem k clt.h
-        | _ -> ()) ;
-        incr msg_count ;
-        (*!logger.debug "received %d messages" !msg_count ;*)
-        if !msg_count mod 1 (*10*) = 0 then (
-          let status_msg =
-            Printf.sprintf "%d messages, %d keys"
-              !msg_count
-              (Client.Tree.length clt.h) in
-          if gc_debug then Gc.compact () ;
-          signal_sync (Ok status_msg) ;
-          if gc_debug then Gc.compact ()
-        ) in
-  let rec handle_msgs_out () =
-    if gc_debug then Gc.compact () ;
-    match next_pending_request () with
-    | NoReq -> ()
+  let rec handle_msgs_in n =
+    if n > 0 then
+      match ZMQClient.try_recv_cmd () with
+      | exception Unix.(Unix_error (EINTR, _, _)) ->
+          ()
+      | None ->
+          ()
+      | Some msg ->
+          (* Tail tuples are kept in the internal store as well, since they
+           * are received only while some tail is subscribed to, and must
+           * then be deleted when unsubscribing: *)
+          if is_stale clt msg then
+            !logger.debug "Ignoring %a for a key no longer subscribed to"
+              Client.SrvMsg.print msg
+          else
+            Client.process_msg clt msg ;
+          incr msg_count ;
+          (*!logger.debug "received %d messages" !msg_count ;*)
+          if !msg_count mod 1 (*10*) = 0 then (
+            let status_msg =
+              Printf.sprintf "%d messages, %d keys"
+                !msg_count
+                (Client.Tree.length clt.h) in
+            if gc_debug then Gc.compact () ;
+            signal_sync (Ok status_msg) ;
+            if gc_debug then Gc.compact ()
+          ) ;
+          handle_msgs_in (n - 1) in
+  let send_req = function
     | New (k, v) ->
-        ZMQClient.send_cmd (Client.CltMsg.NewKey (Key.of_string k, v, 0.)) ;
-        handle_msgs_out ()
+        ZMQClient.send_cmd (Client.CltMsg.NewKey (Key.of_string k, v, 0.))
     | Set (k, v) ->
-        ZMQClient.send_cmd (Client.CltMsg.SetKey (Key.of_string k, v)) ;
-        handle_msgs_out ()
+        ZMQClient.send_cmd (Client.CltMsg.SetKey (Key.of_string k, v))
     | Lock k ->
         ZMQClient.send_cmd
-          (Client.CltMsg.LockKey (Key.of_string k, Default.sync_gui_lock_timeout)) ;
-        handle_msgs_out ()
+          (Client.CltMsg.LockKey (Key.of_string k, Default.sync_gui_lock_timeout))
     | LockOrCreate k ->
         ZMQClient.send_cmd
-          (Client.CltMsg.LockOrCreateKey (Key.of_string k, Default.sync_gui_lock_timeout)) ;
-        handle_msgs_out ()
+          (Client.CltMsg.LockOrCreateKey (Key.of_string k, Default.sync_gui_lock_timeout))
     | Unlock k ->
-        ZMQClient.send_cmd (Client.CltMsg.UnlockKey (Key.of_string k)) ;
-        handle_msgs_out ()
+        ZMQClient.send_cmd (Client.CltMsg.UnlockKey (Key.of_string k))
     | Del k ->
-        ZMQClient.send_cmd (Client.CltMsg.DelKey (Key.of_string k)) ;
-        handle_msgs_out ()
-  in
+        ZMQClient.send_cmd (Client.CltMsg.DelKey (Key.of_string k))
+    | Subscribe topic ->
+        subscribe_topic topic
+    | Unsubscribe topic ->
+        unsubscribe_topic clt topic in
+  let handle_msgs_out () =
+    if gc_debug then Gc.compact () ;
+    List.iter send_req (next_pending_requests ()) in
+  let wake_up_fd = wake_up_fd () in
   while not (should_quit ()) do
     if gc_debug then Gc.compact () ;
     try
       ZMQClient.may_send_ping () ;
-      handle_msgs_in () ;
+      handle_msgs_in max_msgs_in_batch ;
       handle_msgs_out () ;
+      (* Sleep until the server or the GUI have something for us: *)
+      ZMQClient.wait_cmd ~fds:[ wake_up_fd ] max_sync_wait ;
       if gc_debug then Gc.compact ()
     with e ->
       print_exception ~what:"sync loop" e ;
       signal_sync (Fail (Printexc.to_string e))
   done ;
   !logger.info "Flushing pending requests..." ;
-  handle_msgs_out ()
+  handle_msgs_out () ;
+  if snapshot <> "" then Snapshot.save snapshot clt
+
+(*
+ * Recording and replay of the message stream, for benchmarking (see
+ * Benchmark.cpp):
+ *)
+
+(* Every message received from the server is appended to that file, marshalled
+ * along with its reception time: *)
+let start_recording fname =
+  !logger.info "Recording received messages into %S" fname ;
+  let flags = Unix.[ O_WRONLY ; O_CREAT ; O_TRUNC ; O_CLOEXEC ] in
+  let fd = Files.safe_open (N.path fname) flags 0o644 in
+  ZMQClient.on_recv := fun msg ->
+    Files.marshal_into_fd ~at_start:false fd
+      ((Unix.gettimeofday (), msg) : float * SrvMsg.t)
+
+let read_recorded_msg fd : float * SrvMsg.t =
+  let header = Files.really_read_fd fd Marshal.header_size in
+  let data_size = Marshal.data_size header 0 in
+  let buf = Bytes.extend header 0 data_size in
+  Files.really_read_fd_into buf Marshal.header_size fd data_size ;
+  Marshal.from_bytes buf 0
+
+(* Feed all the messages of a recording to the same callbacks as the sync
+ * loop, as fast as possible, with no server involved.
+ * Requests from the GUI are discarded. Returns the number of messages and
+ * the duration of the recording: *)
+let replay fname =
+  !logger.info "Replaying messages from %S" fname ;
+  let clt =
+    Client.make ~my_uid:"replay" ~on_new ~on_set ~on_del ~on_lock ~on_unlock in
+  let fd = Files.safe_open (N.path fname) Unix.[ O_RDONLY ; O_CLOEXEC ] 0 in
+  finally
+    (fun () -> Files.safe_close fd)
+    (fun () ->
+      let rec loop n first_t last_t =
+        if should_quit () then n, last_t -. first_t else
+        match read_recorded_msg fd with
+        | exception End_of_file ->
+            n, last_t -. first_t
+        | t, msg ->
+            Client.process_msg clt msg ;
+            if n mod max_msgs_in_batch = 0 then
+              ignore (next_pending_requests ()) ;
+            let first_t = if n = 0 then t else first_t in
+            loop (n + 1) first_t t in
+      loop 0 0. 0.
+    ) ()
 
 external set_my_id : string -> string -> unit = "set_my_id"
 
@@ -182,16 +440,28 @@ let on_progress url clt stage status =
   | ZMQClient.Stage.Auth -> signal_auth
   | ZMQClient.Stage.Sync -> signal_sync) status
 
-(* Will be called by the C++ on a dedicated thread, never returns: *)
-let start_sync url username srv_pub_key clt_pub_key clt_priv_key =
+(* Will be called by the C++ on a dedicated thread, never returns.
+ * [snapshot] is the base name of the local snapshot, or empty to always
+ * fully synchronise: *)
+let start_sync url username srv_pub_key clt_pub_key clt_priv_key snapshot =
   if gc_debug then Gc.compact () ;
   !logger.info "Will connect to %S using key %S" url srv_pub_key ;
+  let since, on_sock =
+    match if snapshot = "" then None else Snapshot.load snapshot with
+    | None ->
+        None, ignore
+    | Some (since, keys) ->
+        (* Populate the GUI right away, before even connecting: *)
+        Some since,
+        (fun clt ->
+          List.iter (fun (k, hv) -> Client.add_unconfirmed clt k hv) keys) in
   log_and_ignore_exceptions ~what:"Initializing config client" (fun () ->
     ZMQClient.start
       ~url ~srv_pub_key ~username ~clt_pub_key ~clt_priv_key
-      ~topics:["*"] ~on_progress:(on_progress url)
+      ~topics:base_topics ?since ~on_progress:(on_progress url)
+      ~on_sock ~on_synced:Client.drop_unconfirmed
       ~on_new ~on_set ~on_del ~on_lock ~on_unlock
-      ~recvtimeo:0.1 sync_loop
+      ~recvtimeo:0.1 (sync_loop snapshot)
   ) ()
 
 let init =
@@ -199,4 +469,6 @@ let init =
   init_logger (if Array.mem "--debug" Sys.argv then Debug else Normal) ;
   (* Register the functions that will be called from C++ *)
   ignore (Callback.register "start_sync" start_sync) ;
+  ignore (Callback.register "start_recording" start_recording) ;
+  ignore (Callback.register "replay" replay) ;
   ignore (Callback.register "value_of_string" value_of_string)
@@ -6,15 +6,7 @@
 #include "KErrorMsg.h"
 
 KErrorMsg::KErrorMsg(QWidget *parent) :
-  QLabel(parent)
-{
-  connect(&kvs, &KVStore::valueCreated,
-          this, &KErrorMsg::setValueFromStore);
-  connect(&kvs, &KVStore::valueChanged,
-          this, &KErrorMsg::setValueFromStore);
-  connect(&kvs, &KVStore::valueDeleted,
-          this, &KErrorMsg::warnTimeout);
-}
+  QLabel(parent) {}
 
 /* Beware:
  * First, this setKey is not the one from an AtomicWidget.
@@ -26,6 +18,14 @@ void KErrorMsg::setKey(std::string const &k)
   assert(key.length() == 0);
   qDebug() << "KErrorMsg: setting key to" << QString::fromStdString(k);
   key = k;
+
+  KVSubscriber const *subscriber = kvs.subscribeKey(key);
+  connect(subscriber, &KVSubscriber::valueCreated,
+          this, &KErrorMsg::setValueFromStore);
+  connect(subscriber, &KVSubscriber::valueChanged,
+          this, &KErrorMsg::setValueFromStore);
+  connect(subscriber, &KVSubscriber::valueDeleted,
+          this, &KErrorMsg::warnTimeout);
 }
 
 void KErrorMsg::displayError(QString const &str)
@@ -0,0 +1,84 @@
+#include <array>
+#include <mutex>
+#include <new>
+#include "MemoryPool.h"
+
+namespace MemoryPool {
+
+static size_t const minBlockSize = 16;
+static unsigned const numClasses = 8;  // So up to 2KiB
+// Max number of free blocks kept per class:
+static unsigned const maxFree = 4096;
+
+struct FreeBlock {
+  FreeBlock *next;
+};
+
+struct SizeClass {
+  std::mutex lock;
+  FreeBlock *freeList = nullptr;
+  unsigned numFree = 0;
+};
+
+/* Never destroyed, as values might still be freed by other static
+ * destructors: */
+static SizeClass &sizeClass(unsigned c)
+{
+  static std::array<SizeClass, numClasses> *classes =
+    new std::array<SizeClass, numClasses>;
+  return (*classes)[c];
+}
+
+// Returns numClasses if that size is not pooled:
+static unsigned classOfSize(size_t sz)
+{
+  unsigned c = 0;
+  for (size_t bs = minBlockSize; bs < sz; bs <<= 1) {
+    if (++c >= numClasses) return numClasses;
+  }
+  return c;
+}
+
+void *alloc(size_t sz)
+{
+  unsigned const c = classOfSize(sz);
+  if (c >= numClasses) return ::operator new(sz);
+
+  SizeClass &sc = sizeClass(c);
+  {
+    std::lock_guard<std::mutex> guard(sc.lock);
+    if (sc.freeList) {
+      FreeBlock *b = sc.freeList;
+      sc.freeList = b->next;
+      sc.numFree --;
+      return b;
+    }
+  }
+  return ::operator new(minBlockSize << c);
+}
+
+void free(void *p, size_t sz)
+{
+  if (! p) return;
+
+  unsigned const c = classOfSize(sz);
+  if (c >= numClasses) {
+    ::operator delete(p);
+    return;
+  }
+
+  SizeClass &sc = sizeClass(c);
+  {
+    std::lock_guard<std::mutex> guard(sc.lock);
+    if (sc.numFree < maxFree) {
+      FreeBlock *b = static_cast<FreeBlock *>(p);
+      b->next = sc.freeList;
+      sc.freeList = b;
+      sc.numFree ++;
+      return;
+    }
+  }
+  ::operator delete(p);
+}
+
+};
@@ -0,0 +1,18 @@
+#ifndef MEMORYPOOL_H_191018
+#define MEMORYPOOL_H_191018
+#include <cstddef>
+
+/* Allocator for the many small blocks that are allocated by one thread and
+ * freed by another, such as the configuration values that are built by the
+ * sync thread and released by the GUI thread once replaced.
+ * Sizes are rounded up to the next power of two, and freed blocks are kept
+ * in a free list per size (up to some limit) rather than given back to
+ * malloc. Larger blocks are not pooled. */
+
+namespace MemoryPool {
+  void *alloc(size_t);
+  // Must be given the same size as to alloc:
+  void free(void *, size_t);
+};
+
+#endif
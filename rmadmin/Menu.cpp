@@ -15,6 +15,7 @@
 #include "NamesTreeWin.h"
 #include "StorageWin.h"
 #include "ServerInfoWin.h"
+#include "DiagnosticsWin.h"
 #include "Menu.h"
 
 static bool const verbose = true;
@@ -29,6 +30,7 @@ RCEditorDialog *Menu::rcEditorDialog;
 NamesTreeWin *Menu::namesTreeWin;
 StorageWin *Menu::storageWin;
 ServerInfoWin *Menu::serverInfoWin;
+DiagnosticsWin *Menu::diagnosticsWin;
 
 void Menu::initDialogs(QString const &srvUrl)
 {
@@ -50,6 +52,8 @@ void Menu::initDialogs(QString const &srvUrl)
   if (! storageWin) storageWin = new StorageWin;
   if (verbose) qDebug() << "Create ServerInfoWin ...";
   if (! serverInfoWin) serverInfoWin = new ServerInfoWin(srvUrl);
+  if (verbose) qDebug() << "Create DiagnosticsWin ...";
+  if (! diagnosticsWin) diagnosticsWin = new DiagnosticsWin;
 }
 
 void Menu::deleteDialogs()
@@ -64,6 +68,7 @@ void Menu::deleteDialogs()
   danceOfDel<NamesTreeWin>(&namesTreeWin);
   danceOfDel<StorageWin>(&storageWin);
   danceOfDel<ServerInfoWin>(&serverInfoWin);
+  danceOfDel<DiagnosticsWin>(&diagnosticsWin);
 }
 
 Menu::Menu(bool with_beta_features, QMainWindow *mainWindow) :
@@ -125,6 +130,11 @@ Menu::Menu(bool with_beta_features, QMainWindow *mainWindow) :
     QCoreApplication::translate("QMenuBar", "Server Information…"),
     this, &Menu::openServerInfoWin);
 
+  /* Internal statistics about RmAdmin itself: */
+  windowMenu->addAction(
+    QCoreApplication::translate("QMenuBar", "Diagnostics…"),
+    this, &Menu::openDiagnosticsWin);
+
   /* As a last resort, a raw edition window: */
   windowMenu->addAction(
     QCoreApplication::translate("QMenuBar", "Raw Configuration…"),
@@ -210,6 +220,11 @@ void Menu::openServerInfoWin()
   showRaised(serverInfoWin);
 }
 
+void Menu::openDiagnosticsWin()
+{
+  showRaised(diagnosticsWin);
+}
+
 void Menu::prepareQuit()
 {
   saveWindowVisibility = true;
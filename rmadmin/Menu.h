@@ -14,6 +14,7 @@ class SourcesWin;
 class NamesTreeWin;
 class StorageWin;
 class ServerInfoWin;
+class DiagnosticsWin;
 
 /* We need some slots to open the windows from various places, therefore
  * we need a Q_OBJECT.
@@ -36,6 +37,7 @@ public:
   static NamesTreeWin *namesTreeWin;
   static StorageWin *storageWin;
   static ServerInfoWin *serverInfoWin;
+  static DiagnosticsWin *diagnosticsWin;
 
   static void initDialogs(QString const &srvUrl);
   static void deleteDialogs();
@@ -53,6 +55,7 @@ public slots:
   void openNamesTreeWin();
   void openStorageWin();
   void openServerInfoWin();
+  void openDiagnosticsWin();
   void prepareQuit();
 };
 
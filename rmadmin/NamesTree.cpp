@@ -4,6 +4,7 @@
 #include <QDebug>
 #include <QVariant>
 #include "conf.h"
+#include "Diagnostics.h"
 #include "misc.h"
 #include "confValue.h"
 #include "confWorkerRole.h"
@@ -102,11 +103,12 @@ NamesTree::NamesTree(bool withSites_, QObject *parent) :
 {
   root = new SubTree(QString(), nullptr, false);
 
-  connect(&kvs, &KVStore::valueCreated,
+  KVSubscriber const *subscriber = kvs.subscribePrefix("sites/");
+  connect(subscriber, &KVSubscriber::valueCreated,
           this, &NamesTree::updateNames);
-  connect(&kvs, &KVStore::valueChanged,
+  connect(subscriber, &KVSubscriber::valueChanged,
           this, &NamesTree::updateNames);
-  connect(&kvs, &KVStore::valueDeleted,
+  connect(subscriber, &KVSubscriber::valueDeleted,
           this, &NamesTree::deleteNames);
 }
 
@@ -115,11 +117,6 @@ NamesTree::~NamesTree()
   delete root;
 }
 
-static bool isAWorker(std::string const &key)
-{
-  return startsWith(key, "sites/") && endsWith(key, "/worker");
-}
-
 // Empties [names]
 SubTree *NamesTree::findOrCreate(
   SubTree *parent, QStringList &names, bool isField)
@@ -211,9 +208,10 @@ std::pair<std::string, std::string> NamesTree::pathOfIndex(
   return ret;
 }
 
-void NamesTree::updateNames(std::string const &key, KValue const &kv)
+void NamesTree::updateNames(conf::Key const &key, KValue const &kv)
 {
-  if (! isAWorker(key)) return;
+  if (! key.isWorker()) return;
+  ScopedTimer timer(diagnostics.namesTreeUpdates);
 
   std::shared_ptr<conf::Worker const> worker =
     std::dynamic_pointer_cast<conf::Worker const>(kv.val);
@@ -226,44 +224,14 @@ void NamesTree::updateNames(std::string const &key, KValue const &kv)
 
   /* Get the site name, program name list and function name: */
 
-  size_t const prefix_len = sizeof "sites/" - 1;
-  size_t const workers_len = sizeof "/workers/" - 1;
-  size_t const suffix_len = sizeof "/worker" - 1;
-  size_t const min_names = sizeof "s/p/f" - 1;
-
-  if (key.length() < prefix_len + workers_len + suffix_len + min_names) {
-invalid_key:
-    qCritical() << "Invalid worker key:" << QString::fromStdString(key);
-    return;
-  }
-
-  size_t const end = key.length() - suffix_len;
-
-  size_t i = key.find('/', prefix_len);
-  if (i >= end) goto invalid_key;
-  QString const site =
-    QString::fromStdString(key.substr(prefix_len, i - prefix_len));
-
-  // Skip "/workers/"
-  i = key.find('/', i+1);
-  if (i >= end) goto invalid_key;
-
-  // Locate the function name at the end:
-  size_t j = key.rfind('/', end - 1);
-  if (j <= i) goto invalid_key;
-
-  // Everything in between in the program name:
-  std::string const programName(key.substr(i + 1, j - i - 1));
-  std::string const srcPath = srcPathFromProgramName(programName);
-  QString const programs = QString::fromStdString(programName);
-  QStringList const program =
-    programs.split('/', QString::SkipEmptyParts);
-  QString const function =
-    QString::fromStdString(key.substr(j + 1, end - j - 1));
+  QString const &site = key.site;
+  std::string const srcPath = srcPathFromProgramName(key.program.toStdString());
+  QStringList const program = key.program.split('/', QString::SkipEmptyParts);
+  QString const &function = key.function;
 
   if (verbose)
     qDebug() << "NamesTree: found" << site << "/ "
-              << programs << "/" << function;
+              << key.program << "/" << function;
 
   QStringList names(QStringList(site) << program << function);
   if (! withSites) names.removeFirst();
@@ -277,17 +245,15 @@ invalid_key:
 
   std::shared_ptr<conf::SourceInfo const> sourceInfos;
 
-  kvs.lock.lock_shared();
-  auto it = kvs.map.find(infoKey);
-  if (it == kvs.map.end()) {
+  std::shared_ptr<KValue const> kv = kvs.get(infoKey);
+  if (! kv) {
     if (verbose)
       qDebug() << "NamesTree: No source info yet for" << QString::fromStdString(infoKey);
   } else {
-    sourceInfos = std::dynamic_pointer_cast<conf::SourceInfo const>(it->second.val);
+    sourceInfos = std::dynamic_pointer_cast<conf::SourceInfo const>(kv->val);
     if (! sourceInfos)
       qCritical() << "NamesTree: Not a SourceInfo!?";
   }
-  kvs.lock.unlock_shared();
 
   if (! sourceInfos) return;
   if (sourceInfos->isError()) {
@@ -316,9 +282,10 @@ invalid_key:
   }
 }
 
-void NamesTree::deleteNames(std::string const &key, KValue const &)
+void NamesTree::deleteNames(conf::Key const &key, KValue const &)
 {
-  if (! isAWorker(key)) return;
+  if (! key.isWorker()) return;
+  ScopedTimer timer(diagnostics.namesTreeUpdates);
 
   // TODO: actually delete? Or keep the names around for a bit?
 }
@@ -18,6 +18,9 @@
 struct KValue;
 class QStringList;
 class SubTree;
+namespace conf {
+  struct Key;
+};
 
 /*
  * The NamesTree is a model. A proxy could restrict it to some subtree (and,
@@ -57,8 +60,8 @@ public:
   std::pair<std::string, std::string> pathOfIndex(QModelIndex const &) const;
 
 protected slots:
-  void updateNames(std::string const &, KValue const &);
-  void deleteNames(std::string const &, KValue const &);
+  void updateNames(conf::Key const &, KValue const &);
+  void deleteNames(conf::Key const &, KValue const &);
 };
 
 /*
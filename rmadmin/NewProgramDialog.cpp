@@ -60,7 +60,7 @@ NewProgramDialog::NewProgramDialog(QString const &sourceName, QWidget *parent) :
   setLayout(layout);
 
   // Listen for all locks on the RC:
-  connect(&kvs, &KVStore::valueLocked,
+  connect(kvs.subscribeKey(rc_key), &KVSubscriber::valueLocked,
           this, &NewProgramDialog::mayWriteRC);
 
   setWindowTitle(tr("Start New Program"));
@@ -81,11 +81,9 @@ void NewProgramDialog::createProgram()
    * Had we one entry per program we could simply use NewKey.
    * Here instead we write only if/when we obtain the lock. */
   std::shared_ptr<conf::Value> rc_value;
-  kvs.lock.lock_shared();
-  auto it = kvs.map.find(rc_key);
-  if (it != kvs.map.end() && it->second.isMine())
-    rc_value = it->second.val;
-  kvs.lock.unlock_shared();
+  std::shared_ptr<KValue const> kv = kvs.get(rc_key);
+  if (kv && kv->isMine())
+    rc_value = kv->val;
 
   if (rc_value) {
     appendEntry(rc_value);
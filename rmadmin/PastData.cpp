@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <QDebug>
+#include "Diagnostics.h"
 #include "PastData.h"
 
 static bool verbose = true;
@@ -11,7 +12,22 @@ PastData::PastData(std::string const &site_, std::string const &program_,
                    QObject *parent) :
   QObject(parent),
   site(site_), program(program_), function(function_),
-  type(type_), eventTime(eventTime_) {}
+  type(type_), eventTime(eventTime_)
+{
+  diagnostics.addPastData(this);
+}
+
+PastData::~PastData()
+{
+  diagnostics.removePastData(this);
+}
+
+size_t PastData::numTuples() const
+{
+  size_t n = 0;
+  for (PendingReplayRequest const &c : pendingRequests) n += c.rows.size();
+  return n;
+}
 
 void PastData::request(TimeRange req)
 {
@@ -32,19 +48,30 @@ void PastData::request(TimeRange req)
     // Ignore small chunks entirely within the requested interval
   }
 
-  pendingRequests.emplace_back(site, program, function, req, type, eventTime);
+  // Keep the list ordered by time, as assumed above:
+  auto it = std::find_if(
+    pendingRequests.begin(), pendingRequests.end(),
+    [&req](PendingReplayRequest const &c) {
+      return c.timeRange.since > req.since;
+    });
+  PendingReplayRequest &c = *pendingRequests.emplace(
+    it, site, program, function, req, type, eventTime);
+
+  connect(&c, &PendingReplayRequest::dataReceived,
+          this, &PastData::dataReceived);
 }
 
 void PastData::iterTuples(
   TimeRange range,
-  std::function<void (std::shared_ptr<RamenValue const>)> cb) const
+  std::function<void (std::vector<std::unique_ptr<Column>> const &,
+                      size_t row)> cb) const
 {
   for (PendingReplayRequest const &c : pendingRequests) {
     if (c.timeRange.since >= range.until) break;
     if (c.timeRange.until <= range.since) continue;
 
-    for (std::pair<double, std::shared_ptr<RamenValue const>> t : c.tuples) {
-      if (range.contains(t.first)) cb(t.second);
+    for (size_t row : c.rows) {
+      if (range.contains(c.times[row])) cb(c.columns, row);
     }
   }
 }
@@ -20,10 +20,12 @@
  */
 #include <memory>
 #include <functional>
+#include <vector>
 #include <QObject>
 #include "RamenValue.h"
 #include "PendingReplayRequest.h"
 
+class Column;
 struct EventTime;
 struct RamenType;
 
@@ -47,10 +49,23 @@ public:
            std::shared_ptr<EventTime const>,
            QObject *parent = nullptr);
 
+  ~PastData();
+
   void request(TimeRange);
 
+  // Number of tuples received so far, for diagnostics:
+  size_t numTuples() const;
+
+  /* Calls cb with the columns and row of every tuple within that time
+   * range: */
   void iterTuples(
-    TimeRange, std::function<void (std::shared_ptr<RamenValue const>)> cb) const;
+    TimeRange,
+    std::function<void (std::vector<std::unique_ptr<Column>> const &,
+                        size_t row)> cb) const;
+
+signals:
+  // Whenever a replay has completed, so that its tuples can be iterated:
+  void dataReceived();
 };
 
 #endif
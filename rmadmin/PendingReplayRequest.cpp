@@ -3,10 +3,12 @@
 #include <cstdlib>
 #include <QtGlobal>
 #include <QDebug>
+#include "Column.h"
 #include "conf.h"
 #include "confValue.h"
 #include "EventTime.h"
 #include "PendingReplayRequest.h"
+#include "TupleDecoder.h"
 
 static bool const verbose = true;
 
@@ -31,12 +33,16 @@ PendingReplayRequest::PendingReplayRequest(
   completed(false),
   type(type_),
   eventTime(eventTime_),
+  decoder(std::make_unique<TupleDecoder const>(type)),
   timeRange(timeRange_)
 {
+  columns = decoder->makeColumns();
+
   // Prepare to receive the values:
-  connect(&kvs, &KVStore::valueChanged,
+  KVSubscriber const *subscriber = kvs.subscribeKey(respKey);
+  connect(subscriber, &KVSubscriber::valueChanged,
           this, &PendingReplayRequest::receiveValue);
-  connect(&kvs, &KVStore::valueDeleted,
+  connect(subscriber, &KVSubscriber::valueDeleted,
           this, &PendingReplayRequest::endReceived);
 
   std::shared_ptr<conf::ReplayRequest const> req =
@@ -53,6 +59,8 @@ PendingReplayRequest::PendingReplayRequest(
   askSet("replay_requests", req);
 }
 
+PendingReplayRequest::~PendingReplayRequest() {}
+
 void PendingReplayRequest::receiveValue(std::string const &key, KValue const &kv)
 {
   if (key != respKey) return;
@@ -73,25 +81,31 @@ void PendingReplayRequest::receiveValue(std::string const &key, KValue const &kv
     return;
   }
 
-  RamenValue const *val = tuple->unserialize(type);
-  if (! val) {
+  size_t const row = times.size();
+  if (! decoder->decode(
+         tuple->bytes, tuple->bytes + tuple->num_words, columns)) {
     qCritical() << "Cannot unserialize tuple:" << *kv.val;
     return;
   }
 
-  std::optional<double> start = eventTime->ofTuple(*val);
+  std::optional<double> start = eventTime->ofRow(columns, row);
   if (! start.has_value()) {
     qCritical() << "Dropping tuple missing event time";
+    for (std::unique_ptr<Column> &column : columns) column->truncate(row);
     return;
   }
 
-  tuples.emplace_back(*start, val);
+  times.push_back(*start);
+  rows.push_back(row);
+
+  if (completed) emit dataReceived();
 }
 
 void PendingReplayRequest::endReceived()
 {
-  std::sort(tuples.begin(), tuples.end(), [](auto p1, auto p2) {
-    return p1.first < p2.first;
+  std::sort(rows.begin(), rows.end(), [this](size_t r1, size_t r2) {
+    return times[r1] < times[r2];
   });
   completed = true;
+  emit dataReceived();
 }
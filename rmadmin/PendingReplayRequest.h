@@ -2,13 +2,15 @@
 #define PENDINGREPLAYREQUEST_H_191007
 #include <ctime>
 #include <memory>
+#include <vector>
 #include <QObject>
 #include "TimeRange.h"
 
+class Column;
 struct EventTime;
 struct KValue;
 struct RamenType;
-struct RamenValue;
+class TupleDecoder;
 
 class PendingReplayRequest : public QObject
 {
@@ -20,13 +22,18 @@ class PendingReplayRequest : public QObject
   bool completed;
   std::shared_ptr<RamenType const> type;
   std::shared_ptr<EventTime const> eventTime;
+  std::unique_ptr<TupleDecoder const> decoder;
 
 public:
   TimeRange timeRange;
 
-  /* Where the results are stored (in event time order once completed, or
-   * random): */
-  std::vector<std::pair<double, std::shared_ptr<RamenValue const>>> tuples;
+  /* Where the results are stored, column by column (see TupleDecoder), in
+   * the order they are received, with their event times: */
+  std::vector<std::unique_ptr<Column>> columns;
+  std::vector<double> times;
+
+  // Indices of those rows in event time order once completed, or random:
+  std::vector<size_t> rows;
 
   /* Also start the actual request: */
   PendingReplayRequest(
@@ -35,6 +42,12 @@ public:
     std::shared_ptr<RamenType const> type_,
     std::shared_ptr<EventTime const>);
 
+  ~PendingReplayRequest();
+
+signals:
+  // Once all the tuples are received, and then for any late one:
+  void dataReceived();
+
 protected slots:
   void receiveValue(std::string const &, KValue const &);
   void endReceived();
@@ -15,6 +15,7 @@
 #include <QVBoxLayout>
 #include <QVector>
 #include <QTimer>
+#include "conf.h"
 #include "Resources.h"
 #include "Menu.h"
 #include "GraphModel.h"
@@ -162,6 +163,24 @@ ProcessesWidget::ProcessesWidget(GraphModel *graphModel, QWidget *parent) :
           this, &ProcessesWidget::adjustColumnSize);
 }
 
+ProcessesWidget::~ProcessesWidget()
+{
+}
+
+void ProcessesWidget::showEvent(QShowEvent *event)
+{
+  if (! statsTopic)
+    statsTopic =
+      std::make_unique<TopicSubscription>("sites/*/workers/*/stats/runtime");
+  QWidget::showEvent(event);
+}
+
+void ProcessesWidget::hideEvent(QHideEvent *event)
+{
+  statsTopic.reset();
+  QWidget::hideEvent(event);
+}
+
 /* Those ModelIndexes come from the GraphModel not the proxy, so no conversion
  * is necessary.
  * Actually does not adjust right now but use a timer to cluster changes as this
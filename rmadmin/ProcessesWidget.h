@@ -11,6 +11,7 @@ class QTreeView;
 class QLineEdit;
 class QTimer;
 class ProcessesWidgetProxy;
+class TopicSubscription;
 class ProgramItem;
 struct Program;
 class Function;
@@ -22,6 +23,13 @@ class ProcessesWidget : public QWidget
   QTimer *adjustColumnTimer;
   std::bitset<GraphModel::NumColumns> needResizing;
 
+  // Runtime stats are received only while the list is visible:
+  std::unique_ptr<TopicSubscription> statsTopic;
+
+protected:
+  void showEvent(QShowEvent *) override;
+  void hideEvent(QHideEvent *) override;
+
 public:
   QTreeView *treeView;
   QLineEdit *searchBox;
@@ -29,6 +37,7 @@ public:
   ProcessesWidgetProxy *proxyModel;
 
   ProcessesWidget(GraphModel *, QWidget *parent = nullptr);
+  ~ProcessesWidget();
 
   QSize sizeHint() const { return QSize(700, 300); }
 
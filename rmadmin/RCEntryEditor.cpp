@@ -126,11 +126,12 @@ RCEntryEditor::RCEntryEditor(bool sourceEditable_, QWidget *parent) :
 
   /* Each creation/deletion of source files while this editor is alive should
    * refresh the source select box and its associated warnings: */
-  connect(&kvs, &KVStore::valueCreated,
+  KVSubscriber const *subscriber = kvs.subscribePrefix("sources/");
+  connect(subscriber, &KVSubscriber::valueCreated,
           this, &RCEntryEditor::addSourceFromStore);
-  connect(&kvs, &KVStore::valueChanged,
+  connect(subscriber, &KVSubscriber::valueChanged,
           this, &RCEntryEditor::updateSourceFromStore);
-  connect(&kvs, &KVStore::valueDeleted,
+  connect(subscriber, &KVSubscriber::valueDeleted,
           this, &RCEntryEditor::removeSourceFromStore);
 }
 
@@ -257,15 +258,11 @@ void RCEntryEditor::updateSourceWarnings()
   } else {
     QString const name(sourceBox->currentText());
     std::string info_k(keyOfSourceName(name, "info"));
-    kvs.lock.lock_shared();
     sourceDoesExist =
-      kvs.map.find(keyOfSourceName(name, "ramen")) != kvs.map.end() ||
-      kvs.map.find(keyOfSourceName(name, "alert")) != kvs.map.end();
-    auto it = kvs.map.find(info_k);
-    sourceIsCompiled =
-      it != kvs.map.end() &&
-      isCompiledSource(it->second);
-    kvs.lock.unlock_shared();
+      kvs.get(keyOfSourceName(name, "ramen")) ||
+      kvs.get(keyOfSourceName(name, "alert"));
+    std::shared_ptr<KValue const> kv = kvs.get(info_k);
+    sourceIsCompiled = kv && isCompiledSource(*kv);
   }
 
   deletedSourceWarning->setVisible(!sourceDoesExist);
@@ -317,12 +314,10 @@ void RCEntryEditor::resetParams()
   QString const baseName = sourceBox->currentText();
   std::string infoKey("sources/" + baseName.toStdString() + "/info");
 
-  kvs.lock.lock_shared();
   std::shared_ptr<conf::SourceInfo const> info;
-  auto it = kvs.map.find(infoKey);
-  if (it != kvs.map.end())
-    info = std::dynamic_pointer_cast<conf::SourceInfo const>(it->second.val);
-  kvs.lock.unlock_shared();
+  std::shared_ptr<KValue const> kv = kvs.get(infoKey);
+  if (kv)
+    info = std::dynamic_pointer_cast<conf::SourceInfo const>(kv->val);
 
   if (! info) {
     qCritical() << "Cannot get info" << QString::fromStdString(infoKey);
@@ -334,11 +334,13 @@ struct VCidr : public RamenValue {
   VCidr() : VCidr((uint32_t)0, 0) {}
 };
 
+// Compound values own their items:
 struct VTuple : public RamenValue {
   std::vector<RamenValue const *> v;
 
   VTuple(size_t numFields) { v.reserve(numFields); }
   VTuple(value);
+  ~VTuple() { for (RamenValue const *i : v) delete i; }
 
   QString const toQString(std::string const &) const;
   void append(RamenValue const *);
@@ -353,6 +355,7 @@ struct VVec : public RamenValue {
 
   VVec(size_t dim) { v.reserve(dim); }
   VVec(value);
+  ~VVec() { for (RamenValue const *i : v) delete i; }
 
   QString const toQString(std::string const &) const;
   void append(RamenValue const *i) {
@@ -370,6 +373,7 @@ struct VList : public RamenValue {
 
   VList(size_t dim) { v.reserve(dim); }
   VList(value);
+  ~VList() { for (RamenValue const *i : v) delete i; }
 
   QString const toQString(std::string const &) const;
   void append(RamenValue const *i) { v.push_back(i); }
@@ -382,6 +386,7 @@ struct VRecord : public RamenValue {
    * with a setter instead of an appender: */
   VRecord(size_t numFields);
   VRecord(value);
+  ~VRecord() { for (auto &f : v) delete f.second; }
 
   QString const toQString(std::string const &) const;
 
@@ -19,10 +19,13 @@ ServerInfoWidget::ServerInfoWidget(QString const &srvUrl, QWidget *parent) :
 
   setLayout(layout);
 
-  connect(&kvs, &KVStore::valueCreated,
-          this, &ServerInfoWidget::setKey);
-  connect(&kvs, &KVStore::valueChanged,
-          this, &ServerInfoWidget::setKey);
+  for (KVSubscriber const *subscriber :
+         { kvs.subscribeKey("time"), kvs.subscribePrefix("versions/") }) {
+    connect(subscriber, &KVSubscriber::valueCreated,
+            this, &ServerInfoWidget::setKey);
+    connect(subscriber, &KVSubscriber::valueChanged,
+            this, &ServerInfoWidget::setKey);
+  }
 }
 
 void ServerInfoWidget::setKey(std::string const &key, KValue const &kv)
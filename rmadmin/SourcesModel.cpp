@@ -16,9 +16,10 @@ SourcesModel::SourcesModel(QObject *parent) :
 {
   root = new DirItem("");
 
-  connect(&kvs, &KVStore::valueCreated,
+  KVSubscriber const *subscriber = kvs.subscribePrefix("sources/");
+  connect(subscriber, &KVSubscriber::valueCreated,
           this, &SourcesModel::addSource);
-  connect(&kvs, &KVStore::valueDeleted,
+  connect(subscriber, &KVSubscriber::valueDeleted,
           this, &SourcesModel::delSource);
 }
 
@@ -306,10 +307,8 @@ std::shared_ptr<conf::SourceInfo const> SourcesModel::sourceInfoOfItem(TreeItem
   std::string const infoKey = file->sourceKeyPrefix + "/info";
 
   std::shared_ptr<conf::Value const> v;
-  kvs.lock.lock_shared();
-  auto it = kvs.map.find(infoKey);
-  if (it != kvs.map.end()) v = it->second.val;
-  kvs.lock.unlock_shared();
+  std::shared_ptr<KValue const> kv = kvs.get(infoKey);
+  if (kv) v = kv->val;
 
   if (! v) return nullptr;
   return std::dynamic_pointer_cast<conf::SourceInfo const>(v);
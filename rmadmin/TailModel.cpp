@@ -1,14 +1,33 @@
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <set>
 #include <string>
 #include <memory>
 #include <optional>
+#include <QByteArray>
+#include <QDataStream>
 #include <QDebug>
+#include <QDir>
+#include <QTemporaryFile>
 #include <QtGlobal>
+#include "Column.h"
 #include "conf.h"
 #include "confValue.h"
+#include "Diagnostics.h"
 #include "EventTime.h"
 #include "RamenType.h"
 #include "TailModel.h"
+#include "TupleDecoder.h"
+
+size_t TailModel::maxMemory = 32 * 1024 * 1024;
+size_t TailModel::maxTotMemory = 512 * 1024 * 1024;
+size_t TailModel::maxSpill = (size_t)1024 * 1024 * 1024;
+double TailModel::maxAge = 0.;
+bool TailModel::spill = false;
+
+// All the TailModels alive, for the global memory budget:
+static std::set<TailModel *> liveTails;
 
 TailModel::TailModel(
   QString const &fqName_, QString const &workerSign_,
@@ -20,14 +39,31 @@ TailModel::TailModel(
   eventTime(eventTime_),
   fqName(fqName_),
   workerSign(workerSign_),
-  keyPrefix("tails/" + fqName.toStdString() + "/" +
-            workerSign.toStdString() + "/lasts/"),
+  keyPrefix(keyPrefixOf(fqName, workerSign)),
   type(type_),
   factors(factors_)
 {
-  tuples.reserve(500);
+  decoder = std::make_unique<TupleDecoder const>(type);
+  columns = decoder->makeColumns();
+  for (std::unique_ptr<Column> &column : columns) column->reserve(500);
+  times.reserve(500);
+
+  diagnostics.addTailModel(this);
+
+  /* Budgets are enforced once per batch of changes rather than for every
+   * tuple: */
+  static bool enforcing = false;
+  if (! enforcing) {
+    QObject::connect(&kvs, &KVStore::batchDelivered,
+                     &TailModel::enforceBudgets);
+    enforcing = true;
+  }
+  liveTails.insert(this);
 
-  connect(&kvs, &KVStore::valueCreated,
+  tailTopic = std::make_unique<TopicSubscription>(
+    "tails/" + fqName.toStdString() + "/" + workerSign.toStdString() + "/*");
+
+  connect(kvs.subscribePrefix(keyPrefix), &KVSubscriber::valueCreated,
           this, &TailModel::addTuple);
 
   // Subscribe
@@ -39,11 +75,30 @@ TailModel::TailModel(
 
 TailModel::~TailModel()
 {
+  diagnostics.removeTailModel(this);
+  liveTails.erase(this);
+
   // Unsubscribe
   std::string k(subscriberKey());
   askDel(k);
 }
 
+size_t TailModel::memoryUsage() const
+{
+  size_t sz = times.size() * sizeof(times[0]);
+  for (std::unique_ptr<Column> const &column : columns)
+    sz += column->memoryUsage();
+  return sz;
+}
+
+std::string TailModel::keyPrefixOf(
+  QString const &fqName, QString const &workerSign)
+{
+  return std::string(
+    "tails/" + fqName.toStdString() + "/" +
+    workerSign.toStdString() + "/lasts/");
+}
+
 std::string TailModel::subscriberKey() const
 {
   return std::string(
@@ -51,9 +106,11 @@ std::string TailModel::subscriberKey() const
     workerSign.toStdString() + "/users/" + my_uid->toStdString());
 }
 
-void TailModel::addTuple(std::string const &key, KValue const &kv)
+/* Only receives the keys starting with keyPrefix, from its subscriber, so
+ * there is no need to check the key: */
+void TailModel::addTuple(conf::Key const &, KValue const &kv)
 {
-  if (! startsWith(key, keyPrefix)) return;
+  ScopedTimer timer(diagnostics.tailModelUpdates);
 
   std::shared_ptr<conf::Tuple const> tuple =
     std::dynamic_pointer_cast<conf::Tuple const>(kv.val);
@@ -63,25 +120,254 @@ void TailModel::addTuple(std::string const &key, KValue const &kv)
     return;
   }
 
-  RamenValue const *val = tuple->unserialize(type);
-  if (! val) {
+  if (! decoder->decode(
+         tuple->bytes, tuple->bytes + tuple->num_words, columns)) {
     qCritical() << "Cannot unserialize tuple:" << *kv.val;
     return;
   }
 
-  /* If a function has no event time info, all tuples will have time 0.
+  /* The new row is in the columns already, but only becomes visible once
+   * its time is added.
+   * If a function has no event time info, all tuples will have time 0.
    * Past data is disabled in that case anyway. */
-  double start(eventTime->ofTuple(*val).value_or(0.));
+  double start(eventTime->ofRow(columns, times.size()).value_or(0.));
 
-  beginInsertRows(QModelIndex(), tuples.size(), tuples.size());
-  tuples.emplace_back(start, val);
+  int const row = rowCount();
+  beginInsertRows(QModelIndex(), row, row);
+  times.push_back(start);
   endInsertRows();
 }
 
+size_t TailModel::rowsAbove(size_t maxBytes) const
+{
+  size_t const usage = memoryUsage();
+  if (usage <= maxBytes || times.empty()) return 0;
+
+  size_t const keep = times.size() * ((double)maxBytes / usage);
+  return times.size() - keep;
+}
+
+void TailModel::evict(size_t numRows)
+{
+  numRows = std::min(numRows, times.size());
+  if (0 == numRows) return;
+
+  if (spill && ! spillFile) {
+    spillFile = std::make_unique<QTemporaryFile>(
+      QDir::tempPath() + "/rmadmin-tail-XXXXXX");
+    if (! spillFile->open())
+      qCritical() << "Cannot create a file to spill tuples into:"
+                  << spillFile->errorString();
+  }
+
+  bool spilled = false;
+  if (spillFile && spillFile->isOpen()) {
+    SpilledChunk chunk {
+      spillFile->size(), 0, numSpilled, numRows, times[0], times[0] };
+
+    spillFile->seek(chunk.offset);
+    QDataStream out(spillFile.get());
+    for (size_t r = 0; r < numRows; r ++) {
+      out << times[r];
+      chunk.minTime = std::min(chunk.minTime, times[r]);
+      chunk.maxTime = std::max(chunk.maxTime, times[r]);
+    }
+    for (std::unique_ptr<Column> const &column : columns)
+      column->save(out, 0, numRows);
+
+    if (out.status() == QDataStream::Ok) {
+      chunk.size = spillFile->pos() - chunk.offset;
+      spilledChunks.push_back(chunk);
+      numSpilled += numRows;
+      spilledBytes += chunk.size;
+      spilled = true;
+    } else {
+      qCritical() << "Cannot spill tuples:" << spillFile->errorString();
+    }
+  }
+
+  /* Spilled rows are still part of the model, whereas forgotten ones must be
+   * removed: */
+  if (! spilled)
+    beginRemoveRows(QModelIndex(), numSpilled, numSpilled + numRows - 1);
+
+  times.erase(times.begin(), times.begin() + numRows);
+  for (std::unique_ptr<Column> &column : columns) column->dropFront(numRows);
+
+  if (! spilled) endRemoveRows();
+
+  if (spilled) trimSpilled();
+}
+
+void TailModel::trimSpilled()
+{
+  if (0 == maxSpill || spilledBytes <= (qint64)maxSpill) return;
+
+  // Forget a bit more than needed so that this does not happen every time:
+  size_t numChunks = 0, numRows = 0;
+  qint64 freed = 0;
+  while (numChunks < spilledChunks.size() &&
+         spilledBytes - freed > (qint64)(maxSpill * 3 / 4)) {
+    freed += spilledChunks[numChunks].size;
+    numRows += spilledChunks[numChunks].numRows;
+    numChunks ++;
+  }
+  if (0 == numRows) return;
+
+  beginRemoveRows(QModelIndex(), 0, numRows - 1);
+
+  spilledChunks.erase(spilledChunks.begin(), spilledChunks.begin() + numChunks);
+  for (SpilledChunk &chunk : spilledChunks) chunk.firstRow -= numRows;
+  numSpilled -= numRows;
+  spilledBytes -= freed;
+  cachedChunk = SIZE_MAX;
+
+  endRemoveRows();
+
+  // The file only shrinks once at least half of it is garbage:
+  if (spillFile->size() > 2 * spilledBytes) compactSpillFile();
+}
+
+void TailModel::compactSpillFile()
+{
+  std::unique_ptr<QTemporaryFile> newFile =
+    std::make_unique<QTemporaryFile>(
+      QDir::tempPath() + "/rmadmin-tail-XXXXXX");
+  if (! newFile->open()) {
+    qCritical() << "Cannot create a file to compact spilled tuples into:"
+                << newFile->errorString();
+    return;
+  }
+
+  std::vector<SpilledChunk> newChunks(spilledChunks);
+  for (SpilledChunk &chunk : newChunks) {
+    QByteArray bytes;
+    if (spillFile->seek(chunk.offset)) bytes = spillFile->read(chunk.size);
+    qint64 const newOffset = newFile->pos();
+    if (bytes.size() != chunk.size || newFile->write(bytes) != chunk.size) {
+      qCritical() << "Cannot compact spilled tuples:"
+                  << spillFile->errorString() << newFile->errorString();
+      return;
+    }
+    chunk.offset = newOffset;
+  }
+
+  spillFile.swap(newFile);
+  spilledChunks.swap(newChunks);
+  cachedChunk = SIZE_MAX;
+}
+
+void TailModel::enforceBudgets()
+{
+  size_t totMemory = 0;
+
+  for (TailModel *tail : liveTails) {
+    /* Same as for memory, once some tuples are too old evict all those that
+     * would be too old with only 3/4 of the maximum age: */
+    if (maxAge > 0 && ! tail->times.empty() &&
+        tail->times.front() < tail->times.back() - maxAge) {
+      double const oldest = tail->times.back() - maxAge * 3 / 4;
+      size_t numRows = 0;
+      while (numRows < tail->times.size() && tail->times[numRows] < oldest)
+        numRows ++;
+      tail->evict(numRows);
+    }
+
+    // Evict a bit more than needed so that this does not happen every time:
+    if (maxMemory > 0 && tail->memoryUsage() > maxMemory)
+      tail->evict(tail->rowsAbove(maxMemory * 3 / 4));
+
+    totMemory += tail->memoryUsage();
+  }
+
+  // Then evict from the largest tails until all of them fit:
+  while (maxTotMemory > 0 && totMemory > maxTotMemory) {
+    TailModel *largest = *std::max_element(
+      liveTails.begin(), liveTails.end(), [](TailModel *a, TailModel *b) {
+        return a->memoryUsage() < b->memoryUsage();
+      });
+
+    size_t const usage = largest->memoryUsage();
+    size_t const excess = totMemory - maxTotMemory * 3 / 4;
+    largest->evict(largest->rowsAbove(usage > excess ? usage - excess : 0));
+
+    size_t const freed = usage - largest->memoryUsage();
+    if (0 == freed) break;
+    totMemory -= freed;
+  }
+}
+
+TailModel::SpilledChunk const *TailModel::loadChunk(size_t row) const
+{
+  // Last chunk which first row is not after row:
+  auto it = std::upper_bound(
+    spilledChunks.begin(), spilledChunks.end(), row,
+    [](size_t r, SpilledChunk const &chunk) {
+      return r < chunk.firstRow;
+    });
+  if (it == spilledChunks.begin()) return nullptr;
+  size_t const c = (it - spilledChunks.begin()) - 1;
+  SpilledChunk const &chunk = spilledChunks[c];
+
+  if (c == cachedChunk) return &chunk;
+
+  spillFile->seek(chunk.offset);
+  QDataStream in(spillFile.get());
+
+  cachedTimes.resize(chunk.numRows);
+  for (size_t r = 0; r < chunk.numRows; r ++) in >> cachedTimes[r];
+  cachedColumns = decoder->makeColumns();
+  for (std::unique_ptr<Column> &column : cachedColumns)
+    column->load(in, chunk.numRows);
+
+  if (in.status() != QDataStream::Ok) {
+    qCritical() << "Cannot read back spilled tuples:"
+                << spillFile->errorString();
+    cachedChunk = SIZE_MAX;
+    return nullptr;
+  }
+
+  cachedChunk = c;
+  return &chunk;
+}
+
+double TailModel::timeOf(int row) const
+{
+  if ((size_t)row >= numSpilled) return times[row - numSpilled];
+
+  SpilledChunk const *chunk = loadChunk(row);
+  return chunk ? cachedTimes[row - chunk->firstRow] : 0.;
+}
+
+void TailModel::iterRows(
+  TimeRange range,
+  std::function<void (std::vector<std::unique_ptr<Column>> const &,
+                      size_t row)> cb,
+  size_t firstRow, size_t endRow) const
+{
+  for (SpilledChunk const &chunk : spilledChunks) {
+    if (chunk.firstRow >= endRow) return;
+    if (chunk.firstRow + chunk.numRows <= firstRow) continue;
+    if (chunk.maxTime < range.since || chunk.minTime >= range.until) continue;
+    if (! loadChunk(chunk.firstRow)) continue;
+    size_t const r0 =
+      firstRow > chunk.firstRow ? firstRow - chunk.firstRow : 0;
+    size_t const r1 = std::min(chunk.numRows, endRow - chunk.firstRow);
+    for (size_t r = r0; r < r1; r ++)
+      if (range.contains(cachedTimes[r])) cb(cachedColumns, r);
+  }
+
+  if (numSpilled >= endRow) return;
+  size_t const r0 = firstRow > numSpilled ? firstRow - numSpilled : 0;
+  size_t const r1 = std::min(times.size(), endRow - numSpilled);
+  for (size_t r = r0; r < r1; r ++)
+    if (range.contains(times[r])) cb(columns, r);
+}
+
 int TailModel::rowCount(QModelIndex const &parent) const
 {
   if (parent.isValid()) return 0;
-  return tuples.size();
+  return numSpilled + times.size();
 }
 
 int TailModel::columnCount(QModelIndex const &parent) const
@@ -103,8 +389,11 @@ QVariant TailModel::data(QModelIndex const &index, int role) const
 
   switch (role) {
     case Qt::DisplayRole:
-      return
-        QVariant(tuples[row].second->columnValue(column)->toQString(std::string()));
+      if ((size_t)row >= numSpilled)
+        return QVariant(columns[column]->toQString(row - numSpilled));
+      if (SpilledChunk const *chunk = loadChunk(row))
+        return QVariant(cachedColumns[column]->toQString(row - chunk->firstRow));
+      return QVariant();
     case Qt::ToolTipRole:
       // TODO
       return QVariant(QString("Column #") + QString::number(column));
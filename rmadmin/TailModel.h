@@ -1,12 +1,16 @@
 #ifndef TAILMODEL_H_190515
 #define TAILMODEL_H_190515
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <vector>
 #include <QAbstractItemModel>
 #include <QString>
 #include <QStringList>
+#include "TimeRange.h"
 
 /* The model representing lines of tuples, with possibly some tuples skipped
- * in between 2 lines. The model stores *all* tuples and is owned by a
+ * in between 2 lines. The model stores the tuples and is owned by a
  * function, that share it with 0 or several widgets. When the function is
  * the only user then it can, after a while, destroy it to reclaim memory.
  * The function will also delete its counted reference to the TailModel
@@ -17,15 +21,29 @@
  * unsubscribe at destruction), and an unserializing function (or rather, the
  * tuple RamenType).
  *
- * It then receives and stores the tuples, as a pair of event time (for those
- * tuples that have one, or 0) and the unserialized RamenValues.
+ * It then receives and stores the tuples, as their event time (for those
+ * tuples that have one, or 0) and, column by column, their values (see
+ * Column.h).
+ *
+ * To bound the memory used by the tails, the oldest tuples are evicted once
+ * a tail is over its memory budget or when all tails together are over
+ * theirs, or once older than a maximum age. Evicted tuples are either
+ * forgotten, or spilled into a temporary file from which they are read back
+ * whenever needed, so that they are still part of the model, until that
+ * file is itself over budget.
  */
 
+class QTemporaryFile;
+
+class Column;
 struct EventTime;
 struct KValue;
+class TopicSubscription;
+class TupleDecoder;
 struct RamenValue;
 struct RamenType;
 namespace conf {
+  struct Key;
   class Value;
 };
 
@@ -35,13 +53,61 @@ class TailModel : public QAbstractTableModel
 
   std::shared_ptr<EventTime const> eventTime;
 
+  // Tuples are received only while this is alive:
+  std::unique_ptr<TopicSubscription> tailTopic;
+
+  std::unique_ptr<TupleDecoder const> decoder;
+
+  /* Evicted tuples saved in spillFile, in chunks of consecutive rows, that
+   * come before the rows still in memory: */
+  struct SpilledChunk {
+    qint64 offset, size; // in spillFile
+    size_t firstRow, numRows;
+    double minTime, maxTime;
+  };
+  std::vector<SpilledChunk> spilledChunks;
+  size_t numSpilled = 0;
+  // Bytes of spillFile still used by spilledChunks:
+  qint64 spilledBytes = 0;
+  std::unique_ptr<QTemporaryFile> spillFile;
+
+  // The last chunk read back from the spill file (if any):
+  mutable size_t cachedChunk = SIZE_MAX;
+  mutable std::vector<double> cachedTimes;
+  mutable std::vector<std::unique_ptr<Column>> cachedColumns;
+
+  SpilledChunk const *loadChunk(size_t row) const;
+
+  // Evicts from memory the numRows oldest tuples:
+  void evict(size_t numRows);
+
+  /* Forgets about the oldest spilled chunks until the spill file is within
+   * its budget, and then compacts it: */
+  void trimSpilled();
+  void compactSpillFile();
+
+  // How many tuples to evict to use no more than that many bytes:
+  size_t rowsAbove(size_t maxBytes) const;
+
 public:
   QString const fqName;
   QString const workerSign;
   std::string const keyPrefix;
 
-  std::vector<std::pair<double, std::unique_ptr<RamenValue const>>> tuples;
   std::shared_ptr<RamenType const> type;
+
+  /* The event time of each tuple, and all their values column by column,
+   * for the tuples still in memory (the last rowCount() - numSpilled rows): */
+  std::vector<double> times;
+  std::vector<std::unique_ptr<Column>> columns;
+
+  /* Memory budget of each tail and of all tails together, in bytes, and
+   * maximum age of the tuples in seconds of event time (or 0 for no
+   * limit). Whether to spill evicted tuples or forget about them, and the
+   * size budget of the spill file of each tail (or 0 for no limit): */
+  static size_t maxMemory, maxTotMemory, maxSpill;
+  static double maxAge;
+  static bool spill;
   QStringList factors; // supposed to be a list of strings
 
   TailModel(
@@ -55,6 +121,30 @@ public:
 
   std::string subscriberKey() const;
 
+  // Approximate memory used by the tuples still in memory, in bytes:
+  size_t memoryUsage() const;
+
+  // Also counted by rowCount():
+  size_t spilledRows() const { return numSpilled; }
+
+  double timeOf(int row) const;
+
+  /* Calls cb with the columns and row of every tuple within that time range,
+   * from firstRow and before endRow, reading back spilled tuples if
+   * needed: */
+  void iterRows(
+    TimeRange,
+    std::function<void (std::vector<std::unique_ptr<Column>> const &,
+                        size_t row)> cb,
+    size_t firstRow = 0, size_t endRow = SIZE_MAX) const;
+
+  // Evicts tuples from all tails as required by the above limits:
+  static void enforceBudgets();
+
+  // The prefix of the keys of the tuples of that worker:
+  static std::string keyPrefixOf(
+    QString const &fqName, QString const &workerSign);
+
   int rowCount(QModelIndex const &parent = QModelIndex()) const override;
   int columnCount(QModelIndex const &parent = QModelIndex()) const override;
   QVariant data(QModelIndex const &index, int role) const override;
@@ -63,7 +153,7 @@ public:
   bool isFactor(int) const;
 
 protected slots:
-  void addTuple(std::string const &, KValue const &);
+  void addTuple(conf::Key const &, KValue const &);
 };
 
 #endif
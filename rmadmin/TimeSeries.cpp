@@ -14,7 +14,7 @@ QSharedPointer<QCPAxisTickerDateTime> TimeSeries::dateTicker(
 TimeSeries::TimeSeries(Chart *chart_) :
   Graphic(chart_, ChartTypeTimeSeries),
   xMin(std::numeric_limits<double>::max()),
-  xMax(std::numeric_limits<double>::min()),
+  xMax(std::numeric_limits<double>::lowest()),
   yMin(std::numeric_limits<double>::max()),
   yMax(std::numeric_limits<double>::min()),
   xDataset(0),
@@ -31,9 +31,8 @@ TimeSeries::TimeSeries(Chart *chart_) :
   layout->addWidget(plot);
   setLayout(layout);
 
-  // Create graph and assign data to it:
+  // Create graph (the chart will then assign data to it):
   plot->addGraph();
-  setData();
   // Give the axes some labels:
   // TODO: if there are several Y Axis, use a legend instead:
   // Or another graphic kind would have been chosen:
@@ -47,7 +46,7 @@ TimeSeries::TimeSeries(Chart *chart_) :
   plot->setInteractions(QCP::iRangeDrag | QCP::iRangeZoom | QCP::iSelectPlottables);
 
   connect(forceZeroCheckBox, &QCheckBox::stateChanged,
-          this, &TimeSeries::reformat);
+          this, &TimeSeries::replot);
 
   /* TODO:
    * In any case, all this must be editable by the user, so we can start with the
@@ -59,30 +58,58 @@ TimeSeries::TimeSeries(Chart *chart_) :
 }
 
 void TimeSeries::setData()
+{
+  plot->graph(0)->data()->clear();
+  xMin = yMin = std::numeric_limits<double>::max();
+  xMax = yMax = std::numeric_limits<double>::lowest();
+
+  addPoints(&Chart::iterValues);
+}
+
+void TimeSeries::addData()
+{
+  addPoints(&Chart::iterNewValues);
+}
+
+/* The points of the removed rows are removed one by one by their X, so that
+ * the points of other rows (such as past data) within the same range of X
+ * are kept. Rows that were not plotted (see addPoints) are skipped: */
+void TimeSeries::removeData()
+{
+  QSharedPointer<QCPGraphDataContainer> data = plot->graph(0)->data();
+
+  chart->iterRemovedValues([&data, this](
+                             std::vector<std::optional<double>> const &values) {
+    std::optional<double> const x = values[xDataset];
+    if (! x || ! values[y1Dataset]) return;
+    // Removes a single point with exactly that key:
+    data->remove(*x * timeUnit);
+  });
+
+  if (! data->isEmpty()) xMin = data->constBegin()->key;
+}
+
+void TimeSeries::addPoints(Chart::IterFunction iter)
 {
   QVector<double> x, y;
 
-  chart->iterValues([&x, &y, this](std::vector<RamenValue const *> const values) {
-    std::optional<double> v =
-      values[xDataset] != nullptr ? values[xDataset]->toDouble() : std::nullopt;
-    if (v) {
-      double const t = *v * timeUnit;
-      x.append(t);
-      if (t > xMax) xMax = t;
-      if (t < xMin) xMin = t;
-    } // or else what?
-    v =
-      values[y1Dataset] != nullptr ? values[y1Dataset]->toDouble() : std::nullopt;
-    if (v) {
-      y.append(*v);
-      if (*v > yMax) yMax = *v;
-      if (*v < yMin) yMin = *v;
-    } // or else what?
+  (chart->*iter)([&x, &y, this](
+                   std::vector<std::optional<double>> const &values) {
+    std::optional<double> const vx = values[xDataset];
+    std::optional<double> const vy = values[y1Dataset];
+    // A point needs both coordinates, or x and y would get out of step:
+    if (! vx || ! vy) return;
+
+    double const t = *vx * timeUnit;
+    x.append(t);
+    if (t > xMax) xMax = t;
+    if (t < xMin) xMin = t;
+    y.append(*vy);
+    if (*vy > yMax) yMax = *vy;
+    if (*vy < yMin) yMin = *vy;
   });
 
   plot->graph(0)->addData(x, y);
-
-  reformat();
 }
 
 void TimeSeries::reformat()
@@ -97,7 +124,8 @@ void TimeSeries::reformat()
     forceZero ? std::max(0., yMax) : yMax);
 }
 
-void TimeSeries::replot() const
+void TimeSeries::replot()
 {
+  reformat();
   plot->replot();
 }
@@ -1,6 +1,7 @@
 #ifndef TIMESERIES_190925
 #define TIMESERIES_190925
 #include <QSharedPointer>
+#include "Chart.h"
 #include "Graphic.h"
 
 class QCustomPlot;
@@ -51,16 +52,24 @@ class TimeSeries : public Graphic
   // All TimeSeries share the same date ticker:
   static QSharedPointer<QCPAxisTickerDateTime> dateTicker;
 
+  // Add the points given by that Chart iterator:
+  void addPoints(Chart::IterFunction);
+
 public:
   TimeSeries(Chart *);
-  void replot() const;
 
 protected slots:
   /* Internal usage: Keep the same data but update the presentation: */
   void reformat();
 public slots:
-  /* Redraw the plot after some data (or time range) have changed: */
+  /* Reset the data after the time range have changed: */
   void setData();
+  // Add only the new points:
+  void addData();
+  // Remove the points of evicted tail rows, one per plotted row:
+  void removeData();
+  // Redraw the plot (only when the chart asks):
+  void replot();
 };
 
 #endif
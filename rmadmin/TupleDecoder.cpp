@@ -0,0 +1,289 @@
+#include <cassert>
+#include <cstring>
+#include <QDebug>
+#include "Column.h"
+#include "RamenType.h"
+#include "RamenValue.h"
+#include "TupleDecoder.h"
+
+// Returns the number of words required to store that many bytes:
+static size_t roundUpWords(size_t sz)
+{
+  return (sz + 3) >> 2;
+}
+
+static bool bitSet(unsigned char const *nullmask, unsigned null_i)
+{
+  return nullmask[null_i >> 3] & (1U << (null_i & 7));
+}
+
+TupleDecoder::Kind TupleDecoder::kindOfType(RamenType const &type)
+{
+  RamenTypeStructure const *s = type.structure.get();
+
+  if (dynamic_cast<TFloat const *>(s)) return Float;
+  if (dynamic_cast<TBool const *>(s)) return Bool;
+  if (dynamic_cast<TString const *>(s)) return String;
+  if (dynamic_cast<TU8 const *>(s)) return U8;
+  if (dynamic_cast<TU16 const *>(s)) return U16;
+  if (dynamic_cast<TU32 const *>(s)) return U32;
+  if (dynamic_cast<TU64 const *>(s)) return U64;
+  if (dynamic_cast<TU128 const *>(s)) return U128;
+  if (dynamic_cast<TI8 const *>(s)) return I8;
+  if (dynamic_cast<TI16 const *>(s)) return I16;
+  if (dynamic_cast<TI32 const *>(s)) return I32;
+  if (dynamic_cast<TI64 const *>(s)) return I64;
+  if (dynamic_cast<TI128 const *>(s)) return I128;
+  return Other;
+}
+
+/* Must follow the same layout as RamenTypeStructure::unserialize, including
+ * its quirks (such as the width of the nullmask of compound types): */
+TupleDecoder::TupleDecoder(std::shared_ptr<RamenType const> type) :
+  nullmaskWords(0)
+{
+  RamenTypeStructure const *s = type->structure.get();
+
+  // Fields of compound types are the columns, in serialization order:
+  std::vector<std::pair<unsigned, std::shared_ptr<RamenType const>>> fields;
+
+  if (TRecord const *rec = dynamic_cast<TRecord const *>(s)) {
+    nullmaskWords = roundUpWords(rec->nullmaskWidth(true));
+    for (uint16_t idx : rec->serOrder)
+      fields.emplace_back(idx, rec->fields[idx].second);
+  } else if (TTuple const *tup = dynamic_cast<TTuple const *>(s)) {
+    nullmaskWords = roundUpWords(tup->nullmaskWidth(true));
+    for (unsigned idx = 0; idx < tup->fields.size(); idx ++)
+      fields.emplace_back(idx, tup->fields[idx]);
+  } else if (TVec const *vec = dynamic_cast<TVec const *>(s)) {
+    nullmaskWords = roundUpWords(vec->nullmaskWidth(true));
+    for (unsigned idx = 0; idx < vec->dim; idx ++)
+      fields.emplace_back(idx, vec->subType);
+  } else {
+    // Then the whole value is the only column:
+    Kind const kind = kindOfType(*type);
+    columnKinds.push_back(kind);
+    steps.push_back({ kind, -1, 0, kind == Other ? type : nullptr });
+    return;
+  }
+
+  columnKinds.resize(fields.size(), Other);
+  int nullBit = 0;
+  for (auto const &field : fields) {
+    Kind const kind = kindOfType(*field.second);
+    columnKinds[field.first] = kind;
+    steps.push_back({
+      kind, field.second->nullable ? nullBit ++ : -1, field.first,
+      kind == Other ? field.second : nullptr });
+  }
+}
+
+std::vector<std::unique_ptr<Column>> TupleDecoder::makeColumns() const
+{
+  std::vector<std::unique_ptr<Column>> columns;
+  columns.reserve(columnKinds.size());
+
+  for (Kind kind : columnKinds) {
+    switch (kind) {
+      case Float:
+        columns.push_back(std::make_unique<NumColumn<VFloat, double>>());
+        break;
+      case Bool:
+        columns.push_back(std::make_unique<NumColumn<VBool, bool>>());
+        break;
+      case String:
+        columns.push_back(std::make_unique<StringColumn>());
+        break;
+      case U8:
+        columns.push_back(std::make_unique<NumColumn<VU8, uint8_t>>());
+        break;
+      case U16:
+        columns.push_back(std::make_unique<NumColumn<VU16, uint16_t>>());
+        break;
+      case U32:
+        columns.push_back(std::make_unique<NumColumn<VU32, uint32_t>>());
+        break;
+      case U64:
+        columns.push_back(std::make_unique<NumColumn<VU64, uint64_t>>());
+        break;
+      case U128:
+        columns.push_back(std::make_unique<NumColumn<VU128, uint128_t>>());
+        break;
+      case I8:
+        columns.push_back(std::make_unique<NumColumn<VI8, int8_t>>());
+        break;
+      case I16:
+        columns.push_back(std::make_unique<NumColumn<VI16, int16_t>>());
+        break;
+      case I32:
+        columns.push_back(std::make_unique<NumColumn<VI32, int32_t>>());
+        break;
+      case I64:
+        columns.push_back(std::make_unique<NumColumn<VI64, int64_t>>());
+        break;
+      case I128:
+        columns.push_back(std::make_unique<NumColumn<VI128, int128_t>>());
+        break;
+      case Other:
+        columns.push_back(std::make_unique<StringColumn>(true));
+        break;
+    }
+  }
+
+  return columns;
+}
+
+/* Scalars are stored in the lower bytes of as many words as needed: */
+template<class V, class T, unsigned words>
+static bool decodeNum(
+  uint32_t const *&start, uint32_t const *max, Column &column, bool isNull)
+{
+  NumColumn<V, T> &c = static_cast<NumColumn<V, T> &>(column);
+
+  if (isNull) {
+    c.pushNull();
+    return true;
+  }
+
+  if (start + words > max) return false;
+
+  T v;
+  static_assert(sizeof(T) <= words * sizeof(uint32_t));
+  memcpy(&v, start, sizeof(T));
+  start += words;
+
+  c.push(v);
+  return true;
+}
+
+static bool decodeBool(
+  uint32_t const *&start, uint32_t const *max, Column &column, bool isNull)
+{
+  NumColumn<VBool, bool> &c = static_cast<NumColumn<VBool, bool> &>(column);
+
+  if (isNull) {
+    c.pushNull();
+    return true;
+  }
+
+  if (start + 1 > max) return false;
+
+  c.push(!! *start);
+  start += 1;
+  return true;
+}
+
+static bool decodeString(
+  uint32_t const *&start, uint32_t const *max, Column &column, bool isNull)
+{
+  StringColumn &c = static_cast<StringColumn &>(column);
+
+  if (isNull) {
+    c.pushNull();
+    return true;
+  }
+
+  if (start + 1 > max) return false;
+
+  size_t const len = *(start++);
+  size_t const wordLen = roundUpWords(len);
+  if (start + wordLen > max) return false;
+
+  c.push((char const *)start, len);
+  start += wordLen;
+  return true;
+}
+
+static bool decodeOther(
+  uint32_t const *&start, uint32_t const *max, Column &column, bool isNull,
+  RamenType const &type)
+{
+  if (isNull) {
+    column.append(nullptr);
+    return true;
+  }
+
+  std::unique_ptr<RamenValue const> v(
+    type.structure->unserialize(start, max, false));
+  if (! v) return false;
+
+  column.append(v.get());
+  return true;
+}
+
+bool TupleDecoder::decode(
+  uint32_t const *start, uint32_t const *max,
+  std::vector<std::unique_ptr<Column>> &columns) const
+{
+  assert(columns.size() == columnKinds.size());
+  size_t const numRows = columns.empty() ? 0 : columns[0]->size();
+
+  unsigned char const *nullmask = (unsigned char const *)start;
+  start += nullmaskWords;
+
+  bool ok = start <= max;
+
+  for (size_t i = 0; ok && i < steps.size(); i ++) {
+    Step const &step = steps[i];
+    Column &column = *columns[step.column];
+    bool const isNull = step.nullBit >= 0 && ! bitSet(nullmask, step.nullBit);
+
+    switch (step.kind) {
+      case Float:
+        ok = decodeNum<VFloat, double, 2>(start, max, column, isNull);
+        break;
+      case Bool:
+        ok = decodeBool(start, max, column, isNull);
+        break;
+      case String:
+        ok = decodeString(start, max, column, isNull);
+        break;
+      case U8:
+        ok = decodeNum<VU8, uint8_t, 1>(start, max, column, isNull);
+        break;
+      case U16:
+        ok = decodeNum<VU16, uint16_t, 1>(start, max, column, isNull);
+        break;
+      case U32:
+        ok = decodeNum<VU32, uint32_t, 1>(start, max, column, isNull);
+        break;
+      case U64:
+        ok = decodeNum<VU64, uint64_t, 2>(start, max, column, isNull);
+        break;
+      case U128:
+        ok = decodeNum<VU128, uint128_t, 4>(start, max, column, isNull);
+        break;
+      case I8:
+        ok = decodeNum<VI8, int8_t, 1>(start, max, column, isNull);
+        break;
+      case I16:
+        ok = decodeNum<VI16, int16_t, 1>(start, max, column, isNull);
+        break;
+      case I32:
+        ok = decodeNum<VI32, int32_t, 1>(start, max, column, isNull);
+        break;
+      case I64:
+        ok = decodeNum<VI64, int64_t, 2>(start, max, column, isNull);
+        break;
+      case I128:
+        ok = decodeNum<VI128, int128_t, 4>(start, max, column, isNull);
+        break;
+      case Other:
+        ok = decodeOther(start, max, column, isNull, *step.type);
+        break;
+    }
+  }
+
+  if (ok && start != max) {
+    qCritical() << "TupleDecoder: tuple has" << (max - start)
+                << "words in excess";
+    ok = false;
+  }
+
+  if (! ok) {
+    for (std::unique_ptr<Column> &column : columns) column->truncate(numRows);
+    return false;
+  }
+
+  return true;
+}
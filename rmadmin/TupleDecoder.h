@@ -0,0 +1,61 @@
+#ifndef TUPLEDECODER_H_191018
+#define TUPLEDECODER_H_191018
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/* Decodes serialized tuples of a given type straight into Columns (see
+ * Column.h), one column per column of the type.
+ *
+ * Rather than walking the RamenTypeStructure for every tuple, as
+ * RamenTypeStructure::unserialize does, the type is compiled once into a
+ * flat list of steps, one per field in serialization order, telling how to
+ * read that field, where its null bit is and which column it goes to.
+ * Scalar fields are then decoded without any allocation or virtual call.
+ * Fields of other types (compound values, network addresses...) are still
+ * unserialized the slow way and kept as strings. */
+
+class Column;
+struct RamenType;
+
+class TupleDecoder
+{
+  enum Kind {
+    Float, Bool, String,
+    U8, U16, U32, U64, U128,
+    I8, I16, I32, I64, I128,
+    Other // Unserialized into a RamenValue
+  };
+
+  struct Step {
+    Kind kind;
+    int nullBit; // or -1 if the field is not nullable
+    unsigned column;
+    // Only for Other fields:
+    std::shared_ptr<RamenType const> type;
+  };
+
+  // Words to skip before the first field:
+  unsigned nullmaskWords;
+
+  std::vector<Step> steps;
+
+  // The kind of each column, in column order:
+  std::vector<Kind> columnKinds;
+
+  static Kind kindOfType(RamenType const &);
+
+public:
+  TupleDecoder(std::shared_ptr<RamenType const>);
+
+  // The empty columns decode can write into:
+  std::vector<std::unique_ptr<Column>> makeColumns() const;
+
+  /* Appends a row to those columns. Returns false, leaving the columns
+   * untouched, if the tuple cannot be decoded: */
+  bool decode(
+    uint32_t const *start, uint32_t const *max,
+    std::vector<std::unique_ptr<Column>> &) const;
+};
+
+#endif
@@ -1,8 +1,14 @@
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <cstring>
 #include <regex>
+#include <fcntl.h>
+#include <unistd.h>
 #include <QtGlobal>
 #include <QDebug>
-#include <QLinkedList>
+#include <QTimer>
 extern "C" {
 # include <caml/mlvalues.h>
 # include <caml/memory.h>
@@ -14,6 +20,7 @@ extern "C" {
 }
 #include "confValue.h"
 #include "conf.h"
+#include "Diagnostics.h"
 
 static bool const verbose = true;
 
@@ -21,132 +28,438 @@ static bool const verbose = true;
 
 KVStore kvs;
 
+KVStore::Shard &KVStore::shardOf(std::string const &key)
+{
+  return shards[std::hash<std::string>{}(key) % numShards];
+}
+
+KVStore::Shard const &KVStore::shardOf(std::string const &key) const
+{
+  return shards[std::hash<std::string>{}(key) % numShards];
+}
+
+std::shared_ptr<KValue const> KVStore::get(std::string const &key) const
+{
+  Shard const &shard = shardOf(key);
+  std::shared_lock<std::shared_mutex> guard(shard.lock);
+  auto it = shard.map.find(key);
+  return it == shard.map.end() ? nullptr : it->second;
+}
+
+void KVStore::forEach(
+  std::function<void(std::string const &,
+                     std::shared_ptr<KValue const>)> f) const
+{
+  for (Shard const &shard : shards) {
+    // Call f without the lock so that it can look up other keys:
+    std::vector<std::pair<std::string, std::shared_ptr<KValue const>>> copy;
+    {
+      std::shared_lock<std::shared_mutex> guard(shard.lock);
+      copy.assign(shard.map.begin(), shard.map.end());
+    }
+    for (auto const &p : copy) f(p.first, p.second);
+  }
+}
+
+std::shared_ptr<KValue const> KVStore::insert(
+  std::string const &key, KValue const &kv)
+{
+  std::shared_ptr<KValue const> snapshot = std::make_shared<KValue const>(kv);
+  Shard &shard = shardOf(key);
+  std::unique_lock<std::shared_mutex> guard(shard.lock);
+  return shard.map.emplace(key, snapshot).second ? snapshot : nullptr;
+}
+
+std::shared_ptr<KValue const> KVStore::update(
+  std::string const &key, std::function<void(KValue &)> f)
+{
+  Shard &shard = shardOf(key);
+  std::unique_lock<std::shared_mutex> guard(shard.lock);
+  auto it = shard.map.find(key);
+  if (it == shard.map.end()) return nullptr;
+  // Only the sync thread modifies values, so f can be called with the lock:
+  std::shared_ptr<KValue> snapshot = std::make_shared<KValue>(*it->second);
+  f(*snapshot);
+  it->second = snapshot;
+  return snapshot;
+}
+
+std::shared_ptr<KValue const> KVStore::erase(std::string const &key)
+{
+  Shard &shard = shardOf(key);
+  std::unique_lock<std::shared_mutex> guard(shard.lock);
+  auto it = shard.map.find(key);
+  if (it == shard.map.end()) return nullptr;
+  std::shared_ptr<KValue const> last = it->second;
+  shard.map.erase(it);
+  return last;
+}
+
+KVSubscriber const *KVStore::subscribeKey(std::string const &key)
+{
+  std::lock_guard<std::mutex> guard(subscriptionsLock);
+  std::unique_ptr<KVSubscriber> &s = keySubscribers[key];
+  if (! s) s = std::make_unique<KVSubscriber>();
+  return s.get();
+}
+
+KVSubscriber const *KVStore::subscribePrefix(std::string const &prefix)
+{
+  std::lock_guard<std::mutex> guard(subscriptionsLock);
+  PrefixNode *node = &prefixSubscribers;
+  for (char const c : prefix) {
+    std::unique_ptr<PrefixNode> &child = node->children[c];
+    if (! child) child = std::make_unique<PrefixNode>();
+    node = child.get();
+  }
+  if (! node->subscriber) node->subscriber = std::make_unique<KVSubscriber>();
+  return node->subscriber.get();
+}
+
+std::vector<KVSubscriber const *> KVStore::subscribersOf(std::string const &key)
+{
+  std::vector<KVSubscriber const *> subscribers;
+  std::lock_guard<std::mutex> guard(subscriptionsLock);
+
+  auto it = keySubscribers.find(key);
+  if (it != keySubscribers.end()) subscribers.push_back(it->second.get());
+
+  PrefixNode const *node = &prefixSubscribers;
+  if (node->subscriber) subscribers.push_back(node->subscriber.get());
+  for (char const c : key) {
+    auto child = node->children.find(c);
+    if (child == node->children.end()) break;
+    node = child->second.get();
+    if (node->subscriber) subscribers.push_back(node->subscriber.get());
+  }
+
+  return subscribers;
+}
+
+void KVStore::signalChange(Change const &c)
+{
+  std::vector<KVSubscriber const *> const subscribers(subscribersOf(c.key->s));
+  conf::Key const &key = *c.key;
+  KValue const &kv = *c.snapshot;
+
+  switch (c.kind) {
+#   define SIGNAL(kind, signal) \
+      case kind: \
+        emit signal(key, kv); \
+        for (KVSubscriber const *s : subscribers) emit s->signal(key, kv); \
+        break
+    SIGNAL(Created, valueCreated);
+    SIGNAL(Changed, valueChanged);
+    SIGNAL(Locked, valueLocked);
+    SIGNAL(Unlocked, valueUnlocked);
+    SIGNAL(Deleted, valueDeleted);
+#   undef SIGNAL
+  }
+}
+
+void KVStore::queueChange(
+  ChangeKind kind, std::shared_ptr<conf::Key const> key,
+  std::shared_ptr<KValue const> snapshot)
+{
+  /* Every tuple matters, such as the successive results of a replay set
+   * into the same response key: */
+  bool const keepAll =
+    dynamic_cast<conf::Tuple const *>(snapshot->val.get()) != nullptr;
+
+  std::lock_guard<std::mutex> guard(batchLock);
+
+  if (batch.empty()) batchStart.start();
+  batch.add(kind, key, snapshot, keepAll);
+
+  if (! deliveryScheduled) {
+    deliveryScheduled = true;
+    // This is called from the sync thread but kvs lives in the GUI thread:
+    QMetaObject::invokeMethod(this, "scheduleDelivery", Qt::QueuedConnection);
+  }
+}
+
+void KVStore::scheduleDelivery()
+{
+  qint64 delay = 0;
+  if (lastDelivery.isValid())
+    delay = std::max<qint64>(0, frameDuration - lastDelivery.elapsed());
+  QTimer::singleShot(delay, this, &KVStore::deliverBatch);
+}
+
+void KVStore::deliverBatch()
+{
+  std::vector<Change> changes;
+  qint64 latency = 0;
+  {
+    std::lock_guard<std::mutex> guard(batchLock);
+    if (! batch.empty()) latency = batchStart.elapsed();
+    changes = batch.take();
+    /* Changes queued from now on will be part of the next batch, delivered
+     * no sooner than a frame from now: */
+    deliveryScheduled = false;
+  }
+  lastDelivery.start();
+
+  deliveryStats.numBatches ++;
+  deliveryStats.numChanges += changes.size();
+  deliveryStats.maxBatchSize =
+    std::max(deliveryStats.maxBatchSize, changes.size());
+  deliveryStats.maxLatency = std::max(deliveryStats.maxLatency, latency);
+
+  if (verbose)
+    qDebug() << "Delivering a batch of" << changes.size() << "changes";
+
+  ScopedTimer timer(diagnostics.batchDelivery);
+
+  for (Change const &c : changes) signalChange(c);
+
+  /* Now that their deletion is known to every receivers, the deleted keys
+   * can be forgotten (if they were not re-created since): */
+  std::unordered_map<conf::Key const *, std::shared_ptr<conf::Key const>>
+    deleted;
+  for (Change const &c : changes) {
+    if (c.kind == Deleted) deleted[c.key.get()] = c.key;
+    else deleted.erase(c.key.get());
+  }
+  changes.clear();
+  for (auto const &p : deleted) conf::Key::forget(p.second);
+
+  emit batchDelivered();
+}
+
 struct ConfRequest {
-  enum Action { New, Set, Lock, LockOrCreate, Unlock, Del } action;
+  enum Action {
+    New, Set, Lock, LockOrCreate, Unlock, Del, Subscribe, Unsubscribe
+  } action;
   std::string const key;
   std::optional<std::shared_ptr<conf::Value const>> value;
+  ConfRequest *next;  // Next older request in pendingRequests
 };
 
-// The ZMQ thread will pop and execute those:
-QLinkedList<ConfRequest> pending_requests;
+/* The ZMQ thread will pop and execute those.
+ * Any thread can push requests, which are chained from the most recent one
+ * (lock-free Treiber stack). The sync thread takes them all at once and
+ * therefore never competes with the producers but for a single exchange: */
+static std::atomic<ConfRequest *> pendingRequests(nullptr);
+
+/* The sync thread waits for messages from the server or for a byte on that
+ * pipe, which is written whenever a request is pushed onto an empty
+ * pendingRequests, so that requests do not have to wait for the receive
+ * timeout. A pipe is used rather than an eventfd for portability: */
+static int wakeUpFds[2] = { -1, -1 };
+static std::once_flag wakeUpInit;
+
+static void initWakeUp()
+{
+  std::call_once(wakeUpInit, []() {
+    if (0 != pipe(wakeUpFds)) {
+      qCritical() << "Cannot create the wake-up pipe:" << strerror(errno);
+      return;
+    }
+    for (int fd : wakeUpFds)
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  });
+}
+
+void wakeUpSync()
+{
+  initWakeUp();
+  char const c = 0;
+  /* If the pipe is full then the sync thread is going to wake up anyway,
+   * so errors can be ignored: */
+  if (write(wakeUpFds[1], &c, 1) < 0 && errno != EAGAIN)
+    qCritical() << "Cannot wake up the sync thread:" << strerror(errno);
+}
+
+static void pushRequest(
+  ConfRequest::Action action, std::string const &key,
+  std::optional<std::shared_ptr<conf::Value const>> value =
+    std::optional<std::shared_ptr<conf::Value const>>())
+{
+  ConfRequest *req = new ConfRequest { action, key, value, nullptr };
+  ConfRequest *head = pendingRequests.load(std::memory_order_relaxed);
+  do {
+    req->next = head;
+  } while (! pendingRequests.compare_exchange_weak(
+               head, req,
+               std::memory_order_release, std::memory_order_relaxed));
+  /* If there were already some pending requests then the sync thread has
+   * already been woken up: */
+  if (! head) wakeUpSync();
+}
+
+static value ocamlOfRequest(ConfRequest const &cr)
+{
+  CAMLparam0();
+  CAMLlocal1(req);
+  switch (cr.action) {
+    case ConfRequest::New:
+      if (verbose)
+        qDebug() << "...a New for" << QString::fromStdString(cr.key) << "="
+                 << (*cr.value)->toQString(cr.key);
+      req = caml_alloc(2, 0);
+      Store_field(req, 0, caml_copy_string(cr.key.c_str()));
+      Store_field(req, 1, (*cr.value)->toOCamlValue());
+      break;
+    case ConfRequest::Set:
+      if (verbose)
+        qDebug() << "...a Set for" << QString::fromStdString(cr.key) << "="
+                 << (*cr.value)->toQString(cr.key);
+      req = caml_alloc(2, 1);
+      Store_field(req, 0, caml_copy_string(cr.key.c_str()));
+      Store_field(req, 1, (*cr.value)->toOCamlValue());
+      break;
+    case ConfRequest::Lock:
+      if (verbose)
+        qDebug() << "...a Lock for" << QString::fromStdString(cr.key);
+      req = caml_alloc(1, 2);
+      Store_field(req, 0, caml_copy_string(cr.key.c_str()));
+      break;
+    case ConfRequest::LockOrCreate:
+      if (verbose)
+        qDebug() << "...a LockOrCreate for" << QString::fromStdString(cr.key);
+      req = caml_alloc(1, 3);
+      Store_field(req, 0, caml_copy_string(cr.key.c_str()));
+      break;
+    case ConfRequest::Unlock:
+      if (verbose)
+        qDebug() << "...an Unlock for" << QString::fromStdString(cr.key);
+      req = caml_alloc(1, 4);
+      Store_field(req, 0, caml_copy_string(cr.key.c_str()));
+      break;
+    case ConfRequest::Del:
+      if (verbose)
+        qDebug() << "...a Del for" << QString::fromStdString(cr.key);
+      req = caml_alloc(1, 5);
+      Store_field(req, 0, caml_copy_string(cr.key.c_str()));
+      break;
+    case ConfRequest::Subscribe:
+      if (verbose)
+        qDebug() << "...a Subscribe to" << QString::fromStdString(cr.key);
+      req = caml_alloc(1, 6);
+      Store_field(req, 0, caml_copy_string(cr.key.c_str()));
+      break;
+    case ConfRequest::Unsubscribe:
+      if (verbose)
+        qDebug() << "...an Unsubscribe from" << QString::fromStdString(cr.key);
+      req = caml_alloc(1, 7);
+      Store_field(req, 0, caml_copy_string(cr.key.c_str()));
+      break;
+  }
+  CAMLreturn(req);
+}
 
 extern "C" {
-  // This _does_ alloc on the OCaml heap but is called from OCaml thread
-  value next_pending_request()
+  // Returns the file descriptor the sync thread must wait on:
+  value wake_up_fd()
   {
     CAMLparam0();
-    CAMLlocal1(req);
-    if (pending_requests.isEmpty()) {
-      req = Val_int(0); // NoReq
-    } else {
-      if (verbose)
-        qDebug() << "Popping a pending request...";
-      ConfRequest cr = pending_requests.takeFirst();
-      switch (cr.action) {
-        case ConfRequest::New:
-          if (verbose)
-            qDebug() << "...a New for" << QString::fromStdString(cr.key) << "="
-                     << (*cr.value)->toQString(cr.key);
-          req = caml_alloc(2, 0);
-          Store_field(req, 0, caml_copy_string(cr.key.c_str()));
-          Store_field(req, 1, (*cr.value)->toOCamlValue());
-          break;
-        case ConfRequest::Set:
-          if (verbose)
-            qDebug() << "...a Set for" << QString::fromStdString(cr.key) << "="
-                     << (*cr.value)->toQString(cr.key);
-          req = caml_alloc(2, 1);
-          Store_field(req, 0, caml_copy_string(cr.key.c_str()));
-          Store_field(req, 1, (*cr.value)->toOCamlValue());
-          break;
-        case ConfRequest::Lock:
-          if (verbose)
-            qDebug() << "...a Lock for" << QString::fromStdString(cr.key);
-          req = caml_alloc(1, 2);
-          Store_field(req, 0, caml_copy_string(cr.key.c_str()));
-          break;
-        case ConfRequest::LockOrCreate:
-          if (verbose)
-            qDebug() << "...a LockOrCreate for" << QString::fromStdString(cr.key);
-          req = caml_alloc(1, 3);
-          Store_field(req, 0, caml_copy_string(cr.key.c_str()));
-          break;
-        case ConfRequest::Unlock:
-          if (verbose)
-            qDebug() << "...an Unlock for" << QString::fromStdString(cr.key);
-          req = caml_alloc(1, 4);
-          Store_field(req, 0, caml_copy_string(cr.key.c_str()));
-          break;
-        case ConfRequest::Del:
-          if (verbose)
-            qDebug() << "...a Del for" << QString::fromStdString(cr.key);
-          req = caml_alloc(1, 5);
-          Store_field(req, 0, caml_copy_string(cr.key.c_str()));
-          break;
-      }
+    initWakeUp();
+    CAMLreturn(Val_int(wakeUpFds[0]));
+  }
+
+  /* Returns all the pending requests, oldest first.
+   * This _does_ alloc on the OCaml heap but is called from OCaml thread */
+  value next_pending_requests()
+  {
+    CAMLparam0();
+    CAMLlocal3(reqs, req, cons);
+
+    /* Empty the pipe before taking the requests, so that a request pushed
+     * in between cannot be left behind without having woken us up: */
+    initWakeUp();
+    char buf[64];
+    while (read(wakeUpFds[0], buf, sizeof(buf)) > 0) ;
+
+    ConfRequest *cr = pendingRequests.exchange(nullptr, std::memory_order_acquire);
+
+    /* Requests are chained from the most recent one, so consing them as
+     * they come gives the list in the order they were requested: */
+    reqs = Val_emptylist;
+    unsigned count = 0;
+    while (cr) {
+      req = ocamlOfRequest(*cr);
+      cons = caml_alloc(2, 0);
+      Store_field(cons, 0, req);
+      Store_field(cons, 1, reqs);
+      reqs = cons;
+      ConfRequest *next = cr->next;
+      delete cr;
+      cr = next;
+      count ++;
     }
-    CAMLreturn(req);
+
+    if (verbose && count > 0)
+      qDebug() << "Popped" << count << "pending requests";
+
+    CAMLreturn(reqs);
   }
 }
 
 void askNew(std::string const &key, std::shared_ptr<conf::Value const> val)
 {
-  ConfRequest req = {
-    .action = ConfRequest::New,
-    .key = key,
-    .value = val
-  };
-  pending_requests.push_back(req);
+  pushRequest(ConfRequest::New, key, val);
 }
 
 void askSet(std::string const &key, std::shared_ptr<conf::Value const> val)
 {
-  ConfRequest req = {
-    .action = ConfRequest::Set,
-    .key = key,
-    .value = val
-  };
-  pending_requests.push_back(req);
+  pushRequest(ConfRequest::Set, key, val);
 }
 
 void askLock(std::string const &key)
 {
-  ConfRequest req = {
-    .action = ConfRequest::Lock,
-    .key = key,
-    .value = std::optional<std::shared_ptr<conf::Value const>>()
-  };
-  pending_requests.push_back(req);
+  pushRequest(ConfRequest::Lock, key);
 }
 
 void askUnlock(std::string const &key)
 {
-  ConfRequest req = {
-    .action = ConfRequest::Unlock,
-    .key = key,
-    .value = std::optional<std::shared_ptr<conf::Value const>>()
-  };
-  pending_requests.push_back(req);
+  pushRequest(ConfRequest::Unlock, key);
 }
 
 void askDel(std::string const &key)
 {
-  ConfRequest req = {
-    .action = ConfRequest::Del,
-    .key = key,
-    .value = std::optional<std::shared_ptr<conf::Value const>>()
-  };
-  pending_requests.push_back(req);
+  pushRequest(ConfRequest::Del, key);
+}
+
+// Number of subscribers per topic:
+static std::mutex topicsLock;
+static std::unordered_map<std::string, unsigned> topics;
+
+void subscribeTopic(std::string const &topic)
+{
+  std::lock_guard<std::mutex> guard(topicsLock);
+  if (1 == ++topics[topic])
+    pushRequest(ConfRequest::Subscribe, topic);
+}
+
+void unsubscribeTopic(std::string const &topic)
+{
+  std::lock_guard<std::mutex> guard(topicsLock);
+  auto it = topics.find(topic);
+  if (it == topics.end()) {
+    qCritical() << "Unsubscribing from unknown topic"
+                << QString::fromStdString(topic);
+    return;
+  }
+  if (0 == --it->second) {
+    topics.erase(it);
+    pushRequest(ConfRequest::Unsubscribe, topic);
+  }
 }
 
 #include <cassert>
 extern "C" {
 #  include <caml/custom.h>
 #  include <caml/startup.h>
+#  include <caml/signals.h>
 #  undef alloc
 
   /*
-   * Called at reception of commands from the server:
+   * Called at reception of commands from the server.
+   *
+   * Once everything has been copied out of the OCaml values, the OCaml
+   * runtime is released while the store is updated, so that the GUI thread
+   * can use it meanwhile (see RamenValue::ofQString):
    */
 
   value conf_new_key(value k_, value v_, value u_, value mt_, value cw_, value cd_,
@@ -154,6 +467,7 @@ extern "C" {
   {
     CAMLparam5(k_, v_, u_, mt_, cw_);
     CAMLxparam3(cd_, o_, ex_);
+    ScopedTimer timer(diagnostics.confNewKey);
     std::string const k(String_val(k_));
     std::shared_ptr<conf::Value> v(conf::valueOfOCaml(v_));
     QString u(String_val(u_));
@@ -164,32 +478,31 @@ extern "C" {
     if (verbose) qDebug() << "New key" << QString::fromStdString(k)
                           << "with value" << *v;
 
-    kvs.lock.lock();
-
-    auto emplaced =
-      kvs.map.emplace(std::piecewise_construct,
-                      std::forward_as_tuple(k),
-                      std::forward_as_tuple(v, u, mt, cw, cd));
-
-    auto map_it = emplaced.first;
-    std::string const &key = map_it->first;
-    KValue &kv = map_it->second;
-    bool const isNew = emplaced.second;
-
-    if (! isNew)
-      /* Not supposed to happen but better safe than sorry: */
-      qCritical() << "Supposedly new key" << QString::fromStdString(key) << "is not new!";
-
-    emit kvs.valueCreated(key, kv);
-
+    KValue kv(v, u, mt, cw, cd);
     if (caml_string_length(o_) > 0) {
       QString o(String_val(o_));
       double ex(Double_val(ex_));
       kv.setLock(o, ex);
-      emit kvs.valueLocked(key, kv);
     }
 
-    kvs.lock.unlock();
+    caml_enter_blocking_section();
+
+    std::shared_ptr<KValue const> snapshot = kvs.insert(k, kv);
+    if (! snapshot) {
+      /* Not supposed to happen but better safe than sorry: */
+      qCritical() << "Supposedly new key" << QString::fromStdString(k) << "is not new!";
+      snapshot = kvs.update(k, [&kv](KValue &old) { old = kv; });
+    }
+
+    /* Changes are queued once the value is in the store, without holding
+     * any lock: */
+    std::shared_ptr<conf::Key const> key = conf::Key::intern(k);
+    diagnostics.countMessage(*key);
+    kvs.queueChange(KVStore::Created, key, snapshot);
+    if (snapshot->isLocked()) kvs.queueChange(KVStore::Locked, key, snapshot);
+
+    caml_leave_blocking_section();
+
     CAMLreturn(Val_unit);
   }
 
@@ -201,6 +514,7 @@ extern "C" {
   value conf_set_key(value k_, value v_, value u_, value mt_)
   {
     CAMLparam4(k_, v_, u_, mt_);
+    ScopedTimer timer(diagnostics.confSetKey);
     std::string k(String_val(k_));
     std::shared_ptr<conf::Value> v(conf::valueOfOCaml(v_));
     QString u(String_val(u_));
@@ -209,44 +523,52 @@ extern "C" {
     if (verbose) qDebug() << "Set key" << QString::fromStdString(k)
                           << "to value" << *v;
 
-    kvs.lock.lock();
+    caml_enter_blocking_section();
 
-    auto it = kvs.map.find(k);
-    if (it == kvs.map.end()) {
+    std::shared_ptr<KValue const> snapshot =
+      kvs.update(k, [&v, &u, mt](KValue &kv) { kv.set(v, u, mt); });
+    if (! snapshot) {
       qCritical() << "!!! Setting unknown key" << QString::fromStdString(k);
     } else {
-      it->second.set(v, u, mt);
-      emit kvs.valueChanged(it->first, it->second);
+      std::shared_ptr<conf::Key const> key = conf::Key::intern(k);
+      diagnostics.countMessage(*key);
+      kvs.queueChange(KVStore::Changed, key, snapshot);
     }
 
-    kvs.lock.unlock();
+    caml_leave_blocking_section();
+
     CAMLreturn(Val_unit);
   }
 
   value conf_del_key(value k_)
   {
     CAMLparam1(k_);
+    ScopedTimer timer(diagnostics.confDelKey);
     std::string k(String_val(k_));
 
     if (verbose) qDebug() << "Del key" << QString::fromStdString(k);
 
-    kvs.lock.lock();
+    caml_enter_blocking_section();
 
-    auto it = kvs.map.find(k);
-    if (it == kvs.map.end()) {
+    std::shared_ptr<KValue const> last = kvs.erase(k);
+    if (! last) {
       qCritical() << "!!! Deleting unknown key" << QString::fromStdString(k);
     } else {
-      emit kvs.valueDeleted(it->first, it->second);
-      kvs.map.erase(it);
+      std::shared_ptr<conf::Key const> key = conf::Key::intern(k);
+      diagnostics.countMessage(*key);
+      // The Key is forgotten once that change is delivered:
+      kvs.queueChange(KVStore::Deleted, key, last);
     }
 
-    kvs.lock.unlock();
+    caml_leave_blocking_section();
+
     CAMLreturn(Val_unit);
   }
 
   value conf_lock_key(value k_, value o_, value ex_)
   {
     CAMLparam3(k_, o_, ex_);
+    ScopedTimer timer(diagnostics.confLockKey);
     std::string k(String_val(k_));
     assert(caml_string_length(o_) > 0);
     QString o(String_val(o_));
@@ -254,38 +576,45 @@ extern "C" {
 
     if (verbose) qDebug() << "Lock key" << QString::fromStdString(k);
 
-    kvs.lock.lock();
+    caml_enter_blocking_section();
 
-    auto it = kvs.map.find(k);
-    if (it == kvs.map.end()) {
+    std::shared_ptr<KValue const> snapshot =
+      kvs.update(k, [&o, ex](KValue &kv) { kv.setLock(o, ex); });
+    if (! snapshot) {
       qCritical() << "!!! Locking unknown key" << QString::fromStdString(k);
     } else {
-      it->second.setLock(o, ex);
-      emit kvs.valueLocked(it->first, it->second);
+      std::shared_ptr<conf::Key const> key = conf::Key::intern(k);
+      diagnostics.countMessage(*key);
+      kvs.queueChange(KVStore::Locked, key, snapshot);
     }
 
-    kvs.lock.unlock();
+    caml_leave_blocking_section();
+
     CAMLreturn(Val_unit);
   }
 
   value conf_unlock_key(value k_)
   {
     CAMLparam1(k_);
+    ScopedTimer timer(diagnostics.confUnlockKey);
     std::string k(String_val(k_));
 
     if (verbose) qDebug() << "Unlock key" << QString::fromStdString(k);
 
-    kvs.lock.lock();
+    caml_enter_blocking_section();
 
-    auto it = kvs.map.find(k);
-    if (it == kvs.map.end()) {
+    std::shared_ptr<KValue const> snapshot =
+      kvs.update(k, [](KValue &kv) { kv.setUnlock(); });
+    if (! snapshot) {
       qCritical() << "!!! Unlocking unknown key" << QString::fromStdString(k);
     } else {
-      it->second.setUnlock();
-      emit kvs.valueUnlocked(it->first, it->second);
+      std::shared_ptr<conf::Key const> key = conf::Key::intern(k);
+      diagnostics.countMessage(*key);
+      kvs.queueChange(KVStore::Unlocked, key, snapshot);
     }
 
-    kvs.lock.unlock();
+    caml_leave_blocking_section();
+
     CAMLreturn(Val_unit);
   }
 }
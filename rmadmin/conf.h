@@ -1,30 +1,164 @@
 #ifndef CONF_H_190504
 #define CONF_H_190504
+#include <array>
 #include <string>
 #include <memory>
 #include <functional>
 #include <optional>
 #include <shared_mutex>
+#include <mutex>
 #include <map>
+#include <unordered_map>
+#include <vector>
 #include <QString>
 #include <QObject>
+#include <QElapsedTimer>
+#include "ChangeBatch.h"
+#include "confKey.h"
 #include "KValue.h"
-#include "rec_shared_mutex.h"
+
+/* Emits the changes of only some keys (see KVStore::subscribeKey and
+ * KVStore::subscribePrefix), so that receivers that are interested in a
+ * single key or a single subtree do not have to be notified of, and filter
+ * out, every other change: */
+class KVSubscriber : public QObject
+{
+  Q_OBJECT
+
+signals:
+  void valueCreated(conf::Key const &, KValue const &) const;
+  void valueChanged(conf::Key const &, KValue const &) const;
+  void valueLocked(conf::Key const &, KValue const &) const;
+  void valueUnlocked(conf::Key const &, KValue const &) const;
+  void valueDeleted(conf::Key const &, KValue const &) const;
+};
 
 class KVStore : public QObject
 {
   Q_OBJECT
 
+  /* Subscribers per key and per key prefix, created on demand and never
+   * deleted. Prefixes are stored in a trie indexed by character, so that
+   * finding all the prefixes of a key takes time proportional to the
+   * length of the key, whatever the number of subscribers: */
+  struct PrefixNode {
+    std::map<char, std::unique_ptr<PrefixNode>> children;
+    std::unique_ptr<KVSubscriber> subscriber;
+  };
+
+  std::mutex subscriptionsLock;
+  std::unordered_map<std::string, std::unique_ptr<KVSubscriber>> keySubscribers;
+  PrefixNode prefixSubscribers;
+
+  /* Returns all the subscribers interested in that key. Signals are then
+   * emitted without the subscriptionsLock, so that receivers can subscribe
+   * from their slots: */
+  std::vector<KVSubscriber const *> subscribersOf(std::string const &);
+
+  /* The values are spread over several shards, each with its own lock, and
+   * are never modified in place: a change replaces the value by a new
+   * snapshot. Readers therefore hold a shard lock only for as long as it
+   * takes to copy a shared pointer, and can then use their snapshot at
+   * leisure while the sync thread carries on with other changes: */
+  static unsigned const numShards = 64;
+
+  struct Shard {
+    mutable std::shared_mutex lock;
+    std::unordered_map<std::string, std::shared_ptr<KValue const>> map;
+  };
+
+  std::array<Shard, numShards> shards;
+
+  Shard &shardOf(std::string const &);
+  Shard const &shardOf(std::string const &) const;
+
+public:
+  enum ChangeKind { Created, Changed, Locked, Unlocked, Deleted };
+
+private:
+  /* Changes are not signalled as soon as the sync thread performs them, but
+   * accumulated into a batch that is delivered to the GUI thread at most
+   * once per frame (see ChangeBatch.h for how changes are merged): */
+  typedef ChangeBatch<ChangeKind, conf::Key, KValue>::Change Change;
+
+  std::mutex batchLock;
+  ChangeBatch<ChangeKind, conf::Key, KValue> batch;
+  bool deliveryScheduled = false;
+  // When the first change of the current batch was queued:
+  QElapsedTimer batchStart;
+
+  // Only ever used from the GUI thread:
+  QElapsedTimer lastDelivery;
+
+  /* Emit a change both to every receivers of the signals below and to the
+   * receivers of the relevant subscribers: */
+  void signalChange(Change const &);
+
+private slots:
+  void scheduleDelivery();
+  void deliverBatch();
+
 public:
-  std::map<std::string const, KValue> map;
-  rec_shared_mutex lock;
+  // Minimum time between two deliveries, in milliseconds:
+  static int const frameDuration = 16;
+
+  /* How much work is waiting for the GUI thread, for diagnostics.
+   * Only ever accessed from the GUI thread: */
+  struct DeliveryStats {
+    unsigned long numBatches = 0;
+    unsigned long numChanges = 0;
+    size_t maxBatchSize = 0;
+    // Longest time a change waited before being delivered, in milliseconds:
+    qint64 maxLatency = 0;
+  } deliveryStats;
+
+  // Returns a snapshot of the value of that key, or nullptr:
+  std::shared_ptr<KValue const> get(std::string const &) const;
+
+  /* Calls f for every key, in no particular order, on the snapshots taken
+   * when reaching each shard: */
+  void forEach(
+    std::function<void(std::string const &,
+                       std::shared_ptr<KValue const>)>) const;
 
+  /* Modifications, performed by the sync thread only (see conf.cpp).
+   * They return the new snapshot, or nullptr if the key was already present
+   * (for insert) or missing (for the others): */
+  std::shared_ptr<KValue const> insert(std::string const &, KValue const &);
+  std::shared_ptr<KValue const> update(
+    std::string const &, std::function<void(KValue &)>);
+  // Returns the last snapshot:
+  std::shared_ptr<KValue const> erase(std::string const &);
+
+  /* Return the object emitting the changes of that key (resp. of all the
+   * keys starting with that prefix). The same object is returned for the
+   * same key (resp. prefix), so that one can disconnect from it: */
+  KVSubscriber const *subscribeKey(std::string const &);
+  KVSubscriber const *subscribePrefix(std::string const &);
+
+  /* Add a change to the next batch, from the sync thread, once the store
+   * has been updated (snapshot being the value after the change, or the
+   * last value for Deleted): */
+  void queueChange(
+    ChangeKind, std::shared_ptr<conf::Key const>,
+    std::shared_ptr<KValue const>);
+
+  /* Those are emitted for every key. Receivers that are interested in only
+   * a few keys should rather connect to a subscriber.
+   * Since they are all emitted from the GUI thread, receivers living in that
+   * thread are called directly and nothing is copied.
+   * Receivers can take either the interned conf::Key, or just its name as a
+   * std::string const &: */
 signals:
-  void valueCreated(std::string const &, KValue const &) const;
-  void valueChanged(std::string const &, KValue const &) const;
-  void valueLocked(std::string const &, KValue const &) const;
-  void valueUnlocked(std::string const &, KValue const &) const;
-  void valueDeleted(std::string const &, KValue const &) const;
+  void valueCreated(conf::Key const &, KValue const &) const;
+  void valueChanged(conf::Key const &, KValue const &) const;
+  void valueLocked(conf::Key const &, KValue const &) const;
+  void valueUnlocked(conf::Key const &, KValue const &) const;
+  void valueDeleted(conf::Key const &, KValue const &) const;
+
+  /* Emitted once all the changes of a batch have been signalled, so that
+   * models can defer their own notifications until then: */
+  void batchDelivered() const;
 };
 
 extern KVStore kvs;
@@ -39,6 +173,40 @@ void askLock(std::string const &);
 void askUnlock(std::string const &);
 void askDel(std::string const &);
 
+/* The sync thread receives only the keys matching some base topics (see
+ * base_topics in GuiHelper.ml) and the topics (globs over key names) that
+ * are currently subscribed to using those functions.
+ * Subscriptions are counted, so that several widgets can share a topic that
+ * is unsubscribed only once the last of them is gone. The keys that are no
+ * longer subscribed to are then deleted from the store: */
+void subscribeTopic(std::string const &);
+void unsubscribeTopic(std::string const &);
+
+// Subscribes to a topic for the lifetime of that object:
+class TopicSubscription
+{
+  std::string const topic;
+
+public:
+  TopicSubscription(std::string const &topic_) : topic(topic_)
+  {
+    subscribeTopic(topic);
+  }
+
+  ~TopicSubscription()
+  {
+    unsubscribeTopic(topic);
+  }
+
+  TopicSubscription(TopicSubscription const &) = delete;
+  TopicSubscription &operator=(TopicSubscription const &) = delete;
+};
+
+/* Those requests are executed by the sync thread, that is woken up as soon
+ * as one is queued. This can also be called directly to have the sync thread
+ * check for anything else, such as the quit flag: */
+void wakeUpSync();
+
 Q_DECLARE_METATYPE(std::string); // To serialize the keys above
 
 #endif
@@ -0,0 +1,85 @@
+#include <cassert>
+#include <mutex>
+#include <unordered_map>
+#include <QRegularExpression>
+#include "confKey.h"
+
+namespace conf {
+
+Key::Key(std::string const &s_) :
+  s(s_),
+  qs(QString::fromStdString(s_)),
+  names(qs.split('/', QString::SkipEmptyParts)),
+  isSiteKey(false)
+{
+  if (! names.count()) return;
+  if (names[0] != "sites") {
+    family = names[0];
+    return;
+  }
+
+  static QRegularExpression re(
+    "^sites/(?<site>[^/]+)/"
+    "("
+      "workers/(?<program>.+)/"
+      "(?<function>[^/]+)/"
+      "(?<function_property>"
+        "worker|"
+        "stats/runtime|"
+        "archives/(times|num_files|current_size|alloc_size)|"
+        "instances/(?<signature>[^/]+)/(?<instance_property>[^/]+)"
+      ")"
+    "|"
+      "(?<site_property>is_master)"
+    ")$"
+    ,
+    QRegularExpression::DontCaptureOption
+  );
+  assert(re.isValid());
+  QRegularExpressionMatch match = re.match(qs);
+  isSiteKey = match.hasMatch();
+  if (isSiteKey) {
+    site = match.captured("site");
+    program = match.captured("program");
+    function = match.captured("function");
+    // Try the deepest first:
+    instanceSignature = match.captured("signature");
+    if (instanceSignature.isNull()) {
+      property = match.captured("function_property");
+    } else {
+      property = match.captured("instance_property");
+    }
+    if (property.isNull()) {
+      property = match.captured("site_property");
+    }
+    family =
+      function.isEmpty() ? "sites/*/" + property :
+      instanceSignature.isEmpty() ? "sites/*/workers/*/" + property :
+      "sites/*/workers/*/instances/*/" + property;
+  } else {
+    family = "sites/*" + (names.count() > 2 ? "/" + names[2] : QString());
+  }
+}
+
+static std::mutex internedLock;
+static std::unordered_map<std::string, std::shared_ptr<Key const>> interned;
+
+std::shared_ptr<Key const> Key::intern(std::string const &s)
+{
+  std::lock_guard<std::mutex> guard(internedLock);
+  std::shared_ptr<Key const> &key = interned[s];
+  if (! key) key = std::make_shared<Key const>(s);
+  return key;
+}
+
+void Key::forget(std::shared_ptr<Key const> const &key)
+{
+  std::lock_guard<std::mutex> guard(internedLock);
+  auto it = interned.find(key->s);
+  /* Others can only get that Key from the table, which is locked, or from
+   * the caller, so it cannot be shared while it is being forgotten: */
+  if (it != interned.end() && it->second == key && key.use_count() <= 2)
+    interned.erase(it);
+}
+
+};
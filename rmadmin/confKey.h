@@ -0,0 +1,63 @@
+#ifndef CONFKEY_H_191018
+#define CONFKEY_H_191018
+#include <memory>
+#include <string>
+#include <QString>
+#include <QStringList>
+
+namespace conf {
+
+/* Keys are interned: every key of the KVStore is parsed only once, when it
+ * is first received, into a Key that is then shared by all the changes of
+ * that key, until it is deleted.
+ * The KVStore signals pass those Keys to receivers, that can then dispatch
+ * on the pre-parsed components instead of parsing the name at every change,
+ * and compare keys by address (two Keys being alive at the same time are
+ * equal if and only if they are the same object). */
+struct Key
+{
+  std::string const s;
+  // The same, as a QString and split on slashes:
+  QString const qs;
+  QStringList const names;
+
+  /* isSiteKey tells if that key is one of:
+   *   sites/$SITE/is_master
+   *   sites/$SITE/workers/$PROGRAM/$FUNCTION/$PROPERTY
+   *   sites/$SITE/workers/$PROGRAM/$FUNCTION/instances/$SIGNATURE/$PROPERTY
+   * for the properties of interest to the GraphModel, in which case the
+   * components are set (only the site and property for site properties, and
+   * instanceSignature only for instance properties): */
+  bool isSiteKey;
+  QString site, program, function, property, instanceSignature;
+
+  /* The name with the site, function and such replaced by stars, to
+   * aggregate statistics about similar keys (see Diagnostics): */
+  QString family;
+
+  Key(std::string const &);
+
+  // Is that sites/$SITE/workers/$PROGRAM/$FUNCTION/worker?
+  bool isWorker() const
+  {
+    return isSiteKey && ! function.isEmpty() && property == "worker";
+  }
+
+  /* Returns the Key of that name, parsing it only if it is not interned
+   * already: */
+  static std::shared_ptr<Key const> intern(std::string const &);
+
+  /* Removes that Key from the table, once its deletion has been delivered,
+   * unless it is still held by someone else than the caller (such as a
+   * change of the same key, re-created since, that is still queued), so
+   * that a key is never interned twice at the same time: */
+  static void forget(std::shared_ptr<Key const> const &);
+
+  /* So that the receivers that just want the name can still be connected to
+   * signals passing a Key, without copying it: */
+  operator std::string const &() const { return s; }
+};
+
+};
+
+#endif
@@ -338,14 +338,19 @@ bool TimeRange::operator==(Value const &other) const
 }
 
 Tuple::Tuple(unsigned skipped_, unsigned char const *bytes_, size_t size) :
-  Value(TupleType), skipped(skipped_), num_words(size / 4)
+  Value(TupleType), skipped(skipped_), num_words((size + 3) / 4)
 {
   assert(0 == (size & 3));
   if (verbose)
     qDebug() << "New tuple of" << num_words << "words";
   if (bytes_) {
-    bytes = new uint32_t[num_words];
-    memcpy((void *)bytes, (void *)bytes_, size);
+    /* This is the only copy of the tuple out of the OCaml heap, into a
+     * pooled buffer of the same size as given to MemoryPool::free: */
+    size_t const alloced = num_words * sizeof(uint32_t);
+    void *buf = MemoryPool::alloc(alloced);
+    memcpy(buf, (void *)bytes_, size);
+    memset(static_cast<char *>(buf) + size, 0, alloced - size);
+    bytes = static_cast<uint32_t const *>(buf);
   } else {
     assert(size == 0);
     bytes = nullptr;
@@ -356,7 +361,7 @@ Tuple::Tuple() : Tuple(0, nullptr, 0) {}
 
 Tuple::~Tuple()
 {
-  if (bytes) delete[](bytes);
+  MemoryPool::free((void *)bytes, num_words * sizeof(uint32_t));
 }
 
 QString const Tuple::toQString(std::string const &) const
@@ -654,7 +659,7 @@ Replay::Replay(value v_) :
   Value(ReplayType)
 {
   CAMLparam1(v_);
-  assert(9 == Wosize_val(v_));
+  assert(10 == Wosize_val(v_));
   channel = Long_val(Field(v_, 0));
   target = SiteFq(Field(v_, 1));
   since = Double_val(Field(v_, 3));
@@ -686,7 +691,7 @@ QString const Replay::toQString(std::string const &) const
 Replayer::Replayer(value v_) : Value(ReplayerType)
 {
   CAMLparam1(v_);
-  assert(6 == Wosize_val(v_));
+  assert(7 == Wosize_val(v_));
   // wtv, not used anywhere in the GUI for now
   CAMLreturn0;
 }
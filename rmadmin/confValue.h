@@ -19,6 +19,7 @@ extern "C" {
 #include "RamenValue.h"
 #include "confRCEntry.h"
 #include "confWorkerRef.h"
+#include "MemoryPool.h"
 
 struct RamenType;
 class AtomicWidget;
@@ -67,6 +68,11 @@ public:
   virtual bool isNull() const { return false; }
   virtual bool operator==(Value const &) const;
   bool operator!=(Value const &) const;
+
+  /* Values are allocated by the sync thread for every received change, and
+   * freed by the GUI thread once they are replaced: */
+  static void *operator new(size_t sz) { return MemoryPool::alloc(sz); }
+  static void operator delete(void *p, size_t sz) { MemoryPool::free(p, sz); }
 };
 
 // Construct from an OCaml value
@@ -2,6 +2,7 @@
 #include <iostream>
 #include <string>
 #include <cstdlib>
+#include <cstring>
 extern "C" {
 # include <caml/mlvalues.h>
 # include <caml/memory.h>
@@ -20,6 +21,9 @@ extern "C" {
 #include <QMetaType>
 #include <QFile>
 #include <QCommandLineParser>
+#include <QRegularExpression>
+#include <QStandardPaths>
+#include "Benchmark.h"
 #include "SourcesWin.h"
 #include "SyncStatus.h"
 #include "UserIdentity.h"
@@ -29,6 +33,7 @@ extern "C" {
 #include "GraphViewSettings.h"
 #include "Menu.h"
 #include "NamesTree.h"
+#include "TailModel.h"
 extern "C" {
 # include "../src/config.h"
 }
@@ -79,11 +84,17 @@ extern "C" {
   }
 }
 
-static void call_for_new_frame(QString const srvUrl, UserIdentity const *id, bool insecure)
+static void call_for_new_frame(QString const srvUrl, UserIdentity const *id, bool insecure, QString const recordFile, QString const snapshotFile)
 {
   CAMLparam0();
   CAMLlocal5(srv_url_, username_,
              srv_pub_key_, clt_pub_key_, clt_priv_key_);
+  CAMLlocal1(snapshot_);
+  if (! recordFile.isEmpty()) {
+    value *start_recording = caml_named_value("start_recording");
+    caml_callback(*start_recording,
+                  caml_copy_string(recordFile.toStdString().c_str()));
+  }
   srv_url_ = caml_copy_string(srvUrl.toStdString().c_str());
   username_ = caml_copy_string(my_uid->toStdString().c_str());
 # define GET(val, var) \
@@ -91,19 +102,21 @@ static void call_for_new_frame(QString const srvUrl, UserIdentity const *id, boo
   GET(srv_pub_key_, srv_pub_key);
   GET(clt_pub_key_, clt_pub_key);
   GET(clt_priv_key_, clt_priv_key);
-  value args[5] { srv_url_, username_, srv_pub_key_, clt_pub_key_, clt_priv_key_ };
+  snapshot_ = caml_copy_string(snapshotFile.toStdString().c_str());
+  value args[6] { srv_url_, username_, srv_pub_key_, clt_pub_key_, clt_priv_key_,
+                  snapshot_ };
   value *start_sync = caml_named_value("start_sync");
-  caml_callbackN(*start_sync, 5, args);
+  caml_callbackN(*start_sync, 6, args);
   CAMLreturn0;
 }
 
 // The only thread that will ever call OCaml runtime:
-static void do_sync_thread(QString const srvUrl, UserIdentity const *id, bool insecure)
+static void do_sync_thread(QString const srvUrl, UserIdentity const *id, bool insecure, QString const recordFile, QString const snapshotFile)
 {
   ocamlThreadId = std::this_thread::get_id();
   caml_c_thread_register();
   caml_acquire_runtime_system();
-  call_for_new_frame(srvUrl, id, insecure);
+  call_for_new_frame(srvUrl, id, insecure, recordFile, snapshotFile);
   caml_release_runtime_system();
   caml_c_thread_unregister();
 }
@@ -113,6 +126,14 @@ int main(int argc, char *argv[])
   caml_startup(argv);
   caml_release_runtime_system();
 
+  /* Benchmarks run without any window, and therefore must not need a
+   * display. This must be decided before the QApplication is created: */
+  for (int i = 1; i < argc; i ++) {
+    if (0 == strncmp(argv[i], "--benchmark", 11) &&
+        ! qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+      qputenv("QT_QPA_PLATFORM", "offscreen");
+  }
+
   QApplication app(argc, argv);
   QCoreApplication::setOrganizationName("Accedian");
   QCoreApplication::setApplicationName("RmAdmin");
@@ -148,8 +169,80 @@ int main(int argc, char *argv[])
       QCoreApplication::translate("main", "Display confserver messages"));
   parser.addOption(debugOption);
 
+  /* To save the messages received from the server: */
+  QCommandLineOption recordOption(
+    QString("record"),
+    QCoreApplication::translate("main", "Save all received messages into that file"),
+    QCoreApplication::translate("main", "file"));
+  parser.addOption(recordOption);
+
+  /* Or to replay them without a server (see Benchmark.h): */
+  QCommandLineOption benchmarkOption(
+    QString("benchmark"),
+    QCoreApplication::translate("main", "Replay the messages saved in that file "
+                                        "without displaying anything, then "
+                                        "report performance"),
+    QCoreApplication::translate("main", "file"));
+  parser.addOption(benchmarkOption);
+
+  /* To start from scratch: */
+  QCommandLineOption noSnapshotOption(
+    QString("no-snapshot"),
+    QCoreApplication::translate("main", "Neither load nor save the local "
+                                        "copy of the configuration"));
+  parser.addOption(noSnapshotOption);
+
+  /* To bound the memory used by tails (see TailModel.h): */
+  QCommandLineOption tailMemoryOption(
+    QString("tail-memory"),
+    QCoreApplication::translate("main", "Memory budget of each tail, in MiB "
+                                        "(0 for no limit)"),
+    QCoreApplication::translate("main", "MiB"));
+  parser.addOption(tailMemoryOption);
+
+  QCommandLineOption tailsMemoryOption(
+    QString("tails-memory"),
+    QCoreApplication::translate("main", "Memory budget of all tails together, "
+                                        "in MiB (0 for no limit)"),
+    QCoreApplication::translate("main", "MiB"));
+  parser.addOption(tailsMemoryOption);
+
+  QCommandLineOption tailMaxAgeOption(
+    QString("tail-max-age"),
+    QCoreApplication::translate("main", "Evict tail tuples older than that, "
+                                        "in event time"),
+    QCoreApplication::translate("main", "seconds"));
+  parser.addOption(tailMaxAgeOption);
+
+  QCommandLineOption spillTailsOption(
+    QString("spill-tails"),
+    QCoreApplication::translate("main", "Save evicted tail tuples into "
+                                        "temporary files rather than "
+                                        "forgetting them"));
+  parser.addOption(spillTailsOption);
+
+  QCommandLineOption tailSpillOption(
+    QString("tail-spill"),
+    QCoreApplication::translate("main", "Size budget of the spill file of "
+                                        "each tail, in MiB (0 for no limit)"),
+    QCoreApplication::translate("main", "MiB"));
+  parser.addOption(tailSpillOption);
+
   parser.process(app);
 
+  if (parser.isSet(tailMemoryOption))
+    TailModel::maxMemory =
+      parser.value(tailMemoryOption).toULongLong() * 1024 * 1024;
+  if (parser.isSet(tailsMemoryOption))
+    TailModel::maxTotMemory =
+      parser.value(tailsMemoryOption).toULongLong() * 1024 * 1024;
+  if (parser.isSet(tailMaxAgeOption))
+    TailModel::maxAge = parser.value(tailMaxAgeOption).toDouble();
+  TailModel::spill = parser.isSet(spillTailsOption);
+  if (parser.isSet(tailSpillOption))
+    TailModel::maxSpill =
+      parser.value(tailSpillOption).toULongLong() * 1024 * 1024;
+
   QString srvUrl(
     parser.positionalArguments().isEmpty() ?
       "localhost:29340" :
@@ -157,6 +250,7 @@ int main(int argc, char *argv[])
   if (srvUrl.length() == 0) srvUrl = QString("localhost");
 
   bool insecure = parser.isSet(insecureOption);
+  bool benchmarking = parser.isSet(benchmarkOption);
 
   QString defaultIdentityFileName =
     getenv("HOME") ?
@@ -166,7 +260,7 @@ int main(int argc, char *argv[])
     parser.isSet(identityFileOption) ?
       parser.value(identityFileOption) :
       QFile(defaultIdentityFileName);
-  if (! identityFile.exists() && ! insecure) {
+  if (! identityFile.exists() && ! insecure && ! benchmarking) {
     std::cout
       << "File" << identityFile.fileName().toStdString()
       << " does not exist.\n"
@@ -176,7 +270,7 @@ int main(int argc, char *argv[])
     exit(1);
   }
   UserIdentity *userIdentity = new UserIdentity(identityFile);
-  if (! userIdentity->isValid && ! insecure) exit(1);
+  if (! userIdentity->isValid && ! insecure && ! benchmarking) exit(1);
 
   my_uid = QString(getenv("USER") ? getenv("USER") : "Waldo");
   if (userIdentity->isValid) my_uid = userIdentity->username;
@@ -190,6 +284,11 @@ int main(int argc, char *argv[])
   qRegisterMetaType<conf::Retention>();
   qRegisterMetaType<QVector<int>>();
 
+  if (benchmarking) {
+    Benchmark benchmark(parser.value(benchmarkOption));
+    return benchmark.run();
+  }
+
   /* A GraphModel satisfies both the TreeView and the GraphView
    * requirements: */
   GraphViewSettings *settings = new GraphViewSettings;
@@ -200,10 +299,23 @@ int main(int argc, char *argv[])
   Menu::initDialogs(srvUrl);
   Menu::sourceEditor->show();
 
-  std::thread sync_thread(do_sync_thread, srvUrl, userIdentity, insecure);
+  /* The configuration received from that server is saved locally between
+   * sessions (see Snapshot in GuiHelper.ml): */
+  QString snapshotFile;
+  if (! parser.isSet(noSnapshotOption)) {
+    QString name(srvUrl + "_" + *my_uid);
+    name.replace(QRegularExpression("[^a-zA-Z0-9._-]"), "_");
+    snapshotFile =
+      QStandardPaths::writableLocation(QStandardPaths::CacheLocation) +
+      "/snapshots/" + name;
+  }
+
+  std::thread sync_thread(do_sync_thread, srvUrl, userIdentity, insecure,
+                          parser.value(recordOption), snapshotFile);
 
   int ret = app.exec();
   quit = true;
+  wakeUpSync();
 
   Menu::deleteDialogs();
   danceOfDel<NamesTree>(&NamesTree::globalNamesTree);
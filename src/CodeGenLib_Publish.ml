@@ -38,6 +38,11 @@ let on_del _clt k _v =
       IntGauge.set stats_num_subscribers (c - 1)
   | _ -> ()
 
+let has_subscribers () =
+  match IntGauge.get stats_num_subscribers with
+  | Some (_mi, num, _ma) -> num > 0
+  | None -> false
+
 (* Write a tuple into some key *)
 let publish_tuple ?while_ key sersize_of_tuple serialize_tuple mask tuple =
   if !ZMQClient.zmq_session = None then
@@ -67,22 +72,20 @@ let may_publish_tail clt ?while_ key_of_seq =
     (* Process incoming messages without waiting for them: *)
     ZMQClient.process_in ?while_ clt ;
     (* Now publish (if there are subscribers) *)
-    match IntGauge.get stats_num_subscribers with
-    | Some (_mi, num, _ma) when num > 0 ->
-        IntCounter.add stats_num_rate_limited_unpublished skipped ;
-        (* TODO: *)
-        let mask = RamenFieldMask.all_fields in
-        let ser_len = sersize_of_tuple mask tuple in
-        let tx = RingBuf.bytes_tx ser_len in
-        serialize_tuple mask tx 0 tuple ;
-        let values = RingBuf.read_raw_tx tx in
-        let v = Value.Tuple { skipped ; values } in
-        let seq = !next_seq in
-        incr next_seq ;
-        let k = key_of_seq seq in
-        let cmd = Client.CltMsg.NewKey (k, v, 0.) in
-        ZMQClient.send_cmd ?while_ cmd
-    | _ -> ()
+    if has_subscribers () then (
+      IntCounter.add stats_num_rate_limited_unpublished skipped ;
+      (* TODO: *)
+      let mask = RamenFieldMask.all_fields in
+      let ser_len = sersize_of_tuple mask tuple in
+      let tx = RingBuf.bytes_tx ser_len in
+      serialize_tuple mask tx 0 tuple ;
+      let values = RingBuf.read_raw_tx tx in
+      let v = Value.Tuple { skipped ; values } in
+      let seq = !next_seq in
+      incr next_seq ;
+      let k = key_of_seq seq in
+      let cmd = Client.CltMsg.NewKey (k, v, 0.) in
+      ZMQClient.send_cmd ?while_ cmd)
 
 let publish_stats clt ?while_ stats_key init_stats stats =
   (* Process incoming messages without waiting for them: *)
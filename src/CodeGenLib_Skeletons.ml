@@ -890,7 +890,88 @@ let read read_source parse_data sersize_of_tuple time_of_tuple
  * Operations that funcs may run: listen to some known protocol.
  *)
 
+(* Returns a function returning the ringbuffer tuples can currently be
+ * written into straight away, bypassing the outputer, if any: that is when
+ * the only recipient is a ringbuffer on the live channel that is [accept]ed
+ * (by default, one that wants all the fields) and nobody is tailing the
+ * output. [on_unload] is called with any ringbuffer before it is unloaded.
+ * Like the outputer's [last_check_outref], the out-ref file is stat'ed for
+ * each batch and re-read whenever its mtime changes (or every 10s anyway,
+ * for timeouts); None is returned then so that the outputer still gets to
+ * see some tuples to keep track of factors and event times. *)
+let direct_output ?(accept = fun _fname fieldmask ->
+                              Array.length fieldmask > 0 &&
+                              Array.for_all ((=) FieldMask.Copy) fieldmask)
+                  ?(on_unload = ignore) rb_ref_out_fname =
+  let cur = ref None (* fname, inode and ringbuffer *)
+  and last_check = ref 0.
+  and last_mtime = ref 0. in
+  let set_cur c =
+    Option.may (fun (fname, _, rb) ->
+      !logger.debug "Stop writing directly into %a" N.path_print fname ;
+      on_unload rb ;
+      RingBuf.unload rb
+    ) !cur ;
+    cur := c in
+  let check () =
+    let direct_fname =
+      if Publish.has_subscribers () then None else
+      match Hashtbl.to_list (OutRef.read_live rb_ref_out_fname) with
+      | exception e ->
+          !logger.error "Cannot read out-ref: %s" (Printexc.to_string e) ;
+          None
+      | [ OutRef.File fname, { OutRef.file_type = RingBuf ; fieldmask ; _ } ]
+        when accept fname fieldmask ->
+          Some fname
+      | _ ->
+          None in
+    match direct_fname, !cur with
+    | None, None ->
+        ()
+    | None, Some _ ->
+        set_cur None
+    | Some fname, Some (cur_fname, inode, _)
+      when fname = cur_fname &&
+           (try Files.inode fname = inode with _ -> false) ->
+        ()
+    | Some fname, _ ->
+        let what =
+          Printf.sprintf2 "loading %a" N.path_print fname in
+        set_cur (
+          default_on_exception None ~what (fun () ->
+            let inode = Files.inode fname in
+            let rb = RingBuf.load fname in
+            !logger.debug "Writing directly into %a" N.path_print fname ;
+            Some (fname, inode, rb)) ()) in
+  fun () ->
+    let now = Unix.gettimeofday ()
+    and mtime = Files.mtime_def 0. rb_ref_out_fname in
+    if mtime <> !last_mtime ||
+       now > !last_check +. 10. ||
+       (Option.is_some !cur && Publish.has_subscribers ())
+    then (
+      last_mtime := mtime ;
+      last_check := now ;
+      check () ;
+      None
+    ) else
+      Option.map (fun (_, _, rb) -> rb) !cur
+
+(* [direct_collector] is an optional faster alternative to [collector], for
+ * protocols that know how to write their tuples straight into a ringbuffer
+ * (see [direct_output]). It is given a function to register a callback to
+ * be called before a ringbuffer is unloaded.
+ * By default it writes all the fields. If [direct_child] is set, it writes
+ * instead only for the child of that name, given the MD5 of the signature
+ * of its input type and the fieldmask it reads this function output with
+ * (see RamenNetflow.preagg_spec): *)
 let listen_on
+      ?(direct_collector :
+          (?while_:(unit -> bool) ->
+           on_unload:((RingBuf.t -> unit) -> unit) ->
+           (unit -> RingBuf.t option) ->
+           (int -> unit) -> ('a -> unit) -> unit) option)
+      ?(direct_child : (N.func * string * string) option)
       (collector : ?while_:(unit -> bool) -> ('a -> unit) -> unit)
       proto_name
       sersize_of_tuple time_of_tuple factors_of_tuple serialize_tuple
@@ -913,11 +994,39 @@ let listen_on
     let while_ () =
       may_publish_stats conf publish_stats ;
       while_ () in
-    collector ~while_ (fun tup ->
+    let on_tuple tup =
       IO.on_each_input_pre () ;
       IntCounter.inc stats_in_tuple_count ;
       outputer (Some tup) ;
-      ignore (Gc.major_slice 0)))
+      ignore (Gc.major_slice 0) in
+    match direct_collector with
+    | None ->
+        collector ~while_ on_tuple
+    | Some direct_collector ->
+        let on_direct num_tuples =
+          IO.on_each_input_pre () ;
+          IntCounter.add stats_in_tuple_count num_tuples ;
+          IntCounter.add stats_out_tuple_count num_tuples ;
+          FloatGauge.set stats_last_out !IO.now ;
+          update_output_times () in
+        let accept =
+          Option.map (fun (child, in_sign, child_fieldmask) ->
+            (* Recognize the input ringbuf of that child of this program
+             * (see RamenConf.in_ringbuf_name_base): *)
+            let prog, _ = N.fq_parse worker_name in
+            let needle =
+              "/"^ (N.path_of_program ~suffix:true prog :> string) ^
+              "/"^ (child : N.func :> string) ^"/"^ in_sign ^"/" in
+            fun fname fieldmask ->
+              FieldMask.to_string fieldmask = child_fieldmask &&
+              String.exists (fname : N.path :> string) needle
+          ) direct_child
+        and unload_hooks = ref [] in
+        let on_unload rb = List.iter (fun f -> f rb) !unload_hooks in
+        direct_collector
+          ~while_ ~on_unload:(fun f -> unload_hooks := f :: !unload_hooks)
+          (direct_output ?accept ~on_unload rb_ref_out_fname)
+          on_direct on_tuple)
 
 (*
  * Operations that funcs may run: read known tuples from a ringbuf.
@@ -1887,7 +1996,7 @@ let replay
       (time_of_tuple : 'tuple_out -> (float * float) option)
       (factors_of_tuple : 'tuple_out -> (string * T.value) array)
       (serialize_tuple : FieldMask.fieldmask -> RingBuf.tx -> int -> 'tuple_out -> int)
-      orc_make_handler orc_write orc_read orc_close =
+      orc_make_handler orc_write orc_read_par orc_close =
   let worker_name = getenv ~def:"?fq_name?" "fq_name" in
   let log_level = getenv ~def:"normal" "log_level" |> log_level_of_string in
   let prefix = worker_name ^" (REPLAY): " in
@@ -1912,6 +2021,22 @@ let replay
                     string_split_on_char ',' |>
                     List.map Channel.of_string
   and replayer_id = getenv "replayer_id" |> int_of_string
+  and orc_read_threads =
+    getenv ~def:(string_of_int Default.orc_read_threads) "orc_read_threads" |>
+    int_of_string
+  (* Optional bounds on some numeric fields, as "field:min:max;...", that
+   * are used to skip ORC archives that cannot possibly match (see
+   * RamenReplay.field_bounds_of_where): *)
+  and replay_filters =
+    getenv ~def:"" "replay_filters" |>
+    string_split_on_char ';' |>
+    List.filter_map (fun filter ->
+      match string_split_on_char ':' filter with
+      | [ field ; mi ; ma ] ->
+          (* Same as the column names in ORC files: *)
+          let field = Printf.sprintf2 "%a" RamenOrc.print_label field in
+          Some (field, float_of_string mi, float_of_string ma)
+      | _ -> None)
   in
   !logger.debug "Starting REPLAY of %s. Will log into %s at level %s."
     worker_name
@@ -1973,21 +2098,45 @@ let replay
                            with search (%f..%f)"
               N.path_print_quoted rb_archive
               st.t_min st.t_max since until) () in
-  let rec loop_files clt =
-    if while_ () then
-      match Enum.get_exn files with
-      | exception Enum.No_more_elements -> ()
-      | _s1, _s2, t1, t2, arc_typ, fname ->
-          if time_overlap t1 t2 then (
-            match arc_typ with
-            | RingBufLib.RingBuf ->
-                loop_tuples_of_ringbuf clt fname
-            | RingBufLib.Orc ->
-                let num_lines, num_errs =
-                  orc_read fname Default.orc_rows_per_batch (output_tuple clt) in
-                if num_errs <> 0 then
-                  !logger.error "%d/%d errors" num_errs num_lines) ;
-          loop_files clt
+  let loop_orc_files clt fnames =
+    if fnames <> [||] then (
+      !logger.debug "Reading %d ORC archives with %d threads"
+        (Array.length fnames) orc_read_threads ;
+      let num_lines, num_errs =
+        orc_read_par fnames Default.orc_rows_per_batch orc_read_threads
+                     (output_tuple clt) in
+      if num_errs <> 0 then
+        !logger.error "%d/%d errors" num_errs num_lines) in
+  let loop_files clt =
+    (* Archives of both kinds are read in order of start time, so that
+     * tuples are replayed in (approximately) event time order whatever
+     * the archive format. Consecutive ORC archives are read together so
+     * that their stripes can be decoded in parallel, but no more than
+     * [orc_read_threads] files at a time so that [while_] is still checked
+     * often enough: *)
+    let files =
+      RingBufLib.replay_arc_files ~filters:replay_filters dir since until
+                                  files in
+    let max_orc_files = max 1 orc_read_threads in
+    let flush_orc_files orc_files =
+      if orc_files <> [] && while_ () then
+        List.rev orc_files |> Array.of_list |> loop_orc_files clt in
+    let rec loop orc_files num_orc_files = function
+      | [] ->
+          flush_orc_files orc_files
+      | _ when not (while_ ()) ->
+          ()
+      | (_, RingBufLib.RingBuf, fname) :: rest ->
+          flush_orc_files orc_files ;
+          loop_tuples_of_ringbuf clt fname ;
+          loop [] 0 rest
+      | (_, RingBufLib.Orc, fname) :: rest ->
+          if num_orc_files >= max_orc_files then (
+            flush_orc_files orc_files ;
+            loop [ fname ] 1 rest
+          ) else
+            loop (fname :: orc_files) (num_orc_files + 1) rest in
+    loop [] 0 files
   in
   let url = getenv ~def:"" "sync_url" in
   Publish.start_zmq_client_simple ~while_ url [] (fun clt ->
@@ -2004,9 +2153,44 @@ let replay
   exit (!quit |? ExitCodes.terminated)
 
 
+(* Convert a ringbuf archive into an ORC file without deserializing the
+ * tuples into OCaml values, which is how archives are compressed (see
+ * RamenGc). Returns false, after having deleted the ORC file, if the
+ * ringbuf could not be converted entirely, in which case the generic
+ * conversion, which is more forgiving with damaged archives, should be
+ * attempted. *)
+let orc_of_ringbuf_file
+      orc_make_handler orc_of_ringbuf orc_close
+      (in_fname : N.path) (out_fname : N.path) =
+  let with_index = false
+  and batch_size = Default.orc_rows_per_batch
+  and num_batches = Default.orc_batches_per_file in
+  match RingBuf.load in_fname with
+  | exception e ->
+      !logger.debug "Cannot load %a: %s"
+        N.path_print in_fname (Printexc.to_string e) ;
+      false
+  | rb ->
+      let hdr = orc_make_handler out_fname with_index batch_size
+                                 num_batches false in
+      let num_lines, num_errs =
+        finally (fun () ->
+          orc_close hdr ;
+          RingBuf.unload rb)
+          (orc_of_ringbuf hdr) rb in
+      if num_errs = 0 then (
+        !logger.debug "Converted %d tuples" num_lines ;
+        true
+      ) else (
+        !logger.debug "Cannot convert %a directly, falling back"
+          N.path_print in_fname ;
+        Files.safe_unlink out_fname ;
+        false
+      )
+
 let convert
       in_fmt (in_fname : N.path) out_fmt (out_fname : N.path)
-      orc_read csv_write orc_make_handler orc_write orc_close
+      orc_read csv_write orc_make_handler orc_write orc_of_ringbuf orc_close
       (read_tuple : RingBuf.tx -> RingBufLib.message_header * 'tuple_out option)
       (sersize_of_tuple : FieldMask.fieldmask -> 'tuple_out -> int)
       (time_of_tuple : 'tuple_out -> (float * float) option)
@@ -2029,6 +2213,10 @@ let convert
   let open Unix in
   if in_fname = out_fname then
     failwith "Input and output files must be distinct" ;
+  if in_fmt = Casing.RB && out_fmt = Casing.ORC &&
+     orc_of_ringbuf_file orc_make_handler orc_of_ringbuf orc_close
+                         in_fname out_fname
+  then () else
   let orc_handler = ref None
   and out_rb = ref None and in_rb = ref None
   and in_fd = ref None and out_fd = ref None
@@ -2776,7 +2776,48 @@ let emit_read opc name source_name format_name =
     p "    factors_of_tuple_ serialize_tuple_" ;
     p "    orc_make_handler_ orc_write orc_close\n")
 
-let emit_listen_on opc name net_addr port proto =
+(* Emits the arguments of [CodeGenLib_Skeletons.listen_on] to pre-aggregate
+ * the flows for that [child] (see RamenOperation.netflow_preagg): *)
+let emit_netflow_preagg opc inet_addr port (child, child_op) =
+  let p fmt = emit opc.code 0 fmt in
+  let spec =
+    O.netflow_preagg child_op |>
+    option_get "netflow_preagg" in
+  let in_type = RamenFieldMaskLib.in_type_of_operation child_op in
+  let in_sign = N.md5 (RamenFieldMaskLib.in_type_signature in_type)
+  and fieldmask =
+    RamenFieldMaskLib.fieldmask_of_operation
+      ~out_typ:RamenNetflow.tuple_typ child_op |>
+    RamenFieldMask.to_string
+  and columns =
+    List.map (fun f -> E.id_of_path f.RamenFieldMaskLib.path) in_type |>
+    RamenNetflow.preagg_columns spec in
+  let print_fields =
+    List.print ~first:"[ " ~last:" ]" ~sep:" ; " (fun oc (f : N.field) ->
+      Printf.fprintf oc "N.field %S" (f :> string)) in
+  p "    ~direct_child:(N.func %S, %S, %S)"
+    (child : N.func :> string) in_sign fieldmask ;
+  p "    ~direct_collector:(RamenNetflowSerialization.collector_preagg" ;
+  p "      RamenNetflow.{ bucket_duration = %h ;" spec.bucket_duration ;
+  p "                     keys = %a ;" print_fields spec.keys ;
+  p "                     aggrs = %a }"
+    (List.print ~first:"[ " ~last:" ]" ~sep:" ; " (fun oc (op, f) ->
+      Printf.fprintf oc "%s, N.field %S"
+        (match op with RamenNetflow.Sum -> "Sum"
+                     | Min -> "Min"
+                     | Max -> "Max")
+        (f : N.field :> string))) spec.aggrs ;
+  p "      %a"
+    (Array.print ~first:"[| " ~last:" |]" ~sep:" ; " (fun oc c ->
+      String.print oc (match c with
+        | RamenNetflow.Start -> "RamenNetflow.Start"
+        | Stop -> "RamenNetflow.Stop"
+        | Key i -> "RamenNetflow.Key "^ string_of_int i
+        | Aggr i -> "RamenNetflow.Aggr "^ string_of_int i))) columns ;
+  p "      ~inet_addr:(Unix.inet_addr_of_string %S) ~port:%d)"
+    inet_addr port
+
+let emit_listen_on ?netflow_preagg opc name net_addr port proto =
   let open RamenProtocols in
   let p fmt = emit opc.code 0 fmt in
   let tuple_typ = tuple_typ_of_proto proto in
@@ -2788,11 +2829,20 @@ let emit_listen_on opc name net_addr port proto =
   fail_with_context "tuple serialization" (fun () ->
     emit_serialize_tuple 0 "serialize_tuple_" opc.code tuple_typ) ;
   fail_with_context "listening function" (fun () ->
+    let inet_addr = Unix.string_of_inet_addr net_addr in
     p "let %s () =" name ;
     p "  CodeGenLib_Skeletons.listen_on" ;
+    (match netflow_preagg with
+    | Some child ->
+        emit_netflow_preagg opc inet_addr port child
+    | None ->
+        direct_collector_of_proto proto |>
+        Option.may (fun direct_collector ->
+          p "    ~direct_collector:(%s" direct_collector ;
+          p "      ~inet_addr:(Unix.inet_addr_of_string %S) ~port:%d)"
+            inet_addr port)) ;
     p "    (%s ~inet_addr:(Unix.inet_addr_of_string %S) ~port:%d)"
-      collector
-      (Unix.string_of_inet_addr net_addr) port ;
+      collector inet_addr port ;
     p "    %S sersize_of_tuple_ time_of_tuple_ factors_of_tuple_"
       (string_of_proto proto) ;
     p "    serialize_tuple_" ;
@@ -3915,7 +3965,7 @@ let emit_header params_mod oc =
     open %s\n"
     params_mod
 
-let emit_operation name top_half_name func
+let emit_operation ?netflow_preagg name top_half_name func
                    global_env group_env env_env param_env opc =
   (* Default top-half (for non-aggregate operations): a NOP *)
   Printf.fprintf opc.code "let %s = ignore\n\n" top_half_name ;
@@ -3935,7 +3985,7 @@ let emit_operation name top_half_name func
         emit_parse_rowbinary opc format_name specs);
     emit_read opc name source_name format_name
   | ListenFor { net_addr ; port ; proto } ->
-    emit_listen_on opc name net_addr port proto
+    emit_listen_on ?netflow_preagg opc name net_addr port proto
   | Instrumentation { from } ->
     emit_well_known opc name from
       "RamenWorkerStatsSerialization.unserialize" "report_ringbuf"
@@ -3971,7 +4021,7 @@ let emit_replay name func opc =
   p "  CodeGenLib_Skeletons.replay read_out_tuple_" ;
   p "    sersize_of_tuple_ time_of_tuple_ factors_of_tuple_" ;
   p "    serialize_tuple_" ;
-  p "    orc_make_handler_ orc_write orc_read orc_close\n"
+  p "    orc_make_handler_ orc_write orc_read_par orc_close\n"
 
 (* Generator for function [out_of_pub_] that adds missing private fields. *)
 let emit_priv_pub opc =
@@ -4066,6 +4116,11 @@ let emit_orc_wrapper func orc_write_func orc_read_func oc =
   p "external orc_read_pub : N.path -> int -> (%a -> unit) -> (int * int) = %S"
     otype_of_type pub
     orc_read_func ;
+  p "(* Parameters: files * row per batch * threads * callback *)" ;
+  p "external orc_read_par_pub :" ;
+  p "  N.path array -> int -> int -> (%a -> unit) -> (int * int) = %S"
+    otype_of_type pub
+    (Orc.parallel_reader_name orc_read_func) ;
   (* Destructor do not seems to be called when the OCaml program exits: *)
   p "external orc_close : handler -> unit = \"orc_handler_close\"" ;
   p "" ;
@@ -4073,9 +4128,17 @@ let emit_orc_wrapper func orc_write_func orc_read_func oc =
   p "external orc_make_handler : string -> N.path -> bool -> int -> int -> bool -> handler =" ;
   p "  \"orc_handler_create_bytecode_lol\" \"orc_handler_create\"" ;
   p "" ;
+  p "(* Write a whole ringbuf archive into the handler and close it: *)" ;
+  p "external orc_of_ringbuf : handler -> RingBuf.t -> (int * int) = %S"
+    (Orc.ringbuf_converter_name orc_write_func) ;
+  p "" ;
   (* A wrapper that inject missing private fields: *)
   p "let orc_read fname_ batch_sz_ k_ =" ;
   p "  orc_read_pub fname_ batch_sz_ (fun t_ -> k_ (out_of_pub_ t_))" ;
+  p "" ;
+  p "let orc_read_par fnames_ batch_sz_ num_threads_ k_ =" ;
+  p "  orc_read_par_pub fnames_ batch_sz_ num_threads_" ;
+  p "    (fun t_ -> k_ (out_of_pub_ t_))" ;
   p ""
 
 let emit_make_orc_handler name func oc =
@@ -4108,11 +4171,13 @@ let emit_convert name func oc =
   p "  in" ;
   p "  CodeGenLib_Skeletons.convert" ;
   p "    in_fmt_ in_fname_ out_fmt_ out_fname_" ;
-  p "    orc_read csv_write orc_make_handler_ orc_write orc_close" ;
+  p "    orc_read csv_write orc_make_handler_ orc_write orc_of_ringbuf orc_close" ;
   p "    read_out_tuple_ sersize_of_tuple_ time_of_tuple_" ;
   p "    serialize_tuple_ (out_of_pub_ %% my_tuple_of_strings_)\n"
 
-let compile conf func obj_name params_mod dessser_mod
+(* [netflow_preagg] is the name and operation of the child of that netflow
+ * listener which aggregation it should start, if any: *)
+let compile ?netflow_preagg conf func obj_name params_mod dessser_mod
             orc_write_func orc_read_func params envvars =
   !logger.debug "Going to compile function %s: %a"
     (N.func_color func.FS.name)
@@ -4165,7 +4230,8 @@ let compile conf func obj_name params_mod dessser_mod
         fail_with_context "factors extractor" (fun () ->
           emit_factors_of_tuple "factors_of_tuple_" func opc.code) ;
         fail_with_context "operation" (fun () ->
-          emit_operation EntryPoints.worker EntryPoints.top_half func
+          emit_operation ?netflow_preagg
+                         EntryPoints.worker EntryPoints.top_half func
                          global_env group_env env_env param_env opc) ;
         fail_with_context "replay function" (fun () ->
           emit_replay EntryPoints.replay func opc) ;
@@ -146,11 +146,12 @@ let start_daemon conf daemonize to_stdout to_syslog service_name =
 
 let supervisor conf daemonize to_stdout to_syslog
                use_external_compiler max_simult_compils
-               smt_solver fail_for_good_ kill_at_exit () =
+               smt_solver fail_for_good_ kill_at_exit replay_threads () =
   RamenCompiler.init use_external_compiler max_simult_compils smt_solver ;
   start_daemon conf daemonize to_stdout to_syslog ServiceNames.supervisor ;
   (* Controls all calls to restart_on_failure: *)
   fail_for_good := fail_for_good_ ;
+  RamenSupervisor.orc_read_threads := replay_threads ;
   let open RamenProcesses in
   prepare_signal_handlers conf ;
   (* Also attempt to repair the report/notifs ringbufs.
@@ -6,19 +6,16 @@ open RamenCollectd
 
 external decode : Bytes.t -> int -> collectd_metric array = "wrap_collectd_decode"
 
+(* Receive and decode all the available datagrams at once: *)
+external recv : Unix.file_descr -> collectd_metric array = "wrap_collectd_recv"
+
 let collector ~inet_addr ~port ?while_ k =
   (* Listen to incoming UDP datagrams on given port: *)
-  let serve ?sender buffer recv_len =
-    !logger.debug "Received %d bytes from collectd @ %s"
-      recv_len
-      (match sender with None -> "??" |
-       Some ip -> Unix.string_of_inet_addr ip) ;
-    decode buffer recv_len |>
-    Array.iter k
+  let serve metrics =
+    !logger.debug "Received %d metrics from collectd" (Array.length metrics) ;
+    Array.iter k metrics
   in
-  (* collectd current network.c buffer is 1452 bytes: *)
-  udp_server
-    ~what:"collectd sink" ~buffer_size:1500 ~inet_addr ~port ?while_ serve
+  udp_batch_server ~what:"collectd sink" ~inet_addr ~port ?while_ recv serve
 
 let test ?(port=25826) () =
   init_logger Normal ;
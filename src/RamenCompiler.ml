@@ -118,6 +118,14 @@ let orc_codec conf orc_write_func orc_read_func prefix_name rtyp =
     Orc.emit_intro oc ;
     Orc.emit_write_value orc_write_func rtyp oc ;
     Orc.emit_read_values orc_read_func rtyp oc ;
+    Orc.emit_read_values_parallel
+      (Orc.parallel_reader_name orc_read_func) rtyp oc ;
+    (* Archives are made of whole output records: *)
+    (match rtyp.T.structure with
+    | T.TRecord _ ->
+        Orc.emit_write_from_ringbuf
+          (Orc.ringbuf_converter_name orc_write_func) rtyp oc
+    | _ -> ()) ;
     Orc.emit_outro oc in
   cpp_compile print_code conf prefix_name ObjectSuffixes.orc_codec,
   schema
@@ -577,9 +585,39 @@ let compile conf info ~exec_file base_file (program_name : N.program) =
       conf ~keep_temp_files what params_src_file params_obj_name ;
     let params_mod_name =
       RamenOCamlCompiler.module_name_of_file_name params_src_file in
+    (* A netflow listener which only child in this program can have its
+     * aggregation started by the listener (see RamenNetflow.preagg_spec)
+     * does so: *)
+    let netflow_preaggs =
+      List.filter_map (fun func ->
+        match func.FS.operation with
+        | O.ListenFor { proto = RamenProtocols.NetflowV5 ; _ } ->
+            (match List.filter (fun child ->
+                     List.exists (function
+                       | _, None, pname -> pname = func.FS.name
+                       | _ -> false
+                     ) (O.parents_of_operation child.FS.operation)
+                   ) info.PS.funcs with
+            | [ child ] when O.netflow_preagg child.FS.operation <> None ->
+                !logger.info "Function %s will pre-aggregate flows for %s"
+                  (N.func_color func.FS.name) (N.func_color child.FS.name) ;
+                Some (func.FS.name, (child.FS.name, child.FS.operation))
+            | _ -> None)
+        | _ -> None
+      ) info.PS.funcs in
+    let netflow_preagg_of_func func =
+      try Some (List.assoc func.FS.name netflow_preaggs)
+      with Not_found -> None in
     let src_name_of_func func =
+      (* The code of a listener also depends on the child it pre-aggregates
+       * for: *)
+      let preagg_sign =
+        match netflow_preagg_of_func func with
+        | None -> ""
+        | Some (child, op) ->
+            "_"^ N.md5 ((child :> string) ^ IO.to_string (O.print true) op) in
       N.cat base_file
-            (N.path ("_"^ func.FS.signature ^
+            (N.path ("_"^ func.FS.signature ^ preagg_sign ^
                      "_"^ RamenVersions.codegen)) |>
       RamenOCamlCompiler.make_valid_for_module in
     let obj_files =
@@ -630,6 +668,7 @@ let compile conf info ~exec_file base_file (program_name : N.program) =
         Files.mkdir_all ~is_file:true obj_name ;
         (try
           CodeGen_OCaml.compile
+            ?netflow_preagg:(netflow_preagg_of_func func)
             conf func obj_name params_mod_name dessser_mod_name
             orc_write_func orc_read_func info.default_params envvars
         with e ->
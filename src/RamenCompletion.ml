@@ -214,7 +214,8 @@ let complete str () =
               CliInfo.max_simult_compilations ;
             "--solver=", CliInfo.smt_solver ;
             "--kill-at-exit", CliInfo.kill_at_exit ;
-            "--fail-for-good", CliInfo.fail_for_good ] @
+            "--fail-for-good", CliInfo.fail_for_good ;
+            "--replay-threads=", CliInfo.replay_threads ] @
           copts true
        | "alerter" ->
           [ "--daemonize", CliInfo.daemonize ;
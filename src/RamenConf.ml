@@ -495,7 +495,11 @@ struct
        * channel events, in order to avoid spamming unrelated nodes
        * (Cf. issue #640): *)
       links : (N.site_fq * N.site_fq) list ;
-      timeout_date : float }
+      timeout_date : float ;
+      (* Bounds that the numeric fields of the target must be within, as
+       * (field, min, max), used to skip archives (see
+       * RingBufLib.replay_arc_files): *)
+      field_bounds : (string * float * float) list [@ppp_default []] }
     [@@ppp PPP_OCaml]
 
   type replays = (RamenChannel.t, entry) Hashtbl.t
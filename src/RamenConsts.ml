@@ -256,6 +256,8 @@ struct
     "Command to run the SMT solver (with %s in place of the SMT2 file name)."
   let fail_for_good = "For tests: do not restart after a crash."
   let kill_at_exit = "For tests: SIGKILL all workers at exit."
+  let replay_threads =
+    "How many threads each replayer uses to decode ORC archives."
   let master  =
     "Indicates that Ramen must run in distributed mode and what sites play \
      the master role."
@@ -478,6 +480,9 @@ struct
   let orc_rows_per_batch = 1000
   let orc_batches_per_file = 1000
 
+  (* How many threads a replayer uses to decode ORC archives: *)
+  let orc_read_threads = 1
+
   (* Alerter: delay between first scheduling of a new alert: *)
   let init_schedule_delay = 30.
 
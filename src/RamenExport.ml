@@ -184,7 +184,8 @@ let replay conf ~while_ worker field_names where since until
   (* Find out all required sources: *)
   (* FIXME: Replay.create should be given the clt and should look up itself what
    * it needs instead of forcing callee to build [stats] at every calls *)
-  match Replay.create conf stats site_name func since until with
+  let field_bounds = Replay.field_bounds_of_where where in
+  match Replay.create conf stats ~field_bounds site_name func since until with
   | exception Replay.NoData ->
       (* When we have not enough archives to replay anything *)
       on_exit ()
@@ -306,7 +307,9 @@ let replay_via_confserver
   (* FIXME: Replay.create should be given the clt and should look up itself what
    * it needs instead of forcing callee to build [stats] at every calls *)
   let resp_key = Key.to_string response_key in
-  match Replay.create conf stats ~resp_key site_name func since until with
+  let field_bounds = Replay.field_bounds_of_where where in
+  match Replay.create conf stats ~resp_key ~field_bounds site_name func
+                      since until with
   | exception Replay.NoData ->
       (* When we have not enough archives to replay anything *)
       on_exit ()
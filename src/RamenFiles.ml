@@ -348,7 +348,8 @@ let really_read_fd_into buf offs fd size =
 
 let really_read_fd fd size =
   let buf = Bytes.create size in
-  really_read_fd_into buf 0 fd size
+  really_read_fd_into buf 0 fd size ;
+  buf
 
 let marshal_into_fd ?(at_start=true) fd v =
   let open Unix in
@@ -125,13 +125,20 @@ let clean_seq_archives del_ratio dry_run dir alloced =
           ) ;
           del (n - 1) to_del
         ) in
-  del num_to_del to_del
+  del num_to_del to_del ;
+  (* The statistics of deleted ORC archives are no longer needed: *)
+  if num_to_del > 0 && not dry_run then
+    log_and_ignore_exceptions RingBufLib.prune_arc_stats dir
 
 let get_alloced_special _fname _rel_fname =
   150_000_000 (* TODO *)
 
 (* TODO: instrumentation for number of successful/failed compressions *)
 
+(* Record the column statistics of a new ORC archive (see
+ * RingBufLib.read_arc_stats): *)
+external orc_append_column_stats : N.path -> unit = "orc_append_column_stats"
+
 let compress_archive (bin : N.path) (func_name : N.func) rb_name =
   let orc_name = Files.change_ext "orc" rb_name in
   let args =
@@ -144,6 +151,7 @@ let compress_archive (bin : N.path) (func_name : N.func) rb_name =
     if errors = "" then (
       !logger.debug "Compressed %a into %a"
         N.path_print rb_name N.path_print orc_name ;
+      orc_append_column_stats orc_name ;
       ignore_exceptions Files.safe_unlink rb_name
     ) else
       !logger.error "Cannot compress archive %a with %a: %s"
@@ -848,7 +848,7 @@ let string_of_duration d =
   "0s" (string_of_duration 0.)
 *)
 
-let udp_server ?(buffer_size=2000) ~what ~inet_addr ~port ?(while_=always) k =
+let udp_socket ~what ~inet_addr ~port =
   if port < 0 || port > 65535 then
     Printf.sprintf "%s: port number (%d) not within valid range" what port |>
     failwith ;
@@ -864,6 +864,11 @@ let udp_server ?(buffer_size=2000) ~what ~inet_addr ~port ?(while_=always) k =
     with _ -> sock_of_domain PF_INET in
   !logger.info "Listening for datagrams on %s:%d"
     (Unix.string_of_inet_addr inet_addr) port ;
+  sock
+
+let udp_server ?(buffer_size=2000) ~what ~inet_addr ~port ?(while_=always) k =
+  let open Unix in
+  let sock = udp_socket ~what ~inet_addr ~port in
   let buffer = Bytes.create buffer_size in
   let rec until_exit () =
     if while_ () then
@@ -882,6 +887,24 @@ let udp_server ?(buffer_size=2000) ~what ~inet_addr ~port ?(while_=always) k =
   with Exit -> (* from the above restart_on_eintr *)
     ()
 
+(* Same as above, but [recv] receives and decodes all datagrams available
+ * at once (see udp/udp_batch.h) and [k] is given the whole batch.
+ * If [recv_timeout] is set then [recv] fails with EAGAIN when nothing has
+ * been received for that long: *)
+let udp_batch_server ~what ~inet_addr ~port ?(while_=always) ?recv_timeout
+                     recv k =
+  let sock = udp_socket ~what ~inet_addr ~port in
+  Option.may (Unix.setsockopt_float sock Unix.SO_RCVTIMEO) recv_timeout ;
+  let rec until_exit () =
+    if while_ () then (
+      let batch = restart_on_eintr ~while_ recv sock in
+      k batch ;
+      (until_exit [@tailcall]) ())
+  in
+  try until_exit ()
+  with Exit -> (* from the above restart_on_eintr *)
+    ()
+
 let hex_of =
   let zero = Char.code '0'
   and ten = Char.code 'a' - 10 in
@@ -1,4 +1,4 @@
-(* Collector for netflow v5.  *)
+(* Collector for netflow v5, v9 and IPFIX.  *)
 open Batteries
 open RamenLog
 open RamenHelpers
@@ -8,7 +8,7 @@ open RamenTuple
 module N = RamenName
 
 (* <blink>DO NOT ALTER</blink> this record without also updating
- * wrap_netflow_decode in wrap_netflow.c and tuple_typ below! *)
+ * netflow/wrappers.c and tuple_typ below! *)
 type netflow_metric =
   RamenIp.t nullable * float * float *
   Uint32.t * Uint8.t * Uint8.t * Uint8.t * Uint16.t *
@@ -144,3 +144,89 @@ let event_time =
         StopField (N.field "stop", ref OutputField, 1.))
 
 let factors = [ N.field "source" ]
+
+(*
+ * Native pre-aggregation (see netflow/preagg.h)
+ *
+ * When the only child of a netflow listener merely sums, mins or maxs some
+ * fields of the flows per group of other fields and per time bucket, the
+ * listener can start that aggregation right after decoding and send that
+ * child only one row per group and bucket, which the child then aggregates
+ * further as if they were flows (see RamenOperation.netflow_preagg).
+ *)
+
+(* <blink>DO NOT ALTER</blink> the order of those constructors without also
+ * updating netflow/preagg.h: *)
+type preagg_op = Sum | Min | Max
+
+type preagg_spec =
+  { bucket_duration : float ;
+    (* The group-by fields: *)
+    keys : N.field list ;
+    (* The aggregates and the aggregated fields: *)
+    aggrs : (preagg_op * N.field) list }
+
+(* The fields that can be used as keys or be aggregated, in the order of
+ * enum nf_field in netflow/preagg.h: *)
+let preagg_fields =
+  [| "seqnum" ; "engine_type" ; "engine_id" ; "sampling_type" ;
+     "sampling_rate" ; "src" ; "dst" ; "next_hop" ; "src_port" ; "dst_port" ;
+     "in_iface" ; "out_iface" ; "packets" ; "bytes" ; "tcp_flags" ;
+     "ip_proto" ; "ip_tos" ; "src_as" ; "dst_as" ; "src_mask" ;
+     "dst_mask" |]
+
+let is_preagg_field (name : N.field) =
+  Array.mem (name :> string) preagg_fields
+
+let preagg_field_index name =
+  match Array.findi ((=) (name : N.field :> string)) preagg_fields with
+  | exception Not_found ->
+      Printf.sprintf "Cannot pre-aggregate netflow field %a"
+        N.field_print_quoted name |>
+      failwith
+  | i -> i
+
+(* The largest value that can be serialized for that field. Sums must not
+ * exceed it, since the rows have the type of the flows: *)
+let preagg_max_value name =
+  match List.find (fun ft -> ft.name = name) tuple_typ with
+  | { typ = { structure = TU8 ; _ } ; _ } -> 0xff
+  | { typ = { structure = TU16 ; _ } ; _ } -> 0xffff
+  | _ -> 0xffff_ffff
+
+(* <blink>DO NOT ALTER</blink> without also updating netflow/wrappers.c: *)
+type preagg_column = Start | Stop | Key of int | Aggr of int
+
+(* The columns of the rows sent to a child that reads only [fields], in
+ * serialization order (ie. sorted by name): *)
+let preagg_columns spec fields =
+  List.fast_sort N.compare fields |>
+  List.map (fun name ->
+    match (name :> string) with
+    | "start" -> Start
+    | "stop" -> Stop
+    | _ ->
+        (match List.index_of name spec.keys with
+        | Some i -> Key i
+        | None ->
+            (match List.findi (fun _ (_, n) -> n = name) spec.aggrs with
+            | exception Not_found ->
+                Printf.sprintf "Field %a is neither a key nor aggregated"
+                  N.field_print_quoted name |>
+                failwith
+            | i, _ -> Aggr i))) |>
+  Array.of_list
+
+(*$inject
+  let spec =
+    { bucket_duration = 60. ;
+      keys = [ N.field "src" ; N.field "dst" ] ;
+      aggrs = [ Sum, N.field "bytes" ; Max, N.field "packets" ] }
+*)
+(*$T preagg_columns
+  preagg_columns spec (List.map N.field [ "start" ; "src" ; "bytes" ; \
+                                          "dst" ; "packets" ]) = \
+    [| Aggr 0 ; Key 1 ; Aggr 1 ; Key 0 ; Start |]
+  try ignore (preagg_columns spec [ N.field "ip_tos" ]) ; false \
+  with Failure _ -> true
+*)
@@ -9,18 +9,162 @@ external decode :
   Bytes.t -> int -> RamenIp.t nullable -> netflow_metric array =
   "wrap_netflow_v5_decode"
 
+(* Receive and decode all the available datagrams at once, whatever their
+ * version (v5, v9 or IPFIX): *)
+external recv : Unix.file_descr -> netflow_metric array =
+  "wrap_netflow_recv"
+
 let collector ~inet_addr ~port ?while_ k =
   (* Listen to incoming UDP datagrams on given port: *)
-  let serve ?sender buffer recv_len =
-    let sender = Option.map RamenIp.of_unix_addr sender in
-    !logger.debug "Received %d bytes from netflow source @ %a"
-      recv_len
-      (Option.print RamenIp.print) sender ;
-    decode buffer recv_len (nullable_of_option sender) |>
-    Array.iter k
+  let serve flows =
+    !logger.debug "Received %d flows from netflow sources"
+      (Array.length flows) ;
+    Array.iter k flows
+  in
+  udp_batch_server ~what:"netflow sink" ~inet_addr ~port ?while_ recv serve
+
+(* Receive and decode all the available datagrams at once, to be then
+ * retrieved with either [batch], [batch_into] or [preagg_batch_into].
+ * Returns the number of flows: *)
+external recv_batch : Unix.file_descr -> int =
+  "wrap_netflow_recv_batch"
+
+external batch : unit -> netflow_metric array =
+  "wrap_netflow_batch"
+
+(* Write the flows of the last received batch straight into the given
+ * ringbuffer, in the serialization format of [tuple_typ] with all fields
+ * selected, bypassing OCaml values altogether. Returns the number of
+ * written flows and the flows that did not fit. *)
+external batch_into : RingBuf.t -> int * netflow_metric array =
+  "wrap_netflow_batch_into"
+
+(* Like [collector], but whenever [direct_rb ()] returns a ringbuffer the
+ * flows are written straight into it and [k_direct] is told how many were
+ * written. Flows that do not fit are passed to [k] instead, so that the
+ * regular output waits for room rather than dropping them: *)
+let collector_direct ~inet_addr ~port ?while_ ~on_unload:_ direct_rb
+                     k_direct k =
+  let serve _num_flows =
+    let num_written, flows =
+      match direct_rb () with
+      | Some rb -> batch_into rb
+      | None -> 0, batch () in
+    !logger.debug "Received %d flows from netflow sources (%d written \
+                   directly)"
+      (num_written + Array.length flows) num_written ;
+    if num_written > 0 then k_direct num_written ;
+    Array.iter k flows
+  in
+  udp_batch_server ~what:"netflow sink" ~inet_addr ~port ?while_
+    recv_batch serve
+
+(* Pre-aggregation (see RamenNetflow.preagg_spec): *)
+type preagg
+
+external preagg_create :
+  float -> int array -> (int * int * int) array -> preagg_column array ->
+    preagg =
+  "wrap_netflow_preagg_create"
+
+(* Aggregate the flows of the last received batch into the given
+ * ringbuffer. Returns the number of flows that were not aggregated yet
+ * because a row did not fit (call it again once there is room), and the
+ * late flows that must be output as they are: *)
+external preagg_batch_into : preagg -> RingBuf.t -> int * netflow_metric array =
+  "wrap_netflow_preagg_batch_into"
+
+(* Write the rows of the current bucket right away. Returns false if not all
+ * of them could be written: *)
+external preagg_flush_into : preagg -> RingBuf.t -> bool =
+  "wrap_netflow_preagg_flush_into"
+
+(* [preagg_expire_into preagg now grace rb] writes the rows of the current
+ * bucket if it ended more than [grace] seconds before [now]. Returns false
+ * if not all of them could be written: *)
+external preagg_expire_into : preagg -> float -> float -> RingBuf.t -> bool =
+  "wrap_netflow_preagg_expire_into"
+
+external preagg_num_late : preagg -> int =
+  "wrap_netflow_preagg_num_late"
+
+let make_preagg spec columns =
+  let op_index = function
+    | Sum -> 0 | Min -> 1 | Max -> 2 in
+  preagg_create
+    spec.bucket_duration
+    (List.map preagg_field_index spec.keys |> Array.of_list)
+    (List.map (fun (op, name) ->
+      op_index op, preagg_field_index name, preagg_max_value name
+    ) spec.aggrs |> Array.of_list)
+    columns
+
+(* Like [collector_direct], but the flows are aggregated according to
+ * [spec] before they are written into the ringbuffer returned by
+ * [direct_rb], as rows made of the given [columns]. Flows received while
+ * [direct_rb] returns None, and late flows, are passed to [k] as usual.
+ * A bucket is written when a flow of a later bucket is received or, as
+ * flows are exported after they end, one bucket duration after its end.
+ * When the ringbuffer is full, this waits for room rather than dropping
+ * rows. The rows still held when the ringbuffer is unloaded are written if
+ * they fit. *)
+let collector_preagg spec columns ~inet_addr ~port ?(while_=always)
+                     ~on_unload direct_rb k_direct k =
+  let preagg = make_preagg spec columns in
+  (* The ringbuffer the rows of the current bucket are meant for: *)
+  let cur_rb = ref None in
+  on_unload (fun rb ->
+    match !cur_rb with
+    | Some prev when prev == rb ->
+        (* Rows that do not fit will go into the next ringbuffer: *)
+        if not (preagg_flush_into preagg rb) then
+          !logger.warning "Could not write all pre-aggregated rows before \
+                           unloading their ringbuffer" ;
+        cur_rb := None
+    | _ -> ()) ;
+  let wait_for_room what f =
+    let on = function RingBuf.NoMoreRoom -> true | _ -> false in
+    retry ~on ~first_delay:0.001 ~max_delay:1. ~while_ (fun () ->
+      if not (f ()) then (
+        !logger.debug "No more room to write %s" what ;
+        raise RingBuf.NoMoreRoom)) () in
+  let flush_pending () =
+    Option.may (fun rb ->
+      wait_for_room "pre-aggregated rows" (fun () ->
+        preagg_expire_into preagg (Unix.gettimeofday ())
+                           spec.bucket_duration rb)
+    ) !cur_rb in
+  let recv sock =
+    try recv_batch sock
+    with Unix.(Unix_error ((EAGAIN | EWOULDBLOCK), _, _)) ->
+      (* Timed out, giving a chance to expire the current bucket: *)
+      0 in
+  let serve num_flows =
+    if num_flows > 0 then (
+      match direct_rb () with
+      | None ->
+          Array.iter k (batch ())
+      | Some rb ->
+          (* Any previous ringbuffer has been unloaded already: *)
+          cur_rb := Some rb ;
+          wait_for_room "flows" (fun () ->
+            let num_left, late = preagg_batch_into preagg rb in
+            if Array.length late > 0 then
+              !logger.debug "Received %d late flows (%d so far)"
+                (Array.length late) (preagg_num_late preagg) ;
+            Array.iter k late ;
+            num_left = 0) ;
+          !logger.debug "Aggregated %d flows from netflow sources" num_flows ;
+          k_direct num_flows) ;
+    flush_pending ()
   in
-  udp_server
-    ~what:"netflow sink" ~inet_addr ~port ?while_ serve
+  let recv_timeout = min 1. spec.bucket_duration in
+  udp_batch_server ~what:"netflow sink" ~inet_addr ~port ~while_
+                   ~recv_timeout recv serve ;
+  Option.may (fun rb ->
+    if not (preagg_flush_into preagg rb) then
+      !logger.warning "Lost some pre-aggregated rows at exit"
+  ) !cur_rb
 
 let test ?(port=2055) () =
   init_logger Normal ;
@@ -639,6 +639,85 @@ let parents_of_operation = function
   | Aggregate { from ; _ } ->
       List.map func_id_of_data_source from
 
+(* If the aggregation [op], reading from a netflow listener, can be started
+ * by that listener (see RamenNetflow.preagg_spec), returns how.
+ * That is the case when it groups by some plain fields and by
+ * [start // duration], only sums, mins or maxs the other fields it uses,
+ * and uses start (or stop) only as [min start] (or [max stop]) or in its
+ * commit condition. Since [count] counts rows, not flows, it must not be
+ * used. *)
+let netflow_preagg op =
+  let module NF = RamenNetflow in
+  let reject () = raise Exit in
+  let in_field e =
+    match e.E.text with
+    | Stateless (SL2 (Get, n, { text = Variable TupleIn ; _ })) ->
+        Option.map N.field (E.string_of_const n)
+    | Stateless (SL0 (Path [ E.Name n ])) ->
+        Some n
+    | _ -> None in
+  match op with
+  | Aggregate { fields ; and_all_others = false ; merge ; sort = None ;
+                where ; notifications ; key ; commit_cond ; every = None ;
+                _ } when merge.on = [] ->
+      (try
+        let bucket_duration, keys =
+          List.fold_left (fun (duration, keys) k ->
+            match k.E.text, in_field k with
+            | _, Some f when NF.is_preagg_field f ->
+                duration, f :: keys
+            | Stateless (SL2 (IDiv, start, d)), None
+              when in_field start = Some (N.field "start") &&
+                   duration = None ->
+                (match E.float_of_const d with
+                | Some d when d > 0. -> Some d, keys
+                | _ -> reject ())
+            | _ -> reject ()
+          ) (None, []) key in
+        let bucket_duration =
+          match bucket_duration with Some d -> d | None -> reject ()
+        and keys = List.rev keys in
+        let aggrs = ref [] in
+        let add_aggr op f =
+          match List.assoc f !aggrs with
+          | exception Not_found -> aggrs := (f, op) :: !aggrs
+          | op' -> if op <> op' then reject () in
+        (* [in_commit]: whether start and stop can be used as they are: *)
+        let rec check in_commit e =
+          match e.E.text, in_field e with
+          | _, Some f ->
+              if not (List.mem f keys ||
+                      in_commit && N.(f = field "start" || f = field "stop"))
+              then reject ()
+          | Stateful (_, _, SF1 ((AggrSum | AggrMin | AggrMax) as aggr, x)),
+            None when in_field x <> None ->
+              let f = Option.get (in_field x) in
+              (match aggr, (f :> string) with
+              | AggrMin, "start" | AggrMax, "stop" ->
+                  ()
+              | (AggrMin | AggrMax), _ when List.mem f keys ->
+                  ()
+              | _, ("start" | "stop") ->
+                  reject ()
+              | _ ->
+                  if List.mem f keys || not (NF.is_preagg_field f) then
+                    reject () ;
+                  add_aggr (match aggr with AggrSum -> NF.Sum
+                                          | AggrMin -> NF.Min
+                                          | _ -> NF.Max) f)
+          | (Stateful _ | Variable TupleIn), None ->
+              reject ()
+          | _ ->
+              E.fold_subexpressions (fun _ () e -> check in_commit e) [] () e
+        in
+        List.iter (fun sf -> check false sf.expr) fields ;
+        List.iter (check false) (where :: notifications) ;
+        check true commit_cond ;
+        Some NF.{ bucket_duration ; keys ;
+                  aggrs = List.rev_map (fun (f, op) -> op, f) !aggrs }
+      with Exit -> None)
+  | _ -> None
+
 let factors_of_operation = function
   | ReadExternal { factors ; _ }
   | Aggregate { factors ; _ } -> factors
@@ -1820,5 +1899,28 @@ struct
         (test_op "YIELD 1 AS one EVERY 1 SECONDS")
   *)
 
+  (*$inject
+    let preagg_of s =
+      match test_p p s with
+      | Ok (op, _) ->
+          RamenOperation.(netflow_preagg (checked [] op))
+      | _ -> assert false
+  *)
+  (*$T preagg_of
+    preagg_of "from nf select src, min start as start, max stop as stop, \
+                 sum bytes as bytes, max packets as max_packets \
+               group by src, start // 60 \
+               commit after in.start > out.stop + 60" = \
+      Some RamenNetflow.{ \
+        bucket_duration = 60. ; keys = [ N.field "src" ] ; \
+        aggrs = [ Sum, N.field "bytes" ; Max, N.field "packets" ] }
+    preagg_of "from nf select src, sum 1 as n group by src, start // 60" = None
+    preagg_of "from nf select src, sum bytes as b group by src" = None
+    preagg_of "from nf select src, bytes group by src, start // 60" = None
+    preagg_of "from nf select src, sum bytes as b, max bytes as m \
+               group by src, start // 60" = None
+    preagg_of "from nf select max start as s group by start // 60" = None
+  *)
+
   (*$>*)
 end
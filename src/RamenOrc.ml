@@ -539,6 +539,306 @@ let emit_write_value func_name rtyp oc =
 (* ...where flush_batch check for handle->num_batches and close the file and
  * reset handler->ri when the limit is reached.  *)
 
+(*
+ * Converting ringbuf archives into ORC files
+ *
+ * Instead of deserializing each archived tuple into an OCaml value to then
+ * pass it to the function generated by [emit_write_value], the converter
+ * reads the serialized tuples right from the ringbuffer and fills the
+ * vector batches directly. See RingBufLib and ringbuf/wrappers.c for the
+ * serialization format.
+ *)
+
+(* Name of the function converting a whole ringbuffer into an ORC file,
+ * given the name of the function that writes single values: *)
+let ringbuf_converter_name func_name =
+  func_name ^"_of_ringbuf"
+
+(* Emits the code to read the non-null scalar of type [st] at the current
+ * offset of the RbReader [rb] and to store it in [vb_var] at row [i_var].
+ * Mirrors [emit_store_data]. *)
+let rec emit_store_serialized indent vb_var i_var st oc =
+  let p fmt = emit oc indent fmt in
+  let read c_typ sersize =
+    Printf.sprintf "rb.read<%s>(%d)" c_typ sersize in
+  let store c_typ sersize =
+    p "%s->data[%s] = %s;" vb_var i_var (read c_typ sersize)
+  and store_i128 c_typ sersize =
+    let tmp_var = gensym "i128" in
+    p "%s const %s = %s;" c_typ tmp_var (read c_typ sersize) ;
+    p "%s->values[%s] = Int128((int64_t)(%s >> 64), (int64_t)%s);"
+      vb_var i_var tmp_var tmp_var
+  and store_cidr ip_st msk_typ msk_sersize =
+    let ip_vb = batch_type_of_structure ip_st in
+    let ips = gensym "ips" and msks = gensym "msks" in
+    p "%s *%s = dynamic_cast<%s *>(%s->fields[0]);" ip_vb ips ip_vb vb_var ;
+    emit_store_serialized indent ips i_var ip_st oc ;
+    let msk_vb = batch_type_of_structure T.TNum in
+    p "%s *%s = dynamic_cast<%s *>(%s->fields[1]);" msk_vb msks msk_vb vb_var ;
+    p "%s->data[%s] = %s;" msks i_var (read msk_typ msk_sersize)
+  and store_union tag_var cases =
+    let vbs = gensym "vbs" in
+    p "switch (%s) {" tag_var ;
+    List.iteri (fun i (tag, st) ->
+      let vb = batch_type_of_structure st in
+      p "  case %d: /* %a */" tag T.print_structure st ;
+      p "    {" ;
+      p "      %s *%s = dynamic_cast<%s *>(%s->children[%d]);"
+        vb vbs vb vb_var i ;
+      p "      %s->tags[%s] = %d;" vb_var i_var i ;
+      p "      %s->offsets[%s] = %s->numElements;" vb_var i_var vbs ;
+      emit_store_serialized (indent + 3) vbs (vbs ^"->numElements") st oc ;
+      p "      %s->numElements++;" vbs ;
+      p "      break;" ;
+      p "    }"
+    ) cases ;
+    p "  default: /* Invalid */" ;
+    p "    rb.ok = false;" ;
+    p "    break;" ;
+    p "}"
+  in
+  match st with
+  | T.TEmpty | T.TAny | T.TNum
+  (* Never called on compound types (dealt with by
+   * emit_add_serialized_to_batch): *)
+  | T.TTuple _ | T.TVec _ | T.TList _ | T.TRecord _ ->
+      assert false
+  | T.TBool ->
+      store "uint32_t" RingBufLib.sersize_of_bool
+  | T.TU8 -> store "uint8_t" RingBufLib.sersize_of_u8
+  | T.TI8 -> store "int8_t" RingBufLib.sersize_of_i8
+  | T.TU16 -> store "uint16_t" RingBufLib.sersize_of_u16
+  | T.TI16 -> store "int16_t" RingBufLib.sersize_of_i16
+  | T.TU32 -> store "uint32_t" RingBufLib.sersize_of_u32
+  | T.TI32 -> store "int32_t" RingBufLib.sersize_of_i32
+  | T.TIpv4 -> store "uint32_t" RingBufLib.sersize_of_ipv4
+  | T.TU64 -> store "uint64_t" RingBufLib.sersize_of_u64
+  | T.TI64 -> store "int64_t" RingBufLib.sersize_of_i64
+  (* Stored as the whole 8 bytes of the custom value (see WRITE_BOXED): *)
+  | T.TEth -> store "uint64_t" RingBufLib.sersize_of_eth
+  | T.TFloat -> store "double" RingBufLib.sersize_of_float
+  | T.TU128 -> store_i128 "uint128_t" RingBufLib.sersize_of_u128
+  | T.TIpv6 -> store_i128 "uint128_t" RingBufLib.sersize_of_ipv6
+  | T.TI128 -> store_i128 "int128_t" RingBufLib.sersize_of_i128
+  | T.TString ->
+      (* Strings are not copied but point directly into the ringbuffer: *)
+      let len_var = gensym "len" in
+      p "uint32_t %s = %s;" len_var (read "uint32_t" RingBufLib.sersize_of_u32) ;
+      p "%s->data[%s] = rb.read_bytes(%s);" vb_var i_var len_var ;
+      p "%s->length[%s] = %s;" vb_var i_var len_var
+  | T.TIp ->
+      (* The tag is the OCaml constructor (0 for v4 and 1 for v6), written
+       * in a full word: *)
+      let tag_var = gensym "tag" in
+      p "uint32_t const %s = %s;" tag_var
+        (read "uint32_t" RingBuf.rb_word_bytes) ;
+      store_union tag_var [ 0, T.TIpv4 ; 1, T.TIpv6 ]
+  | T.TCidrv4 ->
+      store_cidr T.TIpv4 "uint8_t" RingBufLib.sersize_of_u8
+  | T.TCidrv6 ->
+      store_cidr T.TIpv6 "uint16_t" RingBufLib.sersize_of_u16
+  | T.TCidr ->
+      (* Here the tag is the IP version: *)
+      let tag_var = gensym "tag" in
+      p "uint8_t const %s = %s;" tag_var (read "uint8_t" RingBufLib.sersize_of_u8) ;
+      store_union tag_var [ 4, T.TCidrv4 ; 6, T.TCidrv6 ]
+
+(* Iterates over the fields of a record in serialization order, calling [f]
+ * with the index in that order and the index of the corresponding ORC
+ * field (that are in definition order without private fields): *)
+let iter_serialized_fields kts f =
+  let orc_kts =
+    Array.filter (fun (k, _) -> not N.(is_private (field k))) kts in
+  Array.iteri (fun si (k, t) ->
+    let oi = Array.findi (fun (k', _) -> k' = k) orc_kts in
+    f si oi k t
+  ) (RingBufLib.ser_order kts)
+
+(* Emits the code to read a value of type [rtyp] from the RbReader [rb] and
+ * to add it into the ColumnVectorBatch [batch_var] at row [i_var].
+ * [present] is false when an enclosing value is null, in which case there
+ * is nothing to read and all subfields must be set to null.
+ * [nullbit] is the C++ expressions for the offset of the nullmask and the
+ * index of the bit telling if that value is null; only meaningful when
+ * [rtyp] is nullable.
+ * Mirrors [emit_add_value_to_batch]. *)
+let rec emit_add_serialized_to_batch
+          indent present nullbit batch_var i_var rtyp field_name oc =
+  let p fmt = emit oc indent fmt in
+  let add_to_batch indent present =
+    let p fmt = emit oc indent fmt in
+    let iter_struct kts =
+      (* Compound types start with a nullmask with one bit per item: *)
+      let tup_start = gensym "tup_start" in
+      if present then (
+        p "size_t const %s = rb.offs;" tup_start ;
+        p "rb.offs += %d; /* nullmask */"
+          (RingBufLib.nullmask_sz_of_record kts)) ;
+      iter_serialized_fields kts (fun si oi k t ->
+        p "{ /* Structure/Tuple item %s */" k ;
+        let btyp = batch_type_of_structure t.T.structure in
+        let arr_item = gensym "arr_item" in
+        p "  %s *%s = dynamic_cast<%s *>(%s->fields[%d]);"
+          btyp arr_item btyp batch_var oi ;
+        let field_name =
+          if field_name = "" then k else field_name ^"."^ k
+        and i_var = Printf.sprintf "%s->numElements" arr_item in
+        emit_add_serialized_to_batch
+          (indent + 1) present (tup_start, string_of_int si) arr_item i_var
+          t field_name oc ;
+        p "}")
+    in
+    match rtyp.T.structure with
+    | T.TEmpty | T.TAny ->
+        assert false
+    | T.TBool
+    | T.TU8 | T.TU16 | T.TU32 | T.TU64
+    | T.TI8 | T.TI16 | T.TI32 | T.TI64
+    | T.TU128 | T.TI128
+    | T.TIpv4 | T.TIpv6 | T.TIp
+    | T.TCidrv4 | T.TCidrv6 | T.TCidr
+    | T.TNum | T.TEth | T.TFloat | T.TString ->
+        if present then (
+          p "/* Write the value for %s (of type %a) */"
+            (if field_name <> "" then field_name else "root value")
+            T.print_typ rtyp ;
+          emit_store_serialized indent batch_var i_var rtyp.T.structure oc)
+    | T.TTuple ts ->
+        Array.mapi (fun i t -> string_of_int i, t) ts |>
+        iter_struct
+    | T.TRecord kts ->
+        iter_struct kts
+    | T.TList t | T.TVec (_, t) ->
+        (* Lists are prefixed with their length, then lists and vectors
+         * have a nullmask with one bit per item: *)
+        let len_var = gensym "len" in
+        if present then (
+          p "/* Write the values for %s (of type %a) */"
+            (if field_name <> "" then field_name else "root value")
+            T.print_typ t ;
+          (match rtyp.T.structure with
+          | T.TVec (d, _) ->
+              p "uint32_t const %s = %d;" len_var d
+          | _ ->
+              p "uint32_t const %s = rb.read_count(%d);"
+                len_var RingBufLib.sersize_of_u32) ;
+          let arr_start = gensym "arr_start" in
+          p "size_t const %s = rb.offs;" arr_start ;
+          p "rb.offs += rb_nullmask_sz(%s);" len_var ;
+          let vb = gensym "vb" in
+          emit_get_vb indent vb t (batch_var ^"->elements.get()") oc ;
+          let bi_lst = gensym "bi_lst" in
+          p "uint64_t const %s = %s->numElements;" bi_lst vb ;
+          let idx_var = gensym "idx" in
+          p "for (uint32_t %s = 0; %s < %s; %s++) {"
+            idx_var idx_var len_var idx_var ;
+          emit_add_serialized_to_batch
+            (indent + 1) true (arr_start, idx_var) vb (bi_lst ^"+"^ idx_var)
+            t (field_name ^".elmt") oc ;
+          p "}") ;
+        (* Regardless of the value being NULL or not, when we have a
+         * list we must initialize the offsets value. *)
+        p "%s->offsets[%s + 1] = %s->offsets[%s] + %s;"
+          batch_var i_var batch_var i_var (if present then len_var else "0")
+  in
+  let set_null indent =
+    let p fmt = emit oc indent fmt in
+    p "%s->hasNulls = true;" batch_var ;
+    p "%s->notNull[%s] = 0;" batch_var i_var in
+  if present && rtyp.T.nullable then (
+    let nullmask_var, bit_var = nullbit in
+    p "if (rb.get_bit(%s, %s)) { /* Not null */" nullmask_var bit_var ;
+    add_to_batch (indent + 1) true ;
+    p "} else { /* Null */" ;
+    set_null (indent + 1) ;
+    add_to_batch (indent + 1) false ;
+    p "}"
+  ) else (
+    if not present then set_null indent ;
+    add_to_batch indent present
+  ) ;
+  p "%s->numElements++;" batch_var
+
+(* Generate an OCaml callable function named [func_name] that receives a
+ * "handler" and a (non wrapping) ringbuffer of tuples of type [rtyp], the
+ * output record of some function, and writes all of these tuples in the
+ * handler ORC file, which is then closed. Returns the number of tuples
+ * and errors; on error the conversion is interrupted and the resulting ORC
+ * file should be ignored. *)
+let emit_write_from_ringbuf func_name rtyp oc =
+  let p fmt = emit oc 0 fmt in
+  let kts =
+    match rtyp.T.structure with
+    | T.TRecord kts -> kts
+    | _ -> invalid_arg "emit_write_from_ringbuf: not a record" in
+  let record_func = func_name ^"_record" in
+  p "/* Add the tuple serialized in [words] to the batch. Returns false if" ;
+  p " * the record is invalid. */" ;
+  p "static bool %s(void *handler_, uint32_t const *words, size_t sz)"
+    record_func ;
+  p "{" ;
+  p "  OrcHandler *handler = static_cast<OrcHandler *>(handler_);" ;
+  p "  RbReader rb(words, sz);" ;
+  p "  uint32_t const head = rb.read<uint32_t>(%d);"
+    RingBufLib.(message_header_sersize (DataTuple RamenChannel.live)) ;
+  p "  if (! rb.ok) return false;" ;
+  p "  // Archives have only live tuples (a header of 0) but skip anything else:" ;
+  p "  if (head != 0) return true;" ;
+  p "  if (! handler->writer) handler->start_write();" ;
+  emit_get_vb 1 "root" rtyp "handler->batch.get()" oc ;
+  (* Top level nullmask has only bits for the nullable fields: *)
+  let num_nullables =
+    Array.fold_left (fun n (_, t) ->
+      if t.T.nullable then n + 1 else n
+    ) 0 (RingBufLib.ser_order kts) in
+  p "  size_t const nullmask_start = rb.offs;" ;
+  p "  rb.offs += %d; /* nullmask */"
+    RingBuf.(round_up_to_rb_word (bytes_for_bits num_nullables)) ;
+  let nulli = ref 0 in
+  iter_serialized_fields kts (fun _si oi k t ->
+    p "  { /* Field %s */" k ;
+    let btyp = batch_type_of_structure t.T.structure in
+    let arr_item = gensym "arr_item" in
+    p "    %s *%s = dynamic_cast<%s *>(root->fields[%d]);"
+      btyp arr_item btyp oi ;
+    let i_var = Printf.sprintf "%s->numElements" arr_item in
+    emit_add_serialized_to_batch
+      2 true ("nullmask_start", string_of_int !nulli) arr_item i_var t k oc ;
+    if t.T.nullable then incr nulli ;
+    p "  }") ;
+  p "  root->numElements++;" ;
+  p "  if (! rb.ok) return false;" ;
+  p "  if (root->numElements >= root->capacity) {" ;
+  p "    handler->flush_batch(true);" ;
+  p "    root->numElements = 0;" ;
+  p "  }" ;
+  p "  return true;" ;
+  p "}" ;
+  p "" ;
+  p "extern \"C\" CAMLprim value %s(value hder_, value rb_)" func_name ;
+  p "{" ;
+  p "  CAMLparam2(hder_, rb_);" ;
+  p "  CAMLlocal1(res);" ;
+  p "  OrcHandler *handler = Handler_val(hder_);" ;
+  p "  // Individual tuples have no time range but the whole archive has:" ;
+  p "  ssize_t const num_lines =" ;
+  p "    ringbuf_iter(rb_, %s, handler, &handler->start, &handler->stop);"
+    record_func ;
+  p "  if (num_lines >= 0) {" ;
+  p "    // Strings point into the ringbuffer so flush before it's unloaded:" ;
+  p "    handler->flush_batch(false);" ;
+  p "  } else {" ;
+  p "    // Do not try to write a batch that's been left half filled:" ;
+  p "    handler->writer.reset();" ;
+  p "    handler->batch.reset();" ;
+  p "    handler->outStream.reset();" ;
+  p "  }" ;
+  p "  res = caml_alloc(2, 0);" ;
+  p "  Store_field(res, 0, Val_long(num_lines < 0 ? 0 : num_lines));" ;
+  p "  Store_field(res, 1, Val_long(num_lines < 0 ? 1 : 0));" ;
+  p "  CAMLreturn(res);" ;
+  p "}"
+
 (*
  * Reading ORC files
  *)
@@ -754,15 +1054,10 @@ let rec emit_read_value_from_batch
     emit_read_nonnull indent
   )
 
-(* Generate an OCaml callable function named [func_name] that receive a
- * file name, a batch size and an OCaml callback and read that file, calling
- * back OCaml code with each row as an OCaml value: *)
-let emit_read_values func_name rtyp oc =
+(* Declare the OCaml locals used by [emit_read_value_from_batch]: *)
+let emit_read_locals oc =
   let p fmt = emit oc 0 fmt in
   let max_depth = 7 (* TODO *) in
-  p "extern \"C\" value %s(value path_, value batch_sz_, value cb_)" func_name ;
-  p "{" ;
-  p "  CAMLparam3(path_, batch_sz_, cb_);" ;
   p "  CAMLlocal1(res);" ;
   let rec localN n =
     if n < max_depth then
@@ -771,7 +1066,44 @@ let emit_read_values func_name rtyp oc =
         (Enum.print ~sep:", " (fun oc n -> Printf.fprintf oc "tmp%d" n))
           (Enum.range n ~until:(n + c - 1)) ;
       localN (n + c) in
-  localN 0 ;
+  localN 0
+
+(* Emit the loop over all rows of [batch_var], calling back [cb_] with each
+ * of them. Increments num_lines and num_errors; [path_var] is only used for
+ * error reporting: *)
+let emit_read_rows indent rtyp batch_var path_var oc =
+  let p fmt = emit oc indent fmt in
+  p "for (uint64_t row = 0; row < %s->numElements; row++) {" batch_var ;
+  emit_read_value_from_batch (indent + 1) 0 batch_var "row" "res" rtyp oc ;
+  p "  res = caml_callback_exn(cb_, res);" ;
+  p "  if (Is_exception_result(res)) {" ;
+  p "    res = Extract_exception(res);" ;
+  p "    // Print only the first 10 such exceptions:" ;
+  p "    if (num_errors++ < 10) {" ;
+  p "      cerr << \"Exception while reading ORC file \" << %s" path_var ;
+  p "           << \": to_be_printed\\n\";" ;
+  p "    }" ;
+  p "  }" ;
+  p "  num_lines++;" ;
+  p "}"
+
+let emit_read_return oc =
+  let p fmt = emit oc 0 fmt in
+  p "  // Return the number of lines and errors:" ;
+  p "  res = caml_alloc(2, 0);" ;
+  p "  Store_field(res, 0, Val_long(num_lines));" ;
+  p "  Store_field(res, 1, Val_long(num_errors));" ;
+  p "  CAMLreturn(res);"
+
+(* Generate an OCaml callable function named [func_name] that receive a
+ * file name, a batch size and an OCaml callback and read that file, calling
+ * back OCaml code with each row as an OCaml value: *)
+let emit_read_values func_name rtyp oc =
+  let p fmt = emit oc 0 fmt in
+  p "extern \"C\" value %s(value path_, value batch_sz_, value cb_)" func_name ;
+  p "{" ;
+  p "  CAMLparam3(path_, batch_sz_, cb_);" ;
+  emit_read_locals oc ;
   p "  char const *path = String_val(path_);" ;
   p "  unsigned batch_sz = Long_val(batch_sz_);" ;
   p "  unique_ptr<InputStream> in_file = readLocalFile(path);" ;
@@ -785,32 +1117,55 @@ let emit_read_values func_name rtyp oc =
   p "  unsigned num_lines = 0;" ;
   p "  unsigned num_errors = 0;" ;
   p "  while (row_reader->next(*batch)) {" ;
-  p "    for (uint64_t row = 0; row < batch->numElements; row++) {" ;
-  emit_read_value_from_batch 3 0 "batch.get()" "row" "res" rtyp oc ;
-  p "      res = caml_callback_exn(cb_, res);" ;
-  p "      if (Is_exception_result(res)) {" ;
-  p "        res = Extract_exception(res);" ;
-  p "        // Print only the first 10 such exceptions:" ;
-  p "        if (num_errors++ < 10) {" ;
-  p "          cerr << \"Exception while reading ORC file \" << path" ;
-  p "               << \": to_be_printed\\n\";" ;
-  p "        }" ;
-  p "      }" ;
-  p "      num_lines++;" ;
-  p "    }" ;
+  emit_read_rows 2 rtyp "batch.get()" "path" oc ;
   p "  }" ;
-  p "  // Return the number of lines and errors:" ;
-  p "  res = caml_alloc(2, 0);" ;
-  p "  Store_field(res, 0, Val_long(num_lines));" ;
-  p "  Store_field(res, 1, Val_long(num_errors));" ;
-  p "  CAMLreturn(res);" ;
+  emit_read_return oc ;
+  p "}"
+
+(* Name of the parallel version of the reader named [func_name]: *)
+let parallel_reader_name func_name =
+  func_name ^"_par"
+
+(* Same as above, but for a whole array of file names, which stripes are
+ * decoded by [num_threads] threads. Rows are still passed to the callback
+ * in file and stripe order, by the calling thread. *)
+let emit_read_values_parallel func_name rtyp oc =
+  let p fmt = emit oc 0 fmt in
+  p "extern \"C\" value %s(value paths_, value batch_sz_, value num_threads_, value cb_)"
+    func_name ;
+  p "{" ;
+  p "  CAMLparam4(paths_, batch_sz_, num_threads_, cb_);" ;
+  emit_read_locals oc ;
+  p "  unsigned batch_sz = Long_val(batch_sz_);" ;
+  p "  unsigned num_threads = Long_val(num_threads_);" ;
+  p "  vector<string> paths;" ;
+  p "  for (mlsize_t i = 0; i < Wosize_val(paths_); i++)" ;
+  p "    paths.emplace_back(String_val(Field(paths_, i)));" ;
+  p "  OrcStripeReader reader(paths, batch_sz, num_threads);" ;
+  p "  unsigned num_lines = 0;" ;
+  p "  unsigned num_errors = 0;" ;
+  p "  while (true) {" ;
+  p "    // Let other OCaml threads run while we wait for the decoders:" ;
+  p "    caml_enter_blocking_section();" ;
+  p "    ColumnVectorBatch *batch = reader.next_batch();" ;
+  p "    caml_leave_blocking_section();" ;
+  p "    if (! batch) break;" ;
+  p "    char const *path = reader.current_path();" ;
+  emit_read_rows 2 rtyp "batch" "path" oc ;
+  p "  }" ;
+  p "  num_errors += reader.num_errors();" ;
+  emit_read_return oc ;
   p "}"
 
 let emit_intro oc =
   let p fmt = emit oc 0 fmt in
   p "/* This code is automatically generated. Edition is futile. */" ;
   p "#include <cassert>" ;
+  p "#include <cstring>" ;
   p "#include <orc/OrcFile.hh>" ;
+  (* Shared with orc/wrappers.cc, so that both agree on the layout of
+   * OrcHandler (installed in the bundle): *)
+  p "#include <ramen/orc_handler.h>" ;
   p "extern \"C\" {" ;
   p "#  include <limits.h> /* CHAR_BIT */" ;
   p "#  include <caml/mlvalues.h>" ;
@@ -818,40 +1173,67 @@ let emit_intro oc =
   p "#  include <caml/alloc.h>" ;
   p "#  include <caml/custom.h>" ;
   p "#  include <caml/callback.h>" ;
+  p "#  include <caml/signals.h>" ;
+  p "#  include <sys/types.h> /* ssize_t */" ;
   p "extern struct custom_operations uint128_ops;" ;
   p "extern struct custom_operations uint64_ops;" ;
   p "extern struct custom_operations uint32_ops;" ;
   p "extern struct custom_operations int128_ops;" ;
   p "extern struct custom_operations caml_int64_ops;" ;
   p "extern struct custom_operations caml_int32_ops;" ;
+  p "extern ssize_t ringbuf_iter(" ;
+  p "  value, bool (*)(void *, uint32_t const *, size_t), void *, double *, double *);" ;
   p "}" ;
   p "typedef __int128_t int128_t;" ;
   p "typedef __uint128_t uint128_t;" ;
   p "using namespace std;" ;
   p "using namespace orc;" ;
   p "" ;
-  p "class OrcHandler {" ;
-  p "    unique_ptr<Type> type;" ;
-  p "    string fname;" ;
-  p "    bool const with_index;" ;
-  p "    unsigned const batch_size;" ;
-  p "    unsigned const max_batches;" ;
-  p "    unsigned num_batches;" ;
-  p "    bool archive;" ;
-  p "    std::vector<char> strs;" ;
-  p "  public:" ;
-  p "    OrcHandler(string schema, string fn, bool with_index, unsigned bsz, unsigned mb, bool arc);" ;
-  p "    ~OrcHandler();" ;
-  p "    void start_write();" ;
-  p "    void flush_batch(bool);" ;
-  p "    char *keep_string(char const *, size_t);" ;
-  p "    unique_ptr<OutputStream> outStream;" ;
-  p "    unique_ptr<Writer> writer;" ;
-  p "    unique_ptr<ColumnVectorBatch> batch;" ;
-  p "    double start, stop;" ;
-  p "};" ;
+  p "// Size of the nullmask of a compound value of [n] items in a ringbuffer:" ;
+  p "static inline size_t rb_nullmask_sz(size_t n)" ;
+  p "{" ;
+  p "  return (((n + 7) / 8) + 3) & ~(size_t)3;" ;
+  p "}" ;
+  p "" ;
+  p "// Reads values from a serialized ringbuffer record:" ;
+  p "struct RbReader {" ;
+  p "  uint8_t const *rec;" ;
+  p "  size_t const sz;" ;
+  p "  size_t offs;" ;
+  p "  bool ok;" ;
+  p "" ;
+  p "  RbReader(uint32_t const *words, size_t sz_) :" ;
+  p "    rec((uint8_t const *)words), sz(sz_), offs(0), ok(true) {}" ;
   p "" ;
-  p "#define Handler_val(v) (*((class OrcHandler **)Data_custom_val(v)))" ;
+  p "  // Read a value which serialized size is [sersize]:" ;
+  p "  template<class T> T read(size_t sersize) {" ;
+  p "    T v = T();" ;
+  p "    if (offs + sersize > sz) ok = false;" ;
+  p "    else memcpy(&v, rec + offs, sizeof v);" ;
+  p "    offs += sersize;" ;
+  p "    return v;" ;
+  p "  }" ;
+  p "" ;
+  p "  // Read a number of items, each of which needs at least a nullmask bit:" ;
+  p "  uint32_t read_count(size_t sersize) {" ;
+  p "    uint32_t n = read<uint32_t>(sersize);" ;
+  p "    if (offs > sz || n > 8 * (sz - offs)) { ok = false; n = 0; }" ;
+  p "    return n;" ;
+  p "  }" ;
+  p "" ;
+  p "  // Return the address of the next [len] bytes (zeroing [len] on error):" ;
+  p "  char *read_bytes(uint32_t &len) {" ;
+  p "    size_t const sersize = ((size_t)len + 3) & ~(size_t)3;" ;
+  p "    if (offs + sersize > sz) { ok = false; len = 0; }" ;
+  p "    char *s = (char *)(rec + (offs < sz ? offs : 0));" ;
+  p "    offs += sersize;" ;
+  p "    return s;" ;
+  p "  }" ;
+  p "" ;
+  p "  bool get_bit(size_t start, unsigned bit) const {" ;
+  p "    return start + bit/8 < sz && (rec[start + bit/8] & (1U << (bit % 8)));" ;
+  p "  }" ;
+  p "};" ;
   p ""
 
 let emit_outro oc =
@@ -17,6 +17,12 @@ let collector_of_proto = function
   | NetflowV5 -> "RamenNetflowSerialization.collector"
   | Graphite -> "RamenGraphiteSink.collector"
 
+(* Collectors that can also write their tuples straight into the output
+ * ringbuffer (see CodeGenLib_Skeletons.listen_on): *)
+let direct_collector_of_proto = function
+  | NetflowV5 -> Some "RamenNetflowSerialization.collector_direct"
+  | Collectd | Graphite -> None
+
 let event_time_of_proto = function
   | Collectd -> RamenCollectd.event_time
   | NetflowV5 -> RamenNetflow.event_time
@@ -229,9 +229,63 @@ let find_sources
  * then one can easily replay from an immediate expression, expressing
  * this complex selection in ramen language directly.
  * So, here [func] is supposed to mean the local instance of it only. *)
+(* Turns the comparisons of numeric fields with constants from a [where]
+ * filter into the bounds that those fields must be within, so that the
+ * replayer of the target can skip the archives that cannot match (see
+ * RingBufLib.replay_arc_files). Other conditions are ignored. *)
+let field_bounds_of_where where =
+  List.fold_left (fun bounds ((n : N.field), op, v) ->
+    match RamenTypes.float_of_scalar v with
+    | exception Invalid_argument _ -> bounds
+    | None -> bounds
+    | Some v ->
+        let mi, ma =
+          match op with
+          | "=" -> v, v
+          | ">" | ">=" -> v, infinity
+          | "<" | "<=" -> neg_infinity, v
+          | _ -> neg_infinity, infinity in
+        if mi = neg_infinity && ma = infinity then bounds else
+        let field = (n :> string) in
+        (* Several conditions on the same field must all hold: *)
+        match List.find (fun (f, _, _) -> f = field) bounds with
+        | exception Not_found ->
+            (field, mi, ma) :: bounds
+        | _, mi', ma' ->
+            (field, max mi mi', min ma ma') ::
+              List.filter (fun (f, _, _) -> f <> field) bounds
+  ) [] where |>
+  List.rev
+
+(*$= field_bounds_of_where & ~printer:BatPervasives.dump
+  [ "x", 1., 10. ; "y", 3., 3. ] \
+    (field_bounds_of_where RamenTypes.[ \
+      N.field "x", ">=", VU8 (Stdint.Uint8.of_int 1) ; \
+      N.field "y", "=", VFloat 3. ; \
+      N.field "z", "!=", VFloat 3. ; \
+      N.field "s", "=", VString "foo" ; \
+      N.field "x", "<", VI32 (Stdint.Int32.of_int 10) ])
+*)
+
+(* A replayer serves several replays, so it can only skip the archives that
+ * none of them want: *)
+let merge_field_bounds b1 b2 =
+  List.filter_map (fun (field, mi, ma) ->
+    match List.find (fun (f, _, _) -> f = field) b2 with
+    | exception Not_found -> None
+    | _, mi', ma' -> Some (field, min mi mi', max ma ma')
+  ) b1
+
+(*$= merge_field_bounds & ~printer:BatPervasives.dump
+  [ "x", 0., 10. ] \
+    (merge_field_bounds [ "x", 0., 5. ; "y", 1., 2. ] [ "x", 3., 10. ])
+  [] (merge_field_bounds [ "x", 0., 5. ] [])
+*)
+
 let create
       conf (stats : (N.site_fq, replay_stats) Hashtbl.t)
-      ?(timeout=Default.replay_timeout) ?resp_key site_name func since until =
+      ?(timeout=Default.replay_timeout) ?resp_key ?(field_bounds=[])
+      site_name func since until =
   let timeout_date = Unix.gettimeofday () +. timeout in
   let fq = F.fq_name func in
   let out_type =
@@ -276,7 +330,8 @@ let create
   let sources = Set.to_list sources
   and links = Set.to_list links in
   { channel ; target = site, fq ; target_fieldmask ;
-    since ; until ; recipient ; sources ; links ; timeout_date }
+    since ; until ; recipient ; sources ; links ; timeout_date ;
+    field_bounds }
 
 let teardown_links conf func_of_fq t =
   let rem_out_from (site, fq) =
@@ -32,6 +32,9 @@ module Watchdog = RamenWatchdog
 (* Seed to pass to workers to init their random generator: *)
 let rand_seed = ref None
 
+(* Number of threads to pass to replayers to decode ORC archives: *)
+let orc_read_threads = ref Default.orc_read_threads
+
 (* A single worker can replay for several channels. This is very useful
  * when a dashboard reloads with many graphs requesting the same time interval.
  * So replayers are aggregated for a little while before spawning them.
@@ -296,7 +299,8 @@ let start_worker
  * Pass to each replayer the name of the function, the out_ref files to
  * obey, the channel id to tag tuples with, and since/until dates.
  * Returns the pid. *)
-let start_replayer conf func bin since until channels replayer_id =
+let start_replayer
+      conf func bin since until channels field_bounds replayer_id =
   let fq = F.fq_name func in
   let args = [| Worker_argv0.replay ; (fq :> string) |]
   and out_ringbuf_ref = C.out_ringbuf_names_ref conf func
@@ -323,6 +327,13 @@ let start_replayer conf func bin since until channels replayer_id =
                              (Set.print ~first:"" ~last:"" ~sep:","
                                         RamenChannel.print) channels ;
            "replayer_id="^ string_of_int replayer_id ;
+           (* Hexadecimal floats so that bounds are not rounded: *)
+           "replay_filters="^ Printf.sprintf2 "%a"
+                                (List.print ~first:"" ~last:"" ~sep:";"
+                                  (fun oc (field, mi, ma) ->
+                                    Printf.fprintf oc "%s:%h:%h" field mi ma))
+                                field_bounds ;
+           "orc_read_threads="^ string_of_int !orc_read_threads ;
            "rand_seed="^ (match !rand_seed with None -> ""
                          | Some s -> string_of_int s) |])
       (sync_env conf "replayer" fq) |>
@@ -803,7 +814,8 @@ let update_replayer_status
               (Set.print Channel.print) replayer.channels ;
             let pid =
               start_replayer
-                conf func bin since until replayer.channels replayer_id in
+                conf func bin since until replayer.channels
+                replayer.field_bounds replayer_id in
             let v = Value.Replayer { replayer with pid = Some pid } in
             ZMQClient.send_cmd ~while_ ~eager:true
               (UpdKey (replayer_k, v)) ;
@@ -961,6 +973,11 @@ let synchronize_running conf kill_at_exit =
         (* Find or create all replayers: *)
         List.iter (fun (site, fq) ->
           if site = conf.C.site then (
+            (* Field bounds are on the fields of the target, so only its own
+             * archives can be skipped: *)
+            let field_bounds =
+              if (site, fq) = replay.target then replay.field_bounds
+              else [] in
             let prefix = "sites/"^ (site :> string) ^"/"^
                          (fq : N.fq :> string) ^"/replayers/" in
             let rs =
@@ -980,7 +997,8 @@ let synchronize_running conf kill_at_exit =
                 let id = Random.int RingBufLib.max_replayer_id in
                 let now = Unix.gettimeofday () in
                 let channels = Set.singleton chan in
-                let r = Value.Replayer.make now replay_range channels in
+                let r =
+                  Value.Replayer.make now replay_range channels field_bounds in
                 let replayer_k =
                   Key.PerSite (site, PerWorker (fq, PerReplayer id)) in
                 ZMQClient.send_cmd ~while_ ~eager:true
@@ -990,8 +1008,12 @@ let synchronize_running conf kill_at_exit =
                   "Adding replay for channel %a into replayer created at %a"
                   Channel.print chan print_as_date r.creation ;
                 let time_range = TimeRange.merge r.time_range replay_range
-                and channels = Set.add chan r.channels in
-                let replayer = Value.Replayer { r with time_range ; channels } in
+                and channels = Set.add chan r.channels
+                and field_bounds =
+                  Replay.merge_field_bounds r.field_bounds field_bounds in
+                let replayer =
+                  Value.Replayer { r with time_range ; channels ;
+                                          field_bounds } in
                 ZMQClient.send_cmd ~while_ ~eager:true
                   (UpdKey (k, replayer)))
         ) replay.sources
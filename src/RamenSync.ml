@@ -666,16 +666,19 @@ struct
         exit_status : string option ;
         (* What running chanels are using this process.
          * The replayer can be killed/deleted when empty. *)
-        channels : Channel.t Set.t }
+        channels : Channel.t Set.t ;
+        (* Bounds on numeric fields that hold for all those channels (see
+         * RamenReplay.merge_field_bounds): *)
+        field_bounds : (string * float * float) list }
 
     let print oc t =
       Printf.fprintf oc "Replayer { pid=%a; channels=%a }"
         (Option.print Int.print) t.pid
         (Set.print Channel.print) t.channels
 
-    let make creation time_range channels =
+    let make creation time_range channels field_bounds =
       { time_range ; creation ; pid = None ; last_killed = 0. ;
-        exit_status = None ; channels }
+        exit_status = None ; channels ; field_bounds }
   end
 
   type t =
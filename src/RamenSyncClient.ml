@@ -28,15 +28,20 @@ struct
       mutable on_set : t -> Key.t -> Value.t -> string -> float -> unit ;
       mutable on_del : t -> Key.t -> Value.t -> unit ; (* previous value *)
       mutable on_lock : t -> Key.t -> string -> float -> unit ;
-      mutable on_unlock : t -> Key.t -> unit }
+      mutable on_unlock : t -> Key.t -> unit ;
+      (* Keys which values have been loaded from some local copy (see
+       * [add_unconfirmed]) and not yet confirmed by the server: *)
+      unconfirmed : unit H.t }
 
   and hash_value =
     { mutable value : Value.t ;
       (* These metadata are set exclusively by the confserver.
        * Unreliable if eager. *)
-      (* We could also store can_write/del in here but that's not used *)
       mutable uid : string ;
       mutable mtime : float ;
+      (* As received at creation, to be able to save the value locally: *)
+      mutable can_write : bool ;
+      mutable can_del : bool ;
       mutable owner : string ; (* empty is none *)
       mutable expiry : float ; (* irrelevant if not owned *)
       (* If set eagerly but not received from the server yet: *)
@@ -46,7 +51,8 @@ struct
 
   let make ~my_uid ~on_new ~on_set ~on_del ~on_lock ~on_unlock =
     { h = Tree.empty ; waiters = H.create 99 ; my_socket = None ;
-      my_uid ; on_new ; on_set ; on_del ; on_lock ; on_unlock }
+      my_uid ; on_new ; on_set ; on_del ; on_lock ; on_unlock ;
+      unconfirmed = H.create 0 }
 
   let with_value t k cont =
     match Tree.get t.h k with
@@ -87,6 +93,29 @@ struct
 
   let mem t k = Tree.mem t.h k
 
+  (* Add a key which value is known from a previous session, and that the
+   * server is expected to either confirm (by listing it in a SyncKeys, or
+   * sending its new value) or not (see [drop_unconfirmed]): *)
+  let add_unconfirmed t k hv =
+    t.h <- Tree.add k hv t.h ;
+    H.replace t.unconfirmed k () ;
+    t.on_new t k hv.value hv.uid hv.mtime hv.can_write hv.can_del
+             hv.owner hv.expiry
+
+  (* Once synchronised, the keys that are still not confirmed no longer
+   * exist: *)
+  let drop_unconfirmed t =
+    !logger.debug "Dropping %d unconfirmed keys" (H.length t.unconfirmed) ;
+    H.iter (fun k () ->
+      match Tree.get t.h k with
+      | exception Not_found ->
+          ()
+      | hv ->
+          t.h <- Tree.rem k t.h ;
+          t.on_del t k hv.value
+    ) t.unconfirmed ;
+    H.clear t.unconfirmed
+
   let process_msg t = function
     | SrvMsg.AuthOk socket ->
         t.my_socket <- Some socket
@@ -96,9 +125,10 @@ struct
         failwith
 
     | SrvMsg.SetKey { k ; v ; uid ; mtime } ->
+        H.remove t.unconfirmed k ;
         let new_hv () =
-          { value = v ; uid ; mtime ; owner = "" ; expiry = 0. ;
-            eagerly = Nope } in
+          { value = v ; uid ; mtime ; can_write = false ; can_del = false ;
+            owner = "" ; expiry = 0. ; eagerly = Nope } in
         let set_hv hv =
           !logger.error
             "Server set key %a that has not been created"
@@ -123,7 +153,8 @@ struct
     | SrvMsg.NewKey { k ; v ; uid ; mtime ; can_write ; can_del ; owner ;
                       expiry } ->
         let new_hv ()  =
-          { value = v ; uid ; mtime ; owner ; expiry ; eagerly = Nope } in
+          { value = v ; uid ; mtime ; can_write ; can_del ; owner ; expiry ;
+            eagerly = Nope } in
         let set_hv hv =
             t.h <- Tree.add k hv t.h ;
             t.on_new t k v uid mtime can_write can_del owner expiry in
@@ -133,26 +164,33 @@ struct
             set_hv hv ;
             wait_is_over t k hv
         | prev ->
-            if prev.eagerly = Nope then
+            (* Keys known from a previous session are expected to be
+             * updated this way: *)
+            if prev.eagerly = Nope && not (H.mem t.unconfirmed k) then
               !logger.error
                 "Server create key %a that already exist, updating"
                 Key.print k ;
+            H.remove t.unconfirmed k ;
+            let prev_owner = prev.owner in
             (* Store the value: *)
             prev.value <- v ;
             prev.uid <- uid ;
             prev.mtime <- mtime ;
+            prev.can_write <- can_write ;
+            prev.can_del <- can_del ;
             prev.owner <- owner ;
             prev.expiry <- expiry ;
             prev.eagerly <- Nope ;
             (* Callbacks *)
             t.on_set t k v uid mtime ;
-            if prev.owner = "" && owner <> "" then
+            if prev_owner = "" && owner <> "" then
               t.on_lock t k owner expiry
-            else if prev.owner <> "" && owner = "" then
+            else if prev_owner <> "" && owner = "" then
               t.on_unlock t k
         )
 
     | SrvMsg.DelKey k ->
+        H.remove t.unconfirmed k ;
         (match Tree.get t.h k with
         | exception Not_found ->
             !logger.error "Server wanted to delete an unknown key %a"
@@ -196,4 +234,7 @@ struct
               t.on_unlock t k
             )
         )
+
+    | SrvMsg.SyncKeys ks ->
+        List.iter (H.remove t.unconfirmed) ks
 end
@@ -202,6 +202,14 @@ struct
       (* Will create a dummy value (locked) if the key does not exist yet: *)
       | LockOrCreateKey of Key.t * float
       | UnlockKey of Key.t
+      (* Same as StartSync, but only the keys that have been modified since
+       * that time, or that are currently locked, are sent. This is followed
+       * by a SyncKeys message listing all the keys matching the selection,
+       * so that the client can tell which of those it already has are gone: *)
+      | StartSyncSince of Selector.t * float
+      (* Stop receiving changes for a selection previously passed to
+       * StartSync: *)
+      | StopSync of Selector.t
 
     type t = int * cmd
 
@@ -245,6 +253,13 @@ struct
           print1d "LockOrCreateKey" k d
       | UnlockKey k ->
           print1 "UnlockKey" k
+      | StartSyncSince (sel, since) ->
+          Printf.fprintf oc "StartSyncSince (%a, %a)"
+            Selector.print sel
+            print_as_date since
+      | StopSync sel ->
+          Printf.fprintf oc "StopSync %a"
+            Selector.print sel
 
     let print fmt (i, cmd) =
       Printf.fprintf fmt "#%d, %a" i print_cmd cmd
@@ -268,6 +283,8 @@ struct
       (* New lock or change of lock owner. owner must be <> "". *)
       | LockKey of { k : Key.t ; owner : string ; expiry : float }
       | UnlockKey of Key.t
+      (* All the keys matching a selection, in answer to StartSyncSince: *)
+      | SyncKeys of Key.t list
 
     let print oc msg =
       let print_lock_owner owner expiry oc =
@@ -309,6 +326,9 @@ struct
       | UnlockKey k ->
           Printf.fprintf oc "UnlockKey %a"
             Key.print k
+      | SyncKeys ks ->
+          Printf.fprintf oc "SyncKeys (%d keys)"
+            (List.length ks)
 
     let to_string (m : t) =
       Marshal.(to_string m [ No_sharing ])
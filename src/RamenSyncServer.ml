@@ -326,6 +326,21 @@ struct
       sel, Map.add socket u map
     ) t.subscriptions
 
+  let unsubscribe_user t socket u sel =
+    let id = Selector.to_id sel in
+    !logger.debug "User %a drops selection %a"
+      User.print u
+      Selector.print_id id ;
+    match Hashtbl.find t.subscriptions id with
+    | exception Not_found ->
+        ()
+    | sel, map ->
+        let map = Map.remove socket map in
+        if Map.is_empty map then
+          Hashtbl.remove t.subscriptions id
+        else
+          Hashtbl.replace t.subscriptions id (sel, map)
+
   let owner_of_hash_value hv =
     match hv.locks with
     | [] -> "", 0.
@@ -333,7 +348,9 @@ struct
         IO.to_string User.print_id (User.id owner),
         expiry
 
-  let initial_sync t socket u sel =
+  (* If [since] is given, only the keys modified since then (or locked) are
+   * sent, followed by the list of all matching keys: *)
+  let initial_sync ?since t socket u sel =
     !logger.debug "Initial synchronisation for user %a: Starting!" User.print u ;
     let sorted =
       H.enum t.h //
@@ -343,16 +360,38 @@ struct
       ) |> Array.of_enum in
     let key_seq_cmp (_, hv1) (_, hv2) = Int.compare hv1.key_seq hv2.key_seq in
     Array.fast_sort key_seq_cmp sorted ;
+    (* Keys matching another selection of that client have been sent already
+     * (and are kept up to date): *)
+    let sel_id = Selector.to_id sel in
+    let other_sels =
+      Hashtbl.fold (fun id (sel', map) sels ->
+        if id <> sel_id && Map.mem socket map then sel' :: sels else sels
+      ) t.subscriptions [] in
+    let already_synced hv =
+      List.exists (fun sel' ->
+        Selector.matches sel' hv.prepared_key
+      ) other_sels in
+    let must_send hv =
+      not (already_synced hv) &&
+      match since with
+      | None -> true
+      (* Locks are not remembered by clients: *)
+      | Some since -> hv.mtime >= since || hv.locks <> [] in
     Array.iter (fun (k, hv) ->
       timeout_locks ~and_notify:false t k hv ;
-      let uid = IO.to_string User.print_id (User.id hv.set_by)
-      and owner, expiry = owner_of_hash_value hv
-      and can_write = User.has_any_role hv.can_write u
-      and can_del = User.has_any_role hv.can_del u in
-      let msg = SrvMsg.NewKey { k ; v = hv.v ; uid ; mtime = hv.mtime ;
-                                can_write ; can_del ; owner ; expiry } in
-      t.send_msg (Enum.singleton (socket, msg))
+      if must_send hv then (
+        let uid = IO.to_string User.print_id (User.id hv.set_by)
+        and owner, expiry = owner_of_hash_value hv
+        and can_write = User.has_any_role hv.can_write u
+        and can_del = User.has_any_role hv.can_del u in
+        let msg = SrvMsg.NewKey { k ; v = hv.v ; uid ; mtime = hv.mtime ;
+                                  can_write ; can_del ; owner ; expiry } in
+        t.send_msg (Enum.singleton (socket, msg)))
     ) sorted ;
+    if since <> None then (
+      let ks = Array.fold_right (fun (k, _) ks -> k :: ks) sorted [] in
+      t.send_msg (Enum.singleton (socket, SrvMsg.SyncKeys ks))
+    ) ;
     !logger.debug "Initial synchronisation for user %a: Complete!" User.print u
 
   let set_user_err t u socket i str =
@@ -395,6 +434,15 @@ struct
             initial_sync t socket u sel ;
             u
 
+        | CltMsg.StartSyncSince (sel, since) ->
+            subscribe_user t socket u sel ;
+            initial_sync ~since t socket u sel ;
+            u
+
+        | CltMsg.StopSync sel ->
+            unsubscribe_user t socket u sel ;
+            u
+
         | CltMsg.SetKey (k, v) ->
             set t u k v ;
             u
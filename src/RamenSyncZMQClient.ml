@@ -237,7 +237,9 @@ let send_cmd ?(eager=false) ?while_ ?on_ok ?on_ko ?on_done cmd =
         (Enum.print Key.print) (Hashtbl.keys on_dones) in
     match cmd with
     | CltMsg.Auth _
-    | CltMsg.StartSync _ ->
+    | CltMsg.StartSync _
+    | CltMsg.StartSyncSince _
+    | CltMsg.StopSync _ ->
         ()
     | CltMsg.SetKey (k, v)
     | CltMsg.NewKey (k, v, _)
@@ -292,6 +294,8 @@ let send_cmd ?(eager=false) ?while_ ?on_ok ?on_ko ?on_done cmd =
       Client.{ value = v ;
                uid = session.clt.Client.my_uid ;
                mtime = now ;
+               can_write = true ;
+               can_del = true ;
                owner = if lock_timeo > 0. then session.clt.Client.my_uid
                        else "" ;
                expiry = 0. ; (* whatever *)
@@ -325,11 +329,11 @@ let check_timeout clt = function
       !logger.error "Bummer! The server timed us out!"
   | _ -> ()
 
-let recv_cmd _clt =
-  let session = get_session () in
-  (* Let's fail on EINTR and our caller retry_zmq which will do the right
-   * thing: restart if no INT signal has been received. *)
-  match Zmq.Socket.recv_all session.zock with
+(* Called with every message received from the server once decoded, for
+ * instance to record the message stream: *)
+let on_recv : (SrvMsg.t -> unit) ref = ref ignore
+
+let decode_cmd session = function
   | [ "" ; msg ] ->
       (* !logger.debug "srv message (raw): %S" msg ; *)
       (match Authn.decrypt session.authn msg with
@@ -340,12 +344,44 @@ let recv_cmd _clt =
           !logger.debug "< Srv msg: %a" SrvMsg.print msg ;
           IntCounter.inc stats_num_sync_msgs_in ;
           check_timeout session.clt msg ;
+          !on_recv msg ;
           msg)
   | m ->
       Printf.sprintf2 "Received unexpected message %a"
         (List.print String.print) m |>
       failwith
 
+let recv_cmd _clt =
+  let session = get_session () in
+  (* Let's fail on EINTR and our caller retry_zmq which will do the right
+   * thing: restart if no INT signal has been received. *)
+  Zmq.Socket.recv_all session.zock |>
+  decode_cmd session
+
+(* Same as above but returns None rather than waiting for a message: *)
+let try_recv_cmd () =
+  let session = get_session () in
+  match Zmq.Socket.recv_all ~block:false session.zock with
+  | exception Unix.(Unix_error ((EAGAIN|EWOULDBLOCK), _, _)) ->
+      None
+  | parts ->
+      Some (decode_cmd session parts)
+
+(* Wait until either a message can be received from the server, or one of
+ * the given file descriptors becomes readable, or the timeout expires.
+ * This allows the caller to wait for several sources of work at once: *)
+let wait_cmd ?(fds=[]) timeout =
+  let session = get_session () in
+  match Zmq.Socket.events session.zock with
+  | Zmq.Socket.Poll_in | Zmq.Socket.Poll_in_out ->
+      ()
+  | _ ->
+      (* ZMQ_FD is edge triggered, and therefore can be waited upon only
+       * once events told that no message is pending: *)
+      let zmq_fd = Zmq.Socket.get_fd session.zock in
+      (try ignore (Unix.select (zmq_fd :: fds) [] [] timeout)
+      with Unix.(Unix_error (EINTR, _, _)) -> ())
+
 let unexpected_reply cmd =
   Printf.sprintf "Unexpected reply %s"
     (SrvMsg.to_string cmd) |>
@@ -484,9 +520,11 @@ let process_until ~while_ clt =
     process_in ~while_ clt
   done
 
-let init_sync ?while_ clt topics on_progress =
+(* If [since] is set, the client already has the values of [topics] as they
+ * were at that time, and the server sends only what changed since then: *)
+let init_sync ?while_ ?since clt topics on_progress =
   on_progress clt Stage.Sync Status.InitStart ;
-  let globs = List.map Globs.compile topics in
+  let topic_globs = List.map Globs.compile topics in
   let add_glob_for_key ?(is_dir=false) key globs =
     if List.exists (fun glob -> Globs.matches glob key) globs then (
       !logger.debug "subscribed topics already cover key %a, \
@@ -503,10 +541,17 @@ let init_sync ?while_ clt topics on_progress =
   (* Because we are authenticated: *)
   assert (clt.Client.my_socket <> None) ;
   let globs =
-    add_glob_for_key (my_errors clt |> Option.get |> Key.to_string) globs |>
+    add_glob_for_key (my_errors clt |> Option.get |> Key.to_string)
+                     topic_globs |>
     add_glob_for_key ~is_dir:true
       ("clients/"^ (Option.get clt.my_socket |> User.string_of_socket)
                  ^"/response") in
+  let start_sync glob =
+    match since with
+    | Some since when List.memq glob topic_globs ->
+        CltMsg.StartSyncSince (glob, since)
+    | _ ->
+        CltMsg.StartSync glob in
   let synced = ref false in
   let rec loop = function
     | [] ->
@@ -514,9 +559,9 @@ let init_sync ?while_ clt topics on_progress =
     | [glob] ->
         (* Last command: wait until it's acked *)
         let on_ok () = synced := true in
-        send_cmd ?while_ ~on_ok (CltMsg.StartSync glob)
+        send_cmd ?while_ ~on_ok (start_sync glob)
     | glob :: rest ->
-        send_cmd ?while_ (CltMsg.StartSync glob) ;
+        send_cmd ?while_ (start_sync glob) ;
         loop rest in
   match loop globs with
   | exception e ->
@@ -535,7 +580,7 @@ let init_sync ?while_ clt topics on_progress =
 
 (* Will be called by the C++ on a dedicated thread, never returns: *)
 let start ?while_ ~url ~srv_pub_key ~username ~clt_pub_key ~clt_priv_key
-          ?(topics=[]) ?(on_progress=default_on_progress)
+          ?(topics=[]) ?since ?(on_progress=default_on_progress)
           ?(on_sock=ignore1) ?(on_synced=ignore1)
           ?(on_new=ignore9) ?(on_set=ignore5) ?(on_del=ignore3)
           ?(on_lock=ignore4) ?(on_unlock=ignore2)
@@ -594,7 +639,7 @@ let start ?while_ ~url ~srv_pub_key ~username ~clt_pub_key ~clt_priv_key
             log_exceptions ~what:"init_auth"
               (fun () -> init_auth ?while_ clt username on_progress) &&
             log_exceptions ~what:"init_sync"
-              (fun () -> init_sync ?while_ clt topics on_progress)
+              (fun () -> init_sync ?while_ ?since clt topics on_progress)
           then (
             on_synced clt ;
             log_exceptions ~what:"sync_loop" (fun () -> sync_loop clt)
@@ -438,6 +438,166 @@ let arc_files_of dir =
 let arc_file_compare (s1, _, _, _, _, _) (s2, _, _, _, _, _) =
   Int.compare s1 s2
 
+(* ORC archives come with the min/max of their numeric columns, that are
+ * gathered in a table in the archive directory when the files are archived
+ * (see append_column_stats in orc/wrappers.cc), so that whole files can be
+ * skipped at replay without being opened. *)
+
+let arc_stats_file dir =
+  N.cat dir (N.path "/.stats")
+
+(* Parses a line of that table, as "file\tnum_rows\tname:min:max\t...",
+ * into the file name (without directory) and its known column bounds: *)
+let parse_arc_stats line =
+  match string_split_on_char '\t' line with
+  | arc_fname :: _num_rows :: columns ->
+      let bounds =
+        List.filter_map (fun col ->
+          match string_split_on_char ':' col with
+          | [ name ; mi ; ma ] ->
+              (try Some (name, float_of_string mi, float_of_string ma)
+              with Failure _ -> None)
+          | _ -> None
+        ) columns in
+      Some (arc_fname, bounds)
+  | _ -> None
+
+(*$= parse_arc_stats & ~printer:BatPervasives.dump
+  (Some ("a.orc", [ "x", 1., 10. ; "y", 0., 0. ])) \
+    (parse_arc_stats "a.orc\t42\tx:0x1p+0:0x1.4p+3\ty:0x0p+0:0x0p+0")
+  (Some ("a.orc", [])) (parse_arc_stats "a.orc\t42")
+  None (parse_arc_stats "")
+*)
+
+let arc_stats_lines fd =
+  Files.read_whole_fd fd |>
+  string_split_on_char '\n' |>
+  List.filter ((<>) "")
+
+(* Returns a hash from archive file names (without directory) to the list of
+ * known column bounds: *)
+let read_arc_stats dir =
+  let h = Hashtbl.create 31 in
+  let fname = arc_stats_file dir in
+  if Files.exists fname then (
+    try
+      RamenAdvLock.with_r_lock fname (fun fd ->
+        arc_stats_lines fd |>
+        List.iter (fun line ->
+          match parse_arc_stats line with
+          | Some (arc_fname, bounds) -> Hashtbl.replace h arc_fname bounds
+          | None -> ()))
+    with e ->
+      let what =
+        Printf.sprintf2 "Reading archive statistics %a"
+          N.path_print fname in
+      print_exception ~what e) ;
+  h
+
+(* Rewrites the table without the lines of the archives that have been
+ * deleted since: *)
+let prune_arc_stats dir =
+  let fname = arc_stats_file dir in
+  if Files.exists fname then
+    RamenAdvLock.with_w_lock fname (fun fd ->
+      let lines = arc_stats_lines fd in
+      let kept =
+        List.filter (fun line ->
+          match parse_arc_stats line with
+          | Some (arc_fname, _) ->
+              Files.exists (N.path_cat [ dir ; N.path arc_fname ])
+          | None -> false
+        ) lines in
+      if List.length kept < List.length lines then (
+        !logger.debug "Pruning %d lines from %a"
+          (List.length lines - List.length kept) N.path_print fname ;
+        let content =
+          String.concat "" (List.map (fun l -> l ^"\n") kept) in
+        Unix.ftruncate fd 0 ;
+        Unix.lseek fd 0 Unix.SEEK_SET |> ignore ;
+        Files.write_whole_string fd content))
+
+(* Tells if any tuple from that file can possibly have all of the given
+ * fields within the given bounds. Unknown files or fields may always
+ * match. *)
+let arc_file_may_match stats (fname : N.path) filters =
+  match Hashtbl.find stats (Files.basename fname :> string) with
+  | exception Not_found -> true
+  | bounds ->
+      List.for_all (fun (field, mi, ma) ->
+        match List.find (fun (name, _, _) -> name = field) bounds with
+        | exception Not_found -> true
+        | _, fmi, fma -> fmi <= ma && mi <= fma
+      ) filters
+
+(*$inject
+  let stats = Hashtbl.of_list [ "a.orc", [ "x", 1., 10. ; "y", 0., 0. ] ]
+*)
+(*$T arc_file_may_match
+  arc_file_may_match stats (N.path "/tmp/b.orc") [ "x", 20., 30. ]
+  arc_file_may_match stats (N.path "/tmp/a.orc") [ "x", 10., 30. ]
+  arc_file_may_match stats (N.path "/tmp/a.orc") [ "z", 10., 30. ]
+  not (arc_file_may_match stats (N.path "/tmp/a.orc") [ "x", 20., 30. ])
+  not (arc_file_may_match stats (N.path "/tmp/a.orc") \
+        [ "x", 1., 2. ; "y", 1., 2. ])
+*)
+
+(* Plan a replay: returns the archive files (as returned by arc_files_of) to
+ * read, in order of start time, skipping those outside the time range and
+ * the ORC archives which statistics prove that they have no tuple with all
+ * the given fields within the given bounds. Statistics are only read if
+ * there are such filters. *)
+let replay_arc_files ?(filters=[]) dir since until files =
+  let stats =
+    if filters = [] then Hashtbl.create 0 else read_arc_stats dir in
+  Enum.filter_map (fun (_s1, _s2, t1, t2, arc_typ, fname) ->
+    if not (since < t2 && until >= t1) then None else
+    match arc_typ with
+    | RingBuf ->
+        Some (t1, arc_typ, fname)
+    | Orc ->
+        if arc_file_may_match stats fname filters then
+          Some (t1, arc_typ, fname)
+        else (
+          !logger.debug "Skipping archive %a that cannot match %a"
+            N.path_print_quoted fname
+            (pretty_list_print (fun oc (field, mi, ma) ->
+              Printf.fprintf oc "%s in %g..%g" field mi ma))
+              filters ;
+          None
+        )
+  ) files |>
+  List.of_enum |>
+  List.fast_sort (fun (t1, _, _) (t1', _, _) -> Float.compare t1 t1')
+
+(* Check that a filtered replay skips the ORC archives that cannot match,
+ * with an actual table of statistics: *)
+(*$R replay_arc_files
+  let dir = N.path (Filename.get_temp_dir_name () ^"/arc_stats_test") in
+  Files.mkdir_all dir ;
+  let stats_file = arc_stats_file dir in
+  File.with_file_out ~mode:[`create;`trunc] (stats_file :> string) (fun oc ->
+    IO.nwrite oc "1.orc\t10\tx:0x1p+0:0x1.4p+3\n" ;
+    IO.nwrite oc "2.orc\t10\tx:0x1.4p+4:0x1.ep+4\n") ;
+  let files () =
+    List.enum [
+      0, 1, 0., 10., Orc, N.path_cat [ dir ; N.path "1.orc" ] ;
+      2, 3, 10., 20., Orc, N.path_cat [ dir ; N.path "2.orc" ] ;
+      4, 5, 20., 30., RingBuf, N.path_cat [ dir ; N.path "3.b" ] ;
+      6, 7, 30., 40., Orc, N.path_cat [ dir ; N.path "4.orc" ] ] in
+  let names lst =
+    List.map (fun (_, _, f) -> (Files.basename f :> string)) lst in
+  assert_equal ~printer:dump [ "1.orc" ; "2.orc" ; "3.b" ; "4.orc" ]
+    (replay_arc_files dir 0. 40. (files ()) |> names) ;
+  assert_equal ~printer:dump [ "2.orc" ; "3.b" ; "4.orc" ]
+    (replay_arc_files ~filters:[ "x", 15., 25. ] dir 0. 40. (files ()) |>
+     names) ;
+  assert_equal ~printer:dump [ "2.orc" ; "3.b" ]
+    (replay_arc_files ~filters:[ "x", 15., 25. ] dir 0. 25. (files ()) |>
+     names) ;
+  Files.safe_unlink stats_file
+*)
+
 let seq_range bname =
   (* Returns the first and last available seqnums.
    * Takes first from the per.seq subdir names and last from same subdir +
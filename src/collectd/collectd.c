@@ -98,6 +98,8 @@ enum collectd_decode_status collectd_decode(
         char const *src = (char const *)(msg + p); \
         p += part_length; \
         if (msg[p-1] != '\0') return COLLECTD_PARSE_ERROR; \
+        /* Parts often repeat the previous value, then keep that copy: */ \
+        if (VAR && 0 == strcmp(VAR, src)) break; \
         VAR = alloc_string(arena, part_length); \
         if (! (VAR)) return COLLECTD_NOT_ENOUGH_RAM; \
         memcpy(VAR, src, part_length); \
@@ -170,6 +172,7 @@ enum collectd_decode_status collectd_decode(
           }
           uint8_t const *types = msg + p;
           p += num_vals;
+          if (num_vals == 0) break;
 
           struct collectd_metric *metric = alloc_metric(arena);
           if (! metric) return COLLECTD_NOT_ENOUGH_RAM;
@@ -179,10 +182,16 @@ enum collectd_decode_status collectd_decode(
           metric->plugin_instance = plugin_instance;
           metric->type_name = type_name;
           metric->type_instance = type_instance;
-          metric->num_values = num_vals;
+          metric->num_values =
+            num_vals < COLLECTD_NB_VALUES ? num_vals : COLLECTD_NB_VALUES;
           // Fill in the values:
           unsigned v;
-          for (v = 0; v < num_vals && v < COLLECTD_NB_VALUES; v++) {
+          for (v = 0; v < num_vals; v++) {
+            if (v >= COLLECTD_NB_VALUES) {
+              // Skip the values we have no room for:
+              p += 8;
+              continue;
+            }
             double *val = metric->values + v;
             switch (types[v]) {
               case 1: // gauge, little endian double because why not
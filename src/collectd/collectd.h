@@ -2,6 +2,8 @@
 #ifndef COLLECTD_H_170919
 #define COLLECTD_H_170919
 
+#include <stddef.h>
+
 /* Given a buffer with a collectd binary messages (one or several
  * concatenated makes no difference), return metrics contained
  * therein, as pairs of a string label and a double value (and
@@ -39,6 +41,12 @@ struct collectd_metric {
   double values[COLLECTD_NB_VALUES];
 };
 
+/* Amount of memory that is always enough to decode a message of that size:
+ * each metric comes with a value part of at least 15 bytes, and strings
+ * are never longer than the message: */
+#define COLLECTD_MEM_SIZE(msg_size) \
+  (64 + ((msg_size) / 15 + 1) * sizeof(struct collectd_metric) + (msg_size))
+
 extern enum collectd_decode_status collectd_decode(
   // The incoming message(s):
   size_t msg_size, char const *msg,
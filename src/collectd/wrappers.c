@@ -1,6 +1,7 @@
 // vim: ft=c bs=2 ts=2 sts=2 sw=2 expandtab
 #include <assert.h>
 #include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <inttypes.h>
@@ -13,12 +14,98 @@
 #include <caml/custom.h>
 #include <caml/fail.h>
 #include <caml/callback.h>
+#include <caml/signals.h>
+#include <caml/unixsupport.h>
 
 #include "collectd.h"
+#include "../udp/udp_batch.h"
 
 #define STR_(s) STR(s)
 #define STR(s) #s
 
+/*
+ * Interned strings
+ *
+ * The same few host, plugin and type names come up again and again, so
+ * rather than allocating new OCaml strings for each metric, we keep the
+ * OCaml strings (and their `Some` wrappers) that were built for the most
+ * recent names and share them between metrics. This is safe as OCaml
+ * strings are immutable.
+ * When the table gets too full it's merely emptied.
+ */
+
+#define INTERN_SIZE 4096  // Must be a power of 2
+#define INTERN_MAX_FILL (INTERN_SIZE / 2)
+#define INTERN_MAX_LEN 256  // Longer strings are not interned
+
+static struct interned {
+  char *str;  // NULL if this slot is free
+  uint32_t hash;
+  value v;  // The OCaml string
+  value some_v;  // Some v, or 0 if not built yet
+} interned[INTERN_SIZE];
+static unsigned num_interned;
+
+static uint32_t hash_of_string(char const *str, size_t *len)
+{
+  // FNV-1a:
+  uint32_t h = 2166136261U;
+  size_t l = 0;
+  for (; str[l] != '\0'; l++) h = (h ^ (unsigned char)str[l]) * 16777619U;
+  *len = l;
+  return h;
+}
+
+static void clear_interned(void)
+{
+  for (unsigned i = 0; i < INTERN_SIZE; i++) {
+    struct interned *e = interned + i;
+    if (! e->str) continue;
+    free(e->str);
+    e->str = NULL;
+    caml_remove_generational_global_root(&e->v);
+    if (e->some_v) caml_remove_generational_global_root(&e->some_v);
+  }
+  num_interned = 0;
+}
+
+/* Returns the slot for that string, or NULL if the string is not to be
+ * interned: */
+static struct interned *intern(char const *str)
+{
+  size_t len;
+  uint32_t const h = hash_of_string(str, &len);
+  if (len > INTERN_MAX_LEN) return NULL;
+
+  unsigned i = h & (INTERN_SIZE - 1);
+  while (interned[i].str) {
+    if (interned[i].hash == h && 0 == strcmp(interned[i].str, str))
+      return interned + i;
+    i = (i + 1) & (INTERN_SIZE - 1);
+  }
+
+  if (num_interned >= INTERN_MAX_FILL) {
+    clear_interned();
+    i = h & (INTERN_SIZE - 1);
+  }
+
+  struct interned *e = interned + i;
+  e->str = strdup(str);
+  if (! e->str) return NULL;
+  e->hash = h;
+  e->v = caml_copy_string(str);
+  caml_register_generational_global_root(&e->v);
+  e->some_v = 0;
+  num_interned ++;
+  return e;
+}
+
+static value copy_string(char const *str)
+{
+  struct interned *e = intern(str);
+  return e ? e->v : caml_copy_string(str);
+}
+
 static void set_nullable_string(value block, unsigned idx, char const *str)
 {
   CAMLparam1(block);
@@ -26,68 +113,169 @@ static void set_nullable_string(value block, unsigned idx, char const *str)
   if (!str || str[0] == '\0')
     Store_field(block, idx, Val_int(0));
   else {
-    tmp = caml_alloc(1, 0);
-    Store_field(tmp, 0, caml_copy_string(str));
-    Store_field(block, idx, tmp);
+    struct interned *e = intern(str);
+    if (e && e->some_v) {
+      Store_field(block, idx, e->some_v);
+    } else {
+      tmp = caml_alloc(1, 0);
+      Store_field(tmp, 0, e ? e->v : caml_copy_string(str));
+      Store_field(block, idx, tmp);
+      if (e) {
+        e->some_v = tmp;
+        caml_register_generational_global_root(&e->some_v);
+      }
+    }
   }
   CAMLreturn0;
 }
 
+static value alloc_metric(struct collectd_metric const *m)
+{
+  CAMLparam0();
+  CAMLlocal2(m_tup, tmp);
+  assert(m->num_values > 0);
+  m_tup = caml_alloc(6 + COLLECTD_NB_VALUES, 0);
+  Store_field(m_tup, 0, copy_string(m->host));
+  Store_field(m_tup, 1, caml_copy_double(m->time));
+  set_nullable_string(m_tup, 2, m->plugin_name);
+  set_nullable_string(m_tup, 3, m->plugin_instance);
+  set_nullable_string(m_tup, 4, m->type_name);
+  set_nullable_string(m_tup, 5, m->type_instance);
+  Store_field(m_tup, 6+0, caml_copy_double(m->values[0]));
+  unsigned v;
+  for (v = 1; v < m->num_values; v++) {
+    tmp = caml_alloc(1, 0);
+    Store_field(tmp, 0, caml_copy_double(m->values[v]));
+    Store_field(m_tup, 6+v, tmp);
+  }
+  for (; v < COLLECTD_NB_VALUES; v++) {
+    Store_field(m_tup, 6+v, Val_int(0)); // None
+  }
+  CAMLreturn(m_tup);
+}
+
+static void report_status(enum collectd_decode_status status)
+{
+  switch (status) {
+    case COLLECTD_OK:
+      break;
+    case COLLECTD_SHORT_DATA:
+      fprintf(stderr, "collectd_decode: short data!\n");
+      break;
+    case COLLECTD_NOT_ENOUGH_RAM:
+      fprintf(stderr, "collectd_decode: not enough RAM!\n");
+      break;
+    case COLLECTD_PARSE_ERROR:
+      fprintf(stderr, "collectd_decode: parse error!\n");
+      break;
+  }
+}
+
+/* Where metrics are decoded. Grown as needed and then reused. Large
+ * enough to never run out of memory, see COLLECTD_MEM_SIZE: */
+static char *mem;
+static size_t mem_capacity;
+
+static void reserve_mem(size_t capacity)
+{
+  if (capacity <= mem_capacity) return;
+  char *m = realloc(mem, capacity);
+  if (! m) caml_raise_out_of_memory();
+  mem = m;
+  mem_capacity = capacity;
+}
+
 CAMLprim value wrap_collectd_decode(value buffer_, value num_bytes_)
 {
   CAMLparam2(buffer_, num_bytes_);
-  CAMLlocal3(res, m_tup, tmp);
+  CAMLlocal1(res);
   unsigned num_bytes = Long_val(num_bytes_);
   assert(caml_string_length(buffer_) >= num_bytes);
 
   unsigned num_metrics;
   struct collectd_metric *metrics; // Will point into mem
-  char mem[4096];
+  size_t const mem_size = COLLECTD_MEM_SIZE(num_bytes);
+  reserve_mem(mem_size);
   // Must not call caml_alloc from there until we are done with buffer
   char *buffer = String_val(buffer_);
   enum collectd_decode_status status =
-    collectd_decode(num_bytes, buffer, sizeof(mem), mem, &num_metrics, &metrics);
+    collectd_decode(num_bytes, buffer, mem_size, mem, &num_metrics, &metrics);
 
   // Return an array of collectd_metric:
   res = caml_alloc(num_metrics, 0);
 
   //printf("collectd_decode: collected %u metrics\n", num_metrics);
   for (unsigned i = 0; i < num_metrics; i++) {
-    struct collectd_metric *m = metrics + i;
-    assert(m->num_values > 0);
-    m_tup = caml_alloc(6 + COLLECTD_NB_VALUES, 0);
-    Store_field(m_tup, 0, caml_copy_string(m->host));
-    Store_field(m_tup, 1, caml_copy_double(m->time));
-    set_nullable_string(m_tup, 2, m->plugin_name);
-    set_nullable_string(m_tup, 3, m->plugin_instance);
-    set_nullable_string(m_tup, 4, m->type_name);
-    set_nullable_string(m_tup, 5, m->type_instance);
-    Store_field(m_tup, 6+0, caml_copy_double(m->values[0]));
-    unsigned v;
-    for (v = 1; v < m->num_values; v++) {
-      tmp = caml_alloc(1, 0);
-      Store_field(tmp, 0, caml_copy_double(m->values[v]));
-      Store_field(m_tup, 6+v, tmp);
-    }
-    for (; v < COLLECTD_NB_VALUES; v++) {
-      Store_field(m_tup, 6+v, Val_int(0)); // None
+    Store_field(res, i, alloc_metric(metrics + i));
+  }
+
+  report_status(status);
+
+  CAMLreturn(res);
+}
+
+/*
+ * Receiving and decoding many datagrams at once
+ */
+
+// collectd current network.c buffer is 1452 bytes:
+#define COLLECTD_MSG_SIZE 1500
+#define COLLECTD_BATCH_MAX_MSGS 64
+// Each message's arena must be suitably aligned for the decoded metrics:
+#define COLLECTD_MEM_ALIGN _Alignof(max_align_t)
+#define COLLECTD_MEM_PER_MSG \
+  ((COLLECTD_MEM_SIZE(COLLECTD_MSG_SIZE) + COLLECTD_MEM_ALIGN - 1) & \
+   ~(COLLECTD_MEM_ALIGN - 1))
+
+static struct udp_batch batch;
+static char *batch_mem;  // COLLECTD_MEM_PER_MSG per message
+static struct {
+  unsigned num_metrics;
+  struct collectd_metric *metrics;  // Point into batch_mem
+} batch_decoded[COLLECTD_BATCH_MAX_MSGS];
+
+CAMLprim value wrap_collectd_recv(value fd_)
+{
+  CAMLparam1(fd_);
+  CAMLlocal1(res);
+  int const fd = Int_val(fd_);
+
+  if (! batch_mem) {
+    if (0 != udp_batch_init(&batch, COLLECTD_BATCH_MAX_MSGS, COLLECTD_MSG_SIZE))
+      caml_raise_out_of_memory();
+    batch_mem = malloc(COLLECTD_BATCH_MAX_MSGS * COLLECTD_MEM_PER_MSG);
+    if (! batch_mem) {
+      udp_batch_free(&batch);
+      caml_raise_out_of_memory();
     }
-    Store_field(res, i, m_tup);
   }
 
-  switch (status) {
-    case COLLECTD_OK:
-      break;
-    case COLLECTD_SHORT_DATA:
-      fprintf(stderr, "collectd_decode: short data!\n");
-      break;
-    case COLLECTD_NOT_ENOUGH_RAM:
-      fprintf(stderr, "collectd_decode: not enough RAM!\n");
-      break;
-    case COLLECTD_PARSE_ERROR:
-      fprintf(stderr, "collectd_decode: parse error!\n");
-      break;
+  caml_enter_blocking_section();
+  int const num_msgs = udp_batch_recv(&batch, fd);
+  caml_leave_blocking_section();
+  if (num_msgs < 0) uerror("recvmmsg", Nothing);
+
+  // Decode everything before allocating the result:
+  unsigned tot_metrics = 0;
+  for (int i = 0; i < num_msgs; i++) {
+    enum collectd_decode_status status =
+      collectd_decode(batch.lens[i], udp_batch_msg(&batch, i),
+                      COLLECTD_MEM_PER_MSG,
+                      batch_mem + i * COLLECTD_MEM_PER_MSG,
+                      &batch_decoded[i].num_metrics,
+                      &batch_decoded[i].metrics);
+    report_status(status);
+    tot_metrics += batch_decoded[i].num_metrics;
+  }
+
+  res = caml_alloc(tot_metrics, 0);
+  unsigned r = 0;
+  for (int i = 0; i < num_msgs; i++) {
+    for (unsigned j = 0; j < batch_decoded[i].num_metrics; j++) {
+      Store_field(res, r++, alloc_metric(batch_decoded[i].metrics + j));
+    }
   }
+  assert(r == tot_metrics);
 
   CAMLreturn(res);
 }
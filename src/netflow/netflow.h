@@ -0,0 +1,52 @@
+// vim: ft=c bs=2 ts=2 sts=2 sw=2 expandtab
+#ifndef NETFLOW_H_20261018
+#define NETFLOW_H_20261018
+
+/* Decoders for netflow messages (v5, v9 and IPFIX).
+ *
+ * Whatever the version, flows are decoded into the same flat netflow_record,
+ * which has the fields of the netflow tuple (see RamenNetflow.tuple_typ)
+ * but the source. Decoders write at most max_records records and return
+ * how many were decoded, or -1 and set *err if the message could not be
+ * decoded at all. */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/socket.h>
+
+struct netflow_record {
+  double first, last;  // In seconds since Unix epoch
+  uint32_t seqnum;
+  uint8_t engine_type, engine_id;
+  uint8_t sampling_type;
+  uint16_t sampling_rate;
+  uint32_t src, dst, next_hop;  // IPv4 addresses, in host byte order
+  uint16_t src_port, dst_port;
+  uint16_t in_iface, out_iface;
+  uint32_t packets, bytes;
+  uint8_t tcp_flags, ip_proto, ip_tos;
+  uint16_t src_as, dst_as;
+  uint8_t src_mask, dst_mask;
+};
+
+// Version of the given message, or 0 if it's too short:
+unsigned netflow_version(char const *msg, size_t msg_size);
+
+int netflow_v5_decode(
+  char const *msg, size_t msg_size,
+  struct netflow_record *records, unsigned max_records, char const **err);
+
+/* v9 and IPFIX messages do not describe their records but refer to
+ * templates that are sent from time to time by each exporter. Those are
+ * cached per exporter (identified by its address) and observation domain.
+ * Data records which template is still unknown are skipped. Also,
+ * only the records with IPv4 source and destination addresses are
+ * returned. */
+int netflow_v9_decode(
+  char const *msg, size_t msg_size, struct sockaddr_storage const *exporter,
+  struct netflow_record *records, unsigned max_records, char const **err);
+
+// Upper bound on the number of records in a message of that size:
+#define NETFLOW_MAX_RECORDS(msg_size) ((msg_size) / 8)
+
+#endif
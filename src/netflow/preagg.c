@@ -0,0 +1,272 @@
+// vim: ft=c bs=2 ts=2 sts=2 sw=2 expandtab
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "preagg.h"
+
+#define INIT_CAPACITY 1024
+
+uint32_t netflow_record_field(
+  struct netflow_record const *r, enum nf_field field)
+{
+  switch (field) {
+    case NF_SEQNUM: return r->seqnum;
+    case NF_ENGINE_TYPE: return r->engine_type;
+    case NF_ENGINE_ID: return r->engine_id;
+    case NF_SAMPLING_TYPE: return r->sampling_type;
+    case NF_SAMPLING_RATE: return r->sampling_rate;
+    case NF_SRC: return r->src;
+    case NF_DST: return r->dst;
+    case NF_NEXT_HOP: return r->next_hop;
+    case NF_SRC_PORT: return r->src_port;
+    case NF_DST_PORT: return r->dst_port;
+    case NF_IN_IFACE: return r->in_iface;
+    case NF_OUT_IFACE: return r->out_iface;
+    case NF_PACKETS: return r->packets;
+    case NF_BYTES: return r->bytes;
+    case NF_TCP_FLAGS: return r->tcp_flags;
+    case NF_IP_PROTO: return r->ip_proto;
+    case NF_IP_TOS: return r->ip_tos;
+    case NF_SRC_AS: return r->src_as;
+    case NF_DST_AS: return r->dst_as;
+    case NF_SRC_MASK: return r->src_mask;
+    case NF_DST_MASK: return r->dst_mask;
+    case NF_NUM_FIELDS: break;
+  }
+  assert(!"invalid netflow field");
+  return 0;
+}
+
+static int alloc_table(struct nf_preagg *p, unsigned capacity)
+{
+  p->hashes = calloc(capacity, sizeof(*p->hashes));
+  p->key_vals = malloc(capacity * p->num_keys * sizeof(*p->key_vals));
+  p->aggr_vals = malloc(capacity * p->num_aggrs * sizeof(*p->aggr_vals));
+  p->times = malloc(capacity * 2 * sizeof(*p->times));
+  if (! p->hashes ||
+      (p->num_keys > 0 && ! p->key_vals) ||
+      (p->num_aggrs > 0 && ! p->aggr_vals) ||
+      ! p->times) {
+    free(p->hashes);
+    free(p->key_vals);
+    free(p->aggr_vals);
+    free(p->times);
+    return -1;
+  }
+  p->capacity = capacity;
+  p->num_groups = 0;
+  return 0;
+}
+
+int nf_preagg_init(
+  struct nf_preagg *p, double bucket_duration,
+  unsigned num_keys, enum nf_field const *keys,
+  unsigned num_aggrs, enum nf_aggr const *ops, enum nf_field const *fields,
+  uint64_t const *aggr_max)
+{
+  memset(p, 0, sizeof(*p));
+  if (! (bucket_duration > 0) ||
+      num_keys > NF_PREAGG_MAX_KEYS || num_aggrs > NF_PREAGG_MAX_AGGRS)
+    return -1;
+
+  p->bucket_duration = bucket_duration;
+  p->num_keys = num_keys;
+  for (unsigned k = 0; k < num_keys; k++) {
+    if (keys[k] >= NF_NUM_FIELDS) return -1;
+    p->keys[k] = keys[k];
+  }
+  p->num_aggrs = num_aggrs;
+  for (unsigned a = 0; a < num_aggrs; a++) {
+    if (ops[a] > NF_MAX || fields[a] >= NF_NUM_FIELDS || aggr_max[a] == 0)
+      return -1;
+    p->ops[a] = ops[a];
+    p->fields[a] = fields[a];
+    p->aggr_max[a] = aggr_max[a];
+  }
+
+  return alloc_table(p, INIT_CAPACITY);
+}
+
+void nf_preagg_free(struct nf_preagg *p)
+{
+  free(p->hashes);
+  free(p->key_vals);
+  free(p->aggr_vals);
+  free(p->times);
+  memset(p, 0, sizeof(*p));
+}
+
+// Never 0, which denotes empty slots:
+static uint32_t hash_keys(uint32_t const *key_vals, unsigned num_keys)
+{
+  uint64_t h = 0x9e3779b97f4a7c15ULL;
+  for (unsigned k = 0; k < num_keys; k++) {
+    h ^= key_vals[k];
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+  }
+  uint32_t const h32 = h ^ (h >> 32);
+  return h32 ? h32 : 1;
+}
+
+// Returns the slot of that group, or of the empty slot where it belongs:
+static unsigned find_slot(
+  struct nf_preagg const *p, uint32_t hash, uint32_t const *key_vals)
+{
+  unsigned const mask = p->capacity - 1;
+  for (unsigned i = hash & mask; ; i = (i + 1) & mask) {
+    if (p->hashes[i] == 0) return i;
+    if (p->hashes[i] == hash &&
+        0 == memcmp(p->key_vals + i * p->num_keys, key_vals,
+                    p->num_keys * sizeof(*key_vals)))
+      return i;
+  }
+}
+
+static int grow(struct nf_preagg *p)
+{
+  struct nf_preagg old = *p;
+  if (0 != alloc_table(p, old.capacity * 2)) {
+    *p = old;
+    return -1;
+  }
+  for (unsigned i = 0; i < old.capacity; i++) {
+    if (old.hashes[i] == 0) continue;
+    uint32_t const *key_vals = old.key_vals + i * p->num_keys;
+    unsigned const j = find_slot(p, old.hashes[i], key_vals);
+    p->hashes[j] = old.hashes[i];
+    memcpy(p->key_vals + j * p->num_keys, key_vals,
+           p->num_keys * sizeof(*key_vals));
+    memcpy(p->aggr_vals + j * p->num_aggrs,
+           old.aggr_vals + i * p->num_aggrs,
+           p->num_aggrs * sizeof(*p->aggr_vals));
+    memcpy(p->times + j * 2, old.times + i * 2, 2 * sizeof(*p->times));
+  }
+  p->num_groups = old.num_groups;
+  free(old.hashes);
+  free(old.key_vals);
+  free(old.aggr_vals);
+  free(old.times);
+  return 0;
+}
+
+static bool output_group(
+  struct nf_preagg const *p, unsigned i,
+  nf_preagg_output *output, void *user_data)
+{
+  return output(user_data, p->times[i * 2], p->times[i * 2 + 1],
+                p->key_vals + i * p->num_keys,
+                p->aggr_vals + i * p->num_aggrs);
+}
+
+bool nf_preagg_flush(
+  struct nf_preagg *p, nf_preagg_output *output, void *user_data)
+{
+  if (! p->has_bucket) return true;
+
+  /* Slots are emptied only once all have been output, as the table is not
+   * looked up in the meantime: */
+  unsigned i = p->flushing ? p->flush_next : 0;
+  for (; i < p->capacity; i++) {
+    if (p->hashes[i] == 0) continue;
+    if (! output_group(p, i, output, user_data)) {
+      p->flushing = true;
+      p->flush_next = i;
+      return false;
+    }
+  }
+  memset(p->hashes, 0, p->capacity * sizeof(*p->hashes));
+  p->num_groups = 0;
+  p->flushing = false;
+  p->flush_next = 0;
+  p->has_bucket = false;
+  return true;
+}
+
+bool nf_preagg_expire(
+  struct nf_preagg *p, double now, double grace,
+  nf_preagg_output *output, void *user_data)
+{
+  if (! p->flushing &&
+      (! p->has_bucket ||
+       now < p->bucket_start + p->bucket_duration + grace)) return true;
+  return nf_preagg_flush(p, output, user_data);
+}
+
+enum nf_preagg_result nf_preagg_add(
+  struct nf_preagg *p, struct netflow_record const *r,
+  nf_preagg_output *output, void *user_data)
+{
+  double const bucket_start =
+    floor(r->first / p->bucket_duration) * p->bucket_duration;
+  if (p->flushing ||
+      (p->has_bucket && bucket_start > p->bucket_start)) {
+    if (! nf_preagg_flush(p, output, user_data)) return NF_PREAGG_FULL;
+  }
+  if (! p->has_bucket) {
+    p->has_bucket = true;
+    p->bucket_start = bucket_start;
+  } else if (bucket_start < p->bucket_start) {
+    p->num_late ++;
+    return NF_PREAGG_LATE;
+  }
+
+  // Keep the load factor below one half:
+  if (2 * (p->num_groups + 1) > p->capacity && 0 != grow(p))
+    return NF_PREAGG_NOMEM;
+
+  uint32_t key_vals[NF_PREAGG_MAX_KEYS];
+  for (unsigned k = 0; k < p->num_keys; k++) {
+    key_vals[k] = netflow_record_field(r, p->keys[k]);
+  }
+  uint32_t const hash = hash_keys(key_vals, p->num_keys);
+  unsigned const i = find_slot(p, hash, key_vals);
+  uint64_t *aggr_vals = p->aggr_vals + i * p->num_aggrs;
+  double *times = p->times + i * 2;
+
+  bool is_new = p->hashes[i] == 0;
+  if (is_new) {
+    p->hashes[i] = hash;
+    memcpy(p->key_vals + i * p->num_keys, key_vals,
+           p->num_keys * sizeof(*key_vals));
+    p->num_groups ++;
+  } else {
+    /* Rather than letting a sum overflow the type of the field it is output
+     * as, output the group as it is and restart it with this record: */
+    for (unsigned a = 0; a < p->num_aggrs; a++) {
+      if (p->ops[a] != NF_SUM) continue;
+      uint64_t const v = netflow_record_field(r, p->fields[a]);
+      if (aggr_vals[a] + v <= p->aggr_max[a]) continue;
+      if (! output_group(p, i, output, user_data)) return NF_PREAGG_FULL;
+      is_new = true;
+      break;
+    }
+  }
+
+  if (is_new) {
+    times[0] = r->first;
+    times[1] = r->last;
+  } else {
+    if (r->first < times[0]) times[0] = r->first;
+    if (r->last > times[1]) times[1] = r->last;
+  }
+
+  for (unsigned a = 0; a < p->num_aggrs; a++) {
+    uint64_t const v = netflow_record_field(r, p->fields[a]);
+    switch (p->ops[a]) {
+      case NF_SUM:
+        aggr_vals[a] = is_new ? v : aggr_vals[a] + v;
+        break;
+      case NF_MIN:
+        if (is_new || v < aggr_vals[a]) aggr_vals[a] = v;
+        break;
+      case NF_MAX:
+        if (is_new || v > aggr_vals[a]) aggr_vals[a] = v;
+        break;
+    }
+  }
+
+  return NF_PREAGG_ADDED;
+}
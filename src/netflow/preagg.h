@@ -0,0 +1,121 @@
+// vim: ft=c bs=2 ts=2 sts=2 sw=2 expandtab
+#ifndef PREAGG_H_20261018
+#define PREAGG_H_20261018
+
+/* Native pre-aggregation of netflow records.
+ *
+ * Many functions reading netflow merely sum, min or max a few fields of the
+ * flows per group of other fields and per time bucket. Such an aggregation
+ * can be started right after decoding, in a hash table which keys are the
+ * raw values of the group-by fields, so that only one row per group and
+ * bucket makes it to the ringbuffer of that function, which then completes
+ * the aggregation (sums of sums, min of mins and max of maxs being what we
+ * want).
+ *
+ * Records are assigned to buckets according to their start time. Along with
+ * the aggregates, each group keeps the smallest start and largest stop time
+ * of its records. Records of a past bucket (late records) are not accounted
+ * for and must be output as they are. When a record of a later bucket
+ * arrives the current bucket is flushed, and so it is when it is expired
+ * (see nf_preagg_expire) so that the last rows are not held for as long as
+ * no record arrives.
+ *
+ * Rows are never dropped: when one cannot be output the operation stops
+ * there and must be retried later. */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "netflow.h"
+
+// DO NOT ALTER without also updating RamenNetflow.preagg_fields:
+enum nf_field {
+  NF_SEQNUM, NF_ENGINE_TYPE, NF_ENGINE_ID, NF_SAMPLING_TYPE,
+  NF_SAMPLING_RATE, NF_SRC, NF_DST, NF_NEXT_HOP, NF_SRC_PORT, NF_DST_PORT,
+  NF_IN_IFACE, NF_OUT_IFACE, NF_PACKETS, NF_BYTES, NF_TCP_FLAGS,
+  NF_IP_PROTO, NF_IP_TOS, NF_SRC_AS, NF_DST_AS, NF_SRC_MASK, NF_DST_MASK,
+  NF_NUM_FIELDS
+};
+
+// DO NOT ALTER without also updating RamenNetflow.preagg_op:
+enum nf_aggr { NF_SUM, NF_MIN, NF_MAX };
+
+#define NF_PREAGG_MAX_KEYS 8
+#define NF_PREAGG_MAX_AGGRS 8
+
+struct nf_preagg {
+  double bucket_duration;
+  unsigned num_keys;
+  enum nf_field keys[NF_PREAGG_MAX_KEYS];
+  unsigned num_aggrs;
+  enum nf_aggr ops[NF_PREAGG_MAX_AGGRS];
+  enum nf_field fields[NF_PREAGG_MAX_AGGRS];
+  /* Largest value an aggregate can be output as. A group which sum would
+   * exceed it is output right away and restarted: */
+  uint64_t aggr_max[NF_PREAGG_MAX_AGGRS];
+  // Current bucket, valid only if has_bucket:
+  bool has_bucket;
+  double bucket_start;
+  // Number of late records so far:
+  unsigned num_late;
+  // If a flush could not complete, the slot it must resume from:
+  bool flushing;
+  unsigned flush_next;
+  // The hash table, with linear probing. A hash of 0 denotes an empty slot:
+  unsigned capacity;  // Always a power of 2
+  unsigned num_groups;
+  uint32_t *hashes;
+  uint32_t *key_vals;   // num_keys per slot
+  uint64_t *aggr_vals;  // num_aggrs per slot
+  double *times;        // Smallest start and largest stop, 2 per slot
+};
+
+// The value of any numeric field of a record:
+uint32_t netflow_record_field(struct netflow_record const *, enum nf_field);
+
+/* Returns -1 if the configuration is invalid or the table could not be
+ * allocated: */
+int nf_preagg_init(
+  struct nf_preagg *, double bucket_duration,
+  unsigned num_keys, enum nf_field const *keys,
+  unsigned num_aggrs, enum nf_aggr const *ops, enum nf_field const *fields,
+  uint64_t const *aggr_max);
+
+void nf_preagg_free(struct nf_preagg *);
+
+/* Called once per row, with the smallest start and largest stop of the
+ * records of the group, the values of the group-by fields (in the order of
+ * the keys) and of the aggregates (in the order of the aggregates).
+ * Returns false if the row could not be output. */
+typedef bool nf_preagg_output(
+  void *user_data, double start, double stop,
+  uint32_t const *key_vals, uint64_t const *aggr_vals);
+
+/* Output all groups of the current bucket and empty the table.
+ * Returns false if a row could not be output, in which case the flush
+ * resumes from that row at the next call (and no record can be added
+ * until it completes). */
+bool nf_preagg_flush(struct nf_preagg *, nf_preagg_output *, void *);
+
+/* Complete any pending flush, then flush the current bucket if it ended
+ * more than grace seconds before now. Returns false if a row could not be
+ * output. */
+bool nf_preagg_expire(
+  struct nf_preagg *, double now, double grace, nf_preagg_output *, void *);
+
+enum nf_preagg_result {
+  NF_PREAGG_ADDED,
+  // The record belongs to a past bucket, it was not accounted for:
+  NF_PREAGG_LATE,
+  // Some rows had to be output first and could not, retry later:
+  NF_PREAGG_FULL,
+  // The table could not be grown:
+  NF_PREAGG_NOMEM
+};
+
+/* Account for that record, flushing the current bucket first if the record
+ * belongs to a later one: */
+enum nf_preagg_result nf_preagg_add(
+  struct nf_preagg *, struct netflow_record const *,
+  nf_preagg_output *, void *);
+
+#endif
@@ -7,17 +7,7 @@
 #include <string.h>
 #include <arpa/inet.h>
 
-#define CAML_NAME_SPACE
-#include <caml/mlvalues.h>
-#include <caml/alloc.h>
-#include <caml/memory.h>
-#include <caml/custom.h>
-#include <caml/fail.h>
-#include <caml/callback.h>
-
-#include <uint8.h>
-#include <uint16.h>
-#include <uint32.h>
+#include "netflow.h"
 
 struct nf_msg {
   uint16_t version;
@@ -49,23 +39,30 @@ struct nf_flow {
   uint16_t padding2;
 } __attribute__((__packed__));
 
-CAMLprim value wrap_netflow_v5_decode(
-    value buffer_, value num_bytes_, value source_)
+unsigned netflow_version(char const *msg, size_t msg_size)
+{
+  if (msg_size < sizeof(uint16_t)) return 0;
+  uint16_t version;
+  memcpy(&version, msg, sizeof(version));
+  return ntohs(version);
+}
+
+int netflow_v5_decode(
+  char const *buffer, size_t num_bytes,
+  struct netflow_record *records, unsigned max_records, char const **err)
 {
-  CAMLparam3(buffer_, num_bytes_, source_);
-  CAMLlocal2(res, tup);
-  unsigned num_bytes = Long_val(num_bytes_);
-  assert(caml_string_length(buffer_) >= num_bytes);
   if (num_bytes < sizeof(struct nf_msg)) {
-    caml_invalid_argument("message smaller than netflow header");
+    *err = "message smaller than netflow header";
+    return -1;
   }
 
   // Assuming buffer will be suitably aligned:
-  struct nf_msg const *msg = (struct nf_msg *)String_val(buffer_);
+  struct nf_msg const *msg = (struct nf_msg const *)buffer;
 
   unsigned const version = ntohs(msg->version);
   if (version != 5) {
-    caml_invalid_argument("not netflow v5");
+    *err = "not netflow v5";
+    return -1;
   }
   unsigned const num_flows = ntohs(msg->num_flows);
   double const boot_time =
@@ -75,53 +72,46 @@ CAMLprim value wrap_netflow_v5_decode(
 
   size_t const tot_size = sizeof(*msg) + num_flows*sizeof(struct nf_flow);
   if (num_bytes < tot_size) {
-    caml_invalid_argument("truncated message or not netflow");
+    *err = "truncated message or not netflow";
+    return -1;
+  }
+  if (num_flows > max_records) {
+    *err = "too many flows";
+    return -1;
   }
 
-  struct nf_flow const *f = (struct nf_flow *)(msg+1);
-  // The array of tuples:
-  res = caml_alloc(num_flows, 0);
+  struct nf_flow const *f = (struct nf_flow const *)(msg+1);
+  unsigned const sampling = ntohs(msg->sampling);
 
-# define NB_FLOW_FIELDS 24
   for (unsigned i = 0; i < num_flows; i++, f++) {
-    // Alloc a new tuple:
-    tup = caml_alloc(NB_FLOW_FIELDS, 0);
-    unsigned j = 0;
-    // Source
-    Store_field(tup, j++, source_);
+    struct netflow_record *r = records + i;
     // Time
-    double const first = boot_time + ntohl(f->first) / 1e3;
-    Store_field(tup, j++, caml_copy_double(first));
-    double const last = boot_time + ntohl(f->last) / 1e3;
-    Store_field(tup, j++, caml_copy_double(last));
+    r->first = boot_time + ntohl(f->first) / 1e3;
+    r->last = boot_time + ntohl(f->last) / 1e3;
     // Header
-    Store_field(tup, j++, copy_uint32(ntohl(msg->seqnum)));
-    Store_field(tup, j++, Val_uint8(msg->engine_type));
-    Store_field(tup, j++, Val_uint8(msg->engine_id));
-    unsigned const sampling = ntohs(msg->sampling);
-    Store_field(tup, j++, Val_uint8(sampling >> 14U));
-    Store_field(tup, j++, Val_uint16(sampling & 0x2FFF));
+    r->seqnum = ntohl(msg->seqnum);
+    r->engine_type = msg->engine_type;
+    r->engine_id = msg->engine_id;
+    r->sampling_type = sampling >> 14U;
+    r->sampling_rate = sampling & 0x2FFF;
     // Flow
-    Store_field(tup, j++, copy_uint32(ntohl(f->addr[0])));
-    Store_field(tup, j++, copy_uint32(ntohl(f->addr[1])));
-    Store_field(tup, j++, copy_uint32(ntohl(f->next_hop)));
-    Store_field(tup, j++, Val_uint16(ntohs(f->port[0])));
-    Store_field(tup, j++, Val_uint16(ntohs(f->port[1])));
-    Store_field(tup, j++, Val_uint16(ntohs(f->in_iface)));
-    Store_field(tup, j++, Val_uint16(ntohs(f->out_iface)));
-    Store_field(tup, j++, copy_uint32(ntohl(f->packets)));
-    Store_field(tup, j++, copy_uint32(ntohl(f->bytes)));
-    Store_field(tup, j++, Val_uint8(f->tcp_flags));
-    Store_field(tup, j++, Val_uint8(f->ip_proto));
-    Store_field(tup, j++, Val_uint8(f->ip_tos));
-    Store_field(tup, j++, Val_uint16(ntohs(f->as[0])));
-    Store_field(tup, j++, Val_uint16(ntohs(f->as[1])));
-    Store_field(tup, j++, Val_uint8(f->mask[0]));
-    Store_field(tup, j++, Val_uint8(f->mask[1]));
-
-    assert(j == NB_FLOW_FIELDS);
-    Store_field(res, i, tup);
+    r->src = ntohl(f->addr[0]);
+    r->dst = ntohl(f->addr[1]);
+    r->next_hop = ntohl(f->next_hop);
+    r->src_port = ntohs(f->port[0]);
+    r->dst_port = ntohs(f->port[1]);
+    r->in_iface = ntohs(f->in_iface);
+    r->out_iface = ntohs(f->out_iface);
+    r->packets = ntohl(f->packets);
+    r->bytes = ntohl(f->bytes);
+    r->tcp_flags = f->tcp_flags;
+    r->ip_proto = f->ip_proto;
+    r->ip_tos = f->ip_tos;
+    r->src_as = ntohs(f->as[0]);
+    r->dst_as = ntohs(f->as[1]);
+    r->src_mask = f->mask[0];
+    r->dst_mask = f->mask[1];
   }
 
-  CAMLreturn(res);
+  return num_flows;
 }
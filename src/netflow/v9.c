@@ -0,0 +1,575 @@
+// vim: ft=c bs=2 ts=2 sts=2 sw=2 expandtab
+/* Netflow v9 (RFC 3954) and IPFIX (RFC 7011) decoder.
+ *
+ * Both describe the layout of their data records in templates, that are
+ * sent separately. Each template is compiled once into a decode plan: a
+ * list of (offset, width, target) steps, only for the fields that we are
+ * interested in, so that decoding a data record is merely a matter of
+ * running through that list. */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "netflow.h"
+
+/* Where a field value goes. Values are first collected into an array of
+ * uint64_t indexed by target, then converted into a netflow_record. */
+enum nf9_target {
+  T_BYTES, T_PACKETS, T_IP_PROTO, T_IP_TOS, T_TCP_FLAGS,
+  T_SRC_PORT, T_SRC, T_SRC_MASK, T_IN_IFACE,
+  T_DST_PORT, T_DST, T_DST_MASK, T_OUT_IFACE,
+  T_NEXT_HOP, T_SRC_AS, T_DST_AS,
+  T_LAST_UPTIME_MS, T_FIRST_UPTIME_MS,
+  T_SAMPLING_INTERVAL, T_SAMPLING_ALGORITHM,
+  T_ENGINE_TYPE, T_ENGINE_ID,
+  T_START_S, T_END_S, T_START_MS, T_END_MS, T_SYS_INIT_MS,
+  NB_TARGETS,
+  T_NONE = 0xFF
+};
+
+// Information element ids (common to v9 and IPFIX):
+static enum nf9_target target_of_field(unsigned type)
+{
+  switch (type) {
+    case 1: return T_BYTES;
+    case 2: return T_PACKETS;
+    case 4: return T_IP_PROTO;
+    case 5: return T_IP_TOS;
+    case 6: return T_TCP_FLAGS;
+    case 7: return T_SRC_PORT;
+    case 8: return T_SRC;
+    case 9: return T_SRC_MASK;
+    case 10: return T_IN_IFACE;
+    case 11: return T_DST_PORT;
+    case 12: return T_DST;
+    case 13: return T_DST_MASK;
+    case 14: return T_OUT_IFACE;
+    case 15: return T_NEXT_HOP;
+    case 16: return T_SRC_AS;
+    case 17: return T_DST_AS;
+    case 21: return T_LAST_UPTIME_MS;
+    case 22: return T_FIRST_UPTIME_MS;
+    case 34: return T_SAMPLING_INTERVAL;
+    case 35: return T_SAMPLING_ALGORITHM;
+    case 38: return T_ENGINE_TYPE;
+    case 39: return T_ENGINE_ID;
+    case 150: return T_START_S;
+    case 151: return T_END_S;
+    case 152: return T_START_MS;
+    case 153: return T_END_MS;
+    case 160: return T_SYS_INIT_MS;
+    default: return T_NONE;
+  }
+}
+
+#define VARIABLE_LENGTH 0xFFFF
+
+struct nf9_step {
+  uint32_t offset;  // Only meaningful for fixed length templates
+  uint16_t width;
+  uint8_t target;
+};
+
+struct nf9_template {
+  struct nf9_template *next;  // Within the same hash bucket
+  // The key:
+  uint8_t exporter[16];
+  uint32_t domain;
+  uint16_t id;
+  // The decode plan. For fixed length templates, only the fields with a
+  // target are in there. For variable length templates, all fields are in
+  // there, so that the offsets can be computed as we go:
+  bool variable_length;
+  uint32_t record_len;  // Minimum length for variable length templates
+  unsigned num_steps;
+  struct nf9_step steps[];
+};
+
+/*
+ * The template cache
+ *
+ * Shared by all exporters, so each exporter is also limited to a number of
+ * templates, so that one exporter cannot prevent the others' templates from
+ * being cached.
+ */
+
+#define NB_BUCKETS 1024
+#define MAX_TEMPLATES 8192
+#define MAX_TEMPLATES_PER_EXPORTER 256
+
+static struct nf9_template *templates[NB_BUCKETS];
+static unsigned num_templates;
+
+// Number of templates of each exporter that has any:
+struct nf9_exporter {
+  struct nf9_exporter *next;  // Within the same hash bucket
+  uint8_t exporter[16];
+  unsigned num_templates;
+};
+
+#define NB_EXPORTER_BUCKETS 256
+
+static struct nf9_exporter *exporters[NB_EXPORTER_BUCKETS];
+
+static void exporter_key(
+  uint8_t key[16], struct sockaddr_storage const *exporter)
+{
+  memset(key, 0, 16);
+  switch (exporter->ss_family) {
+    case AF_INET:
+      memcpy(key, &((struct sockaddr_in const *)exporter)->sin_addr, 4);
+      break;
+    case AF_INET6:
+      memcpy(key, &((struct sockaddr_in6 const *)exporter)->sin6_addr, 16);
+      break;
+  }
+}
+
+// FNV-1a:
+#define FNV_INIT 2166136261U
+
+static uint32_t fnv_byte(uint32_t h, uint8_t b)
+{
+  return (h ^ b) * 16777619U;
+}
+
+static uint32_t hash_of_exporter(uint8_t const exporter[16])
+{
+  uint32_t h = FNV_INIT;
+  for (unsigned i = 0; i < 16; i++) h = fnv_byte(h, exporter[i]);
+  return h;
+}
+
+static unsigned bucket_of(uint8_t const exporter[16], uint32_t domain, uint16_t id)
+{
+  uint32_t h = hash_of_exporter(exporter);
+  for (unsigned i = 0; i < 4; i++) h = fnv_byte(h, (domain >> (8*i)) & 0xFF);
+  h = fnv_byte(h, id & 0xFF);
+  h = fnv_byte(h, id >> 8);
+  return h % NB_BUCKETS;
+}
+
+static struct nf9_exporter **find_exporter(uint8_t const exporter[16])
+{
+  struct nf9_exporter **e =
+    exporters + hash_of_exporter(exporter) % NB_EXPORTER_BUCKETS;
+  while (*e) {
+    if (0 == memcmp((*e)->exporter, exporter, 16)) break;
+    e = &(*e)->next;
+  }
+  return e;
+}
+
+/* Account for one more (or, if delta is -1, one less) template for that
+ * exporter. Returns false if the exporter cannot have any more templates: */
+static bool count_exporter_templates(uint8_t const exporter[16], int delta)
+{
+  struct nf9_exporter **e = find_exporter(exporter);
+
+  if (! *e) {
+    assert(delta > 0);
+    struct nf9_exporter *new = malloc(sizeof(*new));
+    if (! new) return false;
+    new->next = NULL;
+    memcpy(new->exporter, exporter, 16);
+    new->num_templates = 0;
+    *e = new;
+  }
+
+  if (delta > 0) {
+    if ((*e)->num_templates >= MAX_TEMPLATES_PER_EXPORTER) return false;
+    (*e)->num_templates ++;
+  } else {
+    assert((*e)->num_templates > 0);
+    if (-- (*e)->num_templates == 0) {
+      struct nf9_exporter *next = (*e)->next;
+      free(*e);
+      *e = next;
+    }
+  }
+
+  return true;
+}
+
+static struct nf9_template **find_template(
+  uint8_t const exporter[16], uint32_t domain, uint16_t id)
+{
+  struct nf9_template **t = templates + bucket_of(exporter, domain, id);
+  while (*t) {
+    if ((*t)->id == id && (*t)->domain == domain &&
+        0 == memcmp((*t)->exporter, exporter, 16)) break;
+    t = &(*t)->next;
+  }
+  return t;
+}
+
+static void remove_template(
+  uint8_t const exporter[16], uint32_t domain, uint16_t id)
+{
+  struct nf9_template **t = find_template(exporter, domain, id);
+  if (! *t) return;
+  struct nf9_template *next = (*t)->next;
+  free(*t);
+  *t = next;
+  num_templates --;
+  count_exporter_templates(exporter, -1);
+}
+
+// Replaces any previous template with the same key:
+static void add_template(struct nf9_template *new)
+{
+  struct nf9_template **t = find_template(new->exporter, new->domain, new->id);
+  if (*t) {
+    new->next = (*t)->next;
+    free(*t);
+  } else {
+    if (num_templates >= MAX_TEMPLATES) {
+      fprintf(stderr, "netflow_v9: too many templates, ignoring new ones\n");
+      free(new);
+      return;
+    }
+    if (! count_exporter_templates(new->exporter, 1)) {
+      fprintf(stderr,
+        "netflow_v9: too many templates for one exporter, ignoring new ones\n");
+      free(new);
+      return;
+    }
+    new->next = NULL;
+    num_templates ++;
+  }
+  *t = new;
+}
+
+/*
+ * Reading
+ */
+
+static unsigned read_u8(unsigned char const *p) { return p[0]; }
+
+static unsigned read_u16(unsigned char const *p)
+{
+  return ((unsigned)p[0] << 8) | p[1];
+}
+
+static uint32_t read_u32(unsigned char const *p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t read_uint(unsigned char const *p, unsigned width)
+{
+  switch (width) {
+    case 1: return read_u8(p);
+    case 2: return read_u16(p);
+    case 4: return read_u32(p);
+    case 8: return ((uint64_t)read_u32(p) << 32) | read_u32(p + 4);
+    default:
+      {
+        // Reduced size encoding (RFC 7011, section 6.2):
+        uint64_t v = 0;
+        for (unsigned i = 0; i < width; i++) v = (v << 8) | p[i];
+        return v;
+      }
+  }
+}
+
+/* Compile a template record into a new template.
+ * Sets *len to the length of the template record.
+ * Returns NULL and sets *err if the record is invalid, or NULL without
+ * setting *err if the template is withdrawn. */
+static struct nf9_template *compile_template(
+  unsigned char const *p, size_t size, bool ipfix,
+  uint8_t const exporter[16], uint32_t domain,
+  size_t *len, char const **err)
+{
+  if (size < 4) {
+    *err = "truncated template";
+    return NULL;
+  }
+  unsigned const id = read_u16(p);
+  unsigned const num_fields = read_u16(p + 2);
+  *len = 4;
+
+  if (num_fields == 0) {
+    // Template withdrawal:
+    remove_template(exporter, domain, id);
+    return NULL;
+  }
+
+  struct nf9_template *t =
+    malloc(sizeof(*t) + num_fields * sizeof(t->steps[0]));
+  if (! t) {
+    *err = "cannot allocate template";
+    return NULL;
+  }
+  memcpy(t->exporter, exporter, 16);
+  t->domain = domain;
+  t->id = id;
+  t->variable_length = false;
+  t->record_len = 0;
+  t->num_steps = 0;
+
+  // Start with one step per field:
+  for (unsigned f = 0; f < num_fields; f++) {
+    if (size < *len + 4) goto truncated;
+    unsigned type = read_u16(p + *len);
+    unsigned const width = read_u16(p + *len + 2);
+    *len += 4;
+    if (ipfix && (type & 0x8000)) {
+      // Enterprise specific field, that we do not know about:
+      if (size < *len + 4) goto truncated;
+      *len += 4;
+      type = 0;
+    }
+    enum nf9_target target = target_of_field(type);
+    // Only integers that fit in 64 bits are of interest:
+    if (width == 0 || width > 8) target = T_NONE;
+
+    t->steps[t->num_steps++] = (struct nf9_step) {
+      .offset = t->record_len, .width = width, .target = target };
+
+    if (width == VARIABLE_LENGTH) {
+      t->variable_length = true;
+      t->record_len += 1;  // Minimum length of the length prefix
+    } else {
+      t->record_len += width;
+    }
+  }
+
+  if (t->record_len == 0) {
+    free(t);
+    *err = "empty template";
+    return NULL;
+  }
+
+  /* Then, if offsets are known in advance, keep only the steps with a
+   * target: */
+  if (! t->variable_length) {
+    unsigned n = 0;
+    for (unsigned s = 0; s < t->num_steps; s++) {
+      if (t->steps[s].target != T_NONE) t->steps[n++] = t->steps[s];
+    }
+    t->num_steps = n;
+  }
+
+  return t;
+
+truncated:
+  free(t);
+  *err = "truncated template";
+  return NULL;
+}
+
+/* Decode one data record, which length is returned (or 0 if the record
+ * is truncated), into vals, setting the corresponding bits of *set: */
+static size_t decode_record(
+  struct nf9_template const *t, unsigned char const *p, size_t size,
+  uint64_t vals[NB_TARGETS], uint32_t *set)
+{
+  *set = 0;
+
+  if (! t->variable_length) {
+    if (size < t->record_len) return 0;
+    for (unsigned s = 0; s < t->num_steps; s++) {
+      struct nf9_step const *step = t->steps + s;
+      vals[step->target] = read_uint(p + step->offset, step->width);
+      *set |= 1U << step->target;
+    }
+    return t->record_len;
+  }
+
+  size_t offs = 0;
+  for (unsigned s = 0; s < t->num_steps; s++) {
+    struct nf9_step const *step = t->steps + s;
+    size_t width = step->width;
+    if (width == VARIABLE_LENGTH) {
+      if (offs + 1 > size) return 0;
+      width = p[offs++];
+      if (width == 255) {
+        if (offs + 2 > size) return 0;
+        width = read_u16(p + offs);
+        offs += 2;
+      }
+    }
+    if (offs + width > size) return 0;
+    if (step->target != T_NONE) {
+      vals[step->target] = read_uint(p + offs, width);
+      *set |= 1U << step->target;
+    }
+    offs += width;
+  }
+  return offs;
+}
+
+#define IS_SET(set, t) ((set) & (1U << (t)))
+
+static uint32_t saturate_u32(uint64_t v)
+{
+  return v > UINT32_MAX ? UINT32_MAX : v;
+}
+
+static uint16_t saturate_u16(uint64_t v)
+{
+  return v > UINT16_MAX ? UINT16_MAX : v;
+}
+
+// 4 bytes AS numbers that do not fit are reported as AS_TRANS (RFC 6793):
+static uint16_t as_of(uint64_t v)
+{
+  return v > UINT16_MAX ? 23456 : v;
+}
+
+/* Convert the collected values into a record.
+ * For v9, relative times are relative to sys_uptime (in ms) at export_time.
+ * For IPFIX, absolute times are preferred, then times relative to the
+ * system init time, then the export time. */
+static void record_of_vals(
+  struct netflow_record *r, uint64_t const vals[NB_TARGETS], uint32_t set,
+  bool ipfix, double export_time, uint32_t sys_uptime, uint32_t seqnum)
+{
+  double first = export_time, last = export_time;
+  if (! ipfix) {
+    double const boot_time = export_time - sys_uptime / 1e3;
+    if (IS_SET(set, T_FIRST_UPTIME_MS))
+      first = boot_time + vals[T_FIRST_UPTIME_MS] / 1e3;
+    if (IS_SET(set, T_LAST_UPTIME_MS))
+      last = boot_time + vals[T_LAST_UPTIME_MS] / 1e3;
+  } else {
+    if (IS_SET(set, T_START_MS)) first = vals[T_START_MS] / 1e3;
+    else if (IS_SET(set, T_START_S)) first = vals[T_START_S];
+    else if (IS_SET(set, T_FIRST_UPTIME_MS) && IS_SET(set, T_SYS_INIT_MS))
+      first = (vals[T_SYS_INIT_MS] + vals[T_FIRST_UPTIME_MS]) / 1e3;
+    if (IS_SET(set, T_END_MS)) last = vals[T_END_MS] / 1e3;
+    else if (IS_SET(set, T_END_S)) last = vals[T_END_S];
+    else if (IS_SET(set, T_LAST_UPTIME_MS) && IS_SET(set, T_SYS_INIT_MS))
+      last = (vals[T_SYS_INIT_MS] + vals[T_LAST_UPTIME_MS]) / 1e3;
+  }
+
+# define VAL(t) (IS_SET(set, t) ? vals[t] : 0)
+  r->first = first;
+  r->last = last;
+  r->seqnum = seqnum;
+  r->engine_type = VAL(T_ENGINE_TYPE);
+  r->engine_id = VAL(T_ENGINE_ID);
+  r->sampling_type = VAL(T_SAMPLING_ALGORITHM) & 0x3;
+  r->sampling_rate = saturate_u16(VAL(T_SAMPLING_INTERVAL));
+  r->src = VAL(T_SRC);
+  r->dst = VAL(T_DST);
+  r->next_hop = VAL(T_NEXT_HOP);
+  r->src_port = VAL(T_SRC_PORT);
+  r->dst_port = VAL(T_DST_PORT);
+  r->in_iface = saturate_u16(VAL(T_IN_IFACE));
+  r->out_iface = saturate_u16(VAL(T_OUT_IFACE));
+  r->packets = saturate_u32(VAL(T_PACKETS));
+  r->bytes = saturate_u32(VAL(T_BYTES));
+  r->tcp_flags = VAL(T_TCP_FLAGS);
+  r->ip_proto = VAL(T_IP_PROTO);
+  r->ip_tos = VAL(T_IP_TOS);
+  r->src_as = as_of(VAL(T_SRC_AS));
+  r->dst_as = as_of(VAL(T_DST_AS));
+  r->src_mask = VAL(T_SRC_MASK);
+  r->dst_mask = VAL(T_DST_MASK);
+# undef VAL
+}
+
+int netflow_v9_decode(
+  char const *msg_, size_t msg_size, struct sockaddr_storage const *exporter,
+  struct netflow_record *records, unsigned max_records, char const **err)
+{
+  unsigned char const *msg = (unsigned char const *)msg_;
+  unsigned const version = netflow_version(msg_, msg_size);
+  bool const ipfix = version == 10;
+  if (version != 9 && ! ipfix) {
+    *err = "not netflow v9 nor IPFIX";
+    return -1;
+  }
+
+  // Header:
+  size_t const header_len = ipfix ? 16 : 20;
+  if (msg_size < header_len) {
+    *err = "message smaller than netflow header";
+    return -1;
+  }
+  double export_time;
+  uint32_t sys_uptime = 0, seqnum, domain;
+  if (ipfix) {
+    size_t const len = read_u16(msg + 2);
+    if (len > msg_size) {
+      *err = "truncated IPFIX message";
+      return -1;
+    }
+    msg_size = len;
+    export_time = read_u32(msg + 4);
+    seqnum = read_u32(msg + 8);
+    domain = read_u32(msg + 12);
+  } else {
+    sys_uptime = read_u32(msg + 4);
+    export_time = read_u32(msg + 8);
+    seqnum = read_u32(msg + 12);
+    domain = read_u32(msg + 16);
+  }
+
+  uint8_t key[16];
+  exporter_key(key, exporter);
+
+  unsigned const template_set = ipfix ? 2 : 0;
+  unsigned const options_set = ipfix ? 3 : 1;
+  unsigned num_records = 0;
+  uint64_t vals[NB_TARGETS];
+
+  // Sets (aka flowsets for v9):
+  size_t offs = header_len;
+  while (offs + 4 <= msg_size) {
+    unsigned const set_id = read_u16(msg + offs);
+    size_t const set_len = read_u16(msg + offs + 2);
+    if (set_len < 4 || offs + set_len > msg_size) {
+      *err = "invalid set length";
+      return -1;
+    }
+    unsigned char const *p = msg + offs + 4;
+    size_t const size = set_len - 4;
+
+    if (set_id == template_set) {
+      size_t o = 0;
+      while (o + 4 <= size) {
+        size_t len;
+        *err = NULL;
+        struct nf9_template *t =
+          compile_template(p + o, size - o, ipfix, key, domain, &len, err);
+        if (t) add_template(t);
+        else if (*err) return -1;
+        o += len;
+      }
+    } else if (set_id == options_set) {
+      // Options templates describe the exporter, not flows.
+    } else if (set_id >= 256) {
+      struct nf9_template **t = find_template(key, domain, set_id);
+      if (*t) {
+        size_t o = 0;
+        while (o < size) {
+          uint32_t set;
+          size_t const len = decode_record(*t, p + o, size - o, vals, &set);
+          if (len == 0) break;  // Padding
+          o += len;
+          if (! IS_SET(set, T_SRC) || ! IS_SET(set, T_DST)) continue;
+          if (num_records >= max_records) {
+            *err = "too many flows";
+            return -1;
+          }
+          record_of_vals(records + num_records++, vals, set, ipfix,
+                         export_time, sys_uptime, seqnum);
+        }
+      }
+    }
+
+    offs += set_len;
+  }
+
+  return num_records;
+}
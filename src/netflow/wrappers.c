@@ -0,0 +1,671 @@
+// vim: ft=c bs=2 ts=2 sts=2 sw=2 expandtab
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#define CAML_NAME_SPACE
+#include <caml/mlvalues.h>
+#include <caml/alloc.h>
+#include <caml/memory.h>
+#include <caml/custom.h>
+#include <caml/fail.h>
+#include <caml/callback.h>
+#include <caml/signals.h>
+#include <caml/unixsupport.h>
+
+#include <uint8.h>
+#include <uint16.h>
+#include <uint32.h>
+
+#include "netflow.h"
+#include "preagg.h"
+#include "../ringbuf/ringbuf.h"
+#include "../udp/udp_batch.h"
+
+/* Decoded records, for all the messages of a batch. Grown as needed and
+ * then reused: */
+static struct netflow_record *records;
+static size_t records_capacity;
+
+static void reserve_records(size_t capacity)
+{
+  if (capacity <= records_capacity) return;
+  struct netflow_record *r = realloc(records, capacity * sizeof(*records));
+  if (! r) caml_raise_out_of_memory();
+  records = r;
+  records_capacity = capacity;
+}
+
+static value alloc_record(struct netflow_record const *r, value source_)
+{
+  CAMLparam1(source_);
+  CAMLlocal1(tup);
+
+# define NB_FLOW_FIELDS 24
+  // Alloc a new tuple:
+  tup = caml_alloc(NB_FLOW_FIELDS, 0);
+  unsigned j = 0;
+  // Source
+  Store_field(tup, j++, source_);
+  // Time
+  Store_field(tup, j++, caml_copy_double(r->first));
+  Store_field(tup, j++, caml_copy_double(r->last));
+  // Header
+  Store_field(tup, j++, copy_uint32(r->seqnum));
+  Store_field(tup, j++, Val_uint8(r->engine_type));
+  Store_field(tup, j++, Val_uint8(r->engine_id));
+  Store_field(tup, j++, Val_uint8(r->sampling_type));
+  Store_field(tup, j++, Val_uint16(r->sampling_rate));
+  // Flow
+  Store_field(tup, j++, copy_uint32(r->src));
+  Store_field(tup, j++, copy_uint32(r->dst));
+  Store_field(tup, j++, copy_uint32(r->next_hop));
+  Store_field(tup, j++, Val_uint16(r->src_port));
+  Store_field(tup, j++, Val_uint16(r->dst_port));
+  Store_field(tup, j++, Val_uint16(r->in_iface));
+  Store_field(tup, j++, Val_uint16(r->out_iface));
+  Store_field(tup, j++, copy_uint32(r->packets));
+  Store_field(tup, j++, copy_uint32(r->bytes));
+  Store_field(tup, j++, Val_uint8(r->tcp_flags));
+  Store_field(tup, j++, Val_uint8(r->ip_proto));
+  Store_field(tup, j++, Val_uint8(r->ip_tos));
+  Store_field(tup, j++, Val_uint16(r->src_as));
+  Store_field(tup, j++, Val_uint16(r->dst_as));
+  Store_field(tup, j++, Val_uint8(r->src_mask));
+  Store_field(tup, j++, Val_uint8(r->dst_mask));
+
+  assert(j == NB_FLOW_FIELDS);
+  CAMLreturn(tup);
+}
+
+CAMLprim value wrap_netflow_v5_decode(
+    value buffer_, value num_bytes_, value source_)
+{
+  CAMLparam3(buffer_, num_bytes_, source_);
+  CAMLlocal1(res);
+  unsigned num_bytes = Long_val(num_bytes_);
+  assert(caml_string_length(buffer_) >= num_bytes);
+
+  reserve_records(NETFLOW_MAX_RECORDS(num_bytes));
+  char const *err;
+  int const num_flows =
+    netflow_v5_decode(String_val(buffer_), num_bytes,
+                      records, records_capacity, &err);
+  if (num_flows < 0) caml_invalid_argument(err);
+
+  // The array of tuples:
+  res = caml_alloc(num_flows, 0);
+  for (int i = 0; i < num_flows; i++) {
+    Store_field(res, i, alloc_record(records + i, source_));
+  }
+
+  CAMLreturn(res);
+}
+
+/*
+ * Receiving and decoding many datagrams at once
+ */
+
+#define NETFLOW_MSG_SIZE 2000
+#define NETFLOW_BATCH_MAX_MSGS 64
+
+static struct udp_batch batch;
+// Index of the first record and number of records for each message:
+static size_t batch_first_record[NETFLOW_BATCH_MAX_MSGS];
+static unsigned batch_num_records[NETFLOW_BATCH_MAX_MSGS];
+
+// Where wrap_netflow_preagg_batch_into resumes in the last received batch:
+static unsigned preagg_next_msg, preagg_next_rec;
+
+extern struct custom_operations uint128_ops;
+
+static value copy_uint128(__uint128_t n)
+{
+  value v = caml_alloc_custom(&uint128_ops, sizeof(n), 0, 1);
+  memcpy(Data_custom_val(v), &n, sizeof(n));
+  return v;
+}
+
+// Returns a RamenIp.t nullable:
+static value alloc_source(struct sockaddr_storage const *addr)
+{
+  CAMLparam0();
+  CAMLlocal2(res, ip);
+  switch (addr->ss_family) {
+    case AF_INET:
+      {
+        struct sockaddr_in const *a = (struct sockaddr_in const *)addr;
+        ip = caml_alloc(1, 0);  // V4
+        Store_field(ip, 0, copy_uint32(ntohl(a->sin_addr.s_addr)));
+      }
+      break;
+    case AF_INET6:
+      {
+        struct sockaddr_in6 const *a = (struct sockaddr_in6 const *)addr;
+        __uint128_t n = 0;
+        for (unsigned i = 0; i < 16; i++) {
+          n = (n << 8) | a->sin6_addr.s6_addr[i];
+        }
+        ip = caml_alloc(1, 1);  // V6
+        Store_field(ip, 0, copy_uint128(n));
+      }
+      break;
+    default:
+      CAMLreturn(Val_int(0));  // Null
+  }
+  res = caml_alloc(1, 0);  // NotNull
+  Store_field(res, 0, ip);
+  CAMLreturn(res);
+}
+
+/* Receive a batch of messages and decode them all into records, whatever
+ * their netflow version. Returns the total number of records, or -1 and
+ * sets errno. */
+static ssize_t recv_batch(int fd, char const *what)
+{
+  if (! batch.bufs &&
+      0 != udp_batch_init(&batch, NETFLOW_BATCH_MAX_MSGS, NETFLOW_MSG_SIZE))
+    caml_raise_out_of_memory();
+
+  caml_enter_blocking_section();
+  int const num_msgs = udp_batch_recv(&batch, fd);
+  caml_leave_blocking_section();
+  if (num_msgs < 0) return -1;
+
+  // That's a new batch for wrap_netflow_preagg_batch_into:
+  preagg_next_msg = 0;
+  preagg_next_rec = 0;
+
+  size_t max_records = 0;
+  for (int i = 0; i < num_msgs; i++) {
+    max_records += NETFLOW_MAX_RECORDS(batch.lens[i]);
+  }
+  reserve_records(max_records);
+
+  size_t tot_records = 0;
+  for (int i = 0; i < num_msgs; i++) {
+    char const *msg = udp_batch_msg(&batch, i);
+    size_t const len = batch.lens[i];
+    struct netflow_record *r = records + tot_records;
+    unsigned const max = records_capacity - tot_records;
+    char const *err = "unknown netflow version";
+    int num_records = -1;
+    switch (netflow_version(msg, len)) {
+      case 5:
+        num_records = netflow_v5_decode(msg, len, r, max, &err);
+        break;
+      case 9:
+      case 10:
+        num_records =
+          netflow_v9_decode(msg, len, batch.senders + i, r, max, &err);
+        break;
+    }
+    if (num_records < 0) {
+      fprintf(stderr, "%s: %s\n", what, err);
+      num_records = 0;
+    }
+    batch_first_record[i] = tot_records;
+    batch_num_records[i] = num_records;
+    tot_records += num_records;
+  }
+
+  return tot_records;
+}
+
+/* Box the records of the last received batch, starting at record first_rec
+ * of message first_msg: */
+static value alloc_records(unsigned first_msg, unsigned first_rec)
+{
+  CAMLparam0();
+  CAMLlocal2(res, source);
+
+  size_t num_records = 0;
+  for (unsigned i = first_msg; i < batch.num_msgs; i++) {
+    num_records += batch_num_records[i] - (i == first_msg ? first_rec : 0);
+  }
+
+  res = caml_alloc(num_records, 0);
+  unsigned r = 0;
+  for (unsigned i = first_msg; i < batch.num_msgs; i++) {
+    unsigned const j0 = i == first_msg ? first_rec : 0;
+    if (batch_num_records[i] <= j0) continue;
+    source = alloc_source(batch.senders + i);
+    for (unsigned j = j0; j < batch_num_records[i]; j++) {
+      Store_field(res, r++,
+        alloc_record(records + batch_first_record[i] + j, source));
+    }
+  }
+  assert(r == num_records);
+
+  CAMLreturn(res);
+}
+
+CAMLprim value wrap_netflow_recv(value fd_)
+{
+  CAMLparam1(fd_);
+  int const fd = Int_val(fd_);
+
+  ssize_t const tot_records = recv_batch(fd, "netflow_recv");
+  if (tot_records < 0) uerror("recvmmsg", Nothing);
+
+  CAMLreturn(alloc_records(0, 0));
+}
+
+/* Receive and decode a batch of messages, to be then retrieved with
+ * wrap_netflow_batch, wrap_netflow_batch_into or
+ * wrap_netflow_preagg_batch_into. Returns the number of records: */
+CAMLprim value wrap_netflow_recv_batch(value fd_)
+{
+  CAMLparam1(fd_);
+  int const fd = Int_val(fd_);
+
+  ssize_t const tot_records = recv_batch(fd, "netflow_recv_batch");
+  if (tot_records < 0) uerror("recvmmsg", Nothing);
+
+  CAMLreturn(Val_long(tot_records));
+}
+
+CAMLprim value wrap_netflow_batch(value unit)
+{
+  CAMLparam1(unit);
+  CAMLreturn(alloc_records(0, 0));
+}
+
+/*
+ * Serializing flows straight into a ringbuffer
+ *
+ * For pure ingestion workers, which output the netflow tuples as they are,
+ * there is no need to build OCaml values only to serialize them back right
+ * away. Instead, the flows are serialized directly in the format expected
+ * by the readers of the ringbuffer, for a tuple of type
+ * RamenNetflow.tuple_typ with all fields selected: a message header, the
+ * nullmask (only source is nullable) and then each field in serialization
+ * order (ie. sorted by name), each rounded up to a 4 bytes word.
+ */
+
+extern struct ringbuf *ringbuf_of_value(value);
+
+// Message header (DataTuple on the live channel) + nullmask + all the
+// fields but source:
+#define FLOW_FIXED_WORDS (1 + 1 + 16 + 4 + 2*2 + 1)
+
+static unsigned source_words(struct sockaddr_storage const *addr)
+{
+  switch (addr->ss_family) {
+    case AF_INET: return 1 + 1;
+    case AF_INET6: return 1 + 4;
+    default: return 0;  // Null
+  }
+}
+
+static void write_double(uint32_t *w, double d)
+{
+  memcpy(w, &d, sizeof(d));
+}
+
+static void write_source(uint32_t *w, struct sockaddr_storage const *addr)
+{
+  switch (addr->ss_family) {
+    case AF_INET:
+      {
+        struct sockaddr_in const *a = (struct sockaddr_in const *)addr;
+        w[0] = 0;  // V4
+        w[1] = ntohl(a->sin_addr.s_addr);
+      }
+      break;
+    case AF_INET6:
+      {
+        struct sockaddr_in6 const *a = (struct sockaddr_in6 const *)addr;
+        __uint128_t n = 0;
+        for (unsigned i = 0; i < 16; i++) {
+          n = (n << 8) | a->sin6_addr.s6_addr[i];
+        }
+        w[0] = 1;  // V6
+        memcpy(w + 1, &n, sizeof(n));
+      }
+      break;
+  }
+}
+
+// Returns false if there was no room for that record:
+static bool write_record(
+  struct ringbuf *rb, struct netflow_record const *r,
+  struct sockaddr_storage const *source)
+{
+  unsigned const src_words = source_words(source);
+  uint32_t const num_words = FLOW_FIXED_WORDS + src_words;
+  struct ringbuf_tx tx;
+  if (ringbuf_enqueue_alloc(rb, &tx, num_words)) return false;
+
+  uint32_t *w = (uint32_t *)(rb->rbf->data + tx.record_start);
+  unsigned j = 0;
+  w[j++] = 0;  // DataTuple on the live channel
+  w[j++] = src_words > 0 ? 1 : 0;  // nullmask
+  w[j++] = r->bytes;
+  w[j++] = r->dst;
+  w[j++] = r->dst_as;
+  w[j++] = r->dst_mask;
+  w[j++] = r->dst_port;
+  w[j++] = r->engine_id;
+  w[j++] = r->engine_type;
+  w[j++] = r->in_iface;
+  w[j++] = r->ip_proto;
+  w[j++] = r->ip_tos;
+  w[j++] = r->next_hop;
+  w[j++] = r->out_iface;
+  w[j++] = r->packets;
+  w[j++] = r->sampling_rate;
+  w[j++] = r->sampling_type;
+  w[j++] = r->seqnum;
+  write_source(w + j, source);
+  j += src_words;
+  w[j++] = r->src;
+  w[j++] = r->src_as;
+  w[j++] = r->src_mask;
+  w[j++] = r->src_port;
+  write_double(w + j, r->first);  // start
+  j += 2;
+  write_double(w + j, r->last);  // stop
+  j += 2;
+  w[j++] = r->tcp_flags;
+  assert(j == num_words);
+
+  ringbuf_enqueue_commit(rb, &tx, r->first, r->last);
+  return true;
+}
+
+/* Write the flows of the last received batch into the given ringbuffer.
+ * Returns the number of written flows and, rather than dropping them, the
+ * flows that did not fit (which are all the flows after the first one that
+ * did not fit, so that the order is preserved). */
+CAMLprim value wrap_netflow_batch_into(value rb_)
+{
+  CAMLparam1(rb_);
+  CAMLlocal2(res, rest);
+  struct ringbuf *rb = ringbuf_of_value(rb_);
+
+  unsigned num_written = 0;
+  unsigned i, j = 0;
+  for (i = 0; i < batch.num_msgs; i++) {
+    for (j = 0; j < batch_num_records[i]; j++) {
+      if (! write_record(rb, records + batch_first_record[i] + j,
+                         batch.senders + i))
+        goto full;
+      num_written ++;
+    }
+  }
+  // All written:
+  i = batch.num_msgs;
+  j = 0;
+
+full:
+  rest = alloc_records(i, j);
+  res = caml_alloc_tuple(2);
+  Store_field(res, 0, Val_int(num_written));
+  Store_field(res, 1, rest);
+  CAMLreturn(res);
+}
+
+/*
+ * Pre-aggregating flows straight into a ringbuffer
+ *
+ * The aggregated rows are serialized as netflow tuples for a child reading
+ * only some of the fields (see RamenNetflow.preagg_columns): start and
+ * stop, the group-by fields and the aggregated fields, in serialization
+ * order. Source is never selected, so there is no nullmask.
+ */
+
+// DO NOT ALTER without also updating RamenNetflow.preagg_column:
+enum preagg_column_kind { COL_START, COL_STOP, COL_KEY, COL_AGGR };
+
+struct preagg_column {
+  enum preagg_column_kind kind;
+  unsigned idx;  // For keys and aggregates
+};
+
+#define PREAGG_MAX_COLUMNS (2 + NF_PREAGG_MAX_KEYS + NF_PREAGG_MAX_AGGRS)
+
+struct wrap_preagg {
+  struct nf_preagg preagg;
+  unsigned num_columns;
+  struct preagg_column columns[PREAGG_MAX_COLUMNS];
+  unsigned num_words;  // Including the message header
+  // Where to write the rows:
+  struct ringbuf *rb;
+};
+
+#define Preagg_val(v) (*((struct wrap_preagg **)Data_custom_val(v)))
+
+static void preagg_finalize(value v)
+{
+  struct wrap_preagg *wp = Preagg_val(v);
+  if (! wp) return;
+  nf_preagg_free(&wp->preagg);
+  free(wp);
+  Preagg_val(v) = NULL;
+}
+
+static struct custom_operations preagg_ops = {
+  "org.happyleptic.ramen.netflow_preagg",
+  preagg_finalize,
+  custom_compare_default,
+  custom_hash_default,
+  custom_serialize_default,
+  custom_deserialize_default,
+  custom_compare_ext_default
+};
+
+// All fields but the times are at most 32 bits:
+static unsigned column_words(struct preagg_column const *c)
+{
+  return c->kind == COL_START || c->kind == COL_STOP ? 2 : 1;
+}
+
+/* Takes the bucket duration, the group-by fields, the aggregates as
+ * triplets of operation, field and largest output value, and the output
+ * columns in serialization order: */
+CAMLprim value wrap_netflow_preagg_create(
+  value duration_, value keys_, value aggrs_, value columns_)
+{
+  CAMLparam4(duration_, keys_, aggrs_, columns_);
+  CAMLlocal1(res);
+
+  unsigned const num_keys = Wosize_val(keys_);
+  unsigned const num_aggrs = Wosize_val(aggrs_);
+  unsigned const num_columns = Wosize_val(columns_);
+  if (num_keys > NF_PREAGG_MAX_KEYS || num_aggrs > NF_PREAGG_MAX_AGGRS ||
+      num_columns > PREAGG_MAX_COLUMNS)
+    caml_invalid_argument("netflow_preagg_create: too many columns");
+
+  enum nf_field keys[NF_PREAGG_MAX_KEYS];
+  for (unsigned k = 0; k < num_keys; k++) {
+    keys[k] = Int_val(Field(keys_, k));
+  }
+  enum nf_aggr ops[NF_PREAGG_MAX_AGGRS];
+  enum nf_field fields[NF_PREAGG_MAX_AGGRS];
+  uint64_t aggr_max[NF_PREAGG_MAX_AGGRS];
+  for (unsigned a = 0; a < num_aggrs; a++) {
+    ops[a] = Int_val(Field(Field(aggrs_, a), 0));
+    fields[a] = Int_val(Field(Field(aggrs_, a), 1));
+    aggr_max[a] = Long_val(Field(Field(aggrs_, a), 2));
+  }
+
+  struct wrap_preagg *wp = malloc(sizeof(*wp));
+  if (! wp) caml_raise_out_of_memory();
+  if (0 != nf_preagg_init(&wp->preagg, Double_val(duration_),
+                          num_keys, keys, num_aggrs, ops, fields,
+                          aggr_max)) {
+    free(wp);
+    caml_invalid_argument("netflow_preagg_create");
+  }
+
+  wp->num_columns = num_columns;
+  wp->num_words = 1;
+  for (unsigned c = 0; c < num_columns; c++) {
+    value const col = Field(columns_, c);
+    struct preagg_column *pc = wp->columns + c;
+    if (Is_long(col)) {
+      pc->kind = Int_val(col) == 0 ? COL_START : COL_STOP;
+      pc->idx = 0;
+    } else {
+      pc->kind = Tag_val(col) == 0 ? COL_KEY : COL_AGGR;
+      pc->idx = Int_val(Field(col, 0));
+      if (pc->idx >= (pc->kind == COL_KEY ? num_keys : num_aggrs)) {
+        nf_preagg_free(&wp->preagg);
+        free(wp);
+        caml_invalid_argument("netflow_preagg_create: invalid column");
+      }
+    }
+    wp->num_words += column_words(pc);
+  }
+  wp->rb = NULL;
+
+  res = caml_alloc_custom(&preagg_ops, sizeof(wp), 0, 1);
+  Preagg_val(res) = wp;
+  CAMLreturn(res);
+}
+
+static bool write_row(
+  void *wp_, double start, double stop,
+  uint32_t const *key_vals, uint64_t const *aggr_vals)
+{
+  struct wrap_preagg const *wp = wp_;
+  struct ringbuf_tx tx;
+  if (ringbuf_enqueue_alloc(wp->rb, &tx, wp->num_words)) return false;
+
+  uint32_t *w = (uint32_t *)(wp->rb->rbf->data + tx.record_start);
+  unsigned j = 0;
+  w[j++] = 0;  // DataTuple on the live channel
+  for (unsigned c = 0; c < wp->num_columns; c++) {
+    struct preagg_column const *pc = wp->columns + c;
+    switch (pc->kind) {
+      case COL_START:
+        write_double(w + j, start);
+        break;
+      case COL_STOP:
+        write_double(w + j, stop);
+        break;
+      case COL_KEY:
+        w[j] = key_vals[pc->idx];
+        break;
+      case COL_AGGR:
+        // Bounded by aggr_max:
+        w[j] = aggr_vals[pc->idx];
+        break;
+    }
+    j += column_words(pc);
+  }
+  assert(j == wp->num_words);
+
+  ringbuf_enqueue_commit(wp->rb, &tx, start, stop);
+  return true;
+}
+
+// The late records found by wrap_netflow_preagg_batch_into:
+static struct late_record { unsigned msg, rec; } *late_records;
+static size_t late_records_capacity;
+
+/* Aggregate the flows of the last received batch (see
+ * wrap_netflow_recv_batch), writing the rows of any completed bucket into
+ * the given ringbuffer. When a row does not fit, stops there so that it can
+ * be called again later to resume with the remaining flows.
+ * Returns the number of remaining flows, and the late flows that must be
+ * output as they are. */
+CAMLprim value wrap_netflow_preagg_batch_into(value preagg_, value rb_)
+{
+  CAMLparam2(preagg_, rb_);
+  CAMLlocal3(res, late, source);
+  struct wrap_preagg *wp = Preagg_val(preagg_);
+  wp->rb = ringbuf_of_value(rb_);
+
+  if (late_records_capacity < records_capacity) {
+    struct late_record *l =
+      realloc(late_records, records_capacity * sizeof(*l));
+    if (! l) caml_raise_out_of_memory();
+    late_records = l;
+    late_records_capacity = records_capacity;
+  }
+
+  unsigned num_late = 0;
+  unsigned i, j = 0;
+  for (i = preagg_next_msg; i < batch.num_msgs; i++) {
+    unsigned const j0 = i == preagg_next_msg ? preagg_next_rec : 0;
+    for (j = j0; j < batch_num_records[i]; j++) {
+      switch (nf_preagg_add(&wp->preagg,
+                            records + batch_first_record[i] + j,
+                            write_row, wp)) {
+        case NF_PREAGG_ADDED:
+          break;
+        case NF_PREAGG_LATE:
+          late_records[num_late].msg = i;
+          late_records[num_late].rec = j;
+          num_late ++;
+          break;
+        case NF_PREAGG_FULL:
+          goto full;
+        case NF_PREAGG_NOMEM:
+          caml_raise_out_of_memory();
+      }
+    }
+  }
+  // All aggregated:
+  i = batch.num_msgs;
+  j = 0;
+
+full:
+  preagg_next_msg = i;
+  preagg_next_rec = j;
+  size_t num_remaining = 0;
+  for (unsigned m = i; m < batch.num_msgs; m++) {
+    num_remaining += batch_num_records[m] - (m == i ? j : 0);
+  }
+
+  late = caml_alloc(num_late, 0);
+  for (unsigned l = 0; l < num_late; l++) {
+    unsigned const msg = late_records[l].msg;
+    source = alloc_source(batch.senders + msg);
+    Store_field(late, l,
+      alloc_record(records + batch_first_record[msg] + late_records[l].rec,
+                   source));
+  }
+
+  res = caml_alloc_tuple(2);
+  Store_field(res, 0, Val_long(num_remaining));
+  Store_field(res, 1, late);
+  CAMLreturn(res);
+}
+
+/* Write the rows of the current bucket right away. Returns false if not all
+ * of them could be written, in which case it must be called again. */
+CAMLprim value wrap_netflow_preagg_flush_into(value preagg_, value rb_)
+{
+  CAMLparam2(preagg_, rb_);
+  struct wrap_preagg *wp = Preagg_val(preagg_);
+  wp->rb = ringbuf_of_value(rb_);
+  CAMLreturn(Val_bool(nf_preagg_flush(&wp->preagg, write_row, wp)));
+}
+
+/* Write the rows of the current bucket if it ended more than grace seconds
+ * ago. Returns false if not all of them could be written. */
+CAMLprim value wrap_netflow_preagg_expire_into(
+  value preagg_, value now_, value grace_, value rb_)
+{
+  CAMLparam4(preagg_, now_, grace_, rb_);
+  struct wrap_preagg *wp = Preagg_val(preagg_);
+  wp->rb = ringbuf_of_value(rb_);
+  CAMLreturn(Val_bool(
+    nf_preagg_expire(&wp->preagg, Double_val(now_), Double_val(grace_),
+                     write_row, wp)));
+}
+
+// Number of late flows so far:
+CAMLprim value wrap_netflow_preagg_num_late(value preagg_)
+{
+  CAMLparam1(preagg_);
+  CAMLreturn(Val_int(Preagg_val(preagg_)->preagg.num_late));
+}
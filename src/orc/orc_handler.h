@@ -0,0 +1,57 @@
+// vim: ft=cpp bs=2 ts=2 sts=2 sw=2 expandtab
+/* The classes shared by the ORC helper library (wrappers.cc) and the ORC
+ * codecs generated for each type (see RamenOrc.emit_intro), which access the
+ * members of OrcHandler directly. Both must therefore see the very same
+ * definition, which is why it is installed in the bundle along with the ORC
+ * headers rather than emitted again by the code generator.
+ */
+#ifndef ORC_HANDLER_H_20191018
+#define ORC_HANDLER_H_20191018
+#include <memory>
+#include <string>
+#include <vector>
+#include <orc/OrcFile.hh>
+extern "C" {
+#  include <caml/mlvalues.h>
+#  include <caml/custom.h>
+}
+
+class OrcHandler {
+    std::shared_ptr<orc::Type> type;
+    std::string fname;
+    bool const with_index;
+    unsigned const batch_size;
+    unsigned const max_batches;
+    unsigned num_batches;
+    unsigned num_files;
+    bool archive;
+    std::string cur_fname;
+    std::vector<char> strs;
+  public:
+    OrcHandler(std::string schema, std::string fn, bool with_index, unsigned bsz, unsigned mb, bool arc);
+    ~OrcHandler();
+    void start_write();
+    void flush_batch(bool);
+    char *keep_string(char const *, size_t len);
+    std::unique_ptr<orc::OutputStream> outStream;
+    std::unique_ptr<orc::Writer> writer;
+    std::unique_ptr<orc::ColumnVectorBatch> batch;
+    double start, stop;
+};
+
+#define Handler_val(v) (*((class OrcHandler **)Data_custom_val(v)))
+
+/* Decodes the stripes of several ORC files with a pool of threads, and
+ * returns their batches in order: */
+class OrcStripeReader {
+    struct Impl;
+    Impl *impl;
+  public:
+    OrcStripeReader(std::vector<std::string> const &paths, unsigned batch_sz, unsigned num_threads);
+    ~OrcStripeReader();
+    orc::ColumnVectorBatch *next_batch();
+    char const *current_path() const;
+    unsigned num_errors() const;
+};
+
+#endif
@@ -3,7 +3,13 @@
  * argument, then writes and compiles an ORC writer for that format, then
  * reads from stdin string representation of ramen values and write them,
  * until EOF when it exits (C++ OrcHandler being deleted and therefore the
- * ORC file flushed). *)
+ * ORC file flushed).
+ * Optionally, also synthesizes a number of random values of that type into
+ * a data file, that can then be fed to the "bench" mode of the generated
+ * program.
+ * For output records, the generated program can also write the values into
+ * a ringbuf archive and then convert it into an ORC file the way archives
+ * are compressed (see "convert"). *)
 open Batteries
 open RamenHelpers
 open RamenLog
@@ -13,6 +19,69 @@ module C = RamenConf
 module Orc = RamenOrc
 module Files = RamenFiles
 
+(* Returns the textual representation of a random value of type [rtyp], as
+ * expected by the generated value_of_string: *)
+let rec random_text_of_type depth rtyp =
+  let random_ipv4 () =
+    Printf.sprintf "%d.%d.%d.%d"
+      (Random.int 256) (Random.int 256) (Random.int 256) (Random.int 256)
+  and random_ipv6 () =
+    List.init 8 (fun _ -> Printf.sprintf "%x" (Random.int 0x10000)) |>
+    String.join ":"
+  and random_list len t =
+    "["^ (List.init len (fun _ -> random_text_of_type (depth + 1) t) |>
+          String.join ";") ^"]"
+  and random_struct ts =
+    "("^ (List.map (random_text_of_type (depth + 1)) ts |>
+          String.join ";") ^")" in
+  if rtyp.T.nullable && Random.int 10 = 0 then "null" else
+  match rtyp.T.structure with
+  | T.TEmpty | T.TAny | T.TNum ->
+      invalid_arg "random_text_of_type"
+  | T.TFloat -> Printf.sprintf "%f" (Random.float 2e6 -. 1e6)
+  | T.TString ->
+      let s = String.init (Random.int 12) (fun _ ->
+                Char.chr (Char.code 'a' + Random.int 26)) in
+      if s = "null" then "nope" else s
+  | T.TBool -> if Random.bool () then "true" else "false"
+  | T.TU8 -> string_of_int (Random.int 0x100)
+  | T.TI8 -> string_of_int (Random.int 0x100 - 0x80)
+  | T.TU16 -> string_of_int (Random.int 0x10000)
+  | T.TI16 -> string_of_int (Random.int 0x10000 - 0x8000)
+  | T.TU32 -> Int64.to_string (Random.int64 0x1_0000_0000L)
+  | T.TI32 -> Int64.(to_string (sub (Random.int64 0x1_0000_0000L) 0x8000_0000L))
+  | T.TU64 | T.TU128 -> Int64.to_string (Random.int64 Int64.max_int)
+  | T.TI64 | T.TI128 ->
+      Int64.(to_string (sub (Random.int64 max_int) (div max_int 2L)))
+  | T.TEth ->
+      List.init 6 (fun _ -> Printf.sprintf "%02x" (Random.int 0x100)) |>
+      String.join ":"
+  | T.TIpv4 -> random_ipv4 ()
+  | T.TIpv6 -> random_ipv6 ()
+  | T.TIp -> if Random.bool () then random_ipv4 () else random_ipv6 ()
+  | T.TCidrv4 -> random_ipv4 () ^"/"^ string_of_int (Random.int 33)
+  | T.TCidrv6 -> random_ipv6 () ^"/"^ string_of_int (Random.int 129)
+  | T.TCidr ->
+      if Random.bool () then
+        random_ipv4 () ^"/"^ string_of_int (Random.int 33)
+      else
+        random_ipv6 () ^"/"^ string_of_int (Random.int 129)
+  | T.TTuple ts -> random_struct (Array.to_list ts)
+  | T.TRecord kts -> random_struct (Array.to_list kts |> List.map snd)
+  | T.TVec (d, t) -> random_list d t
+  (* Keep deeply nested lists short: *)
+  | T.TList t -> random_list (Random.int (max 2 (8 lsr depth))) t
+
+let synthesize_data rtyp num_rows (fname : N.path) =
+  !logger.info "Synthesizing %d values into %a"
+    num_rows N.path_print fname ;
+  File.with_file_out ~mode:[`create; `trunc; `text] (fname :> string)
+    (fun oc ->
+      for _ = 1 to num_rows do
+        IO.nwrite oc (random_text_of_type 0 rtyp) ;
+        IO.write oc '\n'
+      done)
+
 let main =
   init_logger Debug ;
   let exec_file = N.path (Sys.argv.(1)) in
@@ -20,6 +89,8 @@ let main =
   let orc_write_func = "orc_write"
   and orc_read_func = "orc_read" in
   let rtyp = PPP.of_string_exc T.t_ppp_ocaml ramen_type in
+  if Array.length Sys.argv > 4 then
+    synthesize_data rtyp (int_of_string Sys.argv.(3)) (N.path Sys.argv.(4)) ;
   RamenOCamlCompiler.use_external_compiler := false ;
   let bundle_dir =
     N.path (Sys.getenv_opt "RAMEN_LIBS" |? "./bundle") in
@@ -28,6 +99,16 @@ let main =
   let cc_dst, schema =
     RamenCompiler.orc_codec conf orc_write_func orc_read_func
                             (N.path "orc_writer_") rtyp in
+  (* Only output records can be written in a ringbuf, as tuples: *)
+  let tuple_typ =
+    match rtyp.T.structure with
+    | T.TRecord kts when not rtyp.T.nullable ->
+        Some (
+          Array.to_list kts |>
+          List.map (fun (k, typ) ->
+            RamenTuple.{ name = N.field k ; typ ; units = None ; doc = "" ;
+                         aggr = None }))
+    | _ -> None in
   (*
    * Now the ML side:
    *)
@@ -71,6 +152,9 @@ let main =
       p "external orc_read : string -> int -> (%a -> unit) -> (int * int) = %S"
         CodeGen_OCaml.otype_of_type rtyp
         orc_read_func ;
+      p "external orc_read_par : string array -> int -> int -> (%a -> unit) -> (int * int) = %S"
+        CodeGen_OCaml.otype_of_type rtyp
+        (Orc.parallel_reader_name orc_read_func) ;
       (* Destructor do not seems to be called when the OCaml program exits: *)
       p "external orc_close : handler -> unit = \"orc_handler_close\"" ;
       p "" ;
@@ -78,12 +162,141 @@ let main =
       p "external orc_make_handler : string -> string -> bool -> int -> int -> bool -> handler =" ;
       p "  \"orc_handler_create_bytecode_lol\" \"orc_handler_create\"" ;
       p "" ;
+      Option.may (fun typ ->
+        p "external orc_of_ringbuf : handler -> RingBuf.t -> (int * int) = %S"
+          (Orc.ringbuf_converter_name orc_write_func) ;
+        p "" ;
+        CodeGen_OCaml.emit_sersize_of_tuple 0 "sersize_of_tuple" oc typ ;
+        CodeGen_OCaml.emit_serialize_tuple 0 "serialize_tuple" oc typ ;
+        p "" ;
+        p "(* Write the values read from stdin into a non-wrapping ringbuf, as" ;
+        p " * a worker would, then convert that ringbuf into [orc_fname]: *)" ;
+        p "let convert orc_fname batch_size num_batches =" ;
+        p "  let rb_fname = RamenName.path (orc_fname ^\".rb\") in" ;
+        p "  RamenFiles.safe_unlink rb_fname ;" ;
+        p "  RingBuf.create ~wrap:false rb_fname ;" ;
+        p "  let rb = RingBuf.load rb_fname in" ;
+        p "  let sersize_of_tuple = sersize_of_tuple RamenFieldMask.all_fields" ;
+        p "  and serialize_tuple = serialize_tuple RamenFieldMask.all_fields" ;
+        p "  and head = RingBufLib.DataTuple RamenChannel.live in" ;
+        p "  let head_sz = RingBufLib.message_header_sersize head in" ;
+        p "  (try forever (fun () ->" ;
+        p "    let tuple = read_line () |> value_of_string in" ;
+        p "    let sz = head_sz + sersize_of_tuple tuple in" ;
+        p "    let tx = RingBuf.enqueue_alloc rb sz in" ;
+        p "    RingBufLib.write_message_header tx 0 head ;" ;
+        p "    let offs = serialize_tuple tx head_sz tuple in" ;
+        p "    assert (offs = sz) ;" ;
+        p "    RingBuf.enqueue_commit tx 0. 0." ;
+        p "  ) ()" ;
+        p "  with End_of_file -> ()) ;" ;
+        p "  let handler =" ;
+        p "    orc_make_handler %S orc_fname false batch_size num_batches false in"
+          schema ;
+        p "  let lines, errs =" ;
+        p "    finally (fun () ->" ;
+        p "      orc_close handler ;" ;
+        p "      RingBuf.unload rb)" ;
+        p "      (orc_of_ringbuf handler) rb in" ;
+        p "  RamenFiles.safe_unlink rb_fname ;" ;
+        p "  if errs > 0 then (" ;
+        p "    !logger.error \"Converted %%d lines (%%d errors)\" lines errs ;" ;
+        p "    exit 1" ;
+        p "  ) else" ;
+        p "    !logger.debug \"Converted %%d lines\" lines" ;
+        p ""
+      ) tuple_typ ;
+      p "(* Current and peak resident memory, in KiB (Linux only): *)" ;
+      p "let proc_status_kb field =" ;
+      p "  try" ;
+      p "    File.lines_of \"/proc/self/status\" |>" ;
+      p "    Enum.find_map (fun l ->" ;
+      p "      if String.starts_with l (field ^\":\") then" ;
+      p "        Some (Scanf.sscanf l \"%%_s %%d kB\" identity)" ;
+      p "      else None)" ;
+      p "  with _ -> 0" ;
+      p "" ;
+      p "let reset_peak_mem () =" ;
+      p "  try" ;
+      p "    File.with_file_out ~mode:[`append] \"/proc/self/clear_refs\"" ;
+      p "      (fun oc -> IO.nwrite oc \"5\")" ;
+      p "  with _ -> ()" ;
+      p "" ;
+      p "(* Write the given values with various settings, read them back, and" ;
+      p " * append the results as JSON objects, one per line, into [results]: *)" ;
+      p "let bench orc_dir results lines =" ;
+      p "  let values = Array.map value_of_string lines in" ;
+      p "  let num_rows = Array.length values" ;
+      p "  and text_bytes =" ;
+      p "    Array.fold_left (fun s l -> s + String.length l + 1) 0 lines in" ;
+      p "  let schema_name = Filename.basename Sys.argv.(0)" ;
+      p "  and arc_dir = orc_dir ^\"/arc\"" ;
+      p "  and per_sec n dt = if dt > 0. then float_of_int n /. dt else 0. in" ;
+      p "  File.with_file_out ~mode:[`create; `append; `text] results (fun oc ->" ;
+      p "    List.iter (fun (batch_size, num_batches, with_index) ->" ;
+      p "      (try Sys.readdir arc_dir |>" ;
+      p "           Array.iter (fun f -> Sys.remove (arc_dir ^\"/\"^ f))" ;
+      p "      with Sys_error _ -> ()) ;" ;
+      p "      reset_peak_mem () ;" ;
+      p "      let rss_before = proc_status_kb \"VmRSS\" in" ;
+      p "      let t0 = Unix.gettimeofday () in" ;
+      p "      let handler =" ;
+      p "        orc_make_handler %S (orc_dir ^\"/bench.orc\") with_index" schema ;
+      p "                         batch_size num_batches true in" ;
+      p "      Array.iter (fun v -> orc_write handler v 0. 0.) values ;" ;
+      p "      orc_close handler ;" ;
+      p "      let write_time = Unix.gettimeofday () -. t0 in" ;
+      p "      let peak_mem = proc_status_kb \"VmHWM\" - rss_before in" ;
+      p "      (* Archives come with their column statistics: *)" ;
+      p "      let files =" ;
+      p "        Sys.readdir arc_dir |>" ;
+      p "        Array.filter (fun f -> String.ends_with f \".orc\") |>" ;
+      p "        Array.map (fun f -> arc_dir ^\"/\"^ f) in" ;
+      p "      let orc_bytes =" ;
+      p "        Array.fold_left (fun s f -> s + (Unix.stat f).Unix.st_size) 0 files in" ;
+      p "      let read num_threads =" ;
+      p "        let t0 = Unix.gettimeofday () in" ;
+      p "        let lines, errs =" ;
+      p "          orc_read_par files batch_size num_threads ignore in" ;
+      p "        if lines <> num_rows || errs > 0 then" ;
+      p "          !logger.error \"Read %%d lines (%%d errors) instead of %%d\"" ;
+      p "            lines errs num_rows ;" ;
+      p "        Unix.gettimeofday () -. t0 in" ;
+      p "      let read_time = read 1 in" ;
+      p "      let read_par_time = read 4 in" ;
+      p "      let ratio =" ;
+      p "        if orc_bytes > 0 then" ;
+      p "          float_of_int text_bytes /. float_of_int orc_bytes" ;
+      p "        else 0. in" ;
+      p "      [ \"schema\", Printf.sprintf \"%%S\" schema_name ;" ;
+      p "        \"rows\", string_of_int num_rows ;" ;
+      p "        \"batch_size\", string_of_int batch_size ;" ;
+      p "        \"max_batches\", string_of_int num_batches ;" ;
+      p "        \"with_index\", string_of_bool with_index ;" ;
+      p "        \"files\", string_of_int (Array.length files) ;" ;
+      p "        \"text_bytes\", string_of_int text_bytes ;" ;
+      p "        \"orc_bytes\", string_of_int orc_bytes ;" ;
+      p "        \"compression_ratio\", Printf.sprintf \"%%g\" ratio ;" ;
+      p "        \"peak_mem_kb\", string_of_int peak_mem ;" ;
+      p "        \"write_rows_per_sec\", Printf.sprintf \"%%g\" (per_sec num_rows write_time) ;" ;
+      p "        \"write_bytes_per_sec\", Printf.sprintf \"%%g\" (per_sec text_bytes write_time) ;" ;
+      p "        \"read_rows_per_sec\", Printf.sprintf \"%%g\" (per_sec num_rows read_time) ;" ;
+      p "        \"read_bytes_per_sec\", Printf.sprintf \"%%g\" (per_sec text_bytes read_time) ;" ;
+      p "        \"read_par_rows_per_sec\", Printf.sprintf \"%%g\" (per_sec num_rows read_par_time) ] |>" ;
+      p "      List.map (fun (k, v) -> Printf.sprintf \"%%S:%%s\" k v) |>" ;
+      p "      String.join \",\" |>" ;
+      p "      Printf.fprintf oc \"{%%s}\\n%%!\"" ;
+      p "    ) [ 100, 10, false ; 100, 100, false ;" ;
+      p "        1_000, 10, false ; 1_000, 100, false ; 1_000, 100, true ;" ;
+      p "        10_000, 10, false ; 10_000, 100, false ; 10_000, 100, true ])" ;
+      p "" ;
       p "let main =" ;
       p "  let syntax () =" ;
-      p "    !logger.error \"%%s [read|write] file.orc\" Sys.argv.(0) ;" ;
+      p "    !logger.error \"%%s [read|read-par|write|convert] file.orc\" Sys.argv.(0) ;" ;
+      p "    !logger.error \"%%s bench dir results.json\" Sys.argv.(0) ;" ;
       p "    exit 1 in" ;
       p "  let batch_size = 1000 and num_batches = 100 in" ;
-      p "  if Array.length Sys.argv <> 3 then syntax () ;" ;
+      p "  if Array.length Sys.argv < 3 then syntax () ;" ;
       p "  let orc_fname = Sys.argv.(2) in" ;
       p "  match String.lowercase_ascii Sys.argv.(1) with" ;
       p "  | \"read\" | \"r\" ->" ;
@@ -92,6 +305,14 @@ let main =
       p "      let lines, errs = orc_read orc_fname batch_size cb in" ;
       p "      (if errs > 0 then !logger.error else !logger.debug)" ;
       p "        \"Read %%d lines (%%d errors)\" lines errs" ;
+      p "  | \"read-par\" | \"p\" ->" ;
+      p "      let cb x =" ;
+      p "        Printf.printf \"%%s\\n\" (string_of_value x) in" ;
+      p "      let num_threads = 4 in" ;
+      p "      let lines, errs =" ;
+      p "        orc_read_par [| orc_fname |] batch_size num_threads cb in" ;
+      p "      (if errs > 0 then !logger.error else !logger.debug)" ;
+      p "        \"Read %%d lines (%%d errors)\" lines errs" ;
       p "  | \"write\" | \"w\" ->" ;
       p "      let handler =" ;
       p "        orc_make_handler %S orc_fname false batch_size num_batches false in"
@@ -103,6 +324,14 @@ let main =
       p "      with End_of_file ->" ;
       p "        !logger.info \"Exiting...\" ;" ;
       p "        orc_close handler)" ;
+      if tuple_typ <> None then (
+        p "  | \"convert\" | \"c\" ->" ;
+        p "      convert orc_fname batch_size num_batches"
+      ) ;
+      p "  | \"bench\" | \"b\" ->" ;
+      p "      if Array.length Sys.argv <> 4 then syntax () ;" ;
+      p "      let lines = IO.lines_of stdin |> Array.of_enum in" ;
+      p "      bench orc_fname Sys.argv.(3) lines" ;
       p "  | _ -> syntax ()" ;
   ) in
   !logger.info "Generated OCaml support module in %a"
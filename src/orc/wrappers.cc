@@ -1,13 +1,28 @@
 // vim: ft=cpp bs=2 ts=2 sts=2 sw=2 expandtab
 #include <cassert>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <thread>
 #include <orc/OrcFile.hh>
 extern "C" {
 #  include <caml/mlvalues.h>
 #  include <caml/memory.h>
 #  include <caml/alloc.h>
 #  include <caml/custom.h>
+#  include <dirent.h>
+#  include <fcntl.h>
+#  include <signal.h>
+#  include <unistd.h>
 #  include "../ringbuf/archive.h"
 }
+#include "orc_handler.h"
 
 typedef __int128_t int128_t;
 typedef __uint128_t uint128_t;
@@ -16,47 +31,321 @@ using namespace std;
 using namespace orc;
 
 /*
- * Writing ORC files
+ * Column statistics of archived files
+ *
+ * When an ORC file is archived, the min/max statistics of its top level
+ * numeric columns are read back from its footer and appended to a table
+ * in the archive directory, so that replays can skip archive files
+ * without opening them (see RingBufLib.read_arc_stats).
+ * Each line has the file name, the number of rows and then, for each
+ * column with known bounds, name:min:max, all separated by tabs. Bounds are
+ * printed as hexadecimal floats, rounded outward when not exact.
+ * The table is locked while appended to, as the GC rewrites it without the
+ * lines of the archives it deletes (see RingBufLib.prune_arc_stats).
  */
 
-class OrcHandler {
-    unique_ptr<Type> type;
-    string fname;
-    bool const with_index;
-    unsigned const batch_size;
-    unsigned const max_batches;
-    unsigned num_batches;
-    bool archive;
-    std::vector<char> strs;
+#define ARC_STATS_FNAME ".stats"
+
+static double lower_bound(int64_t v)
+{
+  double const d = v;
+  return fabs(d) < 0x1p53 ? d : nextafter(d, -INFINITY);
+}
+
+static double upper_bound(int64_t v)
+{
+  double const d = v;
+  return fabs(d) < 0x1p53 ? d : nextafter(d, INFINITY);
+}
+
+static void append_column_stats(char const *orc_fname)
+{
+  try {
+    ReaderOptions options;
+    unique_ptr<Reader> reader = createReader(readLocalFile(orc_fname), options);
+    Type const &type = reader->getType();
+
+    char const *basename = orc_fname;
+    for (char const *c = orc_fname; *c != '\0'; c++)
+      if (*c == '/') basename = c + 1;
+    string line(basename);
+    line += "\t" + to_string(reader->getNumberOfRows());
+
+    if (type.getKind() == STRUCT) {
+      for (uint64_t i = 0; i < type.getSubtypeCount(); i++) {
+        unique_ptr<ColumnStatistics> stats =
+          reader->getColumnStatistics(type.getSubtype(i)->getColumnId());
+        double mi, ma;
+        if (IntegerColumnStatistics const *is =
+              dynamic_cast<IntegerColumnStatistics const *>(stats.get())) {
+          if (! is->hasMinimum() || ! is->hasMaximum()) continue;
+          mi = lower_bound(is->getMinimum());
+          ma = upper_bound(is->getMaximum());
+        } else if (DoubleColumnStatistics const *ds =
+                     dynamic_cast<DoubleColumnStatistics const *>(stats.get())) {
+          if (! ds->hasMinimum() || ! ds->hasMaximum()) continue;
+          mi = ds->getMinimum();
+          ma = ds->getMaximum();
+        } else continue;
+        if (std::isnan(mi) || std::isnan(ma)) continue;
+        char bounds[64];
+        snprintf(bounds, sizeof(bounds), ":%a:%a", mi, ma);
+        line += "\t" + type.getFieldName(i) + bounds;
+      }
+    }
+    line += "\n";
+
+    char dirname[PATH_MAX] = ".";
+    dirname_of_fname(dirname, sizeof(dirname), orc_fname);
+    string const stats_fname = string(dirname) + "/" ARC_STATS_FNAME;
+    int const fd =
+      open(stats_fname.c_str(), O_WRONLY|O_APPEND|O_CREAT, S_IRUSR|S_IWUSR);
+    if (fd < 0) {
+      cerr << "Cannot open " << stats_fname << ": " << strerror(errno) << "\n";
+      return;
+    }
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    while (0 != fcntl(fd, F_SETLKW, &lock) && errno == EINTR) ;
+    // A single write so that readers never see half a line:
+    if (write(fd, line.c_str(), line.size()) != (ssize_t)line.size())
+      cerr << "Cannot write into " << stats_fname << ": "
+           << strerror(errno) << "\n";
+    close(fd); // also releases the lock
+  } catch (exception const &e) {
+    cerr << "Cannot read statistics of ORC file " << orc_fname << ": "
+         << e.what() << "\n";
+  }
+}
+
+extern "C" value orc_append_column_stats(value orc_fname_)
+{
+  CAMLparam1(orc_fname_);
+  append_column_stats(String_val(orc_fname_));
+  CAMLreturn(Val_unit);
+}
+
+/*
+ * Finalizing ORC files
+ *
+ * Closing a writer (which flushes the last stripe and the footer), syncing
+ * the file and then moving it into the archive (which creates directories
+ * and renames the file) is left to a background thread, so that the
+ * workers do not wait for the filesystem. That thread finalizes all the
+ * files that are waiting at once and then syncs each archive directory
+ * once for the whole lot.
+ */
+
+struct OrcFinalization {
+  // The writer refers to the type until it's closed:
+  shared_ptr<Type> type;
+  unique_ptr<OutputStream> outStream;
+  unique_ptr<Writer> writer;
+  string fname;
+  double start, stop;
+};
+
+class OrcFinalizer {
+    mutex m;
+    condition_variable has_work, is_idle;
+    deque<OrcFinalization> queue;
+    bool busy, quit;
+    thread th;
+    void run();
+    void finalize(OrcFinalization &, set<string> &dirs);
   public:
-    OrcHandler(string schema, string fn, bool with_index, unsigned bsz, unsigned mb, bool arc);
-    ~OrcHandler();
-    void start_write();
-    void flush_batch(bool);
-    char *keep_string(char const *, size_t len);
-    unique_ptr<OutputStream> outStream;
-    unique_ptr<Writer> writer;
-    unique_ptr<ColumnVectorBatch> batch;
-    double start, stop;
+    OrcFinalizer();
+    ~OrcFinalizer();
+    void push(OrcFinalization &&);
+    void drain();
 };
 
+static OrcFinalizer &finalizer()
+{
+  // Destructed (thus drained) at exit:
+  static OrcFinalizer f;
+  return f;
+}
+
+OrcFinalizer::OrcFinalizer() :
+  busy(false), quit(false)
+{
+  th = thread(&OrcFinalizer::run, this);
+}
+
+OrcFinalizer::~OrcFinalizer()
+{
+  {
+    lock_guard<mutex> lock(m);
+    quit = true;
+  }
+  has_work.notify_one();
+  th.join();
+}
+
+void OrcFinalizer::push(OrcFinalization &&f)
+{
+  {
+    lock_guard<mutex> lock(m);
+    queue.push_back(move(f));
+  }
+  has_work.notify_one();
+}
+
+/* Wait until all the files given so far are archived: */
+void OrcFinalizer::drain()
+{
+  unique_lock<mutex> lock(m);
+  is_idle.wait(lock, [this] { return queue.empty() && ! busy; });
+}
+
+static bool sync_file(string const &fname, int flags)
+{
+  int const fd = open(fname.c_str(), O_RDONLY|flags);
+  if (fd < 0) {
+    cerr << "Cannot open " << fname << ": " << strerror(errno) << "\n";
+    return false;
+  }
+  bool const ok = fsync(fd) == 0;
+  if (! ok)
+    cerr << "Cannot fsync " << fname << ": " << strerror(errno) << "\n";
+  close(fd);
+  return ok;
+}
+
+static void sync_dir(string const &dirname)
+{
+  sync_file(dirname, O_DIRECTORY);
+}
+
+void OrcFinalizer::finalize(OrcFinalization &f, set<string> &dirs)
+{
+  try {
+    f.writer->close();
+  } catch (exception const &e) {
+    cerr << "Cannot close ORC file " << f.fname << ": " << e.what() << "\n";
+    return;
+  }
+  f.writer.reset();
+  f.outStream.reset();
+
+  /* The data must be on disk before the file is renamed, lest a crash
+   * leaves an archive with a valid name but no content: */
+  if (! sync_file(f.fname, 0)) return;
+
+  char arc_fname[PATH_MAX];
+  if (0 == ramen_archive(f.fname.c_str(), f.start, f.stop,
+                         arc_fname, sizeof(arc_fname))) {
+    append_column_stats(arc_fname);
+    char dirname[PATH_MAX] = ".";
+    dirname_of_fname(dirname, sizeof(dirname), arc_fname);
+    dirs.insert(dirname);
+    dirname_of_fname(dirname, sizeof(dirname), f.fname.c_str());
+    dirs.insert(dirname);
+  }
+}
+
+void OrcFinalizer::run()
+{
+  unique_lock<mutex> lock(m);
+  while (true) {
+    has_work.wait(lock, [this] { return quit || ! queue.empty(); });
+    if (queue.empty()) break; // then quit is set
+
+    deque<OrcFinalization> todo;
+    todo.swap(queue);
+    busy = true;
+    lock.unlock();
+
+    set<string> dirs;
+    for (OrcFinalization &f : todo) finalize(f, dirs);
+    for (string const &dirname : dirs) sync_dir(dirname);
+    todo.clear();
+
+    lock.lock();
+    busy = false;
+    if (queue.empty()) is_idle.notify_all();
+  }
+}
+
+/*
+ * Writing ORC files
+ */
+
+// OrcHandler is declared in orc_handler.h, shared with the generated code.
+
 #define MAX_STRS_SIZE 999999
 
+/* When archiving, files are written under a name of their own, since the
+ * previous one might still be waiting to be archived. The name includes the
+ * pid of the writer, so that files left behind by a dead process can be
+ * told apart from the ones still being written: */
+static string numbered_fname(string const &fname, unsigned n)
+{
+  size_t const ext = strlen(extension_of_fname(fname.c_str()));
+  return fname.substr(0, fname.size() - ext) + "." + to_string(getpid()) +
+         "." + to_string(n) + fname.substr(fname.size() - ext);
+}
+
+/* Delete the files numbered after [fname] by processes that are no longer
+ * running. Those were either left half written or not archived yet when
+ * their writer died, and nobody would ever archive them: */
+static void remove_orphan_files(string const &fname)
+{
+  size_t const ext_len = strlen(extension_of_fname(fname.c_str()));
+  size_t const slash = fname.rfind('/');
+  size_t const base = slash == string::npos ? 0 : slash + 1;
+  string const prefix = fname.substr(base, fname.size() - ext_len - base) + ".";
+  string const ext = fname.substr(fname.size() - ext_len);
+  char dirname[PATH_MAX] = ".";
+  dirname_of_fname(dirname, sizeof(dirname), fname.c_str());
+
+  DIR *dir = opendir(dirname);
+  if (! dir) return;
+  while (struct dirent const *e = readdir(dir)) {
+    string const name(e->d_name);
+    if (name.size() <= prefix.size() + ext.size() ||
+        name.compare(0, prefix.size(), prefix) != 0 ||
+        name.compare(name.size() - ext.size(), ext.size(), ext) != 0)
+      continue;
+    // What's in between must be "pid.n":
+    string const num =
+      name.substr(prefix.size(), name.size() - prefix.size() - ext.size());
+    unsigned long pid;
+    unsigned n;
+    char garbage;
+    if (2 != sscanf(num.c_str(), "%lu.%u%c", &pid, &n, &garbage)) continue;
+    if ((pid_t)pid == getpid() ||
+        kill((pid_t)pid, 0) == 0 || errno != ESRCH) continue;
+    string const path = string(dirname) + "/" + name;
+    cerr << "Deleting " << path << " left behind by process " << pid << "\n";
+    if (unlink(path.c_str()) < 0)
+      cerr << "Cannot unlink " << path << ": " << strerror(errno) << "\n";
+  }
+  closedir(dir);
+}
+
 OrcHandler::OrcHandler(string sch, string fn, bool wi, unsigned bsz, unsigned mb, bool arc) :
   type(Type::buildTypeFromString(sch)), fname(fn), with_index(wi),
-  batch_size(bsz), max_batches(mb), num_batches(0), archive(arc)
+  batch_size(bsz), max_batches(mb), num_batches(0), num_files(0),
+  archive(arc)
 {
   strs.reserve(MAX_STRS_SIZE);  // FIXME: something better than a vector
+  if (archive) remove_orphan_files(fname);
 }
 
 OrcHandler::~OrcHandler()
 {
   flush_batch(false);
+  if (archive) finalizer().drain();
 };
 
 void OrcHandler::start_write()
 {
-  outStream = writeLocalFile(fname);
+  cur_fname = archive ? numbered_fname(fname, num_files++) : fname;
+  outStream = writeLocalFile(cur_fname);
   WriterOptions options;
   options.setRowIndexStride(with_index ? 10000 : 0); // To disable indexing
   writer = createWriter(*type, outStream.get(), options);
@@ -72,11 +361,15 @@ void OrcHandler::flush_batch(bool more_to_come)
     strs.clear();
     if (!more_to_come || ++num_batches >= max_batches) {
       num_batches = 0;
-      writer->close();
-      writer.reset();
       batch.reset();
-      outStream.reset();
-      if (archive) ramen_archive(fname.c_str(), start, stop);
+      if (archive) {
+        finalizer().push(OrcFinalization {
+          type, move(outStream), move(writer), cur_fname, start, stop });
+      } else {
+        writer->close();
+        writer.reset();
+        outStream.reset();
+      }
       /* We could keep using the batch created by the first writer,
        * as writer->createRowBatch just call the proper createRowBatch for
        * that Type. */
@@ -94,8 +387,6 @@ char *OrcHandler::keep_string(char const *s, size_t len)
   return &strs[pos];
 }
 
-#define Handler_val(v) (*((class OrcHandler **)Data_custom_val(v)))
-
 static struct custom_operations handler_ops = {
   "org.happyleptic.ramen.orc.handler",
   custom_finalize_default,
@@ -134,3 +425,183 @@ extern "C" value orc_handler_close(value hder_)
   }
   CAMLreturn(Val_unit);
 }
+
+/*
+ * Reading ORC files in parallel
+ *
+ * ORC stripes can be decoded independently, so we split the files to be
+ * read into stripes and have a pool of threads decode them into column
+ * vector batches. The (OCaml) caller then consumes those batches in file
+ * and stripe order, so that the tuples come out in the very same order as
+ * with the sequential reader. Only the conversion into OCaml values and
+ * the callback are performed by the caller thread, which is the only one
+ * allowed to touch the OCaml heap.
+ */
+
+struct OrcStripeTask {
+  string path;
+  uint64_t offset, length;
+  // Filled by the decoding threads:
+  vector<unique_ptr<ColumnVectorBatch>> batches;
+  string error;
+  bool done;
+
+  OrcStripeTask(string const &p, uint64_t o, uint64_t l) :
+    path(p), offset(o), length(l), done(false) {}
+};
+
+struct OrcStripeReader::Impl {
+  unsigned const batch_sz;
+  // Tasks are never added once the threads are started:
+  vector<OrcStripeTask> tasks;
+  // Index of the next task to be decoded:
+  size_t next_task;
+  // Index of the task (and batch within that task) being consumed:
+  size_t cur_task, cur_batch;
+  // How many tasks can be decoded ahead of the consumer (bounds memory):
+  size_t const max_ahead;
+  unsigned errors;
+  bool quit;
+  mutex m;
+  condition_variable task_done, can_start;
+  vector<thread> threads;
+
+  Impl(unsigned bsz, unsigned num_threads) :
+    batch_sz(bsz), next_task(0), cur_task(0), cur_batch(0),
+    max_ahead(2 * num_threads), errors(0), quit(false) {}
+
+  void add_file(string const &path);
+  void decode(OrcStripeTask &, string &cur_path, unique_ptr<Reader> &);
+  void run();
+};
+
+void OrcStripeReader::Impl::add_file(string const &path)
+{
+  try {
+    ReaderOptions options;
+    unique_ptr<Reader> reader = createReader(readLocalFile(path), options);
+    uint64_t const num_stripes = reader->getNumberOfStripes();
+    for (uint64_t s = 0; s < num_stripes; s++) {
+      unique_ptr<StripeInformation> stripe = reader->getStripe(s);
+      tasks.emplace_back(path, stripe->getOffset(), stripe->getLength());
+    }
+  } catch (exception const &e) {
+    cerr << "Cannot list stripes of ORC file " << path << ": "
+         << e.what() << "\n";
+    errors++;
+  }
+}
+
+/* Decode all the rows of that task's stripe. Readers are kept from one
+ * task to the next as long as the file does not change, to save on the
+ * footer parsing: */
+void OrcStripeReader::Impl::decode(
+  OrcStripeTask &task, string &cur_path, unique_ptr<Reader> &reader)
+{
+  try {
+    if (! reader || cur_path != task.path) {
+      ReaderOptions options;
+      reader = createReader(readLocalFile(task.path), options);
+      cur_path = task.path;
+    }
+    RowReaderOptions row_options;
+    row_options.range(task.offset, task.length);
+    unique_ptr<RowReader> row_reader = reader->createRowReader(row_options);
+    while (true) {
+      unique_ptr<ColumnVectorBatch> batch =
+        row_reader->createRowBatch(batch_sz);
+      if (! row_reader->next(*batch)) break;
+      task.batches.push_back(move(batch));
+    }
+  } catch (exception const &e) {
+    task.error = e.what();
+    reader.reset();
+  }
+}
+
+void OrcStripeReader::Impl::run()
+{
+  string cur_path;
+  unique_ptr<Reader> reader;
+
+  unique_lock<mutex> lk(m);
+  while (true) {
+    can_start.wait(lk, [this] {
+      return
+        quit || next_task >= tasks.size() ||
+        next_task < cur_task + max_ahead;
+    });
+    if (quit || next_task >= tasks.size()) return;
+    OrcStripeTask &task = tasks[next_task++];
+    lk.unlock();
+    decode(task, cur_path, reader);
+    lk.lock();
+    task.done = true;
+    task_done.notify_all();
+  }
+}
+
+OrcStripeReader::OrcStripeReader(
+  vector<string> const &paths, unsigned batch_sz, unsigned num_threads)
+{
+  if (num_threads < 1) num_threads = 1;
+  impl = new Impl(batch_sz, num_threads);
+  for (string const &path : paths) impl->add_file(path);
+  // No need for more threads than there are stripes:
+  if (num_threads > impl->tasks.size()) num_threads = impl->tasks.size();
+  for (unsigned t = 0; t < num_threads; t++)
+    impl->threads.emplace_back(&OrcStripeReader::Impl::run, impl);
+}
+
+OrcStripeReader::~OrcStripeReader()
+{
+  {
+    lock_guard<mutex> lk(impl->m);
+    impl->quit = true;
+  }
+  impl->can_start.notify_all();
+  for (thread &t : impl->threads) t.join();
+  delete impl;
+}
+
+/* Return the next batch, or nullptr once all files have been read.
+ * The returned batch remains valid until the next call.
+ * Does not touch the OCaml heap and can therefore be called outside of the
+ * OCaml runtime lock. */
+ColumnVectorBatch *OrcStripeReader::next_batch()
+{
+  while (impl->cur_task < impl->tasks.size()) {
+    OrcStripeTask &task = impl->tasks[impl->cur_task];
+    {
+      unique_lock<mutex> lk(impl->m);
+      impl->task_done.wait(lk, [&task] { return task.done; });
+    }
+    if (impl->cur_batch < task.batches.size())
+      return task.batches[impl->cur_batch++].get();
+    // This task is over, reclaim its memory and let another one start:
+    if (! task.error.empty()) {
+      cerr << "Cannot read stripe at offset " << task.offset
+           << " of ORC file " << task.path << ": " << task.error << "\n";
+      impl->errors++;
+    }
+    task.batches.clear();
+    {
+      lock_guard<mutex> lk(impl->m);
+      impl->cur_task++;
+      impl->cur_batch = 0;
+    }
+    impl->can_start.notify_all();
+  }
+  return nullptr;
+}
+
+char const *OrcStripeReader::current_path() const
+{
+  if (impl->cur_task >= impl->tasks.size()) return "";
+  return impl->tasks[impl->cur_task].path.c_str();
+}
+
+unsigned OrcStripeReader::num_errors() const
+{
+  return impl->errors;
+}
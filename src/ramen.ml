@@ -242,6 +242,12 @@ let kill_at_exit =
                    ~env [ "kill-at-exit" ] in
   Arg.(value (flag i))
 
+let replay_threads =
+  let env = Term.env_info "RAMEN_REPLAY_THREADS" in
+  let i = Arg.info ~doc:CliInfo.replay_threads
+                   ~env [ "replay-threads" ] in
+  Arg.(value (opt int Default.orc_read_threads i))
+
 let supervisor =
   Term.(
     (const RamenCliCmd.supervisor
@@ -253,7 +259,8 @@ let supervisor =
       $ max_simult_compilations
       $ smt_solver
       $ fail_for_good
-      $ kill_at_exit),
+      $ kill_at_exit
+      $ replay_threads),
     info ~doc:CliInfo.supervisor "supervisor")
 
 (*
@@ -185,7 +185,7 @@ err0:
 }
 #endif
 
-int ramen_archive(char const *fname, double start, double stop)
+int ramen_archive(char const *fname, double start, double stop, char *arc_fname_out, size_t arc_fname_sz)
 {
   int ret = -1;
 
@@ -228,6 +228,11 @@ int ramen_archive(char const *fname, double start, double stop)
 #endif
     ) {
       // Success renaming the file!
+      if (arc_fname_out) {
+        if ((size_t)snprintf(arc_fname_out, arc_fname_sz, "%s", arc_fname) >= arc_fname_sz) {
+          fprintf(stderr, "Archive file name truncated: '%s'\n", arc_fname_out);
+        }
+      }
       ret = 0;
       break;
     } else {
@@ -6,7 +6,8 @@
 #define ARCHIVE_H_20190228
 
 int mkdir_for_file(char *fname);
-int ramen_archive(char const *fname, double start, double stop);
+/* If not NULL, arc_fname_out is set to the name of the archived file: */
+int ramen_archive(char const *fname, double start, double stop, char *arc_fname_out, size_t arc_fname_sz);
 void dirname_of_fname(char *dirname, size_t sz, char const *fname);
 char const *extension_of_fname(char const *fname);
 int lock(char const *fname, int op /* LOCK_SH|LOCK_EX */, bool only_if_exist);
@@ -366,6 +366,40 @@ CAMLprim value wrap_ringbuf_read_next(value tx)
   }
 }
 
+/* Iterate over all the records of the ringbuffer [rb_] without allocating
+ * any OCaml value, calling [f] with each record (message header included)
+ * and its size in bytes until the end of the ringbuffer or until [f] returns
+ * false. Also sets [tmin] and [tmax] to the time range of the ringbuffer.
+ * Returns the number of records, or -1 on error.
+ * This is for the ringbuf to ORC converters (see RamenOrc). */
+ssize_t ringbuf_iter(
+  value rb_, bool (*f)(void *, uint32_t const *, size_t), void *user,
+  double *tmin, double *tmax)
+{
+  struct ringbuf *rb = Ringbuf_val(rb_);
+  struct ringbuf_file *rbf = rb->rbf;
+  struct ringbuf_tx tx;
+  *tmin = rbf->tmin;
+  *tmax = rbf->tmax;
+  ssize_t size = ringbuf_read_first(rb, &tx);
+  if (size == -2) return -1;
+  ssize_t num_records = 0;
+  while (size > 0) {
+    if (! f(user, (uint32_t const *)(rbf->data + tx.record_start), size))
+      return -1;
+    num_records ++;
+    size = ringbuf_read_next(rb, &tx);
+  }
+  return num_records;
+}
+
+/* Returns the ringbuf behind a RingBuf.t, for decoders that serialize their
+ * tuples straight into the ringbuffers (see netflow/v5.c). */
+struct ringbuf *ringbuf_of_value(value rb_)
+{
+  return Ringbuf_val(rb_);
+}
+
 // Returns a TX that writes into a buffer on the heap instead of a ringbuf:
 CAMLprim value wrap_bytes_tx(value size_)
 {
@@ -0,0 +1,601 @@
+// vim: ft=c bs=2 ts=2 sts=2 sw=2 expandtab
+/* Benchmark of the collectd and netflow decoders.
+ *
+ * Datagrams are either read from a pcap capture file or synthesized, and
+ * are then fed to the decoders either directly (inproc) or through a
+ * loopback UDP socket at a controlled rate (loopback), received in batches
+ * the same way the collectors do.
+ *
+ * One JSON object per run is appended to the result file, with the number
+ * of decoded records per second, the number of datagrams that were dropped
+ * by the kernel and the CPU time spent decoding per thousand records. */
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "../collectd/collectd.h"
+#include "../netflow/netflow.h"
+#include "udp_batch.h"
+
+#define MAX_MSG_SIZE 65535
+#define BATCH_MAX_MSGS 64
+
+enum proto { COLLECTD, NETFLOW5, NETFLOW9 };
+
+static char const *proto_names[] = {
+  [COLLECTD] = "collectd", [NETFLOW5] = "netflow5", [NETFLOW9] = "netflow9"
+};
+
+/*
+ * The datagrams to replay
+ */
+
+struct datagram {
+  size_t len;
+  char *data;
+};
+
+static struct datagram *dgrams;
+static unsigned num_dgrams, dgrams_capacity;
+static size_t max_dgram_len;
+
+static void add_datagram(void const *data, size_t len)
+{
+  if (num_dgrams >= dgrams_capacity) {
+    dgrams_capacity = dgrams_capacity ? 2 * dgrams_capacity : 1024;
+    dgrams = realloc(dgrams, dgrams_capacity * sizeof(*dgrams));
+    if (! dgrams) { perror("realloc"); exit(1); }
+  }
+  struct datagram *d = dgrams + num_dgrams++;
+  d->len = len;
+  d->data = malloc(len);
+  if (! d->data) { perror("malloc"); exit(1); }
+  memcpy(d->data, data, len);
+  if (len > max_dgram_len) max_dgram_len = len;
+}
+
+static void put_u16(unsigned char *p, unsigned v)
+{
+  p[0] = v >> 8; p[1] = v;
+}
+
+static void put_u32(unsigned char *p, uint32_t v)
+{
+  p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static void put_u64(unsigned char *p, uint64_t v)
+{
+  put_u32(p, v >> 32); put_u32(p + 4, v);
+}
+
+// Appends a collectd string part, returns its length:
+static size_t collectd_string(unsigned char *p, unsigned type, char const *s)
+{
+  size_t const len = 4 + strlen(s) + 1;
+  put_u16(p, type);
+  put_u16(p + 2, len);
+  memcpy(p + 4, s, len - 4);
+  return len;
+}
+
+/* Like what collectd sends: a host and time, and then a series of values
+ * which plugin and type are repeated only when they change. */
+static void synth_collectd(unsigned num, uint32_t start)
+{
+  static char const *plugins[] = { "cpu", "interface", "memory", "disk" };
+  static char const *types[] = { "percent", "if_octets", "memory", "disk_ops" };
+  unsigned char msg[1400];
+  for (unsigned i = 0; i < num; i++) {
+    size_t len = 0;
+    char host[32];
+    snprintf(host, sizeof(host), "host%u.example.com", i % 97);
+    len += collectd_string(msg + len, 0, host);
+    put_u16(msg + len, 8);
+    put_u16(msg + len + 2, 12);
+    put_u64(msg + len + 4, (uint64_t)(start + i / 10) << 30);
+    len += 12;
+    for (unsigned m = 0; len + 128 < sizeof(msg); m++) {
+      unsigned const plugin = (i + m / 8) % 4;
+      if (m % 8 == 0) {
+        len += collectd_string(msg + len, 2, plugins[plugin]);
+        len += collectd_string(msg + len, 4, types[plugin]);
+      }
+      char instance[16];
+      snprintf(instance, sizeof(instance), "%u", m % 8);
+      len += collectd_string(msg + len, 3, instance);
+      // Two values, a gauge and a counter:
+      put_u16(msg + len, 6);
+      put_u16(msg + len + 2, 4 + 2 + 2*9);
+      put_u16(msg + len + 4, 2);
+      msg[len + 6] = 1;
+      msg[len + 7] = 0;
+      double const gauge = (i * m) % 1000 / 10.;
+      memcpy(msg + len + 8, &gauge, sizeof(gauge));
+      put_u64(msg + len + 16, (uint64_t)i * 1000 + m);
+      len += 4 + 2 + 2*9;
+    }
+    add_datagram(msg, len);
+  }
+}
+
+#define V5_FLOWS 30
+
+static void synth_netflow5(unsigned num, uint32_t start)
+{
+  unsigned char msg[24 + V5_FLOWS * 48];
+  for (unsigned i = 0; i < num; i++) {
+    memset(msg, 0, sizeof(msg));
+    uint32_t const uptime = 3600000 + i * 10;
+    put_u16(msg, 5);
+    put_u16(msg + 2, V5_FLOWS);
+    put_u32(msg + 4, uptime);
+    put_u32(msg + 8, start + i / 100);
+    put_u32(msg + 16, i * V5_FLOWS);
+    for (unsigned f = 0; f < V5_FLOWS; f++) {
+      unsigned char *p = msg + 24 + f * 48;
+      unsigned const n = i * V5_FLOWS + f;
+      put_u32(p, 0x0a000000 | (n % 5000));      // src
+      put_u32(p + 4, 0xc0a80000 | (n % 251));   // dst
+      put_u16(p + 12, 1 + n % 8);               // in_iface
+      put_u16(p + 14, 1 + n % 4);               // out_iface
+      put_u32(p + 16, 1 + n % 50);              // packets
+      put_u32(p + 20, 64 + n % 1400);           // bytes
+      put_u32(p + 24, uptime - 1000);           // first
+      put_u32(p + 28, uptime - 10);             // last
+      put_u16(p + 32, 1024 + n % 20000);        // src_port
+      put_u16(p + 34, n % 3 ? 443 : 53);        // dst_port
+      p[38] = n % 3 ? 6 : 17;                   // ip_proto
+    }
+    add_datagram(msg, sizeof(msg));
+  }
+}
+
+#define V9_TEMPLATE_ID 256
+#define V9_RECORD_LEN (4+4+2+2+1+4+4+4+4)
+
+static void synth_netflow9(unsigned num, uint32_t start)
+{
+  static uint16_t const template[][2] = {
+    { 8, 4 }, { 12, 4 }, { 7, 2 }, { 11, 2 }, { 4, 1 },
+    { 2, 4 }, { 1, 4 }, { 22, 4 }, { 21, 4 }
+  };
+  unsigned const num_fields = sizeof(template) / sizeof(template[0]);
+  unsigned const num_flows = 40;
+  unsigned char msg[20 + 8 + 4*9 + 4 + 40 * V9_RECORD_LEN];
+  for (unsigned i = 0; i < num; i++) {
+    size_t len = 20;
+    uint32_t const uptime = 3600000 + i * 10;
+    // The template, in every 20th message:
+    unsigned num_sets = 1;
+    if (i % 20 == 0) {
+      put_u16(msg + len, 0);
+      put_u16(msg + len + 2, 8 + 4 * num_fields);
+      put_u16(msg + len + 4, V9_TEMPLATE_ID);
+      put_u16(msg + len + 6, num_fields);
+      for (unsigned f = 0; f < num_fields; f++) {
+        put_u16(msg + len + 8 + 4*f, template[f][0]);
+        put_u16(msg + len + 8 + 4*f + 2, template[f][1]);
+      }
+      len += 8 + 4 * num_fields;
+      num_sets ++;
+    }
+    put_u16(msg + len, V9_TEMPLATE_ID);
+    put_u16(msg + len + 2, 4 + num_flows * V9_RECORD_LEN);
+    len += 4;
+    for (unsigned f = 0; f < num_flows; f++) {
+      unsigned char *p = msg + len;
+      unsigned const n = i * num_flows + f;
+      put_u32(p, 0x0a000000 | (n % 5000));
+      put_u32(p + 4, 0xc0a80000 | (n % 251));
+      put_u16(p + 8, 1024 + n % 20000);
+      put_u16(p + 10, n % 3 ? 443 : 53);
+      p[12] = n % 3 ? 6 : 17;
+      put_u32(p + 13, 1 + n % 50);
+      put_u32(p + 17, 64 + n % 1400);
+      put_u32(p + 21, uptime - 1000);
+      put_u32(p + 25, uptime - 10);
+      len += V9_RECORD_LEN;
+    }
+    // Header:
+    put_u16(msg, 9);
+    put_u16(msg + 2, num_sets);
+    put_u32(msg + 4, uptime);
+    put_u32(msg + 8, start + i / 100);
+    put_u32(msg + 12, i);
+    put_u32(msg + 16, 0);
+    add_datagram(msg, len);
+  }
+}
+
+/* Read the UDP payloads out of a pcap file, optionally only those sent to
+ * the given port. Supports ethernet (with VLAN tags), raw IP and Linux
+ * cooked captures, of IPv4 or IPv6 packets. */
+static void load_pcap(char const *fname, unsigned port)
+{
+  FILE *f = fopen(fname, "rb");
+  if (! f) { perror(fname); exit(1); }
+
+  unsigned char hdr[24];
+  if (1 != fread(hdr, sizeof(hdr), 1, f)) {
+    fprintf(stderr, "%s: not a pcap file\n", fname);
+    exit(1);
+  }
+  uint32_t magic;
+  memcpy(&magic, hdr, sizeof(magic));
+  bool swapped;
+  if (magic == 0xa1b2c3d4 || magic == 0xa1b23c4d) swapped = false;
+  else if (magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1) swapped = true;
+  else {
+    fprintf(stderr, "%s: not a pcap file (pcapng is not supported)\n", fname);
+    exit(1);
+  }
+# define U32(p) ({ \
+    uint32_t v_; memcpy(&v_, (p), 4); swapped ? __builtin_bswap32(v_) : v_; })
+  uint32_t const linktype = U32(hdr + 20);
+  size_t link_len;
+  switch (linktype) {
+    case 1: link_len = 14; break;         // Ethernet
+    case 12: case 101: link_len = 0; break;  // Raw IP
+    case 113: link_len = 16; break;       // Linux cooked
+    case 276: link_len = 20; break;       // Linux cooked v2
+    default:
+      fprintf(stderr, "%s: unsupported link type %"PRIu32"\n", fname, linktype);
+      exit(1);
+  }
+
+  static unsigned char pkt[262144];
+  unsigned char rec[16];
+  while (1 == fread(rec, sizeof(rec), 1, f)) {
+    uint32_t const cap_len = U32(rec + 8);
+    if (cap_len > sizeof(pkt) || 1 != fread(pkt, cap_len, 1, f)) break;
+    unsigned char const *p = pkt;
+    size_t len = cap_len;
+    if (len < link_len) continue;
+    if (linktype == 1) {
+      // Skip VLAN tags:
+      size_t o = 12;
+      while (o + 4 <= len && (p[o] << 8 | p[o+1]) == 0x8100) o += 4;
+      link_len = o + 2;
+    }
+    p += link_len;
+    len -= link_len;
+    // IP:
+    if (len < 1) continue;
+    unsigned char const *udp;
+    switch (p[0] >> 4) {
+      case 4:
+        if (len < 20 || p[9] != 17) continue;
+        udp = p + (p[0] & 0xf) * 4;
+        break;
+      case 6:
+        if (len < 40 || p[6] != 17) continue;
+        udp = p + 40;
+        break;
+      default:
+        continue;
+    }
+    if (udp + 8 > p + len) continue;
+    unsigned const dst_port = udp[2] << 8 | udp[3];
+    if (port && dst_port != port) continue;
+    size_t const udp_len = (size_t)(udp[4] << 8 | udp[5]);
+    if (udp_len < 8 || udp + udp_len > p + len) continue;  // Truncated
+    add_datagram(udp + 8, udp_len - 8);
+  }
+# undef U32
+  fclose(f);
+}
+
+/*
+ * Decoding
+ */
+
+static void *collectd_mem;
+static struct netflow_record *nf_records;
+
+static void init_decoder(void)
+{
+  collectd_mem = malloc(COLLECTD_MEM_SIZE(MAX_MSG_SIZE));
+  nf_records = malloc(NETFLOW_MAX_RECORDS(MAX_MSG_SIZE) * sizeof(*nf_records));
+  if (! collectd_mem || ! nf_records) { perror("malloc"); exit(1); }
+}
+
+// Returns the number of decoded records, or -1 on error:
+static int decode(
+  enum proto proto, char const *msg, size_t len,
+  struct sockaddr_storage const *exporter)
+{
+  char const *err;
+  switch (proto) {
+    case COLLECTD:
+      {
+        unsigned num_metrics;
+        struct collectd_metric *metrics;
+        enum collectd_decode_status status =
+          collectd_decode(len, msg, COLLECTD_MEM_SIZE(MAX_MSG_SIZE),
+                          collectd_mem, &num_metrics, &metrics);
+        return status == COLLECTD_OK ? (int)num_metrics : -1;
+      }
+    case NETFLOW5:
+    case NETFLOW9:
+      switch (netflow_version(msg, len)) {
+        case 5:
+          return netflow_v5_decode(msg, len, nf_records,
+                                   NETFLOW_MAX_RECORDS(len), &err);
+        case 9:
+        case 10:
+          return netflow_v9_decode(msg, len, exporter, nf_records,
+                                   NETFLOW_MAX_RECORDS(len), &err);
+      }
+      return -1;
+  }
+  return -1;
+}
+
+/*
+ * Measurements
+ */
+
+struct result {
+  uint64_t sent, received, bytes, records, errors;
+  double duration, cpu;
+};
+
+static double timespec_diff(struct timespec const *a, struct timespec const *b)
+{
+  return (b->tv_sec - a->tv_sec) + (b->tv_nsec - a->tv_nsec) / 1e9;
+}
+
+static double now(clockid_t clock)
+{
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run_inproc(enum proto proto, double duration, struct result *res)
+{
+  struct sockaddr_storage exporter;
+  memset(&exporter, 0, sizeof(exporter));
+  exporter.ss_family = AF_INET;
+
+  struct timespec start, stop;
+  double const cpu_start = now(CLOCK_PROCESS_CPUTIME_ID);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (unsigned i = 0; ; i++) {
+    struct datagram const *d = dgrams + (i % num_dgrams);
+    int const n = decode(proto, d->data, d->len, &exporter);
+    if (n < 0) res->errors ++;
+    else res->records += n;
+    res->bytes += d->len;
+    res->received ++;
+    if (i % 64 == 63) {
+      clock_gettime(CLOCK_MONOTONIC, &stop);
+      if (timespec_diff(&start, &stop) >= duration) break;
+    }
+  }
+  res->sent = res->received;
+  res->duration = timespec_diff(&start, &stop);
+  res->cpu = now(CLOCK_PROCESS_CPUTIME_ID) - cpu_start;
+}
+
+struct sender {
+  int fd;
+  double rate;  // Datagrams per second, 0 for unlimited
+  double duration;
+  uint64_t sent;
+  volatile bool done;
+};
+
+static void *send_all(void *sender_)
+{
+  struct sender *s = sender_;
+  double const start = now(CLOCK_MONOTONIC);
+  for (unsigned i = 0; ; i++) {
+    double const t = now(CLOCK_MONOTONIC);
+    if (t - start >= s->duration) break;
+    if (s->rate > 0) {
+      // Wait until that datagram is due:
+      double const due = start + i / s->rate;
+      if (due > t + 1e-4) {
+        struct timespec ts = {
+          .tv_sec = (time_t)(due - t),
+          .tv_nsec = (long)((due - t - (time_t)(due - t)) * 1e9) };
+        nanosleep(&ts, NULL);
+      }
+    }
+    struct datagram const *d = dgrams + (i % num_dgrams);
+    if (send(s->fd, d->data, d->len, 0) < 0) {
+      if (errno == ENOBUFS || errno == EAGAIN || errno == ECONNREFUSED)
+        continue;
+      perror("send");
+      break;
+    }
+    s->sent ++;
+  }
+  s->done = true;
+  return NULL;
+}
+
+static void run_loopback(
+  enum proto proto, double rate, double duration, struct result *res)
+{
+  int const rfd = socket(AF_INET, SOCK_DGRAM, 0);
+  int const sfd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (rfd < 0 || sfd < 0) { perror("socket"); exit(1); }
+  int const rcvbuf = 8 * 1024 * 1024;
+  setsockopt(rfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  // So that we notice when the sender is done:
+  struct timeval const tv = { .tv_sec = 0, .tv_usec = 200000 };
+  setsockopt(rfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  struct sockaddr_in addr = {
+    .sin_family = AF_INET,
+    .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+  socklen_t addr_len = sizeof(addr);
+  if (0 != bind(rfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+      0 != getsockname(rfd, (struct sockaddr *)&addr, &addr_len) ||
+      0 != connect(sfd, (struct sockaddr *)&addr, sizeof(addr))) {
+    perror("loopback socket");
+    exit(1);
+  }
+
+  struct udp_batch batch;
+  if (0 != udp_batch_init(&batch, BATCH_MAX_MSGS, MAX_MSG_SIZE)) {
+    perror("udp_batch_init");
+    exit(1);
+  }
+
+  struct sender sender = {
+    .fd = sfd, .rate = rate, .duration = duration, .sent = 0, .done = false };
+  pthread_t thread;
+  if (0 != pthread_create(&thread, NULL, send_all, &sender)) {
+    perror("pthread_create");
+    exit(1);
+  }
+
+  // Only the decoding thread CPU is measured:
+  double const cpu_start = now(CLOCK_THREAD_CPUTIME_ID);
+  double const start = now(CLOCK_MONOTONIC);
+  double last_recv = start;
+  while (true) {
+    int const n = udp_batch_recv(&batch, rfd);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        if (sender.done) break;
+        continue;
+      }
+      perror("udp_batch_recv");
+      exit(1);
+    }
+    last_recv = now(CLOCK_MONOTONIC);
+    for (int i = 0; i < n; i++) {
+      int const r = decode(proto, udp_batch_msg(&batch, i), batch.lens[i],
+                           batch.senders + i);
+      if (r < 0) res->errors ++;
+      else res->records += r;
+      res->bytes += batch.lens[i];
+      res->received ++;
+    }
+  }
+  pthread_join(thread, NULL);
+
+  res->sent = sender.sent;
+  res->duration = last_recv - start;
+  res->cpu = now(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+  udp_batch_free(&batch);
+  close(rfd);
+  close(sfd);
+}
+
+static void report(
+  FILE *out, enum proto proto, char const *mode, char const *source,
+  double rate, struct result const *res)
+{
+  double const dur = res->duration > 0 ? res->duration : 1;
+  fprintf(out,
+    "{\"proto\":\"%s\",\"mode\":\"%s\",\"source\":\"%s\","
+    "\"rate\":%g,\"duration\":%g,"
+    "\"datagrams_sent\":%"PRIu64",\"datagrams_received\":%"PRIu64","
+    "\"drops\":%"PRIu64",\"errors\":%"PRIu64","
+    "\"records\":%"PRIu64",\"records_per_sec\":%g,\"bytes_per_sec\":%g,"
+    "\"cpu_sec\":%g,\"cpu_us_per_1k_records\":%g}\n",
+    proto_names[proto], mode, source, rate, res->duration,
+    res->sent, res->received,
+    res->sent > res->received ? res->sent - res->received : 0,
+    res->errors, res->records, res->records / dur, res->bytes / dur,
+    res->cpu, res->records > 0 ? res->cpu * 1e9 / res->records : 0.);
+}
+
+static void usage(char const *argv0)
+{
+  fprintf(stderr,
+    "%s [options] collectd|netflow5|netflow9 results.json\n"
+    "  -c capture.pcap  replay the UDP payloads of that capture\n"
+    "                   instead of synthesizing datagrams\n"
+    "  -p port          only replay datagrams sent to that port\n"
+    "  -n number        number of datagrams to synthesize (10000)\n"
+    "  -m mode          inproc, loopback or both (both)\n"
+    "  -r rates         comma separated loopback rates in datagrams per\n"
+    "                   second, 0 for unlimited (0)\n"
+    "  -d seconds       duration of each run (5)\n",
+    argv0);
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  char const *capture = NULL;
+  unsigned port = 0, num_synth = 10000;
+  char const *mode = "both";
+  char *rates = "0";
+  double duration = 5;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "c:p:n:m:r:d:")) != -1) {
+    switch (opt) {
+      case 'c': capture = optarg; break;
+      case 'p': port = strtoul(optarg, NULL, 10); break;
+      case 'n': num_synth = strtoul(optarg, NULL, 10); break;
+      case 'm': mode = optarg; break;
+      case 'r': rates = optarg; break;
+      case 'd': duration = strtod(optarg, NULL); break;
+      default: usage(argv[0]);
+    }
+  }
+  if (argc - optind != 2) usage(argv[0]);
+
+  enum proto proto;
+  if (0 == strcmp(argv[optind], "collectd")) proto = COLLECTD;
+  else if (0 == strcmp(argv[optind], "netflow5")) proto = NETFLOW5;
+  else if (0 == strcmp(argv[optind], "netflow9")) proto = NETFLOW9;
+  else usage(argv[0]);
+
+  FILE *out = fopen(argv[optind + 1], "a");
+  if (! out) { perror(argv[optind + 1]); exit(1); }
+
+  uint32_t const start = time(NULL);
+  if (capture) {
+    load_pcap(capture, port);
+  } else {
+    switch (proto) {
+      case COLLECTD: synth_collectd(num_synth, start); break;
+      case NETFLOW5: synth_netflow5(num_synth, start); break;
+      case NETFLOW9: synth_netflow9(num_synth, start); break;
+    }
+  }
+  if (num_dgrams == 0) {
+    fprintf(stderr, "No datagram to replay\n");
+    exit(1);
+  }
+  char const *source = capture ? capture : "synthetic";
+  init_decoder();
+
+  if (0 == strcmp(mode, "inproc") || 0 == strcmp(mode, "both")) {
+    struct result res = { 0 };
+    run_inproc(proto, duration, &res);
+    report(out, proto, "inproc", source, 0, &res);
+  }
+  if (0 == strcmp(mode, "loopback") || 0 == strcmp(mode, "both")) {
+    for (char *r = strtok(rates, ","); r; r = strtok(NULL, ",")) {
+      double const rate = strtod(r, NULL);
+      struct result res = { 0 };
+      run_loopback(proto, rate, duration, &res);
+      report(out, proto, "loopback", source, rate, &res);
+    }
+  }
+
+  fclose(out);
+  return 0;
+}
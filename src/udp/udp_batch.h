@@ -0,0 +1,122 @@
+// vim: ft=c bs=2 ts=2 sts=2 sw=2 expandtab
+#ifndef UDP_BATCH_H_20261018
+#define UDP_BATCH_H_20261018
+
+/* Receive as many datagrams as are available (up to some maximum) in a single
+ * syscall, into a set of buffers that are allocated once and then reused
+ * from one batch to the next.
+ *
+ * This is a header only helper for the collectors: each of them is meant to
+ * use a single static batch. */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "../config.h"
+
+struct udp_batch {
+  unsigned max_msgs;
+  size_t msg_size;
+  // Number of messages received by the last call to udp_batch_recv:
+  unsigned num_msgs;
+#ifdef HAVE_RECVMMSG
+  struct mmsghdr *hdrs;
+#endif
+  struct iovec *iovecs;
+  struct sockaddr_storage *senders;
+  socklen_t *senders_len;
+  size_t *lens;
+  char *bufs;
+};
+
+static inline void udp_batch_free(struct udp_batch *b)
+{
+#ifdef HAVE_RECVMMSG
+  free(b->hdrs);
+#endif
+  free(b->iovecs);
+  free(b->senders);
+  free(b->senders_len);
+  free(b->lens);
+  free(b->bufs);
+  memset(b, 0, sizeof(*b));
+}
+
+// Returns -1 on failure to allocate the buffers:
+static inline int udp_batch_init(
+  struct udp_batch *b, unsigned max_msgs, size_t msg_size)
+{
+  memset(b, 0, sizeof(*b));
+  b->max_msgs = max_msgs;
+  b->msg_size = msg_size;
+#ifdef HAVE_RECVMMSG
+  b->hdrs = calloc(max_msgs, sizeof(*b->hdrs));
+  if (! b->hdrs) goto err;
+#endif
+  b->iovecs = calloc(max_msgs, sizeof(*b->iovecs));
+  b->senders = calloc(max_msgs, sizeof(*b->senders));
+  b->senders_len = calloc(max_msgs, sizeof(*b->senders_len));
+  b->lens = calloc(max_msgs, sizeof(*b->lens));
+  b->bufs = malloc(max_msgs * msg_size);
+  if (! b->iovecs || ! b->senders || ! b->senders_len || ! b->lens ||
+      ! b->bufs) goto err;
+
+  for (unsigned i = 0; i < max_msgs; i++) {
+    b->iovecs[i].iov_base = b->bufs + i * msg_size;
+    b->iovecs[i].iov_len = msg_size;
+  }
+  return 0;
+err:
+  udp_batch_free(b);
+  return -1;
+}
+
+static inline char const *udp_batch_msg(struct udp_batch const *b, unsigned i)
+{
+  return b->bufs + i * b->msg_size;
+}
+
+/* Block until at least one datagram is received, then also take all those
+ * that are already waiting (up to max_msgs).
+ * Returns the number of received messages, or -1 and sets errno. */
+static inline int udp_batch_recv(struct udp_batch *b, int fd)
+{
+  b->num_msgs = 0;
+#ifdef HAVE_RECVMMSG
+  for (unsigned i = 0; i < b->max_msgs; i++) {
+    b->senders_len[i] = sizeof(b->senders[i]);
+    memset(&b->hdrs[i].msg_hdr, 0, sizeof(b->hdrs[i].msg_hdr));
+    b->hdrs[i].msg_hdr.msg_name = b->senders + i;
+    b->hdrs[i].msg_hdr.msg_namelen = b->senders_len[i];
+    b->hdrs[i].msg_hdr.msg_iov = b->iovecs + i;
+    b->hdrs[i].msg_hdr.msg_iovlen = 1;
+  }
+  int const n = recvmmsg(fd, b->hdrs, b->max_msgs, MSG_WAITFORONE, NULL);
+  if (n < 0) return -1;
+  for (int i = 0; i < n; i++) {
+    b->lens[i] = b->hdrs[i].msg_len;
+    b->senders_len[i] = b->hdrs[i].msg_hdr.msg_namelen;
+  }
+  b->num_msgs = n;
+#else
+  // Poor man version: one blocking receive then non-blocking ones:
+  for (unsigned i = 0; i < b->max_msgs; i++) {
+    b->senders_len[i] = sizeof(b->senders[i]);
+    ssize_t const len =
+      recvfrom(fd, b->bufs + i * b->msg_size, b->msg_size,
+               i == 0 ? 0 : MSG_DONTWAIT,
+               (struct sockaddr *)(b->senders + i), b->senders_len + i);
+    if (len < 0) {
+      if (i == 0) return -1;
+      break;
+    }
+    b->lens[i] = len;
+    b->num_msgs ++;
+  }
+#endif
+  return b->num_msgs;
+}
+
+#endif